@@ -0,0 +1,182 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Contention counters for a lock.
+ */
+struct AdaptiveLockStats
+{
+   //! Number of times the lock was acquired.
+   std::atomic<uint64_t> acquisitions { 0 };
+
+   //! Acquisitions which found the lock already held.
+   std::atomic<uint64_t> contentions { 0 };
+
+   //! Number of times a waiter gave up spinning and parked.
+   std::atomic<uint64_t> parks { 0 };
+
+   //! Longest time the lock has been held for, out of the sampled holds.
+   std::atomic<uint64_t> maxHoldNs { 0 };
+
+   void
+   recordHold(uint64_t holdNs)
+   {
+      auto max = maxHoldNs.load(std::memory_order_relaxed);
+
+      while (holdNs > max
+          && !maxHoldNs.compare_exchange_weak(max, holdNs, std::memory_order_relaxed)) {
+      }
+   }
+};
+
+namespace adaptive_lock
+{
+
+//! Number of spin rounds before parking, each round spins twice as long
+//!  as the last up to MaxBackoff pauses.
+static constexpr unsigned MaxSpinRounds = 12;
+static constexpr unsigned MaxBackoff = 64;
+
+//! Hold time is only measured for one in this many acquisitions, reading the
+//!  clock on every lock and unlock costs too much on the hottest locks.
+static constexpr uint64_t HoldSampleInterval = 64;
+
+void
+pause();
+
+/**
+ * Park the calling thread while *word == value.
+ *
+ * Parked threads are counted per word so release only needs to make a
+ * syscall when someone is actually parked.
+ */
+void
+park(std::atomic<uint32_t> *word,
+     uint32_t value);
+
+/**
+ * Wake one thread parked on word, if there are any.
+ */
+void
+unpark(std::atomic<uint32_t> *word);
+
+uint64_t
+now();
+
+/**
+ * Acquire a lock held in word.
+ *
+ * Calls tryAcquire until it succeeds, spinning with exponential backoff for
+ * a bounded number of rounds before parking until word changes.
+ */
+template<typename TryAcquire>
+inline void
+acquire(std::atomic<uint32_t> *word,
+        TryAcquire tryAcquire,
+        AdaptiveLockStats *stats)
+{
+   if (stats) {
+      stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   if (tryAcquire()) {
+      return;
+   }
+
+   if (stats) {
+      stats->contentions.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   auto backoff = 1u;
+
+   for (auto round = 0u; round < MaxSpinRounds; ++round) {
+      for (auto i = 0u; i < backoff; ++i) {
+         pause();
+      }
+
+      if (tryAcquire()) {
+         return;
+      }
+
+      backoff = backoff < MaxBackoff ? backoff * 2 : MaxBackoff;
+   }
+
+   while (!tryAcquire()) {
+      auto value = word->load(std::memory_order_relaxed);
+
+      if (value) {
+         if (stats) {
+            stats->parks.fetch_add(1, std::memory_order_relaxed);
+         }
+
+         park(word, value);
+      }
+   }
+}
+
+} // namespace adaptive_lock
+
+/**
+ * Lock which spins with backoff for a short time and then parks on a futex.
+ *
+ * The lock word holds a non-zero owner id while locked.
+ */
+class AdaptiveLock
+{
+public:
+   void
+   lock(uint32_t owner)
+   {
+      adaptive_lock::acquire(&mOwner,
+                             [&]() { return try_lock(owner); },
+                             &mStats);
+
+      if (mStats.acquisitions.load(std::memory_order_relaxed) % adaptive_lock::HoldSampleInterval == 0) {
+         mAcquireTime = adaptive_lock::now();
+      }
+   }
+
+   bool
+   try_lock(uint32_t owner)
+   {
+      auto expected = uint32_t { 0 };
+      return mOwner.compare_exchange_weak(expected, owner, std::memory_order_acquire, std::memory_order_relaxed);
+   }
+
+   /**
+    * Release the lock, returns the previous owner.
+    */
+   uint32_t
+   unlock()
+   {
+      if (mAcquireTime) {
+         mStats.recordHold(adaptive_lock::now() - mAcquireTime);
+         mAcquireTime = 0;
+      }
+
+      auto owner = mOwner.exchange(0);
+      adaptive_lock::unpark(&mOwner);
+      return owner;
+   }
+
+   uint32_t
+   owner() const
+   {
+      return mOwner.load(std::memory_order_acquire);
+   }
+
+   const AdaptiveLockStats &
+   stats() const
+   {
+      return mStats;
+   }
+
+private:
+   std::atomic<uint32_t> mOwner { 0 };
+
+   //! When a sampled hold started, 0 if this hold is not being measured
+   uint64_t mAcquireTime = 0;
+   AdaptiveLockStats mStats;
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Byte swap count values from src into dst.
+ *
+ * Uses SSSE3 or AVX2 when the host supports them. dst and src may be the
+ * same array, but must not otherwise overlap.
+ */
+void
+byte_swap_array(uint16_t *dst,
+                const uint16_t *src,
+                size_t count);
+
+void
+byte_swap_array(uint32_t *dst,
+                const uint32_t *src,
+                size_t count);
+
+/**
+ * Expand a list of quads, 4 indices each, into a list of triangles, 6
+ * indices each, optionally byte swapping every index.
+ *
+ * Quads are split into triangles 0,1,2 and 0,2,3, rects are split into
+ * triangles 0,1,2 and 2,1,3. dst must have room for quadCount * 6 indices
+ * and must not overlap src.
+ */
+void
+expand_quad_list(uint16_t *dst,
+                 const uint16_t *src,
+                 size_t quadCount,
+                 bool isRects,
+                 bool swap);
+
+void
+expand_quad_list(uint32_t *dst,
+                 const uint32_t *src,
+                 size_t quadCount,
+                 bool isRects,
+                 bool swap);
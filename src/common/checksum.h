@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Update an Adler-32 checksum with size bytes from data, the checksum of no
+ * data is 1.
+ *
+ * Gives the same result as zlib's adler32, using SSE2 on x86-64 hosts.
+ */
+uint32_t
+checksum_adler32(uint32_t adler,
+                 const uint8_t *data,
+                 size_t size);
+
+/**
+ * Update a CRC-32 with size bytes from data, the CRC of no data is 0.
+ *
+ * Gives the same result as zlib's crc32, using carry-less multiplication
+ * when the host supports PCLMULQDQ.
+ */
+uint32_t
+checksum_crc32(uint32_t crc,
+               const uint8_t *data,
+               size_t size);
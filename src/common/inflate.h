@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+enum class InflateFormat
+{
+   //! Raw deflate data without a header or trailer
+   Raw,
+
+   //! Zlib header and Adler-32 trailer
+   Zlib,
+
+   //! Gzip header and CRC-32 trailer
+   Gzip,
+};
+
+enum class InflateStatus
+{
+   Success,
+   BadData,
+   ShortInput,
+   ShortOutput,
+};
+
+struct InflateResult
+{
+   //! Bytes of input used, including the header and trailer
+   size_t inputUsed = 0;
+
+   //! Bytes written to the output
+   size_t outputUsed = 0;
+
+   //! Adler-32 of the output for Zlib, CRC-32 for Gzip, 0 for Raw
+   uint32_t check = 0;
+};
+
+/**
+ * Decompress one complete deflate stream from src to dst.
+ *
+ * windowBits is the largest window a Zlib header may ask for. Streams
+ * which need a preset dictionary, are truncated, do not fit in dst, or
+ * have anything else zlib would reject fail as a whole rather than being
+ * partially decoded, the caller is expected to fall back to zlib for
+ * those, which can report them in detail.
+ */
+InflateStatus
+inflate_buffer(uint8_t *dst,
+               size_t dstSize,
+               const uint8_t *src,
+               size_t srcSize,
+               InflateFormat format,
+               unsigned windowBits,
+               InflateResult &result);
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//! Copies and fills smaller than this are always left to the C library
+static const size_t
+MemoryCopyMinNonTemporalSize = 256 * 1024;
+
+/**
+ * Copies and fills of at least this many bytes use non-temporal stores,
+ * zero if the host does not support them.
+ *
+ * This is the size of the host's L2 cache, a copy bigger than that would
+ * evict its own destination before it could be used from the cache.
+ */
+size_t
+memory_copy_non_temporal_threshold();
+
+void *
+memory_copy_large(void *dst,
+                  const void *src,
+                  size_t size);
+
+void *
+memory_set_large(void *dst,
+                 uint8_t value,
+                 size_t size);
+
+/**
+ * Copy size bytes from src to dst, which must not overlap.
+ *
+ * Copies larger than the non-temporal threshold are streamed past the
+ * cache, so a multi-megabyte copy does not evict everything else from it.
+ */
+inline void *
+memory_copy(void *dst,
+            const void *src,
+            size_t size)
+{
+   if (size < MemoryCopyMinNonTemporalSize) {
+      return std::memcpy(dst, src, size);
+   }
+
+   return memory_copy_large(dst, src, size);
+}
+
+/**
+ * Copy size bytes from src to dst, which may overlap.
+ */
+inline void *
+memory_move(void *dst,
+            const void *src,
+            size_t size)
+{
+   auto dstAddr = reinterpret_cast<uintptr_t>(dst);
+   auto srcAddr = reinterpret_cast<uintptr_t>(src);
+   auto distance = dstAddr > srcAddr ? dstAddr - srcAddr : srcAddr - dstAddr;
+
+   // Overlapping moves are rare enough to not be worth streaming
+   if (size < MemoryCopyMinNonTemporalSize || distance < size) {
+      return std::memmove(dst, src, size);
+   }
+
+   return memory_copy_large(dst, src, size);
+}
+
+/**
+ * Set size bytes at dst to value, large fills use non-temporal stores.
+ */
+inline void *
+memory_set(void *dst,
+           uint8_t value,
+           size_t size)
+{
+   if (size < MemoryCopyMinNonTemporalSize) {
+      return std::memset(dst, value, size);
+   }
+
+   return memory_set_large(dst, value, size);
+}
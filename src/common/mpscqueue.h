@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Lock-free multiple producer, single consumer queue.
+ *
+ * Producers push with a single compare and swap, the consumer takes every
+ * queued item at once with popAll which visits them in the order they were
+ * pushed.
+ */
+template<typename Type>
+class MpscQueue
+{
+   struct Node
+   {
+      Type value;
+      Node *next;
+   };
+
+public:
+   MpscQueue() = default;
+   MpscQueue(const MpscQueue &) = delete;
+   MpscQueue &operator=(const MpscQueue &) = delete;
+
+   ~MpscQueue()
+   {
+      popAll([](Type &) { });
+   }
+
+   void push(const Type &value)
+   {
+      auto node = new Node { value, mHead.load(std::memory_order_relaxed) };
+
+      while (!mHead.compare_exchange_weak(node->next, node,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+      }
+   }
+
+   template<typename Function>
+   size_t popAll(Function fn)
+   {
+      auto node = mHead.exchange(nullptr, std::memory_order_acquire);
+
+      // The list is in LIFO order, reverse it so we visit in push order
+      Node *first = nullptr;
+
+      while (node) {
+         auto next = node->next;
+         node->next = first;
+         first = node;
+         node = next;
+      }
+
+      auto count = size_t { 0 };
+
+      while (first) {
+         auto next = first->next;
+         fn(first->value);
+         delete first;
+         first = next;
+         ++count;
+      }
+
+      return count;
+   }
+
+   bool empty() const
+   {
+      return mHead.load(std::memory_order_relaxed) == nullptr;
+   }
+
+private:
+   std::atomic<Node *> mHead { nullptr };
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <vector>
 
 namespace platform
 {
@@ -19,6 +20,10 @@ isFile(const std::string &path);
 bool
 isDirectory(const std::string &path);
 
+bool
+listDirectory(const std::string &path,
+              std::vector<std::string> &names);
+
 std::string
 getConfigDirectory();
 
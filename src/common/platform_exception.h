@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <functional>
 
 namespace platform
@@ -12,6 +13,7 @@ struct Exception
    {
       AccessViolation = 1,
       InvalidInstruction = 2,
+      SingleStep = 3,
    };
 
    Exception(Type type_) :
@@ -24,13 +26,15 @@ struct Exception
 
 struct AccessViolationException : Exception
 {
-   AccessViolationException(uint64_t address_) :
+   AccessViolationException(uint64_t address_, bool write_) :
       Exception(Exception::AccessViolation),
-      address(address_)
+      address(address_),
+      write(write_)
    {
    }
 
    uint64_t address;
+   bool write;
 };
 
 struct InvalidInstructionException : Exception
@@ -42,6 +46,17 @@ struct InvalidInstructionException : Exception
 
 };
 
+// Raised once the instruction resumed by HandledExceptionSingleStep
+// has executed.
+struct SingleStepException : Exception
+{
+   SingleStepException() :
+      Exception(Exception::SingleStep)
+   {
+   }
+
+};
+
 typedef void (*ExceptionResumeFunc)();
 using ExceptionHandler = std::function<ExceptionResumeFunc(Exception *exception)>;
 
@@ -53,6 +68,11 @@ HandledException = reinterpret_cast<ExceptionResumeFunc>(static_cast<uintptr_t>(
 static ExceptionResumeFunc const
 UnhandledException = reinterpret_cast<ExceptionResumeFunc>(static_cast<uintptr_t>(0));
 
+// Can be returned from ExceptionHandler to resume execution of the current
+// fiber for a single instruction, a SingleStep exception is raised after it.
+static ExceptionResumeFunc const
+HandledExceptionSingleStep = reinterpret_cast<ExceptionResumeFunc>(static_cast<uintptr_t>(-2));
+
 bool
 installExceptionHandler(ExceptionHandler handler);
 
@@ -0,0 +1,29 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace platform
+{
+
+/**
+ * Block the calling thread while *word == expected.
+ *
+ * May return spuriously, callers must re-check their condition.
+ */
+void
+futexWait(std::atomic<uint32_t> *word,
+          uint32_t expected);
+
+/**
+ * Wake up to one thread blocked in futexWait on word.
+ */
+void
+futexWakeOne(std::atomic<uint32_t> *word);
+
+/**
+ * Wake every thread blocked in futexWait on word.
+ */
+void
+futexWakeAll(std::atomic<uint32_t> *word);
+
+} // namespace platform
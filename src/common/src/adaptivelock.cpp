@@ -0,0 +1,75 @@
+#include "adaptivelock.h"
+#include "platform.h"
+#include "platform_futex.h"
+#include <functional>
+#include <thread>
+
+#ifdef PLATFORM_WINDOWS
+#include <intrin.h>
+#endif
+
+namespace adaptive_lock
+{
+
+static constexpr size_t
+ParkBucketCount = 256;
+
+struct alignas(64) ParkBucket
+{
+   //! Number of threads parked on words which hash to this bucket
+   std::atomic<uint32_t> parked { 0 };
+};
+
+static ParkBucket
+sParkBuckets[ParkBucketCount];
+
+static ParkBucket &
+getBucket(std::atomic<uint32_t> *word)
+{
+   auto hash = std::hash<std::atomic<uint32_t> *> { }(word);
+   return sParkBuckets[(hash >> 2) % ParkBucketCount];
+}
+
+void
+pause()
+{
+#ifdef PLATFORM_WINDOWS
+   _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+   __builtin_ia32_pause();
+#else
+   std::this_thread::yield();
+#endif
+}
+
+void
+park(std::atomic<uint32_t> *word,
+     uint32_t value)
+{
+   auto &bucket = getBucket(word);
+
+   // The increment must be visible before we check the word in futexWait,
+   //  unpark changes the word before it checks the count.
+   bucket.parked.fetch_add(1);
+   platform::futexWait(word, value);
+   bucket.parked.fetch_sub(1);
+}
+
+void
+unpark(std::atomic<uint32_t> *word)
+{
+   auto &bucket = getBucket(word);
+
+   if (bucket.parked.load()) {
+      platform::futexWakeOne(word);
+   }
+}
+
+uint64_t
+now()
+{
+   auto time = std::chrono::steady_clock::now().time_since_epoch();
+   return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+}
+
+} // namespace adaptive_lock
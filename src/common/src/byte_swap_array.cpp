@@ -0,0 +1,323 @@
+#include "byte_swap.h"
+#include "byte_swap_array.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define BYTE_SWAP_ARRAY_X86
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#else
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Triangle corners taken from each quad, see expand_quad_list
+static const std::array<unsigned, 6>
+sQuadCorners = { 0, 1, 2, 0, 2, 3 };
+
+static const std::array<unsigned, 6>
+sRectCorners = { 0, 1, 2, 2, 1, 3 };
+
+template<typename Type>
+static void
+byte_swap_array_scalar(Type *dst,
+                       const Type *src,
+                       size_t count)
+{
+   for (auto i = 0u; i < count; ++i) {
+      dst[i] = byte_swap(src[i]);
+   }
+}
+
+template<typename Type>
+static void
+expand_quad_list_scalar(Type *dst,
+                        const Type *src,
+                        size_t quadCount,
+                        bool isRects,
+                        bool swap)
+{
+   auto &corners = isRects ? sRectCorners : sQuadCorners;
+
+   for (auto i = 0u; i < quadCount; ++i) {
+      for (auto corner : corners) {
+         *(dst++) = swap ? byte_swap(src[corner]) : src[corner];
+      }
+
+      src += 4;
+   }
+}
+
+#ifdef BYTE_SWAP_ARRAY_X86
+
+enum class SimdLevel
+{
+   None,
+   SSSE3,
+   AVX2,
+};
+
+static SimdLevel
+detectSimdLevel()
+{
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 0);
+   auto maxLeaf = info[0];
+
+   __cpuid(info, 1);
+   auto hasSSSE3 = (info[2] & (1 << 9)) != 0;
+   auto hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+   auto hasAVX2 = false;
+
+   if (maxLeaf >= 7 && hasOSXSAVE && (_xgetbv(0) & 6) == 6) {
+      __cpuidex(info, 7, 0);
+      hasAVX2 = (info[1] & (1 << 5)) != 0;
+   }
+#else
+   auto hasSSSE3 = __builtin_cpu_supports("ssse3");
+   auto hasAVX2 = __builtin_cpu_supports("avx2");
+#endif
+
+   if (hasAVX2) {
+      return SimdLevel::AVX2;
+   } else if (hasSSSE3) {
+      return SimdLevel::SSSE3;
+   } else {
+      return SimdLevel::None;
+   }
+}
+
+static SimdLevel
+getSimdLevel()
+{
+   static const auto level = detectSimdLevel();
+   return level;
+}
+
+/**
+ * Build a pshufb mask which gathers the given indices of a 16 byte source,
+ * byte swapping each one if swap is set.
+ *
+ * Entries past indexCount zero their destination bytes.
+ */
+template<size_t IndexBytes>
+static std::array<uint8_t, 16>
+makeShuffleMask(const unsigned *indices,
+                size_t indexCount,
+                bool swap)
+{
+   auto mask = std::array<uint8_t, 16> { };
+   mask.fill(0x80);
+
+   for (auto i = 0u; i < indexCount && (i + 1) * IndexBytes <= 16; ++i) {
+      for (auto j = 0u; j < IndexBytes; ++j) {
+         auto byte = swap ? (IndexBytes - 1 - j) : j;
+         mask[i * IndexBytes + j] = static_cast<uint8_t>(indices[i] * IndexBytes + byte);
+      }
+   }
+
+   return mask;
+}
+
+template<size_t IndexBytes>
+static std::array<uint8_t, 16>
+makeSwapMask()
+{
+   auto indices = std::array<unsigned, 16 / IndexBytes> { };
+
+   for (auto i = 0u; i < indices.size(); ++i) {
+      indices[i] = i;
+   }
+
+   return makeShuffleMask<IndexBytes>(indices.data(), indices.size(), true);
+}
+
+template<size_t IndexBytes>
+TARGET_SSSE3 static void
+byte_swap_array_ssse3(uint8_t *dst,
+                      const uint8_t *src,
+                      size_t count)
+{
+   static const auto swapMask = makeSwapMask<IndexBytes>();
+   auto mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(swapMask.data()));
+   auto bytes = count * IndexBytes;
+   auto i = size_t { 0 };
+
+   for (; i + 16 <= bytes; i += 16) {
+      auto value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_shuffle_epi8(value, mask));
+   }
+
+   // Copy each remaining value out first in case dst and src are the same
+   for (; i < bytes; i += IndexBytes) {
+      auto value = std::array<uint8_t, IndexBytes> { };
+      std::memcpy(value.data(), src + i, IndexBytes);
+
+      for (auto j = 0u; j < IndexBytes; ++j) {
+         dst[i + j] = value[IndexBytes - 1 - j];
+      }
+   }
+}
+
+template<size_t IndexBytes>
+TARGET_AVX2 static void
+byte_swap_array_avx2(uint8_t *dst,
+                     const uint8_t *src,
+                     size_t count)
+{
+   static const auto swapMask = makeSwapMask<IndexBytes>();
+   auto mask128 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(swapMask.data()));
+   auto mask = _mm256_broadcastsi128_si256(mask128);
+   auto bytes = count * IndexBytes;
+   auto i = size_t { 0 };
+
+   for (; i + 32 <= bytes; i += 32) {
+      auto value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_shuffle_epi8(value, mask));
+   }
+
+   if (i < bytes) {
+      byte_swap_array_ssse3<IndexBytes>(dst + i, src + i, (bytes - i) / IndexBytes);
+   }
+}
+
+/**
+ * Two quads of 16 bit indices are loaded at once and expanded into 24 bytes,
+ * the first shuffle produces the first 8 indices and the second the last 4.
+ */
+TARGET_SSSE3 static void
+expand_quad_list16_ssse3(uint16_t *dst,
+                         const uint16_t *src,
+                         size_t quadCount,
+                         bool isRects,
+                         bool swap)
+{
+   auto &corners = isRects ? sRectCorners : sQuadCorners;
+   auto indices = std::array<unsigned, 12> { };
+
+   for (auto i = 0u; i < indices.size(); ++i) {
+      indices[i] = (i / 6) * 4 + corners[i % 6];
+   }
+
+   auto lowMask = makeShuffleMask<2>(indices.data(), 8, swap);
+   auto highMask = makeShuffleMask<2>(indices.data() + 8, 4, swap);
+   auto low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lowMask.data()));
+   auto high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(highMask.data()));
+   auto i = size_t { 0 };
+
+   for (; i + 2 <= quadCount; i += 2) {
+      auto value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_shuffle_epi8(value, low));
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + 8), _mm_shuffle_epi8(value, high));
+      src += 8;
+      dst += 12;
+   }
+
+   expand_quad_list_scalar(dst, src, quadCount - i, isRects, swap);
+}
+
+/**
+ * One quad of 32 bit indices is expanded into 24 bytes, the first shuffle
+ * produces the first 4 indices and the second the last 2.
+ */
+TARGET_SSSE3 static void
+expand_quad_list32_ssse3(uint32_t *dst,
+                         const uint32_t *src,
+                         size_t quadCount,
+                         bool isRects,
+                         bool swap)
+{
+   auto &corners = isRects ? sRectCorners : sQuadCorners;
+   auto lowMask = makeShuffleMask<4>(corners.data(), 4, swap);
+   auto highMask = makeShuffleMask<4>(corners.data() + 4, 2, swap);
+   auto low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lowMask.data()));
+   auto high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(highMask.data()));
+
+   for (auto i = 0u; i < quadCount; ++i) {
+      auto value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_shuffle_epi8(value, low));
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + 4), _mm_shuffle_epi8(value, high));
+      src += 4;
+      dst += 6;
+   }
+}
+
+#endif // BYTE_SWAP_ARRAY_X86
+
+void
+byte_swap_array(uint16_t *dst,
+                const uint16_t *src,
+                size_t count)
+{
+#ifdef BYTE_SWAP_ARRAY_X86
+   switch (getSimdLevel()) {
+   case SimdLevel::AVX2:
+      return byte_swap_array_avx2<2>(reinterpret_cast<uint8_t *>(dst), reinterpret_cast<const uint8_t *>(src), count);
+   case SimdLevel::SSSE3:
+      return byte_swap_array_ssse3<2>(reinterpret_cast<uint8_t *>(dst), reinterpret_cast<const uint8_t *>(src), count);
+   default:
+      break;
+   }
+#endif
+
+   byte_swap_array_scalar(dst, src, count);
+}
+
+void
+byte_swap_array(uint32_t *dst,
+                const uint32_t *src,
+                size_t count)
+{
+#ifdef BYTE_SWAP_ARRAY_X86
+   switch (getSimdLevel()) {
+   case SimdLevel::AVX2:
+      return byte_swap_array_avx2<4>(reinterpret_cast<uint8_t *>(dst), reinterpret_cast<const uint8_t *>(src), count);
+   case SimdLevel::SSSE3:
+      return byte_swap_array_ssse3<4>(reinterpret_cast<uint8_t *>(dst), reinterpret_cast<const uint8_t *>(src), count);
+   default:
+      break;
+   }
+#endif
+
+   byte_swap_array_scalar(dst, src, count);
+}
+
+void
+expand_quad_list(uint16_t *dst,
+                 const uint16_t *src,
+                 size_t quadCount,
+                 bool isRects,
+                 bool swap)
+{
+#ifdef BYTE_SWAP_ARRAY_X86
+   if (getSimdLevel() != SimdLevel::None) {
+      return expand_quad_list16_ssse3(dst, src, quadCount, isRects, swap);
+   }
+#endif
+
+   expand_quad_list_scalar(dst, src, quadCount, isRects, swap);
+}
+
+void
+expand_quad_list(uint32_t *dst,
+                 const uint32_t *src,
+                 size_t quadCount,
+                 bool isRects,
+                 bool swap)
+{
+#ifdef BYTE_SWAP_ARRAY_X86
+   if (getSimdLevel() != SimdLevel::None) {
+      return expand_quad_list32_ssse3(dst, src, quadCount, isRects, swap);
+   }
+#endif
+
+   expand_quad_list_scalar(dst, src, quadCount, isRects, swap);
+}
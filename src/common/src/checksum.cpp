@@ -0,0 +1,293 @@
+#include "checksum.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CHECKSUM_X86
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_PCLMUL
+#else
+#define TARGET_PCLMUL __attribute__((target("pclmul")))
+#endif
+#endif
+
+// Largest prime smaller than 65536
+static const uint32_t
+AdlerBase = 65521;
+
+// Most bytes which can be summed before s2 could overflow 32 bits
+static const size_t
+AdlerMaxBlock = 5552;
+
+// Reversed CRC-32 polynomial, as used by zlib
+static const uint32_t
+CrcPolynomial = 0xEDB88320;
+
+/**
+ * Slice-by-8 lookup tables, table[0] is the usual byte at a time table and
+ * table[n] advances it by another n zero bytes.
+ */
+struct CrcTables
+{
+   CrcTables()
+   {
+      for (auto i = 0u; i < 256; ++i) {
+         auto crc = i;
+
+         for (auto bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ CrcPolynomial : (crc >> 1);
+         }
+
+         table[0][i] = crc;
+      }
+
+      for (auto i = 0u; i < 256; ++i) {
+         for (auto n = 1u; n < 8; ++n) {
+            table[n][i] = (table[n - 1][i] >> 8) ^ table[0][table[n - 1][i] & 0xFF];
+         }
+      }
+   }
+
+   std::array<std::array<uint32_t, 256>, 8> table;
+};
+
+static const CrcTables &
+getCrcTables()
+{
+   static const CrcTables tables;
+   return tables;
+}
+
+static void
+adler32_scalar(uint32_t &s1,
+               uint32_t &s2,
+               const uint8_t *data,
+               size_t size)
+{
+   for (auto i = 0u; i < size; ++i) {
+      s1 += data[i];
+      s2 += s1;
+   }
+}
+
+/**
+ * Operates on the inverted CRC, as zlib does internally.
+ */
+static uint32_t
+crc32_scalar(uint32_t crc,
+             const uint8_t *data,
+             size_t size)
+{
+   auto &table = getCrcTables().table;
+
+   for (; size >= 8; size -= 8, data += 8) {
+      uint32_t lo, hi;
+      std::memcpy(&lo, data, 4);
+      std::memcpy(&hi, data + 4, 4);
+      lo ^= crc;
+
+      crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF]
+          ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24]
+          ^ table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF]
+          ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+   }
+
+   for (; size; --size, ++data) {
+      crc = (crc >> 8) ^ table[0][(crc ^ *data) & 0xFF];
+   }
+
+   return crc;
+}
+
+#ifdef CHECKSUM_X86
+
+/**
+ * Sums 16 bytes at a time, s1 and s2 are spread over the four lanes of a
+ * vector each and only reduced at the end of the block.
+ *
+ * Every byte of a chunk adds to s2 the s1 from before the chunk, which is
+ * summed separately in previous and multiplied by 16 at the end, plus its
+ * own value weighted by its distance from the end of the chunk.
+ */
+static void
+adler32_sse2(uint32_t &s1,
+             uint32_t &s2,
+             const uint8_t *data,
+             size_t size)
+{
+   const auto zero = _mm_setzero_si128();
+   const auto weightsLo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+   const auto weightsHi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+   auto vs1 = _mm_cvtsi32_si128(static_cast<int>(s1));
+   auto vs2 = _mm_cvtsi32_si128(static_cast<int>(s2));
+   auto previous = zero;
+
+   for (; size >= 16; size -= 16, data += 16) {
+      auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+      previous = _mm_add_epi32(previous, vs1);
+      vs1 = _mm_add_epi32(vs1, _mm_sad_epu8(bytes, zero));
+      vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), weightsLo));
+      vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), weightsHi));
+   }
+
+   vs2 = _mm_add_epi32(vs2, _mm_slli_epi32(previous, 4));
+
+   // Horizontal sum of the four lanes
+   vs1 = _mm_add_epi32(vs1, _mm_shuffle_epi32(vs1, _MM_SHUFFLE(1, 0, 3, 2)));
+   vs1 = _mm_add_epi32(vs1, _mm_shuffle_epi32(vs1, _MM_SHUFFLE(2, 3, 0, 1)));
+   vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(1, 0, 3, 2)));
+   vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(2, 3, 0, 1)));
+   s1 = static_cast<uint32_t>(_mm_cvtsi128_si32(vs1));
+   s2 = static_cast<uint32_t>(_mm_cvtsi128_si32(vs2));
+
+   adler32_scalar(s1, s2, data, size);
+}
+
+static bool
+detectPclmul()
+{
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 1);
+   return (info[2] & (1 << 1)) != 0;
+#else
+   return __builtin_cpu_supports("pclmul");
+#endif
+}
+
+static bool
+hasPclmul()
+{
+   static const auto supported = detectPclmul();
+   return supported;
+}
+
+/**
+ * Multiply both halves of value by the folding constants in k and add the
+ * next 16 bytes of data.
+ */
+TARGET_PCLMUL static inline __m128i
+crc32_fold(__m128i value,
+           __m128i next,
+           __m128i k)
+{
+   auto lo = _mm_clmulepi64_si128(value, k, 0x00);
+   auto hi = _mm_clmulepi64_si128(value, k, 0x11);
+   return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+/**
+ * Folds 64 bytes at a time with carry-less multiplies, then reduces the
+ * remainder to 32 bits with a Barrett reduction, from Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+ *
+ * size must be a multiple of 16 and at least 64, and the CRC is inverted.
+ */
+TARGET_PCLMUL static uint32_t
+crc32_pclmul(uint32_t crc,
+             const uint8_t *data,
+             size_t size)
+{
+   alignas(16) static const uint64_t k1k2[] = { 0x0154442BD4, 0x01C6E41596 };
+   alignas(16) static const uint64_t k3k4[] = { 0x01751997D0, 0x00CCAA009E };
+   alignas(16) static const uint64_t k5k0[] = { 0x0163CD6124, 0x0000000000 };
+   alignas(16) static const uint64_t poly[] = { 0x01DB710641, 0x01F7011641 };
+
+   auto load = [](const uint8_t *ptr) {
+      return _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+   };
+
+   auto x1 = _mm_xor_si128(load(data + 0), _mm_cvtsi32_si128(static_cast<int>(crc)));
+   auto x2 = load(data + 16);
+   auto x3 = load(data + 32);
+   auto x4 = load(data + 48);
+   auto k = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+   data += 64;
+   size -= 64;
+
+   for (; size >= 64; size -= 64, data += 64) {
+      x1 = crc32_fold(x1, load(data + 0), k);
+      x2 = crc32_fold(x2, load(data + 16), k);
+      x3 = crc32_fold(x3, load(data + 32), k);
+      x4 = crc32_fold(x4, load(data + 48), k);
+   }
+
+   // Fold the four lanes into one, then any remaining 16 byte blocks
+   k = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+   x1 = crc32_fold(x1, x2, k);
+   x1 = crc32_fold(x1, x3, k);
+   x1 = crc32_fold(x1, x4, k);
+
+   for (; size >= 16; size -= 16, data += 16) {
+      x1 = crc32_fold(x1, load(data), k);
+   }
+
+   // Fold 128 bits to 64 bits
+   auto mask = _mm_setr_epi32(-1, 0, -1, 0);
+   x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+   x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+   k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+   x2 = _mm_srli_si128(x1, 4);
+   x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   // Barrett reduction to 32 bits
+   k = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+   x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+   x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), k, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+}
+
+#endif // CHECKSUM_X86
+
+uint32_t
+checksum_adler32(uint32_t adler,
+                 const uint8_t *data,
+                 size_t size)
+{
+   auto s1 = adler & 0xFFFF;
+   auto s2 = adler >> 16;
+
+   while (size) {
+      auto block = size < AdlerMaxBlock ? size : AdlerMaxBlock;
+
+#ifdef CHECKSUM_X86
+      adler32_sse2(s1, s2, data, block);
+#else
+      adler32_scalar(s1, s2, data, block);
+#endif
+
+      s1 %= AdlerBase;
+      s2 %= AdlerBase;
+      data += block;
+      size -= block;
+   }
+
+   return (s2 << 16) | s1;
+}
+
+uint32_t
+checksum_crc32(uint32_t crc,
+               const uint8_t *data,
+               size_t size)
+{
+   crc = ~crc;
+
+#ifdef CHECKSUM_X86
+   if (size >= 64 && hasPclmul()) {
+      auto chunk = size & ~size_t { 15 };
+      crc = crc32_pclmul(crc, data, chunk);
+      data += chunk;
+      size -= chunk;
+   }
+#endif
+
+   return ~crc32_scalar(crc, data, size);
+}
@@ -0,0 +1,811 @@
+#include "checksum.h"
+#include "inflate.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+
+/*
+Deflate decoder for whole streams held in memory.
+
+Input is read through a 64 bit bit buffer which is refilled with a single
+unaligned load whenever at least 8 bytes of input remain, so a literal or
+a whole length and distance pair can be decoded after one refill.
+
+Huffman codes are decoded with one table lookup of the first tableBits
+bits of the code, codes longer than that point to a subtable indexed by
+the rest of the code. Each entry gives the bits to consume, and either the
+literal, the base of a length or distance and its number of extra bits, or
+the subtable to use.
+
+Matches are copied 8 or 16 bytes at a time when there is room in the
+output to overrun the end of the match, which is overwritten later.
+*/
+
+static const unsigned
+MaxCodeLength = 15;
+
+static const unsigned
+LitlenTableBits = 10;
+
+static const unsigned
+DistTableBits = 8;
+
+static const unsigned
+PrecodeTableBits = 7;
+
+static const unsigned
+NumLitlenSymbols = 288;
+
+static const unsigned
+NumDistSymbols = 32;
+
+static const unsigned
+NumPrecodeSymbols = 19;
+
+// Room for the main table and a full size subtable for every symbol
+static const size_t
+LitlenTableSize = (1 << LitlenTableBits) + (NumLitlenSymbols << (MaxCodeLength - LitlenTableBits));
+
+static const size_t
+DistTableSize = (1 << DistTableBits) + (NumDistSymbols << (MaxCodeLength - DistTableBits));
+
+// Order the code length code lengths are stored in
+static const std::array<uint8_t, NumPrecodeSymbols>
+PrecodeOrder = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static const std::array<uint16_t, 29>
+LengthBase = {
+   3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+   35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const std::array<uint8_t, 29>
+LengthExtraBits = {
+   0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+   3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const std::array<uint16_t, 30>
+DistBase = {
+   1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+   8193, 12289, 16385, 24577
+};
+
+static const std::array<uint8_t, 30>
+DistExtraBits = {
+   0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+   7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const uint8_t EntryExtraMask = 0x0F;
+static const uint8_t EntrySubtable = 0x10;
+static const uint8_t EntryEndOfBlock = 0x20;
+static const uint8_t EntryLiteral = 0x40;
+static const uint8_t EntryInvalid = 0x80;
+
+struct HuffmanEntry
+{
+   //! Literal, length or distance base, symbol, or subtable offset
+   uint16_t value;
+
+   //! Bits to consume, or the number of bits indexing a subtable
+   uint8_t length;
+
+   //! Entry flags, and the number of extra bits for a length or distance
+   uint8_t flags;
+};
+
+struct DynamicTables
+{
+   std::array<HuffmanEntry, LitlenTableSize> litlen;
+   std::array<HuffmanEntry, DistTableSize> dist;
+};
+
+/**
+ * Tables which are the same for every stream.
+ */
+struct StaticTables
+{
+   StaticTables();
+
+   //! Entry for each symbol, without the code length
+   std::array<HuffmanEntry, NumLitlenSymbols> litlenSymbols;
+   std::array<HuffmanEntry, NumDistSymbols> distSymbols;
+   std::array<HuffmanEntry, NumPrecodeSymbols> precodeSymbols;
+
+   //! Decode tables for fixed Huffman blocks
+   std::array<HuffmanEntry, 1 << LitlenTableBits> fixedLitlen;
+   std::array<HuffmanEntry, 1 << DistTableBits> fixedDist;
+};
+
+struct BitReader
+{
+   const uint8_t *in;
+   const uint8_t *end;
+   uint64_t buffer;
+
+   //! Number of bits in buffer
+   unsigned available;
+
+   //! Number of zero bytes added to buffer after the end of the input
+   unsigned overread;
+
+   /**
+    * Fill buffer with at least 56 bits.
+    *
+    * The bits above available are left holding the start of the next byte
+    * of input, which is the same data the next refill ORs over them.
+    */
+   void
+   refill()
+   {
+      if (end - in >= 8) {
+         uint64_t word;
+         std::memcpy(&word, in, 8);
+         buffer |= word << available;
+         in += (63 - available) >> 3;
+         available |= 56;
+      } else {
+         while (available <= 56) {
+            if (in < end) {
+               buffer |= uint64_t { *in++ } << available;
+            } else {
+               ++overread;
+            }
+
+            available += 8;
+         }
+      }
+   }
+
+   uint32_t
+   peek(unsigned count) const
+   {
+      return static_cast<uint32_t>(buffer & ((uint64_t { 1 } << count) - 1));
+   }
+
+   void
+   consume(unsigned count)
+   {
+      buffer >>= count;
+      available -= count;
+   }
+
+   uint32_t
+   read(unsigned count)
+   {
+      auto value = peek(count);
+      consume(count);
+      return value;
+   }
+
+   //! True if any of the zero bytes past the end of input were consumed
+   bool
+   overrun() const
+   {
+      return available < overread * 8;
+   }
+
+   /**
+    * Skip to the next byte boundary and give back every whole byte in the
+    * buffer, so in points at the next unread byte of input.
+    */
+   void
+   alignToInput()
+   {
+      consume(available & 7);
+      in -= (available >> 3) - overread;
+      buffer = 0;
+      available = 0;
+      overread = 0;
+   }
+};
+
+static uint32_t
+reverseBits(uint32_t code,
+            unsigned length)
+{
+   auto result = 0u;
+
+   for (auto i = 0u; i < length; ++i) {
+      result = (result << 1) | (code & 1);
+      code >>= 1;
+   }
+
+   return result;
+}
+
+/**
+ * Build a decode table for the canonical Huffman code with the given code
+ * lengths.
+ *
+ * Like zlib, an incomplete code is only accepted if it has a single code of
+ * length 1 and allowSingle is set, or no codes at all.
+ */
+static bool
+buildTable(HuffmanEntry *table,
+           unsigned tableBits,
+           const uint8_t *lengths,
+           const HuffmanEntry *symbols,
+           unsigned numSymbols,
+           bool allowSingle)
+{
+   std::array<uint16_t, MaxCodeLength + 1> count = { 0 };
+   std::array<uint16_t, MaxCodeLength + 2> offset = { 0 };
+   std::array<uint16_t, NumLitlenSymbols> sorted;
+   auto maxLength = 0u;
+
+   for (auto i = 0u; i < numSymbols; ++i) {
+      count[lengths[i]]++;
+   }
+
+   auto left = 1;
+
+   for (auto length = 1u; length <= MaxCodeLength; ++length) {
+      left = (left << 1) - count[length];
+
+      if (left < 0) {
+         return false;
+      }
+
+      if (count[length]) {
+         maxLength = length;
+      }
+   }
+
+   if (left > 0 && maxLength > 0 && (!allowSingle || maxLength != 1)) {
+      return false;
+   }
+
+   for (auto i = 0u; i < (1u << tableBits); ++i) {
+      table[i] = HuffmanEntry { 0, 0, EntryInvalid };
+   }
+
+   // Sort symbols by code length, then by symbol, which is code order
+   for (auto length = 1u; length <= MaxCodeLength; ++length) {
+      offset[length + 1] = offset[length] + count[length];
+   }
+
+   for (auto i = 0u; i < numSymbols; ++i) {
+      if (lengths[i]) {
+         sorted[offset[lengths[i]]++] = static_cast<uint16_t>(i);
+      }
+   }
+
+   auto subtableBits = maxLength > tableBits ? maxLength - tableBits : 0;
+   auto nextSubtable = 1u << tableBits;
+   auto code = 0u;
+   auto index = 0u;
+
+   for (auto length = 1u; length <= maxLength; ++length, code <<= 1) {
+      for (auto i = 0u; i < count[length]; ++i, ++code) {
+         auto entry = symbols[sorted[index++]];
+         auto reversed = reverseBits(code, length);
+
+         if (length <= tableBits) {
+            entry.length = static_cast<uint8_t>(length);
+
+            for (auto j = reversed; j < (1u << tableBits); j += 1u << length) {
+               table[j] = entry;
+            }
+         } else {
+            auto &pointer = table[reversed & ((1u << tableBits) - 1)];
+
+            if (!(pointer.flags & EntrySubtable)) {
+               pointer = HuffmanEntry { static_cast<uint16_t>(nextSubtable), static_cast<uint8_t>(subtableBits), EntrySubtable };
+
+               for (auto j = 0u; j < (1u << subtableBits); ++j) {
+                  table[nextSubtable + j] = HuffmanEntry { 0, 0, EntryInvalid };
+               }
+
+               nextSubtable += 1u << subtableBits;
+            }
+
+            auto subtable = table + pointer.value;
+            auto subLength = length - tableBits;
+            entry.length = static_cast<uint8_t>(subLength);
+
+            for (auto j = reversed >> tableBits; j < (1u << subtableBits); j += 1u << subLength) {
+               subtable[j] = entry;
+            }
+         }
+      }
+   }
+
+   return true;
+}
+
+StaticTables::StaticTables()
+{
+   for (auto i = 0u; i < NumLitlenSymbols; ++i) {
+      if (i < 256) {
+         litlenSymbols[i] = HuffmanEntry { static_cast<uint16_t>(i), 0, EntryLiteral };
+      } else if (i == 256) {
+         litlenSymbols[i] = HuffmanEntry { 0, 0, EntryEndOfBlock };
+      } else if (i - 257 < LengthBase.size()) {
+         litlenSymbols[i] = HuffmanEntry { LengthBase[i - 257], 0, LengthExtraBits[i - 257] };
+      } else {
+         litlenSymbols[i] = HuffmanEntry { 0, 0, EntryInvalid };
+      }
+   }
+
+   for (auto i = 0u; i < NumDistSymbols; ++i) {
+      if (i < DistBase.size()) {
+         distSymbols[i] = HuffmanEntry { DistBase[i], 0, DistExtraBits[i] };
+      } else {
+         distSymbols[i] = HuffmanEntry { 0, 0, EntryInvalid };
+      }
+   }
+
+   for (auto i = 0u; i < NumPrecodeSymbols; ++i) {
+      precodeSymbols[i] = HuffmanEntry { static_cast<uint16_t>(i), 0, 0 };
+   }
+
+   std::array<uint8_t, NumLitlenSymbols> lengths;
+   std::fill(lengths.begin(), lengths.begin() + 144, 8);
+   std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+   std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+   std::fill(lengths.begin() + 280, lengths.end(), 8);
+   buildTable(fixedLitlen.data(), LitlenTableBits, lengths.data(), litlenSymbols.data(), NumLitlenSymbols, false);
+
+   std::fill(lengths.begin(), lengths.begin() + NumDistSymbols, 5);
+   buildTable(fixedDist.data(), DistTableBits, lengths.data(), distSymbols.data(), NumDistSymbols, false);
+}
+
+static thread_local std::unique_ptr<DynamicTables>
+sDynamicTables;
+
+static const StaticTables &
+getStaticTables()
+{
+   static const StaticTables tables;
+   return tables;
+}
+
+static inline HuffmanEntry
+decodeSymbol(BitReader &bits,
+             const HuffmanEntry *table,
+             unsigned tableBits)
+{
+   auto entry = table[bits.peek(tableBits)];
+
+   if (entry.flags & EntrySubtable) {
+      bits.consume(tableBits);
+      entry = table[entry.value + bits.peek(entry.length)];
+   }
+
+   bits.consume(entry.length);
+   return entry;
+}
+
+/**
+ * Copy a match of length bytes from distance bytes back, there must be
+ * room for length bytes at out.
+ */
+static inline void
+copyMatch(uint8_t *out,
+          size_t distance,
+          size_t length,
+          const uint8_t *outEnd)
+{
+   auto from = out - distance;
+   auto end = out + length;
+
+   if (static_cast<size_t>(outEnd - end) >= 16) {
+      if (distance >= 16) {
+         do {
+            std::memcpy(out, from, 16);
+            out += 16;
+            from += 16;
+         } while (out < end);
+         return;
+      } else if (distance >= 8) {
+         do {
+            std::memcpy(out, from, 8);
+            out += 8;
+            from += 8;
+         } while (out < end);
+         return;
+      } else if (distance == 1) {
+         std::memset(out, *from, length);
+         return;
+      } else if (length <= distance) {
+         // Short enough to not overlap itself, so one word holds it all
+         uint64_t word;
+         std::memcpy(&word, from, 8);
+         std::memcpy(out, &word, 8);
+         return;
+      }
+   }
+
+   while (out < end) {
+      *out++ = *from++;
+   }
+}
+
+static InflateStatus
+readDynamicTables(BitReader &bits,
+                  DynamicTables &tables)
+{
+   auto &symbols = getStaticTables();
+   std::array<uint8_t, NumLitlenSymbols + NumDistSymbols> lengths = { 0 };
+   std::array<uint8_t, NumPrecodeSymbols> precodeLengths = { 0 };
+   std::array<HuffmanEntry, 1 << PrecodeTableBits> precode;
+
+   auto numLitlen = bits.read(5) + 257;
+   auto numDist = bits.read(5) + 1;
+   auto numPrecode = bits.read(4) + 4;
+
+   if (numLitlen > 286 || numDist > 30) {
+      return InflateStatus::BadData;
+   }
+
+   for (auto i = 0u; i < numPrecode; ++i) {
+      bits.refill();
+      precodeLengths[PrecodeOrder[i]] = static_cast<uint8_t>(bits.read(3));
+   }
+
+   if (!buildTable(precode.data(), PrecodeTableBits, precodeLengths.data(), symbols.precodeSymbols.data(), NumPrecodeSymbols, false)) {
+      return InflateStatus::BadData;
+   }
+
+   for (auto i = 0u; i < numLitlen + numDist; ) {
+      bits.refill();
+
+      if (bits.overrun()) {
+         return InflateStatus::ShortInput;
+      }
+
+      auto entry = decodeSymbol(bits, precode.data(), PrecodeTableBits);
+      auto value = uint8_t { 0 };
+      auto repeat = 0u;
+
+      if (entry.flags & EntryInvalid) {
+         return InflateStatus::BadData;
+      } else if (entry.value < 16) {
+         lengths[i++] = static_cast<uint8_t>(entry.value);
+         continue;
+      } else if (entry.value == 16) {
+         if (i == 0) {
+            return InflateStatus::BadData;
+         }
+
+         value = lengths[i - 1];
+         repeat = 3 + bits.read(2);
+      } else if (entry.value == 17) {
+         repeat = 3 + bits.read(3);
+      } else {
+         repeat = 11 + bits.read(7);
+      }
+
+      if (i + repeat > numLitlen + numDist) {
+         return InflateStatus::BadData;
+      }
+
+      std::memset(lengths.data() + i, value, repeat);
+      i += repeat;
+   }
+
+   // A block must be able to end
+   if (lengths[256] == 0) {
+      return InflateStatus::BadData;
+   }
+
+   if (!buildTable(tables.litlen.data(), LitlenTableBits, lengths.data(), symbols.litlenSymbols.data(), numLitlen, true)
+    || !buildTable(tables.dist.data(), DistTableBits, lengths.data() + numLitlen, symbols.distSymbols.data(), numDist, true)) {
+      return InflateStatus::BadData;
+   }
+
+   return InflateStatus::Success;
+}
+
+/**
+ * Decode the symbols of one Huffman block, up to and including its end of
+ * block code.
+ */
+static InflateStatus
+decodeHuffmanBlock(BitReader &reader,
+                   uint8_t *dst,
+                   uint8_t *&outPtr,
+                   uint8_t *outEnd,
+                   const HuffmanEntry *litlen,
+                   const HuffmanEntry *dist)
+{
+   // Work on local copies so they can be kept in registers, the output
+   //  stores could otherwise alias them.
+   auto bits = reader;
+   auto out = outPtr;
+   auto status = InflateStatus::Success;
+
+   while (true) {
+      bits.refill();
+
+      if (bits.overrun()) {
+         status = InflateStatus::ShortInput;
+         break;
+      }
+
+      auto entry = decodeSymbol(bits, litlen, LitlenTableBits);
+
+      if (entry.flags & EntryLiteral) {
+         if (out == outEnd) {
+            status = InflateStatus::ShortOutput;
+            break;
+         }
+
+         *out++ = static_cast<uint8_t>(entry.value);
+         continue;
+      }
+
+      if (entry.flags & EntryEndOfBlock) {
+         break;
+      }
+
+      if (entry.flags & EntryInvalid) {
+         status = InflateStatus::BadData;
+         break;
+      }
+
+      size_t length = entry.value + bits.read(entry.flags & EntryExtraMask);
+      entry = decodeSymbol(bits, dist, DistTableBits);
+
+      if (entry.flags & EntryInvalid) {
+         status = InflateStatus::BadData;
+         break;
+      }
+
+      size_t distance = entry.value + bits.read(entry.flags & EntryExtraMask);
+
+      if (distance > static_cast<size_t>(out - dst)) {
+         status = InflateStatus::BadData;
+         break;
+      }
+
+      if (length > static_cast<size_t>(outEnd - out)) {
+         status = InflateStatus::ShortOutput;
+         break;
+      }
+
+      copyMatch(out, distance, length, outEnd);
+      out += length;
+   }
+
+   reader = bits;
+   outPtr = out;
+   return status;
+}
+
+static InflateStatus
+readZlibHeader(const uint8_t *src,
+               size_t size,
+               unsigned windowBits,
+               size_t &headerSize)
+{
+   if (size < 2) {
+      return InflateStatus::ShortInput;
+   }
+
+   auto cmf = src[0];
+   auto flg = src[1];
+
+   if (((cmf << 8) | flg) % 31 != 0 || (cmf & 0xF) != 8 || (cmf >> 4) + 8u > windowBits) {
+      return InflateStatus::BadData;
+   }
+
+   // A preset dictionary is needed, which has to come from the caller
+   if (flg & 0x20) {
+      return InflateStatus::BadData;
+   }
+
+   headerSize = 2;
+   return InflateStatus::Success;
+}
+
+static InflateStatus
+readGzipHeader(const uint8_t *src,
+               size_t size,
+               size_t &headerSize)
+{
+   static const uint8_t FlagHeaderCrc = 0x02;
+   static const uint8_t FlagExtra = 0x04;
+   static const uint8_t FlagName = 0x08;
+   static const uint8_t FlagComment = 0x10;
+   static const uint8_t FlagReserved = 0xE0;
+
+   if (size < 10) {
+      return InflateStatus::ShortInput;
+   }
+
+   if (src[0] != 0x1F || src[1] != 0x8B || src[2] != 8 || (src[3] & FlagReserved)) {
+      return InflateStatus::BadData;
+   }
+
+   auto flags = src[3];
+   auto pos = size_t { 10 };
+
+   if (flags & FlagExtra) {
+      if (size - pos < 2) {
+         return InflateStatus::ShortInput;
+      }
+
+      auto extraSize = static_cast<size_t>(src[pos] | (src[pos + 1] << 8));
+      pos += 2;
+
+      if (size - pos < extraSize) {
+         return InflateStatus::ShortInput;
+      }
+
+      pos += extraSize;
+   }
+
+   for (auto flag : { FlagName, FlagComment }) {
+      if (flags & flag) {
+         auto terminator = std::memchr(src + pos, 0, size - pos);
+
+         if (!terminator) {
+            return InflateStatus::ShortInput;
+         }
+
+         pos = static_cast<const uint8_t *>(terminator) - src + 1;
+      }
+   }
+
+   if (flags & FlagHeaderCrc) {
+      if (size - pos < 2) {
+         return InflateStatus::ShortInput;
+      }
+
+      auto crc = static_cast<uint32_t>(src[pos] | (src[pos + 1] << 8));
+
+      if (crc != (checksum_crc32(0, src, pos) & 0xFFFF)) {
+         return InflateStatus::BadData;
+      }
+
+      pos += 2;
+   }
+
+   headerSize = pos;
+   return InflateStatus::Success;
+}
+
+static uint32_t
+readBigEndian32(const uint8_t *src)
+{
+   return (static_cast<uint32_t>(src[0]) << 24) | (src[1] << 16) | (src[2] << 8) | src[3];
+}
+
+static uint32_t
+readLittleEndian32(const uint8_t *src)
+{
+   return src[0] | (src[1] << 8) | (src[2] << 16) | (static_cast<uint32_t>(src[3]) << 24);
+}
+
+InflateStatus
+inflate_buffer(uint8_t *dst,
+               size_t dstSize,
+               const uint8_t *src,
+               size_t srcSize,
+               InflateFormat format,
+               unsigned windowBits,
+               InflateResult &result)
+{
+   auto &tables = getStaticTables();
+   auto headerSize = size_t { 0 };
+   auto status = InflateStatus::Success;
+   result = InflateResult { };
+
+   if (format == InflateFormat::Zlib) {
+      status = readZlibHeader(src, srcSize, windowBits, headerSize);
+   } else if (format == InflateFormat::Gzip) {
+      status = readGzipHeader(src, srcSize, headerSize);
+   }
+
+   if (status != InflateStatus::Success) {
+      return status;
+   }
+
+   auto bits = BitReader { src + headerSize, src + srcSize, 0, 0, 0 };
+   auto out = dst;
+   auto outEnd = dst + dstSize;
+   auto last = false;
+
+   while (!last) {
+      bits.refill();
+      last = bits.read(1) != 0;
+
+      switch (bits.read(2)) {
+      case 0:
+      {
+         // Stored block, LEN and its complement follow at the next byte
+         bits.consume(bits.available & 7);
+         auto length = bits.read(16);
+         auto check = bits.read(16);
+
+         if (bits.overrun()) {
+            return InflateStatus::ShortInput;
+         }
+
+         if (length != (~check & 0xFFFF)) {
+            return InflateStatus::BadData;
+         }
+
+         bits.alignToInput();
+
+         if (static_cast<size_t>(bits.end - bits.in) < length) {
+            return InflateStatus::ShortInput;
+         }
+
+         if (static_cast<size_t>(outEnd - out) < length) {
+            return InflateStatus::ShortOutput;
+         }
+
+         std::memcpy(out, bits.in, length);
+         bits.in += length;
+         out += length;
+         break;
+      }
+      case 1:
+         status = decodeHuffmanBlock(bits, dst, out, outEnd, tables.fixedLitlen.data(), tables.fixedDist.data());
+         break;
+      case 2:
+         // Kept per thread, allocating them for every small stream is
+         //  noticeably slower.
+         if (!sDynamicTables) {
+            sDynamicTables.reset(new DynamicTables);
+         }
+
+         status = readDynamicTables(bits, *sDynamicTables);
+
+         if (status == InflateStatus::Success) {
+            status = decodeHuffmanBlock(bits, dst, out, outEnd, sDynamicTables->litlen.data(), sDynamicTables->dist.data());
+         }
+         break;
+      default:
+         status = InflateStatus::BadData;
+      }
+
+      if (status == InflateStatus::Success && bits.overrun()) {
+         status = InflateStatus::ShortInput;
+      }
+
+      if (status != InflateStatus::Success) {
+         return status;
+      }
+   }
+
+   bits.alignToInput();
+   result.outputUsed = static_cast<size_t>(out - dst);
+
+   if (format == InflateFormat::Zlib) {
+      if (bits.end - bits.in < 4) {
+         return InflateStatus::ShortInput;
+      }
+
+      result.check = checksum_adler32(1, dst, result.outputUsed);
+
+      if (readBigEndian32(bits.in) != result.check) {
+         return InflateStatus::BadData;
+      }
+
+      bits.in += 4;
+   } else if (format == InflateFormat::Gzip) {
+      if (bits.end - bits.in < 8) {
+         return InflateStatus::ShortInput;
+      }
+
+      result.check = checksum_crc32(0, dst, result.outputUsed);
+
+      if (readLittleEndian32(bits.in) != result.check
+       || readLittleEndian32(bits.in + 4) != static_cast<uint32_t>(result.outputUsed)) {
+         return InflateStatus::BadData;
+      }
+
+      bits.in += 8;
+   }
+
+   result.inputUsed = static_cast<size_t>(bits.in - src);
+   return InflateStatus::Success;
+}
@@ -0,0 +1,256 @@
+#include "memory_copy.h"
+#include "platform.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef PLATFORM_WINDOWS
+#include <vector>
+#include <Windows.h>
+#elif defined(PLATFORM_LINUX)
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define MEMORY_COPY_X86
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Used when the L2 cache size can not be found
+static const size_t
+DefaultCacheSize = 1024 * 1024;
+
+static size_t
+detectCacheSize()
+{
+   auto size = size_t { 0 };
+
+#ifdef PLATFORM_WINDOWS
+   auto bytes = DWORD { 0 };
+   GetLogicalProcessorInformation(nullptr, &bytes);
+
+   auto info = std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION>(bytes / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+
+   if (!info.empty() && GetLogicalProcessorInformation(info.data(), &bytes)) {
+      for (auto &entry : info) {
+         if (entry.Relationship == RelationCache && entry.Cache.Level == 2) {
+            size = std::max<size_t>(size, entry.Cache.Size);
+         }
+      }
+   }
+#elif defined(PLATFORM_LINUX) && defined(_SC_LEVEL2_CACHE_SIZE)
+   auto value = sysconf(_SC_LEVEL2_CACHE_SIZE);
+
+   if (value > 0) {
+      size = static_cast<size_t>(value);
+   }
+#endif
+
+   return size ? size : DefaultCacheSize;
+}
+
+#ifdef MEMORY_COPY_X86
+
+enum class SimdLevel
+{
+   SSE2,
+   AVX2,
+};
+
+static SimdLevel
+detectSimdLevel()
+{
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 0);
+   auto maxLeaf = info[0];
+
+   __cpuid(info, 1);
+   auto hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+   auto hasAVX2 = false;
+
+   if (maxLeaf >= 7 && hasOSXSAVE && (_xgetbv(0) & 6) == 6) {
+      __cpuidex(info, 7, 0);
+      hasAVX2 = (info[1] & (1 << 5)) != 0;
+   }
+#else
+   auto hasAVX2 = __builtin_cpu_supports("avx2");
+#endif
+
+   return hasAVX2 ? SimdLevel::AVX2 : SimdLevel::SSE2;
+}
+
+static SimdLevel
+getSimdLevel()
+{
+   static const auto level = detectSimdLevel();
+   return level;
+}
+
+/**
+ * The destination is aligned to 16 bytes with one unaligned copy, the rest
+ * is streamed 64 bytes at a time and the tail copied normally.
+ */
+static void
+stream_copy_sse2(uint8_t *dst,
+                 const uint8_t *src,
+                 size_t size)
+{
+   auto head = (16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15;
+   std::memcpy(dst, src, head);
+   dst += head;
+   src += head;
+   size -= head;
+
+   for (; size >= 64; size -= 64, dst += 64, src += 64) {
+      auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 0));
+      auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+      auto c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+      auto d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48));
+      _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 0), a);
+      _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 16), b);
+      _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 32), c);
+      _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 48), d);
+   }
+
+   // Non-temporal stores are weakly ordered
+   _mm_sfence();
+   std::memcpy(dst, src, size);
+}
+
+TARGET_AVX2 static void
+stream_copy_avx2(uint8_t *dst,
+                 const uint8_t *src,
+                 size_t size)
+{
+   auto head = (32 - (reinterpret_cast<uintptr_t>(dst) & 31)) & 31;
+   std::memcpy(dst, src, head);
+   dst += head;
+   src += head;
+   size -= head;
+
+   for (; size >= 128; size -= 128, dst += 128, src += 128) {
+      auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 0));
+      auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 32));
+      auto c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 64));
+      auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 96));
+      _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 0), a);
+      _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 32), b);
+      _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 64), c);
+      _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 96), d);
+   }
+
+   _mm_sfence();
+   std::memcpy(dst, src, size);
+}
+
+static void
+stream_set_sse2(uint8_t *dst,
+                uint8_t value,
+                size_t size)
+{
+   auto head = (16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15;
+   auto fill = _mm_set1_epi8(static_cast<char>(value));
+   std::memset(dst, value, head);
+   dst += head;
+   size -= head;
+
+   for (; size >= 64; size -= 64, dst += 64) {
+      _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 0), fill);
+      _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 16), fill);
+      _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 32), fill);
+      _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 48), fill);
+   }
+
+   _mm_sfence();
+   std::memset(dst, value, size);
+}
+
+TARGET_AVX2 static void
+stream_set_avx2(uint8_t *dst,
+                uint8_t value,
+                size_t size)
+{
+   auto head = (32 - (reinterpret_cast<uintptr_t>(dst) & 31)) & 31;
+   auto fill = _mm256_set1_epi8(static_cast<char>(value));
+   std::memset(dst, value, head);
+   dst += head;
+   size -= head;
+
+   for (; size >= 128; size -= 128, dst += 128) {
+      _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 0), fill);
+      _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 32), fill);
+      _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 64), fill);
+      _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 96), fill);
+   }
+
+   _mm_sfence();
+   std::memset(dst, value, size);
+}
+
+#endif // MEMORY_COPY_X86
+
+size_t
+memory_copy_non_temporal_threshold()
+{
+#ifdef MEMORY_COPY_X86
+   // A copy bigger than the L2 cache would evict its own destination before
+   //  it could be used from the cache anyway.
+   static const auto threshold = std::max(MemoryCopyMinNonTemporalSize, detectCacheSize());
+   return threshold;
+#else
+   return 0;
+#endif
+}
+
+void *
+memory_copy_large(void *dst,
+                  const void *src,
+                  size_t size)
+{
+#ifdef MEMORY_COPY_X86
+   if (size >= memory_copy_non_temporal_threshold()) {
+      auto dstBytes = reinterpret_cast<uint8_t *>(dst);
+      auto srcBytes = reinterpret_cast<const uint8_t *>(src);
+
+      if (getSimdLevel() == SimdLevel::AVX2) {
+         stream_copy_avx2(dstBytes, srcBytes, size);
+      } else {
+         stream_copy_sse2(dstBytes, srcBytes, size);
+      }
+
+      return dst;
+   }
+#endif
+
+   return std::memcpy(dst, src, size);
+}
+
+void *
+memory_set_large(void *dst,
+                 uint8_t value,
+                 size_t size)
+{
+#ifdef MEMORY_COPY_X86
+   if (size >= memory_copy_non_temporal_threshold()) {
+      auto dstBytes = reinterpret_cast<uint8_t *>(dst);
+
+      if (getSimdLevel() == SimdLevel::AVX2) {
+         stream_set_avx2(dstBytes, value, size);
+      } else {
+         stream_set_sse2(dstBytes, value, size);
+      }
+
+      return dst;
+   }
+#endif
+
+   return std::memset(dst, value, size);
+}
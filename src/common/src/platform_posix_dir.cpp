@@ -3,6 +3,7 @@
 #include "strutils.h"
 
 #ifdef PLATFORM_POSIX
+#include <dirent.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <sys/stat.h>
@@ -66,6 +67,31 @@ isDirectory(const std::string &path)
    return S_ISDIR(info.st_mode);
 }
 
+/**
+ * Get the names of the entries in a directory, excluding . and ..
+ */
+bool
+listDirectory(const std::string &path,
+              std::vector<std::string> &names)
+{
+   auto dir = opendir(path.c_str());
+
+   if (!dir) {
+      return false;
+   }
+
+   while (auto entry = readdir(dir)) {
+      auto name = std::string { entry->d_name };
+
+      if (name != "." && name != "..") {
+         names.push_back(name);
+      }
+   }
+
+   closedir(dir);
+   return true;
+}
+
 std::string
 getConfigDirectory()
 {
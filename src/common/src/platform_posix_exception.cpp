@@ -31,23 +31,37 @@ sIllHandler;
 static struct sigaction
 sSystemIllHandler;
 
-static void
+static struct sigaction
+sTrapHandler;
+
+static struct sigaction
+sSystemTrapHandler;
+
+// EFLAGS.TF, raises SIGTRAP after executing one instruction
+static const greg_t
+TrapFlag = 0x100;
+
+/**
+ * Returns true if one of the exception handlers handled the exception,
+ * otherwise the original signal handler has been restored.
+ */
+static bool
 dispatchException(Exception *exception,
                   void *context,
                   int signum,
-                  const struct sigaction *ourHandler,
                   const struct sigaction *sysHandler)
 {
-   // Reset to the original signal handler in case an exception handler
-   //  generates a signal of its own
-   sigaction(signum, sysHandler, nullptr);
-
-   static bool sInSignal = false;
+   // Several threads may be handling exceptions at once, for example when
+   //  more than one core touches a watched page, so the handler stays
+   //  installed and only recursion on the same thread is treated as fatal.
+   static thread_local bool sInSignal = false;
+   auto ctx = reinterpret_cast<ucontext_t *>(context);
 
    // Avoid recursive signal handling (in case an exception handler looking
    //  at a SIGILL causes a SIGSEGV, for example)
    if (sInSignal) {
-      return;
+      sigaction(signum, sysHandler, nullptr);
+      return false;
    }
 
    sInSignal = true;
@@ -62,37 +76,58 @@ dispatchException(Exception *exception,
 
       sInSignal = false;
 
-      // Reinstall our signal handler
-      sigaction(signum, ourHandler, nullptr);
-
       if (func == HandledException) {
          // Exception handled, resume execution
-         return;
+      } else if (func == HandledExceptionSingleStep) {
+         // Exception handled, resume execution for one instruction
+         ctx->uc_mcontext.gregs[REG_EFL] |= TrapFlag;
       } else {
          // Exception handled, switch execution to target function
-         auto ctx = reinterpret_cast<ucontext *>(context);
          ctx->uc_mcontext.gregs[REG_RIP] = reinterpret_cast<uint64_t>(func);
-         return;
       }
+
+      return true;
    }
 
-   // No exception handlers, found, so re-run the failing instruction to
-   //  call the original signal handler
-   return;
+   sInSignal = false;
+
+   // No exception handlers found, so reset to the original signal handler
+   //  and re-run the failing instruction to call it
+   sigaction(signum, sysHandler, nullptr);
+   return false;
 }
 
 static void
 segvHandler(int signum, siginfo_t *info, void *context)
 {
-   auto exception = AccessViolationException { reinterpret_cast<uint64_t>(info->si_addr) };
-   dispatchException(&exception, context, signum, &sSegvHandler, &sSystemSegvHandler);
+   auto ctx = reinterpret_cast<ucontext_t *>(context);
+
+   // Bit 1 of the page fault error code is set for writes
+   auto write = !!(ctx->uc_mcontext.gregs[REG_ERR] & 2);
+   auto exception = AccessViolationException { reinterpret_cast<uint64_t>(info->si_addr), write };
+   dispatchException(&exception, context, signum, &sSystemSegvHandler);
 }
 
 static void
 illHandler(int signum, siginfo_t *info, void *context)
 {
    auto exception = InvalidInstructionException { };
-   dispatchException(&exception, context, signum, &sIllHandler, &sSystemIllHandler);
+   dispatchException(&exception, context, signum, &sSystemIllHandler);
+}
+
+static void
+trapHandler(int signum, siginfo_t *info, void *context)
+{
+   auto ctx = reinterpret_cast<ucontext_t *>(context);
+   auto exception = SingleStepException { };
+
+   if (dispatchException(&exception, context, signum, &sSystemTrapHandler)) {
+      ctx->uc_mcontext.gregs[REG_EFL] &= ~TrapFlag;
+   } else {
+      // Re-running the instruction will not trap again, so raise it for
+      //  the original handler ourselves
+      raise(signum);
+   }
 }
 
 bool
@@ -102,10 +137,7 @@ installExceptionHandler(ExceptionHandler handler)
 
    if (!addedHandlers) {
       sigemptyset(&sSegvHandler.sa_mask);
-
-      // Set SA_RESETHAND so that a SEGV in the handler will terminate the
-      // program rather than going into an infinite loop.
-      sSegvHandler.sa_flags = SA_SIGINFO | SA_RESETHAND;
+      sSegvHandler.sa_flags = SA_SIGINFO;
 
       sSegvHandler.sa_sigaction = segvHandler;
       if (sigaction(SIGSEGV, &sSegvHandler, &sSystemSegvHandler) != 0) {
@@ -120,6 +152,13 @@ installExceptionHandler(ExceptionHandler handler)
          return false;
       }
 
+      sTrapHandler = sSegvHandler;
+      sTrapHandler.sa_sigaction = trapHandler;
+      if (sigaction(SIGTRAP, &sTrapHandler, &sSystemTrapHandler) != 0) {
+         gLog->error("sigaction(SIGTRAP) failed: {}", strerror(errno));
+         return false;
+      }
+
       addedHandlers = true;
    }
 
@@ -0,0 +1,98 @@
+#include "platform.h"
+#include "platform_futex.h"
+
+#ifdef PLATFORM_POSIX
+
+#ifdef PLATFORM_LINUX
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#endif
+
+namespace platform
+{
+
+#ifdef PLATFORM_LINUX
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "futex requires std::atomic<uint32_t> to be a plain 32 bit word");
+
+void
+futexWait(std::atomic<uint32_t> *word,
+          uint32_t expected)
+{
+   syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void
+futexWakeOne(std::atomic<uint32_t> *word)
+{
+   syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+void
+futexWakeAll(std::atomic<uint32_t> *word)
+{
+   syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#else
+
+/*
+ * Without a native futex we hash each word to one of a small number of
+ * buckets, each with its own mutex and condition variable. Words sharing a
+ * bucket may see spurious wakeups, which futexWait allows.
+ */
+struct FutexBucket
+{
+   std::mutex mutex;
+   std::condition_variable condition;
+};
+
+static FutexBucket
+sFutexBuckets[64];
+
+static FutexBucket &
+getBucket(std::atomic<uint32_t> *word)
+{
+   auto hash = std::hash<std::atomic<uint32_t> *> { }(word);
+   return sFutexBuckets[(hash >> 4) % 64];
+}
+
+void
+futexWait(std::atomic<uint32_t> *word,
+          uint32_t expected)
+{
+   auto &bucket = getBucket(word);
+   std::unique_lock<std::mutex> lock { bucket.mutex };
+
+   if (word->load() == expected) {
+      bucket.condition.wait(lock);
+   }
+}
+
+void
+futexWakeOne(std::atomic<uint32_t> *word)
+{
+   // Other words may share the bucket, so we must wake everyone
+   futexWakeAll(word);
+}
+
+void
+futexWakeAll(std::atomic<uint32_t> *word)
+{
+   auto &bucket = getBucket(word);
+   std::unique_lock<std::mutex> lock { bucket.mutex };
+   bucket.condition.notify_all();
+}
+
+#endif
+
+} // namespace platform
+
+#endif
@@ -82,6 +82,33 @@ isDirectory(const std::string &path)
    return !!(info.st_mode & _S_IFDIR);
 }
 
+/**
+ * Get the names of the entries in a directory, excluding . and ..
+ */
+bool
+listDirectory(const std::string &path,
+              std::vector<std::string> &names)
+{
+   auto winPath = platform::toWinApiString(path + "\\*");
+   WIN32_FIND_DATAW data;
+   auto handle = FindFirstFileW(winPath.c_str(), &data);
+
+   if (handle == INVALID_HANDLE_VALUE) {
+      return false;
+   }
+
+   do {
+      auto name = platform::fromWinApiString(data.cFileName);
+
+      if (name != "." && name != "..") {
+         names.push_back(name);
+      }
+   } while (FindNextFileW(handle, &data));
+
+   FindClose(handle);
+   return true;
+}
+
 std::string
 getConfigDirectory()
 {
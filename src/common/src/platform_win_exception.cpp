@@ -9,6 +9,10 @@
 namespace platform
 {
 
+// EFLAGS.TF, raises STATUS_SINGLE_STEP after executing one instruction
+static const DWORD
+TrapFlag = 0x100;
+
 static std::vector<ExceptionHandler>
 gExceptionHandlers;
 
@@ -24,6 +28,10 @@ dispatchException(PEXCEPTION_POINTERS info, Exception *exception)
       } else if (func == HandledException) {
          // Exception handled, resume execution
          return EXCEPTION_CONTINUE_EXECUTION;
+      } else if (func == HandledExceptionSingleStep) {
+         // Exception handled, resume execution for one instruction
+         info->ContextRecord->EFlags |= TrapFlag;
+         return EXCEPTION_CONTINUE_EXECUTION;
       } else {
          // Exception handled, jump to new function
          info->ContextRecord->Rip = reinterpret_cast<DWORD64>(func);
@@ -39,10 +47,21 @@ exceptionHandler(PEXCEPTION_POINTERS info)
 {
    switch (info->ExceptionRecord->ExceptionCode) {
    case STATUS_ACCESS_VIOLATION: {
+      auto write = info->ExceptionRecord->ExceptionInformation[0] == 1;
       auto address = info->ExceptionRecord->ExceptionInformation[1];
-      auto exception = AccessViolationException{ address };
+      auto exception = AccessViolationException{ address, write };
       return dispatchException(info, &exception);
    } break;
+   case STATUS_SINGLE_STEP: {
+      auto exception = SingleStepException{ };
+      auto result = dispatchException(info, &exception);
+
+      if (result == EXCEPTION_CONTINUE_EXECUTION) {
+         info->ContextRecord->EFlags &= ~TrapFlag;
+      }
+
+      return result;
+   } break;
    case STATUS_ILLEGAL_INSTRUCTION: {
       auto exception = InvalidInstructionException{ };
       return dispatchException(info, &exception);
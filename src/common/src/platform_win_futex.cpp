@@ -0,0 +1,31 @@
+#include "platform.h"
+#include "platform_futex.h"
+
+#ifdef PLATFORM_WINDOWS
+#include <Windows.h>
+
+namespace platform
+{
+
+void
+futexWait(std::atomic<uint32_t> *word,
+          uint32_t expected)
+{
+   WaitOnAddress(word, &expected, sizeof(expected), INFINITE);
+}
+
+void
+futexWakeOne(std::atomic<uint32_t> *word)
+{
+   WakeByAddressSingle(word);
+}
+
+void
+futexWakeAll(std::atomic<uint32_t> *word)
+{
+   WakeByAddressAll(word);
+}
+
+} // namespace platform
+
+#endif
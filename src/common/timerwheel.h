@@ -0,0 +1,285 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Hierarchical timing wheel.
+ *
+ * Maps items to an absolute deadline with O(1) insert and erase. Time is
+ * split into units of 2^UnitShift ticks, level 0 has one slot per unit and
+ * each higher level has slots SlotCount times as wide as the level below.
+ * Items further away than the top level can cover are kept in a sorted
+ * overflow set.
+ *
+ * Items in a higher level slot are moved down a level when the wheel
+ * reaches that slot, so each item is moved at most Levels times and always
+ * expires at its exact deadline rather than at a slot boundary.
+ */
+template<typename Type, unsigned UnitShift>
+class TimerWheel
+{
+   static constexpr unsigned SlotBits = 6;
+   static constexpr unsigned SlotCount = 1 << SlotBits;
+   static constexpr unsigned SlotMask = SlotCount - 1;
+   static constexpr unsigned Levels = 4;
+   static constexpr unsigned OverflowLevel = Levels;
+
+   struct Node
+   {
+      Type *item;
+      uint64_t deadline;
+      unsigned level;
+      unsigned slot;
+      Node *prev;
+      Node *next;
+   };
+
+public:
+   bool empty() const
+   {
+      return mNodes.empty();
+   }
+
+   size_t size() const
+   {
+      return mNodes.size();
+   }
+
+   bool contains(Type *item) const
+   {
+      return mNodes.find(item) != mNodes.end();
+   }
+
+   /**
+    * Insert an item, or move it if it is already in the wheel.
+    */
+   void insert(Type *item, uint64_t deadline)
+   {
+      auto &node = mNodes[item];
+
+      if (node.item) {
+         unlink(&node);
+      }
+
+      node.item = item;
+      node.deadline = deadline;
+      link(&node);
+   }
+
+   /**
+    * Remove an item, returns false if the item was not in the wheel.
+    */
+   bool erase(Type *item)
+   {
+      auto itr = mNodes.find(item);
+
+      if (itr == mNodes.end()) {
+         return false;
+      }
+
+      unlink(&itr->second);
+      mNodes.erase(itr);
+      return true;
+   }
+
+   /**
+    * Returns the earliest deadline of any item, or UINT64_MAX if empty.
+    */
+   uint64_t nextDeadline() const
+   {
+      auto next = UINT64_MAX;
+
+      for (auto level = 0u; level < Levels; ++level) {
+         // The first occupied slot from the cursor holds the earliest items
+         //  of this level, as a level covers at most SlotCount slots ahead.
+         auto slots = mOccupied[level];
+
+         if (!slots) {
+            continue;
+         }
+
+         auto cursor = static_cast<unsigned>((mCurrent >> (SlotBits * level)) & SlotMask);
+         auto rotated = (slots >> cursor) | (cursor ? (slots << (SlotCount - cursor)) : 0);
+         auto slot = (cursor + countTrailingZeros(rotated)) & SlotMask;
+
+         for (auto node = mSlots[level][slot]; node; node = node->next) {
+            next = std::min(next, node->deadline);
+         }
+      }
+
+      if (!mOverflow.empty()) {
+         next = std::min(next, mOverflow.begin()->first);
+      }
+
+      return next;
+   }
+
+   /**
+    * Advance the wheel to now, removing every item with deadline <= now.
+    *
+    * Expired items are appended to expired in deadline order.
+    */
+   void advance(uint64_t now, std::vector<Type *> &expired)
+   {
+      auto target = now >> UnitShift;
+      auto due = std::vector<std::pair<uint64_t, Type *>> { };
+
+      if (target < mCurrent) {
+         target = mCurrent;
+      }
+
+      auto previous = mCurrent;
+      mCurrent = target;
+
+      // Bring overflow items within range of the top level
+      while (!mOverflow.empty() && getLevel(mOverflow.begin()->first) < OverflowLevel) {
+         auto node = mOverflow.begin()->second;
+         mOverflow.erase(mOverflow.begin());
+         link(node);
+      }
+
+      // Visit the slots we have passed from the top level down, so items
+      //  moved down a level are visited by the lower level pass.
+      for (auto level = Levels; level-- > 0; ) {
+         auto shift = SlotBits * level;
+         auto from = previous >> shift;
+         auto to = target >> shift;
+
+         if (to - from >= SlotCount) {
+            from = to - SlotMask;
+         }
+
+         for (auto slotTime = from; slotTime <= to; ++slotTime) {
+            auto slot = static_cast<unsigned>(slotTime & SlotMask);
+
+            if (!(mOccupied[level] & (uint64_t { 1 } << slot))) {
+               continue;
+            }
+
+            // Take the whole slot so relinked items are not visited twice
+            auto node = mSlots[level][slot];
+            mSlots[level][slot] = nullptr;
+            mOccupied[level] &= ~(uint64_t { 1 } << slot);
+
+            while (node) {
+               auto next = node->next;
+
+               if (node->deadline <= now) {
+                  auto item = node->item;
+                  due.emplace_back(node->deadline, item);
+                  mNodes.erase(item);
+               } else {
+                  link(node);
+               }
+
+               node = next;
+            }
+         }
+      }
+
+      std::stable_sort(due.begin(), due.end(),
+                       [](const std::pair<uint64_t, Type *> &lhs, const std::pair<uint64_t, Type *> &rhs) {
+                          return lhs.first < rhs.first;
+                       });
+
+      for (auto &item : due) {
+         expired.push_back(item.second);
+      }
+   }
+
+private:
+   static unsigned countTrailingZeros(uint64_t value)
+   {
+      auto count = 0u;
+
+      while (!(value & 1)) {
+         value >>= 1;
+         ++count;
+      }
+
+      return count;
+   }
+
+   unsigned getLevel(uint64_t deadline) const
+   {
+      auto unit = std::max(deadline >> UnitShift, mCurrent);
+
+      for (auto level = 0u; level < Levels; ++level) {
+         auto shift = SlotBits * level;
+
+         if ((unit >> shift) - (mCurrent >> shift) < SlotCount) {
+            return level;
+         }
+      }
+
+      return OverflowLevel;
+   }
+
+   void link(Node *node)
+   {
+      node->level = getLevel(node->deadline);
+      node->prev = nullptr;
+      node->next = nullptr;
+
+      if (node->level == OverflowLevel) {
+         mOverflow.emplace(node->deadline, node);
+         return;
+      }
+
+      auto unit = std::max(node->deadline >> UnitShift, mCurrent);
+      node->slot = static_cast<unsigned>((unit >> (SlotBits * node->level)) & SlotMask);
+
+      auto &head = mSlots[node->level][node->slot];
+      node->next = head;
+
+      if (head) {
+         head->prev = node;
+      }
+
+      head = node;
+      mOccupied[node->level] |= uint64_t { 1 } << node->slot;
+   }
+
+   void unlink(Node *node)
+   {
+      if (node->level == OverflowLevel) {
+         mOverflow.erase({ node->deadline, node });
+         return;
+      }
+
+      auto &head = mSlots[node->level][node->slot];
+
+      if (node->prev) {
+         node->prev->next = node->next;
+      } else {
+         head = node->next;
+      }
+
+      if (node->next) {
+         node->next->prev = node->prev;
+      }
+
+      if (!head) {
+         mOccupied[node->level] &= ~(uint64_t { 1 } << node->slot);
+      }
+
+      node->prev = nullptr;
+      node->next = nullptr;
+   }
+
+private:
+   //! Current time in units
+   uint64_t mCurrent = 0;
+
+   //! Node storage, unordered_map never moves its elements
+   std::unordered_map<Type *, Node> mNodes;
+
+   std::array<std::array<Node *, SlotCount>, Levels> mSlots = { };
+   std::array<uint64_t, Levels> mOccupied = { };
+   std::set<std::pair<uint64_t, Node *>> mOverflow;
+};
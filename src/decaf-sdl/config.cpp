@@ -106,13 +106,37 @@ struct CerealDebugger
 struct CerealGPU
 {
    template <class Archive>
-   void serialize(Archive &ar)
+   void save(Archive &ar) const
+   {
+      using namespace gpu;
+      using namespace decaf::config::gpu;
+      ar(CEREAL_NVP(debug),
+         CEREAL_NVP(debug_filters),
+         CEREAL_NVP(force_sync),
+         CEREAL_NVP(shader_compile_threads),
+         CEREAL_NVP(strict_shaders),
+         CEREAL_NVP(shader_cache_path),
+         CEREAL_NVP(surface_writeback),
+         cereal::make_nvp("present_mode", presentModeToString(present_mode)));
+   }
+
+   template <class Archive>
+   void load(Archive &ar)
    {
       using namespace gpu;
       using namespace decaf::config::gpu;
+
+      std::string presentModeStr;
       ar(CEREAL_NVP(debug),
          CEREAL_NVP(debug_filters),
-         CEREAL_NVP(force_sync));
+         CEREAL_NVP(force_sync),
+         CEREAL_NVP(shader_compile_threads),
+         CEREAL_NVP(strict_shaders),
+         CEREAL_NVP(shader_cache_path),
+         CEREAL_NVP(surface_writeback),
+         cereal::make_nvp("present_mode", presentModeStr));
+
+      present_mode = presentModeFromString(presentModeStr);
    }
 };
 
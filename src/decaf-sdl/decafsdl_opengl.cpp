@@ -122,6 +122,12 @@ DecafSDLOpenGL::~DecafSDLOpenGL()
       SDL_GL_DeleteContext(mThreadContext);
       mThreadContext = nullptr;
    }
+
+   for (auto context : mCompileContexts) {
+      SDL_GL_DeleteContext(context);
+   }
+
+   mCompileContexts.clear();
 }
 
 void
@@ -356,6 +362,19 @@ DecafSDLOpenGL::initialise(int width, int height)
       return false;
    }
 
+   // Create contexts for compiling shaders in the background, we can run
+   //  without them so failing to create them is not fatal
+   for (auto i = 0u; i < decaf::config::gpu::shader_compile_threads; ++i) {
+      auto context = SDL_GL_CreateContext(mWindow);
+
+      if (!context) {
+         gCliLog->warn("Failed to create shader compile OpenGL context: {}", SDL_GetError());
+         break;
+      }
+
+      mCompileContexts.push_back(context);
+   }
+
    SDL_GL_MakeCurrent(mWindow, mContext);
 
    // Setup decaf driver
@@ -363,6 +382,15 @@ DecafSDLOpenGL::initialise(int width, int height)
    decaf_check(glDriver);
    mDecafDriver = reinterpret_cast<decaf::OpenGLDriver*>(glDriver);
 
+   mDecafDriver->setSharedContexts(static_cast<unsigned>(mCompileContexts.size()), [this](unsigned index) {
+      if (SDL_GL_MakeCurrent(mWindow, mCompileContexts[index]) != 0) {
+         return false;
+      }
+
+      initialiseContext();
+      return true;
+   });
+
    // Setup rendering
    initialiseContext();
    initialiseDraw();
@@ -5,6 +5,7 @@
 #include "libdecaf/decaf_opengl.h"
 #include <SDL.h>
 #include <glbinding/gl/gl.h>
+#include <vector>
 
 class DecafSDLOpenGL : public DecafSDLGraphics
 {
@@ -48,6 +49,7 @@ protected:
 
    SDL_GLContext mContext = nullptr;
    SDL_GLContext mThreadContext = nullptr;
+   std::vector<SDL_GLContext> mCompileContexts;
 
    gl::GLuint mVertexProgram;
    gl::GLuint mPixelProgram;
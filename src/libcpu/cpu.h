@@ -6,6 +6,7 @@
 #include <functional>
 #include <libcpu/mem.h>
 #include <utility>
+#include <vector>
 
 struct Tracer;
 
@@ -25,6 +26,10 @@ const uint32_t NONMASKABLE_INTERRUPTS = SRESET_INTERRUPT;
 const uint32_t SYSTEM_BPFLAG = 1 << 0;
 const uint32_t USER_BPFLAG = 1 << 1;
 
+const uint32_t WATCH_READ = 1 << 0;
+const uint32_t WATCH_WRITE = 1 << 1;
+const uint32_t WATCH_CHANGE = 1 << 2;
+
 const uint32_t InvalidCoreId = 0xFF;
 
 enum class jit_mode {
@@ -72,6 +77,10 @@ setBranchTraceHandler(BranchTraceHandler handler);
 uint32_t
 registerKernelCall(const KernelCallEntry &entry);
 
+void
+updateKernelCall(uint32_t id,
+                 const KernelCallEntry &entry);
+
 void
 start();
 
@@ -92,6 +101,18 @@ allocTracer(size_t size);
 void
 freeTracer(Tracer *tracer);
 
+struct InterruptStats
+{
+   //! Number of times the core returned from sleeping in waitForInterrupt.
+   uint64_t wakeups;
+
+   //! Wakeups which found no unmasked interrupt pending.
+   uint64_t spuriousWakeups;
+};
+
+InterruptStats
+getInterruptStats(int core_idx);
+
 void
 interrupt(int core_idx,
           uint32_t flags);
@@ -107,9 +128,94 @@ bool
 removeBreakpoint(ppcaddr_t address,
                  uint32_t flags);
 
+struct Watchpoint
+{
+   //! Guest address of the watched value
+   ppcaddr_t address;
+
+   //! Size of the watched value, 1, 2, 4 or 8 bytes
+   uint32_t size;
+
+   //! WATCH_ flags which trigger the watchpoint
+   uint32_t flags;
+
+   //! Number of times the watchpoint has triggered
+   uint64_t hits;
+};
+
+struct WatchpointHit
+{
+   //! Address of the watchpoint which triggered
+   ppcaddr_t address;
+
+   //! Guest address of the access which triggered it
+   ppcaddr_t accessAddress;
+
+   //! WATCH_ flags describing the access
+   uint32_t flags;
+
+   //! Core which made the access
+   uint32_t coreId;
+
+   //! NIA of the core when it made the access
+   ppcaddr_t nia;
+
+   //! Big-endian value of the watched bytes before and after the access
+   uint64_t oldValue;
+   uint64_t newValue;
+};
+
+bool
+addWatchpoint(ppcaddr_t address,
+              uint32_t size,
+              uint32_t flags);
+
+bool
+removeWatchpoint(ppcaddr_t address);
+
+std::vector<Watchpoint>
+getWatchpoints();
+
+bool
+getLastWatchpointHit(WatchpointHit &hit);
+
 uint64_t *
 getJitFallbackStats();
 
+struct JitStats
+{
+   //! Number of blocks currently reachable
+   uint64_t liveBlocks;
+
+   //! Host code bytes used by reachable blocks
+   uint64_t liveBytes;
+
+   //! Total number of blocks which have been invalidated
+   uint64_t invalidatedBlocks;
+
+   //! Host code bytes of invalidated blocks waiting to be reclaimed
+   uint64_t pendingBytes;
+
+   //! Total host code bytes reclaimed from invalidated blocks
+   uint64_t reclaimedBytes;
+
+   //! Host code bytes currently available for reuse
+   uint64_t freeBytes;
+
+   //! Guest register loads from Core emitted into generated blocks
+   uint64_t coreLoads;
+
+   //! Guest register stores to Core emitted into generated blocks
+   uint64_t coreStores;
+};
+
+JitStats
+getJitStats();
+
+void
+invalidateInstructionCache(uint32_t address,
+                           uint32_t size);
+
 namespace this_core
 {
 
@@ -80,6 +80,13 @@ coreIllInstEntry()
 static platform::ExceptionResumeFunc
 exceptionHandler(platform::Exception *exception)
 {
+   // Watched pages may be touched by any thread, not just the cores
+   auto watchResult = handleWatchpointException(exception);
+
+   if (watchResult != platform::UnhandledException) {
+      return watchResult;
+   }
+
    // Handle illegal instructions!
    if (exception->type == platform::Exception::InvalidInstruction) {
       return coreIllInstEntry;
@@ -133,18 +140,21 @@ start()
 
    gRunning.store(true);
 
+   for (auto i = 0; i < 3; ++i) {
+      gCore[i].next_alarm = std::chrono::steady_clock::time_point::max();
+   }
+
+   // Start the timer thread before the cores so it is ready for their alarms
+   startTimerThread();
+
    for (auto i = 0; i < 3; ++i) {
       auto &core = gCore[i];
       core.id = i;
       core.thread = std::thread(coreEntryPoint, &core);
-      core.next_alarm = std::chrono::steady_clock::time_point::max();
 
       static const std::string coreNames[] = { "Core #0", "Core #1", "Core #2" };
       platform::setThreadName(&core.thread, coreNames[core.id]);
    }
-
-   gTimerThread = std::thread(timerEntryPoint);
-   platform::setThreadName(&gTimerThread, "Timer Thread");
 }
 
 void
@@ -159,13 +169,8 @@ join()
    // Mark the CPU as no longer running
    gRunning.store(false);
 
-   // Notify the timer thread that something changed
-   gTimerCondition.notify_all();
-
    // Wait for the timer thread to shut down
-   if (gTimerThread.joinable()) {
-      gTimerThread.join();
-   }
+   stopTimerThread();
 }
 
 void
@@ -200,6 +205,13 @@ setBranchTraceHandler(BranchTraceHandler handler)
    gBranchTraceHandler = handler;
 }
 
+void
+invalidateInstructionCache(uint32_t address,
+                           uint32_t size)
+{
+   jit::invalidate(address, size);
+}
+
 std::chrono::steady_clock::time_point
 tbToTimePoint(uint64_t ticks)
 {
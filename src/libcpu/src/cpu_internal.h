@@ -1,4 +1,5 @@
 #pragma once
+#include <common/platform_exception.h>
 #include "cpu.h"
 #include "mem.h"
 
@@ -25,22 +26,25 @@ gBranchTraceHandler;
 extern jit_mode
 gJitMode;
 
-extern std::condition_variable
-gTimerCondition;
-
-extern std::thread
-gTimerThread;
-
 bool
 hasBreakpoints();
 
 bool
 popBreakpoint(ppcaddr_t address);
 
+platform::ExceptionResumeFunc
+handleWatchpointException(platform::Exception *exception);
+
+bool
+popWatchpointHit();
+
+void
+startTimerThread();
+
 void
-timerEntryPoint();
+stopTimerThread();
 
-KernelCallEntry *
+const KernelCallEntry *
 getKernelCall(uint32_t id);
 
 namespace this_core
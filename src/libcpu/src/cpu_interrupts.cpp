@@ -1,8 +1,19 @@
 #include "cpu.h"
 #include "cpu_internal.h"
+#include "jit/jit.h"
 #include <common/decaf_assert.h>
-#include <condition_variable>
+#include <common/platform.h>
+#include <common/platform_futex.h>
+#include <common/platform_thread.h>
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+
+#ifdef PLATFORM_LINUX
+#include <cerrno>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
 
 namespace cpu
 {
@@ -10,20 +21,24 @@ namespace cpu
 InterruptHandler
 gInterruptHandler;
 
-std::mutex
-gInterruptMutex;
+static std::mutex
+sTimerMutex;
 
-std::condition_variable
-gInterruptCondition;
+static std::thread
+sTimerThread;
 
-std::mutex
-gTimerMutex;
+#ifdef PLATFORM_LINUX
+//! CLOCK_MONOTONIC timerfd armed for the earliest alarm of any core
+static int
+sTimerFd = -1;
 
-std::condition_variable
-gTimerCondition;
-
-std::thread
-gTimerThread;
+//! The time sTimerFd is currently armed for
+static std::chrono::steady_clock::time_point
+sTimerArmedTime = std::chrono::steady_clock::time_point::max();
+#else
+static std::condition_variable
+sTimerCondition;
+#endif
 
 void
 setInterruptHandler(InterruptHandler handler)
@@ -31,43 +46,174 @@ setInterruptHandler(InterruptHandler handler)
    gInterruptHandler = handler;
 }
 
+/**
+ * Raise an interrupt on a core.
+ *
+ * Each core sleeps on a futex on its own interrupt word, so we only wake the
+ * core we are interrupting, and only make a syscall when it is asleep.
+ */
 void
 interrupt(int core_idx, uint32_t flags)
 {
-   std::unique_lock<std::mutex> lock { gInterruptMutex };
-   gCore[core_idx].interrupt.fetch_or(flags);
-   gInterruptCondition.notify_all();
+   auto core = &gCore[core_idx];
+   core->interrupt.fetch_or(flags);
+
+   if (core->sleeping.load()) {
+      platform::futexWakeOne(&core->interrupt);
+   }
+}
+
+InterruptStats
+getInterruptStats(int core_idx)
+{
+   auto stats = InterruptStats { };
+   stats.wakeups = gCore[core_idx].wakeups.load(std::memory_order_relaxed);
+   stats.spuriousWakeups = gCore[core_idx].spurious_wakeups.load(std::memory_order_relaxed);
+   return stats;
 }
 
-void
+/**
+ * Raise ALARM_INTERRUPT on every core whose alarm has passed.
+ *
+ * \return
+ * Returns the earliest alarm which has not yet passed.
+ */
+static std::chrono::steady_clock::time_point
+checkAlarmsNoLock()
+{
+   auto now = std::chrono::steady_clock::now();
+   auto next = std::chrono::steady_clock::time_point::max();
+
+   for (auto i = 0; i < 3; ++i) {
+      auto core = &gCore[i];
+
+      if (core->next_alarm <= now) {
+         core->next_alarm = std::chrono::steady_clock::time_point::max();
+         cpu::interrupt(i, ALARM_INTERRUPT);
+      } else if (core->next_alarm < next) {
+         next = core->next_alarm;
+      }
+   }
+
+   return next;
+}
+
+#ifdef PLATFORM_LINUX
+
+/**
+ * Arm the timerfd for an absolute time, time_point::max() disarms it.
+ *
+ * std::chrono::steady_clock is CLOCK_MONOTONIC on Linux, so we can pass
+ * its time since epoch straight to the kernel.
+ */
+static void
+armTimerNoLock(std::chrono::steady_clock::time_point time)
+{
+   struct itimerspec spec = { };
+
+   if (time == sTimerArmedTime) {
+      return;
+   }
+
+   if (time != std::chrono::steady_clock::time_point::max()) {
+      auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+
+      // A zero it_value disarms the timer, anything in the past fires immediately
+      nanos = std::max<int64_t>(nanos, 1);
+      spec.it_value.tv_sec = static_cast<time_t>(nanos / 1000000000);
+      spec.it_value.tv_nsec = static_cast<long>(nanos % 1000000000);
+   }
+
+   timerfd_settime(sTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+   sTimerArmedTime = time;
+}
+
+static void
 timerEntryPoint()
 {
    while (gRunning.load()) {
-      std::unique_lock<std::mutex> lock{ gTimerMutex };
-      auto now = std::chrono::steady_clock::now();
-      auto next = std::chrono::steady_clock::time_point::max();
-      bool timedWait = false;
-
-      for (auto i = 0; i < 3; ++i) {
-         auto core = &gCore[i];
-
-         if (core->next_alarm <= now) {
-            core->next_alarm = std::chrono::steady_clock::time_point::max();
-            cpu::interrupt(i, ALARM_INTERRUPT);
-         } else if (core->next_alarm < next) {
-            next = core->next_alarm;
-            timedWait = true;
+      uint64_t expirations = 0;
+
+      if (read(sTimerFd, &expirations, sizeof(expirations)) < 0) {
+         if (errno == EINTR) {
+            continue;
          }
+
+         decaf_abort("Failed to read from timer fd");
       }
 
-      if (timedWait) {
-         gTimerCondition.wait_until(lock, next);
+      std::unique_lock<std::mutex> lock { sTimerMutex };
+      sTimerArmedTime = std::chrono::steady_clock::time_point::max();
+      armTimerNoLock(checkAlarmsNoLock());
+   }
+}
+
+void
+startTimerThread()
+{
+   sTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+   decaf_check(sTimerFd >= 0);
+   sTimerArmedTime = std::chrono::steady_clock::time_point::max();
+
+   sTimerThread = std::thread(timerEntryPoint);
+   platform::setThreadName(&sTimerThread, "Timer Thread");
+}
+
+void
+stopTimerThread()
+{
+   {
+      // Fire the timer now so the timer thread sees gRunning is false
+      std::unique_lock<std::mutex> lock { sTimerMutex };
+      armTimerNoLock(std::chrono::steady_clock::time_point { });
+   }
+
+   if (sTimerThread.joinable()) {
+      sTimerThread.join();
+   }
+
+   close(sTimerFd);
+   sTimerFd = -1;
+}
+
+#else
+
+static void
+timerEntryPoint()
+{
+   while (gRunning.load()) {
+      std::unique_lock<std::mutex> lock { sTimerMutex };
+      auto next = checkAlarmsNoLock();
+
+      if (next != std::chrono::steady_clock::time_point::max()) {
+         sTimerCondition.wait_until(lock, next);
       } else {
-         gTimerCondition.wait(lock);
+         sTimerCondition.wait(lock);
       }
    }
 }
 
+void
+startTimerThread()
+{
+   sTimerThread = std::thread(timerEntryPoint);
+   platform::setThreadName(&sTimerThread, "Timer Thread");
+}
+
+void
+stopTimerThread()
+{
+   // Notify the timer thread that something changed
+   sTimerCondition.notify_all();
+
+   // Wait for the timer thread to shut down
+   if (sTimerThread.joinable()) {
+      sTimerThread.join();
+   }
+}
+
+#endif
+
 namespace this_core
 {
 
@@ -104,6 +250,12 @@ checkInterrupts()
       flags |= DBGBREAK_INTERRUPT;
    }
 
+   // Watchpoint hits are recorded from a signal handler, which leaves
+   //  raising the interrupt to us
+   if (popWatchpointHit()) {
+      flags |= DBGBREAK_INTERRUPT;
+   }
+
    if (flags & mask) {
       cpu::gInterruptHandler(flags);
    }
@@ -113,7 +265,7 @@ void
 waitForInterrupt()
 {
    auto core = this_core::state();
-   std::unique_lock<std::mutex> lock { gInterruptMutex };
+   auto woken = false;
 
    while (true) {
       if (!(core->interrupt_mask & ~NONMASKABLE_INTERRUPTS)) {
@@ -124,12 +276,32 @@ waitForInterrupt()
       auto flags = core->interrupt.fetch_and(~mask);
 
       if (flags & mask) {
-         lock.unlock();
+         woken = false;
          gInterruptHandler(flags);
-         lock.lock();
-      } else {
-         gInterruptCondition.wait(lock);
+         continue;
+      }
+
+      if (woken) {
+         // We were woken up but there was nothing for us to handle
+         core->spurious_wakeups.fetch_add(1, std::memory_order_relaxed);
       }
+
+      // Let the JIT know this core is not executing any code
+      jit::markCoreIdle();
+
+      // interrupt() sets the interrupt word before it checks sleeping, and we
+      //  set sleeping before we check the interrupt word, so at least one of
+      //  us will see the other and we can never miss a wakeup.
+      core->sleeping.store(1);
+      auto value = core->interrupt.load();
+
+      if (!(value & mask)) {
+         platform::futexWait(&core->interrupt, value);
+         core->wakeups.fetch_add(1, std::memory_order_relaxed);
+         woken = true;
+      }
+
+      core->sleeping.store(0);
    }
 }
 
@@ -137,9 +309,21 @@ void
 setNextAlarm(std::chrono::steady_clock::time_point time)
 {
    auto core = this_core::state();
-   std::unique_lock<std::mutex> lock { gTimerMutex };
+   std::unique_lock<std::mutex> lock { sTimerMutex };
    core->next_alarm = time;
-   gTimerCondition.notify_all();
+
+#ifdef PLATFORM_LINUX
+   // Only touch the timerfd if this alarm is now the earliest one
+   auto next = std::chrono::steady_clock::time_point::max();
+
+   for (auto i = 0; i < 3; ++i) {
+      next = std::min(next, gCore[i].next_alarm);
+   }
+
+   armTimerNoLock(next);
+#else
+   sTimerCondition.notify_all();
+#endif
 }
 
 } // namespace this_core
@@ -1,27 +1,53 @@
 #include "cpu.h"
-#include <vector>
+#include "cpu_internal.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
 
 namespace cpu
 {
 
-static std::vector<KernelCallEntry>
+// The debugger can relink kernel calls while the cores are running, so each
+//  call is published as a pointer to an entry which is never modified or
+//  freed once another thread may have seen it.  Both are deques so growing
+//  them never moves an existing element.
+static std::mutex
+sKernelCallMutex;
+
+static std::deque<KernelCallEntry>
+sKernelCallEntries;
+
+static std::deque<std::atomic<const KernelCallEntry *>>
 sKernelCalls;
 
 uint32_t
 registerKernelCall(const KernelCallEntry &entry)
 {
-   sKernelCalls.push_back(entry);
+   std::unique_lock<std::mutex> lock { sKernelCallMutex };
+   sKernelCallEntries.push_back(entry);
+   sKernelCalls.emplace_back(&sKernelCallEntries.back());
    return static_cast<uint32_t>(sKernelCalls.size() - 1);
 }
 
-KernelCallEntry *
+void
+updateKernelCall(uint32_t id,
+                 const KernelCallEntry &entry)
+{
+   // Code which was already generated for this kernel call must be
+   //  invalidated by the caller for the change to take effect.
+   std::unique_lock<std::mutex> lock { sKernelCallMutex };
+   sKernelCallEntries.push_back(entry);
+   sKernelCalls[id].store(&sKernelCallEntries.back(), std::memory_order_release);
+}
+
+const KernelCallEntry *
 getKernelCall(uint32_t id)
 {
    if (id >= sKernelCalls.size()) {
       return nullptr;
    }
 
-   return &sKernelCalls[id];
+   return sKernelCalls[id].load(std::memory_order_acquire);
 }
 
 } // namespace cpu
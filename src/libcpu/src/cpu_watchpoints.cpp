@@ -0,0 +1,440 @@
+#include <common/adaptivelock.h>
+#include <common/platform_exception.h>
+#include <common/platform_memory.h>
+#include "cpu.h"
+#include "cpu_internal.h"
+#include "mem.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <map>
+#include <vector>
+
+namespace cpu
+{
+
+/*
+Memory watchpoints.
+
+Every host page of the guest mapping which contains a watchpoint is
+protected, NoAccess if a read watchpoint is on it and ReadOnly otherwise.
+An access to one of those pages faults into handleWatchpointException, which
+checks the access against the watchpoints, unprotects the page and resumes
+the faulting instruction with the trap flag set.  Once that one instruction
+has executed we get a SingleStep exception, where value changed watchpoints
+are compared and the page is protected again.  JIT code which does not touch
+a watched page runs exactly as fast as before.
+
+Accesses are matched by the address which faulted, which is the first byte
+the host instruction touched on the page.  While a page is unprotected for
+a step other threads can access it without faulting, so an access which
+races with another access to the same page may be missed.
+
+Only accesses from the CPU cores are reported, the debugger UI, GPU and
+other host threads are silently stepped over.
+
+The exception handlers run inside signal handlers on POSIX, so they never
+take a mutex, allocate or wake another thread.  The watchpoint state is
+guarded by a spin lock which is only ever held for a few protection changes,
+step state is a fixed size per thread, and a hit only sets a flag for its
+core, which raises DBGBREAK_INTERRUPT from its next checkInterrupts.
+
+Known limitations: the host kernel does not fault when a system call touches
+a protected page, it fails the call with EFAULT instead.  HostPreadFileHandle
+retries those reads and writes through a host buffer so the copy faults as
+usual, any other host system call which reads or writes guest memory on a
+watched page will fail and the access is not reported.
+*/
+
+static const uint32_t
+WatchPageSize = 0x1000;
+
+// One host instruction may fault on at most this many pages in a step
+static const size_t
+MaxSteppingPages = 4;
+
+// Most watchpoints which can be set at once
+static const size_t
+MaxWatchpoints = 64;
+
+struct WatchPage
+{
+   platform::ProtectFlags protection = platform::ProtectFlags::ReadWrite;
+
+   //! Number of threads stepping an instruction on this page
+   uint32_t stepping = 0;
+};
+
+struct PendingHit
+{
+   Watchpoint watch;
+   WatchpointHit hit;
+};
+
+// Accesses seen on this thread while its current instruction is stepped.
+//  Each watchpoint is on a single page and each page faults at most once per
+//  step, so one step can never record more hits than there are watchpoints.
+struct StepState
+{
+   std::array<uint32_t, MaxSteppingPages> pages;
+   size_t numPages;
+   std::array<PendingHit, MaxWatchpoints> hits;
+   size_t numHits;
+};
+
+// Spin lock guarding everything below, safe to take from a signal handler
+//  as long as the thread holding it never faults on a watched page.
+static std::atomic<bool>
+sWatchLock { false };
+
+static std::array<Watchpoint, MaxWatchpoints>
+sWatchpoints;
+
+static std::atomic<size_t>
+sNumWatchpoints { 0 };
+
+// Only modified by the debugger API, the exception handlers only look up
+//  and update existing entries so they never allocate.
+static std::map<uint32_t, WatchPage>
+sWatchPages;
+
+static bool
+sHasLastHit = false;
+
+static WatchpointHit
+sLastHit;
+
+//! Set when a core has hit a watchpoint and should break into the debugger
+static std::atomic<bool>
+sPendingBreak[3];
+
+static thread_local StepState
+tStepState;
+
+struct WatchLock
+{
+   WatchLock()
+   {
+      while (sWatchLock.exchange(true, std::memory_order_acquire)) {
+         adaptive_lock::pause();
+      }
+   }
+
+   ~WatchLock()
+   {
+      sWatchLock.store(false, std::memory_order_release);
+   }
+};
+
+static uint64_t
+readValue(ppcaddr_t address,
+          uint32_t size)
+{
+   auto bytes = reinterpret_cast<const uint8_t *>(mem::base() + address);
+   auto value = uint64_t { 0 };
+
+   for (auto i = 0u; i < size; ++i) {
+      value = (value << 8) | bytes[i];
+   }
+
+   return value;
+}
+
+static bool
+protectPage(uint32_t page,
+            platform::ProtectFlags flags)
+{
+   return platform::protectMemory(mem::base() + page * WatchPageSize, WatchPageSize, flags);
+}
+
+// Note: sWatchLock must be held
+static bool
+updatePage(uint32_t page)
+{
+   auto protection = platform::ProtectFlags::ReadWrite;
+   auto watched = false;
+
+   for (auto i = 0u; i < sNumWatchpoints.load(); ++i) {
+      auto &watch = sWatchpoints[i];
+
+      if (watch.address / WatchPageSize == page) {
+         watched = true;
+
+         if (watch.flags & WATCH_READ) {
+            protection = platform::ProtectFlags::NoAccess;
+         } else if (protection == platform::ProtectFlags::ReadWrite) {
+            protection = platform::ProtectFlags::ReadOnly;
+         }
+      }
+   }
+
+   auto itr = sWatchPages.find(page);
+   auto stepping = itr != sWatchPages.end() && itr->second.stepping;
+
+   if (!watched) {
+      if (itr != sWatchPages.end()) {
+         sWatchPages.erase(itr);
+      }
+
+      // A stepping thread leaves the page unprotected when it is done
+      return stepping || protectPage(page, protection);
+   }
+
+   auto &watchPage = sWatchPages[page];
+   watchPage.protection = protection;
+   return stepping || protectPage(page, protection);
+}
+
+// Note: sWatchLock must be held
+static void
+reportHit(const PendingHit &pending)
+{
+   for (auto i = 0u; i < sNumWatchpoints.load(); ++i) {
+      if (sWatchpoints[i].address == pending.watch.address) {
+         sWatchpoints[i].hits++;
+      }
+   }
+
+   sLastHit = pending.hit;
+   sHasLastHit = true;
+
+   // Hits are only recorded for the core which made the access, which will
+   //  see this the next time it checks for interrupts.
+   sPendingBreak[pending.hit.coreId].store(true, std::memory_order_release);
+}
+
+static platform::ExceptionResumeFunc
+handleAccess(platform::AccessViolationException *info)
+{
+   auto memBase = mem::base();
+   auto &step = tStepState;
+
+   if (!sNumWatchpoints.load() || info->address < memBase || info->address >= memBase + 0x100000000) {
+      return platform::UnhandledException;
+   }
+
+   auto address = static_cast<uint32_t>(info->address - memBase);
+   auto page = address / WatchPageSize;
+   WatchLock lock;
+   auto itr = sWatchPages.find(page);
+
+   if (itr == sWatchPages.end() || step.numPages >= MaxSteppingPages) {
+      return platform::UnhandledException;
+   }
+
+   if (itr->second.stepping++ == 0) {
+      protectPage(page, platform::ProtectFlags::ReadWrite);
+   }
+
+   step.pages[step.numPages++] = page;
+
+   // Only report accesses made by guest code or HLE code on the cores
+   auto coreId = this_core::id();
+
+   if (coreId >= 3) {
+      return platform::HandledExceptionSingleStep;
+   }
+
+   for (auto i = 0u; i < sNumWatchpoints.load(); ++i) {
+      auto &watch = sWatchpoints[i];
+
+      if (watch.address / WatchPageSize != page || step.numHits >= MaxWatchpoints) {
+         continue;
+      }
+
+      auto access = address >= watch.address && address < watch.address + watch.size;
+      auto flags = 0u;
+
+      if (access && info->write && (watch.flags & WATCH_WRITE)) {
+         flags |= WATCH_WRITE;
+      } else if (access && !info->write && (watch.flags & WATCH_READ)) {
+         flags |= WATCH_READ;
+      }
+
+      // Any write to the page may change the value, a wider access which
+      //  starts before the watchpoint would not match the address above.
+      if (info->write && (watch.flags & WATCH_CHANGE)) {
+         flags |= WATCH_CHANGE;
+      }
+
+      if (flags) {
+         auto &pending = step.hits[step.numHits++];
+         pending.watch = watch;
+         pending.hit.address = watch.address;
+         pending.hit.accessAddress = address;
+         pending.hit.flags = flags;
+         pending.hit.coreId = coreId;
+         pending.hit.nia = this_core::state()->nia;
+         pending.hit.oldValue = readValue(watch.address, watch.size);
+         pending.hit.newValue = 0;
+      }
+   }
+
+   return platform::HandledExceptionSingleStep;
+}
+
+static platform::ExceptionResumeFunc
+handleStep()
+{
+   auto &step = tStepState;
+
+   if (!step.numPages) {
+      return platform::UnhandledException;
+   }
+
+   WatchLock lock;
+
+   // The pages are still unprotected, so read the new values before
+   //  protecting them again.
+   for (auto i = 0u; i < step.numHits; ++i) {
+      auto &pending = step.hits[i];
+      pending.hit.newValue = readValue(pending.watch.address, pending.watch.size);
+
+      if (pending.hit.flags == WATCH_CHANGE && pending.hit.newValue == pending.hit.oldValue) {
+         continue;
+      }
+
+      if (pending.hit.newValue == pending.hit.oldValue) {
+         pending.hit.flags &= ~WATCH_CHANGE;
+      }
+
+      reportHit(pending);
+   }
+
+   for (auto i = 0u; i < step.numPages; ++i) {
+      auto page = step.pages[i];
+      auto itr = sWatchPages.find(page);
+
+      // The page may have been unwatched and watched again while we were
+      //  stepping, in which case it is already protected.
+      if (itr != sWatchPages.end() && itr->second.stepping && --itr->second.stepping == 0) {
+         protectPage(page, itr->second.protection);
+      }
+   }
+
+   step.numPages = 0;
+   step.numHits = 0;
+   return platform::HandledException;
+}
+
+bool
+popWatchpointHit()
+{
+   auto &pending = sPendingBreak[this_core::id()];
+
+   if (!pending.load(std::memory_order_relaxed)) {
+      return false;
+   }
+
+   return pending.exchange(false, std::memory_order_acquire);
+}
+
+platform::ExceptionResumeFunc
+handleWatchpointException(platform::Exception *exception)
+{
+   if (exception->type == platform::Exception::AccessViolation) {
+      return handleAccess(reinterpret_cast<platform::AccessViolationException *>(exception));
+   } else if (exception->type == platform::Exception::SingleStep) {
+      return handleStep();
+   }
+
+   return platform::UnhandledException;
+}
+
+// Note: sWatchLock must be held
+static bool
+eraseWatchpoint(ppcaddr_t address)
+{
+   auto begin = sWatchpoints.begin();
+   auto end = begin + sNumWatchpoints.load();
+   auto itr = std::find_if(begin, end, [&](auto &watch) { return watch.address == address; });
+
+   if (itr == end) {
+      return false;
+   }
+
+   std::move(itr + 1, end, itr);
+   sNumWatchpoints.store(sNumWatchpoints.load() - 1);
+   return true;
+}
+
+bool
+addWatchpoint(ppcaddr_t address,
+              uint32_t size,
+              uint32_t flags)
+{
+   if (size != 1 && size != 2 && size != 4 && size != 8) {
+      return false;
+   }
+
+   // Natural alignment keeps every watchpoint within one page
+   if ((address & (size - 1)) || !(flags & (WATCH_READ | WATCH_WRITE | WATCH_CHANGE))) {
+      return false;
+   }
+
+   if (!mem::valid(address)) {
+      return false;
+   }
+
+   WatchLock lock;
+   auto numWatchpoints = sNumWatchpoints.load();
+   auto begin = sWatchpoints.begin();
+   auto end = begin + numWatchpoints;
+   auto itr = std::find_if(begin, end, [&](auto &watch) { return watch.address == address; });
+
+   if (itr == end) {
+      if (numWatchpoints == MaxWatchpoints) {
+         return false;
+      }
+
+      itr->address = address;
+      itr->hits = 0;
+      sNumWatchpoints.store(numWatchpoints + 1);
+   }
+
+   itr->size = size;
+   itr->flags = flags;
+
+   if (!updatePage(address / WatchPageSize)) {
+      eraseWatchpoint(address);
+      updatePage(address / WatchPageSize);
+      return false;
+   }
+
+   return true;
+}
+
+bool
+removeWatchpoint(ppcaddr_t address)
+{
+   WatchLock lock;
+
+   if (!eraseWatchpoint(address)) {
+      return false;
+   }
+
+   updatePage(address / WatchPageSize);
+   return true;
+}
+
+std::vector<Watchpoint>
+getWatchpoints()
+{
+   std::vector<Watchpoint> watchpoints;
+   watchpoints.reserve(MaxWatchpoints);
+
+   WatchLock lock;
+   watchpoints.assign(sWatchpoints.begin(), sWatchpoints.begin() + sNumWatchpoints.load());
+   return watchpoints;
+}
+
+bool
+getLastWatchpointHit(WatchpointHit &hit)
+{
+   WatchLock lock;
+   hit = sLastHit;
+   return sHasLastHit;
+}
+
+} // namespace cpu
@@ -15,8 +15,11 @@
 #include <common/decaf_assert.h>
 #include <common/fastregionmap.h>
 #include <common/log.h>
+#include <atomic>
 #include <cfenv>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace cpu
@@ -28,6 +31,8 @@ namespace jit
 static const bool JIT_DEBUG = true;
 static const int JIT_MAX_INST = 3000;
 static const bool JIT_REGCACHE = true;
+static const bool JIT_DEAD_FLAGS = true;
+static const bool JIT_REGISTER_USES = true;
 
 // Insert NOPs at the beginning of a generated block of code.
 //  The Visual Studio disassembler can get confused without these.
@@ -56,6 +61,84 @@ sPreInstr;
 static void *
 sPostInstr;
 
+struct JitBlockInfo
+{
+   uint32_t start;
+   uint32_t end;
+   JitCode code;
+   size_t codeSize;
+
+   // Guest addresses which were registered in sJitBlocks for this block
+   std::vector<uint32_t> entries;
+
+   // Jump slots in this block which have been linked to another block
+   std::vector<std::pair<JitCode *, JitBlockInfo *>> linksOut;
+
+   // Jump slots in other blocks which have been linked to this block
+   std::vector<std::pair<JitCode *, JitBlockInfo *>> linksIn;
+};
+
+// Per-core state used to decide when retired blocks may be freed.  A core
+//  records the global epoch each time it enters the dispatcher, at that
+//  point it can no longer be executing inside any block it had previously
+//  found.  Calls out of JIT code which might switch fibers pin the epoch
+//  so the block is kept alive until the call returns into it.
+struct alignas(64) CoreEpochState
+{
+   std::atomic<uint64_t> epoch;
+   std::atomic<bool> active;
+};
+
+static const uint32_t JIT_PAGE_SHIFT = 12;
+
+static std::mutex
+sJitMutex;
+
+static std::map<uintptr_t, JitBlockInfo *>
+sHostBlocks;
+
+static std::unordered_map<uint32_t, std::vector<JitBlockInfo *>>
+sPageBlocks;
+
+static std::atomic<uint64_t>
+sInvalidateCounter { 0 };
+
+static std::atomic<uint64_t>
+sGlobalEpoch { 0 };
+
+static CoreEpochState
+sCoreEpochState[3];
+
+// Outstanding pins for each epoch slot.  These are shared by all cores
+//  rather than kept per core, as a fiber may be pinned on one core and
+//  unpinned after resuming on another.
+static std::atomic<int64_t>
+sEpochPins[3];
+
+static std::array<std::vector<JitBlockInfo *>, 3>
+sRetiredBlocks;
+
+static std::atomic<uint64_t>
+sLiveBlocks { 0 };
+
+static std::atomic<uint64_t>
+sLiveBytes { 0 };
+
+static std::atomic<uint64_t>
+sRetiredBytes { 0 };
+
+static std::atomic<uint64_t>
+sReclaimedBytes { 0 };
+
+static std::atomic<uint64_t>
+sInvalidatedBlocks { 0 };
+
+static std::atomic<uint64_t>
+sCoreLoads { 0 };
+
+static std::atomic<uint64_t>
+sCoreStores { 0 };
+
 JitCall
 gCallFn;
 
@@ -118,12 +201,29 @@ initStubs()
    a.sub(asmjit::x86::rsp, stackSpace);
    a.mov(a.stateReg, a.sysArgReg[0]);
    a.mov(a.membaseReg, static_cast<uint64_t>(mem::base()));
+
+   // Chained guest registers live in their host register inside JIT code
+   for (auto &reg : a.mRegs) {
+      if (reg.pinned) {
+         a.loadOne(&reg);
+      }
+   }
+
    a.jmp(a.sysArgReg[1]);
 
    // This is the piece of code executed when we are finished
    //  executing the block of code started above.
    a.bind(extroLabel);
 
+   // Put the chained registers back in Core before any C++ code runs, they
+   //  are callee-saved so still hold the same values if we continue into
+   //  another block.
+   for (auto &reg : a.mRegs) {
+      if (reg.pinned) {
+         a.storeOne(&reg);
+      }
+   }
+
    a.cmp(a.finaleNiaArgReg, CALLBACK_ADDR);
    a.je(exitLabel);
 
@@ -317,42 +417,318 @@ clearCache()
    // Note: This must not be called unless there is guarenteed to be
    //  nobody currently executing code!
 
+   std::unique_lock<std::mutex> lock(sJitMutex);
+
+   for (auto &block : sHostBlocks) {
+      delete block.second;
+   }
+
+   for (auto &retired : sRetiredBlocks) {
+      for (auto block : retired) {
+         delete block;
+      }
+
+      retired.clear();
+   }
+
+   sHostBlocks.clear();
+   sPageBlocks.clear();
+   sLiveBlocks.store(0);
+   sLiveBytes.store(0);
+   sRetiredBytes.store(0);
+   sInvalidateCounter.fetch_add(1);
+
    freeRuntime();
    initialiseRuntime();
 
    sJitBlocks.clear();
 }
 
-using JumpTargetList = std::vector<uint32_t>;
+uint64_t
+pinEpoch()
+{
+   auto &state = sCoreEpochState[this_core::id()];
+   auto epoch = state.epoch.load();
+   sEpochPins[epoch % 3].fetch_add(1);
+   return epoch;
+}
 
 void
-jit_b_direct(PPCEmuAssembler& a, ppcaddr_t addr)
+unpinEpoch(uint64_t epoch)
 {
-   a.saveAll();
+   // We may have returned on a different core, or this core may have been
+   //  idle or run newer code in the meantime, so make sure this core is
+   //  considered to be no newer than the pinned epoch before we drop the pin.
+   auto &state = sCoreEpochState[this_core::id()];
+
+   if (!state.active.load() || state.epoch.load() > epoch) {
+      state.epoch.store(epoch);
+      state.active.store(true);
+   }
 
-   auto target = sJitBlocks.find(addr);
-   if (target) {
-      // We already know where this function is, let's just jump
-      //  directly to it rather than wasting time going through
-      //  the JIT dispatcher!
-      a.jmp(asmjit::Ptr(target));
-   } else {
-      // We have not JIT'd this section yet.  Let's allocate some
-      //  space for an aligned MOV instruction, then mark it as a
-      //  relocation so it can be filled by the 'linker' below.
-      auto relocLbl = a.newLabel();
-      a.bind(relocLbl);
+   sEpochPins[epoch % 3].fetch_sub(1);
+}
+
+static void
+markCoreQuiescent()
+{
+   auto &state = sCoreEpochState[this_core::id()];
+   state.epoch.store(sGlobalEpoch.load());
+   state.active.store(true);
+}
+
+void
+markCoreIdle()
+{
+   auto id = this_core::id();
+
+   if (id < 3) {
+      sCoreEpochState[id].active.store(false);
+   }
+}
+
+// Note: sJitMutex must be held
+static bool
+tryAdvanceEpoch()
+{
+   auto epoch = sGlobalEpoch.load();
+
+   for (auto &state : sCoreEpochState) {
+      if (state.active.load() && state.epoch.load() != epoch) {
+         return false;
+      }
+   }
+
+   if (sEpochPins[(epoch + 2) % 3].load() != 0) {
+      return false;
+   }
+
+   sGlobalEpoch.store(epoch + 1);
+
+   // Blocks retired three epochs ago can no longer be reached by anyone
+   auto &retired = sRetiredBlocks[(epoch + 1) % 3];
+
+   for (auto block : retired) {
+      sRuntime->free(block->code, block->codeSize);
+      sRetiredBytes.fetch_sub(block->codeSize);
+      sReclaimedBytes.fetch_add(block->codeSize);
+      delete block;
+   }
+
+   retired.clear();
+   return true;
+}
+
+// Note: sJitMutex must be held
+static void
+reclaimRetiredBlocks()
+{
+   for (auto i = 0; i < 3 && sRetiredBytes.load(); ++i) {
+      if (!tryAdvanceEpoch()) {
+         break;
+      }
+   }
+}
+
+// Note: sJitMutex must be held
+static JitBlockInfo *
+findBlockByHostAddress(const void *ptr)
+{
+   auto addr = reinterpret_cast<uintptr_t>(ptr);
+   auto itr = sHostBlocks.upper_bound(addr);
+
+   if (itr == sHostBlocks.begin()) {
+      return nullptr;
+   }
+
+   --itr;
+
+   if (addr >= itr->first + itr->second->codeSize) {
+      return nullptr;
+   }
+
+   return itr->second;
+}
+
+// Note: sJitMutex must be held
+static void
+linkBlock(JitBlockInfo *source, JitCode *slot, JitBlockInfo *target, JitCode targetCode)
+{
+   // Aligned writes on x64 are guarenteed to be atomic
+   *slot = targetCode;
+   source->linksOut.emplace_back(slot, target);
+   target->linksIn.emplace_back(slot, source);
+}
+
+static void
+eraseLink(std::vector<std::pair<JitCode *, JitBlockInfo *>> &links,
+          JitCode *slot)
+{
+   links.erase(std::remove_if(links.begin(), links.end(),
+                              [slot](const std::pair<JitCode *, JitBlockInfo *> &link) {
+                                 return link.first == slot;
+                              }),
+               links.end());
+}
+
+// Note: sJitMutex must be held
+static void
+registerBlock(const JitBlock &block)
+{
+   auto info = new JitBlockInfo {};
+   info->start = block.start;
+   info->end = block.end;
+   info->code = block.code;
+   info->codeSize = block.codeSize;
 
-      // Save 32 bytes of memory so we have room to do set up the
-      //  call during relocation once we know where its going to
-      //  reside in the host jit memory section.
-      for (auto i = 0; i < 32; ++i) {
-         a.int3();
+   sJitBlocks.set(block.start, block.entry);
+   info->entries.push_back(block.start);
+
+   for (auto i = block.targets.cbegin(); i != block.targets.cend(); ++i) {
+      if (i->second) {
+         sJitBlocks.set(i->first, i->second);
+         info->entries.push_back(i->first);
+      }
+   }
+
+   sHostBlocks.emplace(reinterpret_cast<uintptr_t>(block.code), info);
+
+   for (auto page = block.start >> JIT_PAGE_SHIFT; page <= (block.end - 1) >> JIT_PAGE_SHIFT; ++page) {
+      sPageBlocks[page].push_back(info);
+   }
+
+   // Link any branches to blocks we already know about
+   for (auto &reloc : block.relocs) {
+      auto targetCode = sJitBlocks.find(reloc.first);
+
+      if (targetCode) {
+         auto target = findBlockByHostAddress(targetCode);
+
+         if (target) {
+            linkBlock(info, reloc.second, target, targetCode);
+         }
+      }
+   }
+
+   sLiveBlocks.fetch_add(1);
+   sLiveBytes.fetch_add(block.codeSize);
+}
+
+// Note: sJitMutex must be held
+static void
+retireBlock(JitBlockInfo *block)
+{
+   auto code = reinterpret_cast<uintptr_t>(block->code);
+
+   // Remove our entry points, unless they have since been taken by another block
+   for (auto addr : block->entries) {
+      auto entry = reinterpret_cast<uintptr_t>(sJitBlocks.find(addr));
+
+      if (entry >= code && entry < code + block->codeSize) {
+         sJitBlocks.set(addr, nullptr);
+      }
+   }
+
+   // Send anyone who was jumping directly to us back to the dispatcher
+   for (auto &link : block->linksIn) {
+      *link.first = reinterpret_cast<JitCode>(gFinaleFn);
+
+      if (link.second != block) {
+         eraseLink(link.second->linksOut, link.first);
+      }
+   }
+
+   for (auto &link : block->linksOut) {
+      if (link.second != block) {
+         eraseLink(link.second->linksIn, link.first);
       }
-      a.jmp(asmjit::x86::rax);
+   }
 
-      a.relocLabels.emplace_back(addr, relocLbl);
+   block->linksIn.clear();
+   block->linksOut.clear();
+   sHostBlocks.erase(code);
+
+   for (auto page = block->start >> JIT_PAGE_SHIFT; page <= (block->end - 1) >> JIT_PAGE_SHIFT; ++page) {
+      auto itr = sPageBlocks.find(page);
+
+      if (itr != sPageBlocks.end()) {
+         auto &blocks = itr->second;
+         blocks.erase(std::remove(blocks.begin(), blocks.end(), block), blocks.end());
+
+         if (blocks.empty()) {
+            sPageBlocks.erase(itr);
+         }
+      }
    }
+
+   sRetiredBlocks[sGlobalEpoch.load() % 3].push_back(block);
+   sLiveBlocks.fetch_sub(1);
+   sLiveBytes.fetch_sub(block->codeSize);
+   sRetiredBytes.fetch_add(block->codeSize);
+   sInvalidatedBlocks.fetch_add(1);
+}
+
+void
+invalidate(uint32_t address, uint32_t size)
+{
+   if (!sRuntime || !size) {
+      return;
+   }
+
+   std::unique_lock<std::mutex> lock(sJitMutex);
+   auto start = static_cast<uint64_t>(address);
+   auto end = start + size;
+   std::vector<JitBlockInfo *> blocks;
+
+   // Make sure any block currently being generated gets regenerated
+   sInvalidateCounter.fetch_add(1);
+
+   for (auto page = start >> JIT_PAGE_SHIFT; page <= (end - 1) >> JIT_PAGE_SHIFT; ++page) {
+      auto itr = sPageBlocks.find(static_cast<uint32_t>(page));
+
+      if (itr == sPageBlocks.end()) {
+         continue;
+      }
+
+      for (auto block : itr->second) {
+         if (block->start < end && block->end > start
+          && std::find(blocks.begin(), blocks.end(), block) == blocks.end()) {
+            blocks.push_back(block);
+         }
+      }
+   }
+
+   for (auto block : blocks) {
+      retireBlock(block);
+   }
+
+   reclaimRetiredBlocks();
+}
+
+using JumpTargetList = std::vector<uint32_t>;
+
+void
+jit_b_direct(PPCEmuAssembler& a, ppcaddr_t addr)
+{
+   a.saveAllForExit();
+
+   // Allocate some space for an aligned MOV instruction, then mark
+   //  it as a relocation so it can be filled by the 'linker' below.
+   //  We always go through a relocation, even if we already know
+   //  where the target is, so the link can be undone when either
+   //  block is invalidated.
+   auto relocLbl = a.newLabel();
+   a.bind(relocLbl);
+
+   // Save 32 bytes of memory so we have room to do set up the
+   //  call during relocation once we know where its going to
+   //  reside in the host jit memory section.
+   for (auto i = 0; i < 32; ++i) {
+      a.int3();
+   }
+   a.jmp(asmjit::x86::rax);
+
+   a.relocLabels.emplace_back(addr, relocLbl);
 }
 
 bool
@@ -374,6 +750,9 @@ gen(JitBlock &block)
    uint32_t lclCia;
    a.bind(codeStart);
 
+   a.genBlockStart = block.start;
+   a.genRegisterUses = block.registerUses;
+
    if (JIT_DEBUG && JIT_INITIAL_NOPS) {
       for (auto i = 0; i < 12; ++i) {
          a.nop();
@@ -410,6 +789,12 @@ gen(JitBlock &block)
 
          a.genCia = lclCia;
 
+         if (!block.liveFlags.empty()) {
+            a.genFlagsLive = block.liveFlags[(lclCia - block.start) / 4];
+         } else {
+            a.genFlagsLive = FlagAll;
+         }
+
          auto genSuccess = false;
 
          auto fptr = sInstructionMap[static_cast<size_t>(data->id)];
@@ -422,7 +807,11 @@ gen(JitBlock &block)
          }
 
          if (doVerify) {
-            insertVerifyCall(a, instr, sPostInstr);
+            // Flag updates which were eliminated as dead will differ from
+            //  the interpreter, so make sure verification ignores them.
+            insertVerifyCall(a, instr, sPostInstr,
+                             getDeadCrMask(a.genFlagsLive),
+                             getDeadXerMask(a.genFlagsLive));
          }
       }
 
@@ -477,8 +866,16 @@ gen(JitBlock &block)
       auto atomicAddr = &mem[aligned_mov_offset + 2];
       decaf_check(align_up(atomicAddr, 8) == atomicAddr);
       *reinterpret_cast<uint64_t*>(atomicAddr) = targetAddr;
+
+      block.relocs.emplace_back(reloc.first, reinterpret_cast<JitCode *>(atomicAddr));
    }
 
+   block.code = func;
+   block.codeSize = a.getCodeSize();
+
+   sCoreLoads.fetch_add(a.mCoreLoads);
+   sCoreStores.fetch_add(a.mCoreStores);
+
    // Calculate the starting address of the block
    auto baseAddr = asmjit_cast<JitCode>(func, a.getLabelOffset(codeStart));
    block.entry = baseAddr;
@@ -552,25 +949,44 @@ get(uint32_t addr)
       return foundBlock;
    }
 
-   auto block = JitBlock { addr };
+   while (true) {
+      auto invalidateCounter = sInvalidateCounter.load();
+      auto block = JitBlock { addr };
 
-   if (!identBlock(block)) {
-      return nullptr;
-   }
+      if (!identBlock(block)) {
+         return nullptr;
+      }
 
-   if (!gen(block)) {
-      return nullptr;
-   }
+      if (JIT_DEAD_FLAGS) {
+         calculateFlagLiveness(block);
+      }
 
-   sJitBlocks.set(addr, block.entry);
+      if (JIT_REGISTER_USES) {
+         calculateRegisterUses(block);
+      }
 
-   for (auto i = block.targets.cbegin(); i != block.targets.cend(); ++i) {
-      if (i->second) {
-         sJitBlocks.set(i->first, i->second);
+      if (!gen(block)) {
+         return nullptr;
       }
-   }
 
-   return block.entry;
+      std::unique_lock<std::mutex> lock(sJitMutex);
+
+      if (sInvalidateCounter.load() != invalidateCounter) {
+         // Guest code may have changed while we were generating, nobody
+         //  has seen this block yet so we can free it straight away.
+         sRuntime->free(block.code, block.codeSize);
+         continue;
+      }
+
+      if (auto existing = sJitBlocks.find(addr)) {
+         // Another core beat us to generating this block
+         sRuntime->free(block.code, block.codeSize);
+         return existing;
+      }
+
+      registerBlock(block);
+      return block.entry;
+   }
 }
 
 JitCode
@@ -579,6 +995,15 @@ jit_continue(uint32_t nia, JitCode *jumpSource)
    // This would be strange...
    decaf_check(nia != CALLBACK_ADDR);
 
+   // We are not inside any block right now, so let any retired
+   //  blocks we may have been executing be reclaimed.
+   markCoreQuiescent();
+
+   if (sRetiredBytes.load() && sJitMutex.try_lock()) {
+      reclaimRetiredBlocks();
+      sJitMutex.unlock();
+   }
+
    // Log the branch if branch tracing is enabled
    if (gBranchTraceHandler) {
       gBranchTraceHandler(nia);
@@ -590,9 +1015,17 @@ jit_continue(uint32_t nia, JitCode *jumpSource)
    // We do not update the jumpSource if branch tracing is enabled,
    //  this is because it would cause those branches to avoid calling
    //  here ever again...
-   if (jumpSource && !gBranchTraceHandler) {
-      // Aligned writes on x64 are guarenteed to be atomic
-      *jumpSource = jitFn;
+   if (jumpSource && jitFn && !gBranchTraceHandler) {
+      std::unique_lock<std::mutex> lock(sJitMutex);
+
+      // Either block may have been invalidated in the meantime, in
+      //  which case we must leave the jump going to the dispatcher.
+      auto source = findBlockByHostAddress(jumpSource);
+      auto target = findBlockByHostAddress(jitFn);
+
+      if (source && target && *jumpSource == reinterpret_cast<JitCode>(gFinaleFn)) {
+         linkBlock(source, jumpSource, target, jitFn);
+      }
    }
 
    return jitFn;
@@ -635,4 +1068,19 @@ PPCEmuAssembler::ErrorHandler::handleError(asmjit::Error code, const char* messa
 
 } // namespace jit
 
+JitStats
+getJitStats()
+{
+   JitStats stats;
+   stats.liveBlocks = jit::sLiveBlocks.load();
+   stats.liveBytes = jit::sLiveBytes.load();
+   stats.invalidatedBlocks = jit::sInvalidatedBlocks.load();
+   stats.pendingBytes = jit::sRetiredBytes.load();
+   stats.reclaimedBytes = jit::sReclaimedBytes.load();
+   stats.freeBytes = jit::sRuntime ? jit::sRuntime->getFreeBytes() : 0;
+   stats.coreLoads = jit::sCoreLoads.load();
+   stats.coreStores = jit::sCoreStores.load();
+   return stats;
+}
+
 } // namespace cpu
@@ -17,6 +17,18 @@ clearCache();
 void
 resume();
 
+void
+invalidate(uint32_t address, uint32_t size);
+
+void
+markCoreIdle();
+
+uint64_t
+pinEpoch();
+
+void
+unpinEpoch(uint64_t epoch);
+
 bool
 hasInstruction(espresso::InstructionID instrId);
 
@@ -1,3 +1,4 @@
+#include "jit.h"
 #include "jit_insreg.h"
 #include "../cpu_internal.h"
 #include <common/bitutils.h>
@@ -27,26 +28,30 @@ enum BcFlags
 static Core*
 jit_interrupt_stub()
 {
+   // The interrupt handler may switch fibers, keep the calling block alive
+   auto epoch = pinEpoch();
    this_core::checkInterrupts();
+   unpinEpoch(epoch);
    return this_core::state();
 }
 
 static void
 jit_b_check_interrupt(PPCEmuAssembler& a)
 {
-   // We need to evict everything in case we call back to the
-   //  interrupt handler which is C++ code...
-   a.evictAll();
-
    // Jump to interrupt handler if there is an interrupt
    auto noInterrupt = a.newLabel();
 
    a.cmp(a.interruptMem, 0);
    a.je(noInterrupt);
 
+   // The interrupt handler is C++ code which may read or modify the guest
+   //  state, so only flush the register cache on this path and reload it
+   //  afterwards, leaving the common path with everything still cached.
+   a.saveAll();
    a.mov(a.niaMem, a.genCia + 4);
    a.call(asmjit::Ptr(jit_interrupt_stub));
    a.mov(a.stateReg, asmjit::x86::rax);
+   a.reloadAll();
 
    a.bind(noInterrupt);
 }
@@ -116,7 +121,7 @@ bcGeneric(PPCEmuAssembler& a, Instruction instr)
    //   this if-block as we use a JMP instruction with
    //   early exit in the else block...
    if (flags & (BcBranchCTR | BcBranchLR)) {
-      a.saveAll();
+      a.saveAllForExit();
 
       if (flags & BcBranchCTR) {
          a.mov(a.finaleNiaArgReg, a.ctrMem);
@@ -49,6 +49,11 @@ template<typename Type, unsigned flags = 0>
 static bool
 cmpGeneric(PPCEmuAssembler& a, Instruction instr)
 {
+   // Nothing reads this field before it is next overwritten
+   if (!a.isCrFieldLive(instr.crfD)) {
+      return true;
+   }
+
    uint32_t crshift = (7 - instr.crfD) * 4;
 
    // We allocate this up here so that any spill/alloc that
@@ -179,6 +184,10 @@ fcmpu(PPCEmuAssembler& a, Instruction instr)
 static bool
 crand(PPCEmuAssembler& a, Instruction instr)
 {
+   if (!a.isCrFieldLive(instr.crbD / 4)) {
+      return true;
+   }
+
    auto crbA = getCRB(a, instr.crbA);
    auto crbB = getCRB(a, instr.crbB);
    a.and_(crbA, crbB);
@@ -190,6 +199,10 @@ crand(PPCEmuAssembler& a, Instruction instr)
 static bool
 crandc(PPCEmuAssembler& a, Instruction instr)
 {
+   if (!a.isCrFieldLive(instr.crbD / 4)) {
+      return true;
+   }
+
    auto crbA = getCRB(a, instr.crbA);
    auto crbB = getCRB(a, instr.crbB);
    a.not_(crbB);
@@ -202,6 +215,10 @@ crandc(PPCEmuAssembler& a, Instruction instr)
 static bool
 creqv(PPCEmuAssembler& a, Instruction instr)
 {
+   if (!a.isCrFieldLive(instr.crbD / 4)) {
+      return true;
+   }
+
    auto crbA = getCRB(a, instr.crbA);
    auto crbB = getCRB(a, instr.crbB);
    a.xor_(crbA, crbB);
@@ -214,6 +231,10 @@ creqv(PPCEmuAssembler& a, Instruction instr)
 static bool
 crnand(PPCEmuAssembler& a, Instruction instr)
 {
+   if (!a.isCrFieldLive(instr.crbD / 4)) {
+      return true;
+   }
+
    auto crbA = getCRB(a, instr.crbA);
    auto crbB = getCRB(a, instr.crbB);
    a.and_(crbA, crbB);
@@ -226,6 +247,10 @@ crnand(PPCEmuAssembler& a, Instruction instr)
 static bool
 crnor(PPCEmuAssembler& a, Instruction instr)
 {
+   if (!a.isCrFieldLive(instr.crbD / 4)) {
+      return true;
+   }
+
    auto crbA = getCRB(a, instr.crbA);
    auto crbB = getCRB(a, instr.crbB);
    a.or_(crbA, crbB);
@@ -238,6 +263,10 @@ crnor(PPCEmuAssembler& a, Instruction instr)
 static bool
 cror(PPCEmuAssembler& a, Instruction instr)
 {
+   if (!a.isCrFieldLive(instr.crbD / 4)) {
+      return true;
+   }
+
    auto crbA = getCRB(a, instr.crbA);
    auto crbB = getCRB(a, instr.crbB);
    a.or_(crbA, crbB);
@@ -249,6 +278,10 @@ cror(PPCEmuAssembler& a, Instruction instr)
 static bool
 crorc(PPCEmuAssembler& a, Instruction instr)
 {
+   if (!a.isCrFieldLive(instr.crbD / 4)) {
+      return true;
+   }
+
    auto crbA = getCRB(a, instr.crbA);
    auto crbB = getCRB(a, instr.crbB);
    a.not_(crbB);
@@ -261,6 +294,10 @@ crorc(PPCEmuAssembler& a, Instruction instr)
 static bool
 crxor(PPCEmuAssembler& a, Instruction instr)
 {
+   if (!a.isCrFieldLive(instr.crbD / 4)) {
+      return true;
+   }
+
    auto crbA = getCRB(a, instr.crbA);
    auto crbB = getCRB(a, instr.crbB);
    a.xor_(crbA, crbB);
@@ -272,6 +309,10 @@ crxor(PPCEmuAssembler& a, Instruction instr)
 static bool
 mcrf(PPCEmuAssembler& a, Instruction instr)
 {
+   if (!a.isCrFieldLive(instr.crfD)) {
+      return true;
+   }
+
    uint32_t crshifts = (7 - instr.crfS) * 4;
    uint32_t crshiftd = (7 - instr.crfD) * 4;
 
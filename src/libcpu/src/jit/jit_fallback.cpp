@@ -25,7 +25,36 @@ bool jit_fallback(PPCEmuAssembler& a, espresso::Instruction instr)
    auto fptr = cpu::interpreter::getInstructionHandler(data->id);
    decaf_assert(fptr, fmt::format("Unimplemented instruction {}", static_cast<int>(data->id)));
 
-   a.evictAll();
+   // The interpreter works on Core, so write back anything the instruction
+   //  reads and drop anything it writes.  Everything else can stay cached,
+   //  as long as it is in a host register which survives the call.
+   auto uses = getRegisterUses(instr);
+
+   for (auto &reg : a.mRegs) {
+      auto gprIndex = a.getGprIndex(reg);
+      auto fprIndex = a.getFprIndex(reg);
+      auto read = true;
+      auto write = true;
+
+      if (reg.content == 0xFFFFFFFF) {
+         continue;
+      }
+
+      if (gprIndex >= 0) {
+         read = !!(uses.gprRead & (1u << gprIndex));
+         write = !!(uses.gprWrite & (1u << gprIndex));
+      } else if (fprIndex >= 0) {
+         read = !!(uses.fprRead & (1u << fprIndex));
+         write = !!(uses.fprWrite & (1u << fprIndex));
+      }
+
+      if (write || !(reg.pinned || PPCEmuAssembler::isCallPreserved(reg))) {
+         a.evictOne(&reg);
+      } else if (read) {
+         a.saveOne(&reg);
+         reg.written = false;
+      }
+   }
 
    if (TRACK_FALLBACK_CALLS) {
       auto fallbackAddr = reinterpret_cast<intptr_t>(&sFallbackCalls[static_cast<uint32_t>(data->id)]);
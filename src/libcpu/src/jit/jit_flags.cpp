@@ -0,0 +1,431 @@
+#include "espresso/espresso_instructionset.h"
+#include "espresso/espresso_registers.h"
+#include "espresso/espresso_spr.h"
+#include "jit_internal.h"
+#include "mem.h"
+
+using espresso::InstructionID;
+using espresso::XERegisterBits;
+
+namespace cpu
+{
+
+namespace jit
+{
+
+/*
+Dead flag elimination.
+
+A lot of integer instructions update CR0 (rc = 1) or XER[CA/OV/SO] as a side
+effect, and more often than not the next flag producing instruction overwrites
+those bits before anything has read them.  We walk the block backwards from
+its exit and record, for every instruction, which flags are live after it so
+the generators can skip computing flag updates nobody will ever observe.
+
+Any instruction which may leave the block or run C++ code which could observe
+the guest state (branches, kc, fallbacks we know nothing about) is treated as
+reading every flag, so everything is live at block exits.
+*/
+
+struct FlagEffects
+{
+   // Flags which are always read by the instruction
+   uint32_t uses = 0;
+
+   // Flags which are fully overwritten by the instruction
+   uint32_t defs = 0;
+
+   // Flags which are only partially written, and so are not killed
+   uint32_t writes = 0;
+
+   // Flags which are only read when something the instruction writes is
+   //  live, e.g. XER[SO] is copied into CR0 by record instructions.
+   uint32_t usesIfLive = 0;
+};
+
+static inline uint32_t
+crFieldFlag(uint32_t crf)
+{
+   return FlagCr0 << crf;
+}
+
+static void
+addRecord(FlagEffects &effects, espresso::Instruction instr)
+{
+   if (instr.rc) {
+      effects.defs |= FlagCr0;
+      effects.usesIfLive |= FlagStickyOV;
+   }
+}
+
+static void
+addOverflow(FlagEffects &effects, espresso::Instruction instr)
+{
+   // XER[SO] is sticky so it is never killed, only XER[OV] is.
+   if (instr.oe) {
+      effects.defs |= FlagOverflow;
+      effects.writes |= FlagStickyOV;
+   }
+}
+
+static FlagEffects
+getFlagEffects(espresso::Instruction instr,
+               espresso::InstructionInfo *data)
+{
+   FlagEffects effects;
+
+   if (!data) {
+      effects.uses = FlagAll;
+      return effects;
+   }
+
+   switch (data->id) {
+   // Add / Subtract
+   case InstructionID::add:
+   case InstructionID::subf:
+      addOverflow(effects, instr);
+      addRecord(effects, instr);
+      break;
+   case InstructionID::addc:
+   case InstructionID::subfc:
+      effects.defs |= FlagCarry;
+      addOverflow(effects, instr);
+      addRecord(effects, instr);
+      break;
+   case InstructionID::adde:
+   case InstructionID::addme:
+   case InstructionID::addze:
+   case InstructionID::subfe:
+   case InstructionID::subfme:
+   case InstructionID::subfze:
+      effects.uses |= FlagCarry;
+      effects.defs |= FlagCarry;
+      addOverflow(effects, instr);
+      addRecord(effects, instr);
+      break;
+   case InstructionID::addic:
+   case InstructionID::subfic:
+      effects.defs |= FlagCarry;
+      break;
+   case InstructionID::addicx:
+      effects.defs |= FlagCarry | FlagCr0;
+      effects.usesIfLive |= FlagStickyOV;
+      break;
+   case InstructionID::addi:
+   case InstructionID::addis:
+   case InstructionID::mulli:
+   case InstructionID::ori:
+   case InstructionID::oris:
+   case InstructionID::xori:
+   case InstructionID::xoris:
+      break;
+
+   // Multiply / Divide / Negate
+   case InstructionID::divw:
+   case InstructionID::divwu:
+   case InstructionID::mullw:
+   case InstructionID::neg:
+      addOverflow(effects, instr);
+      addRecord(effects, instr);
+      break;
+   case InstructionID::mulhw:
+   case InstructionID::mulhwu:
+      addRecord(effects, instr);
+      break;
+
+   // Logical / Rotate / Shift
+   case InstructionID::and_:
+   case InstructionID::andc:
+   case InstructionID::cntlzw:
+   case InstructionID::eqv:
+   case InstructionID::extsb:
+   case InstructionID::extsh:
+   case InstructionID::nand:
+   case InstructionID::nor:
+   case InstructionID::or_:
+   case InstructionID::orc:
+   case InstructionID::xor_:
+   case InstructionID::rlwimi:
+   case InstructionID::rlwinm:
+   case InstructionID::rlwnm:
+   case InstructionID::slw:
+   case InstructionID::srw:
+      addRecord(effects, instr);
+      break;
+   case InstructionID::andi:
+   case InstructionID::andis:
+      effects.defs |= FlagCr0;
+      effects.usesIfLive |= FlagStickyOV;
+      break;
+   case InstructionID::sraw:
+   case InstructionID::srawi:
+      effects.defs |= FlagCarry;
+      addRecord(effects, instr);
+      break;
+
+   // Compare
+   case InstructionID::cmp:
+   case InstructionID::cmpi:
+   case InstructionID::cmpl:
+   case InstructionID::cmpli:
+      effects.defs |= crFieldFlag(instr.crfD);
+      effects.usesIfLive |= FlagStickyOV;
+      break;
+   case InstructionID::fcmpo:
+   case InstructionID::fcmpu:
+   case InstructionID::ps_cmpo0:
+   case InstructionID::ps_cmpo1:
+   case InstructionID::ps_cmpu0:
+   case InstructionID::ps_cmpu1:
+      effects.defs |= crFieldFlag(instr.crfD);
+      break;
+
+   // Condition Register
+   case InstructionID::crand:
+   case InstructionID::crandc:
+   case InstructionID::creqv:
+   case InstructionID::crnand:
+   case InstructionID::crnor:
+   case InstructionID::cror:
+   case InstructionID::crorc:
+   case InstructionID::crxor:
+      // Only a single bit of crbD is written so the field is not killed
+      effects.writes |= crFieldFlag(instr.crbD / 4);
+      effects.usesIfLive |= crFieldFlag(instr.crbA / 4) | crFieldFlag(instr.crbB / 4);
+      break;
+   case InstructionID::mcrf:
+      effects.defs |= crFieldFlag(instr.crfD);
+      effects.usesIfLive |= crFieldFlag(instr.crfS);
+      break;
+   case InstructionID::mcrxr:
+      effects.uses |= FlagXerAll;
+      effects.defs |= crFieldFlag(instr.crfD) | FlagXerAll;
+      break;
+   case InstructionID::mfcr:
+      effects.uses |= FlagCrAll;
+      break;
+   case InstructionID::mtcrf:
+      for (auto i = 0u; i < 8; ++i) {
+         if (instr.crm & (1 << i)) {
+            effects.defs |= crFieldFlag(7 - i);
+         }
+      }
+      break;
+   case InstructionID::stwcx:
+      effects.defs |= FlagCr0;
+      effects.usesIfLive |= FlagStickyOV;
+      break;
+
+   // Special Purpose Registers
+   case InstructionID::mfspr:
+      if (espresso::decodeSPR(instr) == espresso::SPR::XER) {
+         effects.uses |= FlagXerAll;
+      }
+      break;
+   case InstructionID::mtspr:
+      if (espresso::decodeSPR(instr) == espresso::SPR::XER) {
+         effects.defs |= FlagXerAll;
+      }
+      break;
+
+   // Loads and stores do not touch CR or XER flags
+   case InstructionID::lbz:
+   case InstructionID::lbzu:
+   case InstructionID::lbzx:
+   case InstructionID::lbzux:
+   case InstructionID::lha:
+   case InstructionID::lhau:
+   case InstructionID::lhax:
+   case InstructionID::lhaux:
+   case InstructionID::lhz:
+   case InstructionID::lhzu:
+   case InstructionID::lhzx:
+   case InstructionID::lhzux:
+   case InstructionID::lwz:
+   case InstructionID::lwzu:
+   case InstructionID::lwzx:
+   case InstructionID::lwzux:
+   case InstructionID::lhbrx:
+   case InstructionID::lwbrx:
+   case InstructionID::lwarx:
+   case InstructionID::lmw:
+   case InstructionID::stb:
+   case InstructionID::stbu:
+   case InstructionID::stbx:
+   case InstructionID::stbux:
+   case InstructionID::sth:
+   case InstructionID::sthu:
+   case InstructionID::sthx:
+   case InstructionID::sthux:
+   case InstructionID::stw:
+   case InstructionID::stwu:
+   case InstructionID::stwx:
+   case InstructionID::stwux:
+   case InstructionID::sthbrx:
+   case InstructionID::stwbrx:
+   case InstructionID::stmw:
+   case InstructionID::lfd:
+   case InstructionID::lfdu:
+   case InstructionID::lfdx:
+   case InstructionID::lfdux:
+   case InstructionID::lfs:
+   case InstructionID::lfsu:
+   case InstructionID::lfsx:
+   case InstructionID::lfsux:
+   case InstructionID::stfd:
+   case InstructionID::stfdu:
+   case InstructionID::stfdx:
+   case InstructionID::stfdux:
+   case InstructionID::stfiwx:
+   case InstructionID::stfs:
+   case InstructionID::stfsu:
+   case InstructionID::stfsx:
+   case InstructionID::stfsux:
+   case InstructionID::psq_l:
+   case InstructionID::psq_lu:
+   case InstructionID::psq_lx:
+   case InstructionID::psq_lux:
+   case InstructionID::psq_st:
+   case InstructionID::psq_stu:
+   case InstructionID::psq_stx:
+   case InstructionID::psq_stux:
+      break;
+
+   // Cache and synchronisation instructions
+   case InstructionID::dcbf:
+   case InstructionID::dcbi:
+   case InstructionID::dcbst:
+   case InstructionID::dcbt:
+   case InstructionID::dcbtst:
+   case InstructionID::dcbz:
+   case InstructionID::dcbz_l:
+   case InstructionID::icbi:
+   case InstructionID::eieio:
+   case InstructionID::isync:
+   case InstructionID::sync:
+      break;
+
+   // Floating point instructions with rc = 1 write CR1 but never read any
+   //  flags, we simply do not count them as a def of CR1.
+   case InstructionID::fadd:
+   case InstructionID::fadds:
+   case InstructionID::fdiv:
+   case InstructionID::fdivs:
+   case InstructionID::fmul:
+   case InstructionID::fmuls:
+   case InstructionID::fsub:
+   case InstructionID::fsubs:
+   case InstructionID::fres:
+   case InstructionID::frsqrte:
+   case InstructionID::fsel:
+   case InstructionID::fmadd:
+   case InstructionID::fmadds:
+   case InstructionID::fmsub:
+   case InstructionID::fmsubs:
+   case InstructionID::fnmadd:
+   case InstructionID::fnmadds:
+   case InstructionID::fnmsub:
+   case InstructionID::fnmsubs:
+   case InstructionID::fctiw:
+   case InstructionID::fctiwz:
+   case InstructionID::frsp:
+   case InstructionID::fabs:
+   case InstructionID::fnabs:
+   case InstructionID::fmr:
+   case InstructionID::fneg:
+   case InstructionID::ps_add:
+   case InstructionID::ps_div:
+   case InstructionID::ps_mul:
+   case InstructionID::ps_sub:
+   case InstructionID::ps_abs:
+   case InstructionID::ps_nabs:
+   case InstructionID::ps_neg:
+   case InstructionID::ps_sel:
+   case InstructionID::ps_res:
+   case InstructionID::ps_rsqrte:
+   case InstructionID::ps_msub:
+   case InstructionID::ps_madd:
+   case InstructionID::ps_nmsub:
+   case InstructionID::ps_nmadd:
+   case InstructionID::ps_mr:
+   case InstructionID::ps_sum0:
+   case InstructionID::ps_sum1:
+   case InstructionID::ps_muls0:
+   case InstructionID::ps_muls1:
+   case InstructionID::ps_madds0:
+   case InstructionID::ps_madds1:
+   case InstructionID::ps_merge00:
+   case InstructionID::ps_merge01:
+   case InstructionID::ps_merge10:
+   case InstructionID::ps_merge11:
+      break;
+
+   // Everything else (branches, kc, traps, string instructions, ...) is
+   //  assumed to read every flag.
+   default:
+      effects.uses = FlagAll;
+      break;
+   }
+
+   return effects;
+}
+
+void
+calculateFlagLiveness(JitBlock &block)
+{
+   auto numInstrs = (block.end - block.start) / 4;
+   block.liveFlags.resize(numInstrs);
+
+   // Everything is live when we leave the block
+   auto live = static_cast<uint32_t>(FlagAll);
+
+   for (auto i = numInstrs; i > 0; --i) {
+      auto cia = block.start + (i - 1) * 4;
+      auto instr = mem::read<espresso::Instruction>(cia);
+      auto effects = getFlagEffects(instr, espresso::decodeInstruction(instr));
+
+      block.liveFlags[i - 1] = live;
+
+      auto uses = effects.uses;
+
+      if (live & (effects.defs | effects.writes)) {
+         uses |= effects.usesIfLive;
+      }
+
+      live = (live & ~effects.defs) | uses;
+   }
+}
+
+uint32_t
+getDeadCrMask(uint32_t liveFlags)
+{
+   auto mask = 0u;
+
+   for (auto i = 0u; i < 8; ++i) {
+      if (!(liveFlags & (FlagCr0 << i))) {
+         mask |= 0xFu << ((7 - i) * 4);
+      }
+   }
+
+   return mask;
+}
+
+uint32_t
+getDeadXerMask(uint32_t liveFlags)
+{
+   auto mask = 0u;
+
+   if (!(liveFlags & FlagCarry)) {
+      mask |= XERegisterBits::Carry;
+   }
+
+   if (!(liveFlags & (FlagOverflow | FlagStickyOV))) {
+      mask |= XERegisterBits::Overflow | XERegisterBits::StickyOV;
+   }
+
+   return mask;
+}
+
+} // namespace jit
+
+} // namespace cpu
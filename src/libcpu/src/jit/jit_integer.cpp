@@ -19,6 +19,11 @@ updateConditionRegister(PPCEmuAssembler& a,
 {
    decaf_check(eaxLockout.isRegister(asmjit::x86::rax));
 
+   // Nothing reads cr0 before it is next overwritten
+   if (!a.isCrFieldLive(0)) {
+      return;
+   }
+
    auto crtarget = 0;
    auto crshift = (7 - crtarget) * 4;
 
@@ -84,7 +89,7 @@ addGeneric(PPCEmuAssembler& a, Instruction instr)
    bool recordCond = false;
 
    if (flags & AddCarry) {
-      recordCarry = true;
+      recordCarry = a.isCarryLive();
    }
 
    if (flags & AddAlwaysRecord) {
@@ -92,7 +97,7 @@ addGeneric(PPCEmuAssembler& a, Instruction instr)
       recordCond = true;
    } else if (flags & AddCheckRecord) {
       if (instr.oe) {
-         recordOverflow = true;
+         recordOverflow = a.isOverflowLive();
       }
 
       if (instr.rc) {
@@ -377,11 +382,16 @@ divGeneric(PPCEmuAssembler& a, Instruction instr)
    auto eaxLockout = a.lockRegister(asmjit::x86::rax);
    auto edxLockout = a.lockRegister(asmjit::x86::rdx);
 
+   auto recordOverflow = instr.oe && a.isOverflowLive();
+
    auto dst = a.loadRegisterWrite(a.gpr[instr.rD]);
    auto srcA = a.loadRegisterRead(a.gpr[instr.rA]);
    auto srcB = a.loadRegisterRead(a.gpr[instr.rB]);
 
-   auto ppcxer = a.loadRegisterReadWrite(a.xer);
+   PPCEmuAssembler::GpRegister ppcxer;
+   if (recordOverflow) {
+      ppcxer = a.loadRegisterReadWrite(a.xer);
+   }
 
    auto overflowLbl = a.newLabel();
    auto endLbl = a.newLabel();
@@ -411,7 +421,9 @@ divGeneric(PPCEmuAssembler& a, Instruction instr)
    a.mov(dst, asmjit::x86::eax);
 
    // Clear the Overflow flag
-   a.and_(ppcxer, ~XERegisterBits::Overflow);
+   if (recordOverflow) {
+      a.and_(ppcxer, ~XERegisterBits::Overflow);
+   }
 
    a.jmp(endLbl);
    a.bind(overflowLbl);
@@ -426,7 +438,9 @@ divGeneric(PPCEmuAssembler& a, Instruction instr)
    }
 
    // Set Overflow bits
-   a.or_(ppcxer, XERegisterBits::StickyOV | XERegisterBits::Overflow);
+   if (recordOverflow) {
+      a.or_(ppcxer, XERegisterBits::StickyOV | XERegisterBits::Overflow);
+   }
 
    a.bind(endLbl);
 
@@ -528,7 +542,7 @@ mulGeneric(PPCEmuAssembler& a, Instruction instr)
    static_assert(!(flags & MulCheckOverflow) || ((flags & MulSigned) && (flags & MulLow)),
       "X64 cannot do overflow on high bits, or on unsigned mul");
 
-   bool recordOverflow = (flags & MulCheckOverflow) && instr.oe;
+   bool recordOverflow = (flags & MulCheckOverflow) && instr.oe && a.isOverflowLive();
 
    auto eaxLockout = a.lockRegister(asmjit::x86::rax);
    auto edxLockout = a.lockRegister(asmjit::x86::rdx);
@@ -661,7 +675,7 @@ neg(PPCEmuAssembler& a, Instruction instr)
    auto dst = a.loadRegisterWrite(a.gpr[instr.rD]);
    auto src = a.loadRegisterRead(a.gpr[instr.rA]);
 
-   if (!instr.oe) {
+   if (!instr.oe || !a.isOverflowLive()) {
       a.mov(dst, src);
       a.neg(dst);
    } else {
@@ -969,14 +983,16 @@ shiftArithmetic(PPCEmuAssembler& a, Instruction instr)
          a.shr(tmp2.r64(), asmjit::x86::cl);
       }
 
-      a.test(tmp2, tmp.r32());
-      a.mov(tmp2, 0);
-      a.setnz(tmp2.r8());
-      a.shl(tmp2, XERegisterBits::CarryShift);
+      if (a.isCarryLive()) {
+         a.test(tmp2, tmp.r32());
+         a.mov(tmp2, 0);
+         a.setnz(tmp2.r8());
+         a.shl(tmp2, XERegisterBits::CarryShift);
 
-      auto ppcxer = a.loadRegisterReadWrite(a.xer);
-      a.and_(ppcxer, ~XERegisterBits::Carry);
-      a.or_(ppcxer, tmp2);
+         auto ppcxer = a.loadRegisterReadWrite(a.xer);
+         a.and_(ppcxer, ~XERegisterBits::Carry);
+         a.or_(ppcxer, tmp2);
+      }
 
       a.mov(dst, tmp);
    }
@@ -1,6 +1,7 @@
 #pragma once
 #include <common/decaf_assert.h>
 #include "cpu.h"
+#include "espresso/espresso_instruction.h"
 #include <array>
 #include <asmjit/asmjit.h>
 #include <map>
@@ -15,6 +16,34 @@ namespace cpu
 namespace jit
 {
 
+// Guest flags tracked by the dead flag elimination pass, see jit_flags.cpp
+enum FlagBits : uint32_t
+{
+   FlagCr0 = 1 << 0,
+   FlagCr1 = 1 << 1,
+   FlagCr2 = 1 << 2,
+   FlagCr3 = 1 << 3,
+   FlagCr4 = 1 << 4,
+   FlagCr5 = 1 << 5,
+   FlagCr6 = 1 << 6,
+   FlagCr7 = 1 << 7,
+   FlagCrAll = 0xFF,
+   FlagCarry = 1 << 8,
+   FlagOverflow = 1 << 9,
+   FlagStickyOV = 1 << 10,
+   FlagXerAll = FlagCarry | FlagOverflow | FlagStickyOV,
+   FlagAll = FlagCrAll | FlagXerAll,
+};
+
+// Guest GPRs and FPRs accessed by one instruction, see jit_regalloc.cpp
+struct RegisterUses
+{
+   uint32_t gprRead = 0;
+   uint32_t gprWrite = 0;
+   uint32_t fprRead = 0;
+   uint32_t fprWrite = 0;
+};
+
 /*
 Register Assignments:
 RAX    . Scratch
@@ -25,7 +54,9 @@ RSI    . Scratch
 RBX    . Core*
 RBP    . mem::base()
 RSP    . Emu Stack Pointer.
-R8-R15 . Scratch
+R8-R13 . Scratch
+R14    . Guest r3, kept across linked blocks
+R15    . Guest r1, kept across linked blocks
 */
 
 class PPCEmuAssembler : public asmjit::X86Assembler
@@ -68,6 +99,10 @@ public:
       bool written = false;
       uint32_t size = 0;
       uint32_t content = 0xFFFFFFFF;
+
+      // Permanently holds a chained guest register, it is never evicted
+      //  only marked as not loaded when Core has the current value.
+      bool pinned = false;
    };
 
    struct PpcRef {
@@ -171,6 +206,26 @@ public:
       for (auto i = 0; i < mXmmRegVals.size(); ++i) {
          mRegs[regIdx++] = HostRegister(RegType::Xmm, i);
       }
+
+      // The most used guest registers stay in a callee-saved host register
+      //  across block boundaries, so blocks which are linked together pass
+      //  them on without going through Core.  The intro and extro stubs
+      //  move them between Core and the host registers.
+      const std::pair<uint32_t, uint32_t> chainedGprs[] = {
+         { 12, 1 },  // R15 = r1
+         { 11, 3 },  // R14 = r3
+      };
+
+      for (auto &chained : chainedGprs) {
+         auto &reg = mRegs[chained.first];
+         reg.pinned = true;
+         reg.content = gpr[chained.second].offset;
+         reg.size = gpr[chained.second].size;
+         reg.loaded = true;
+
+         // The previous block may have left a newer value than Core has
+         reg.written = true;
+      }
    }
 
    void shiftTo(asmjit::X86GpReg reg, int s, int d)
@@ -183,6 +238,9 @@ public:
    }
 
    uint32_t genCia;
+   uint32_t genFlagsLive = FlagAll;
+   uint32_t genBlockStart = 0;
+   std::vector<RegisterUses> genRegisterUses;
    std::vector<std::pair<uint32_t, asmjit::Label>> relocLabels;
 
    asmjit::X86GpReg sysArgReg[4];
@@ -208,6 +266,24 @@ public:
    PpcGpRef gqr[8];
    PpcGpRef reserve;
 
+   // Returns whether the given CR field is read before being overwritten
+   bool isCrFieldLive(uint32_t crf) const
+   {
+      return !!(genFlagsLive & (FlagCr0 << crf));
+   }
+
+   // Returns whether XER[CA] is read before being overwritten
+   bool isCarryLive() const
+   {
+      return !!(genFlagsLive & FlagCarry);
+   }
+
+   // Returns whether XER[OV] or XER[SO] is read before being overwritten
+   bool isOverflowLive() const
+   {
+      return !!(genFlagsLive & (FlagOverflow | FlagStickyOV));
+   }
+
    std::array<asmjit::X86GpReg, MaxGpRegSlots> mGpRegVals;
    std::array<asmjit::X86XmmReg, MaxXmmRegSlots> mXmmRegVals;
 
@@ -215,6 +291,14 @@ public:
 
    uint32_t mLruCounter = 0;
 
+   // Number of guest register loads and stores emitted, for JitStats
+   uint32_t mCoreLoads = 0;
+   uint32_t mCoreStores = 0;
+
+   // How far ahead getNextUse looks for the next access to a register
+   static const uint32_t NextUseWindow = 64;
+   static const uint32_t NextUseNever = 0xFFFFFFFF;
+
    static bool
    isSameRegister(const asmjit::X86Reg &a, const asmjit::X86Reg &b)
    {
@@ -420,6 +504,7 @@ public:
       for (auto &hreg : mRegs) {
          if (isSameHostRegister(&hreg, reg)) {
             decaf_check(hreg.useCount == 0);
+            decaf_check(!hreg.pinned);
             if (hreg.content != 0xFFFFFFFF) {
                evictOne(&hreg);
             }
@@ -436,36 +521,133 @@ public:
       return RegLockout();
    }
 
-   HostRegister * allocReg(RegType regType) {
-      uint32_t lruReg = 0xFFFFFFFF;
-      uint32_t lruValue = 0xFFFFFFFF;
+   // Returns whether a host register keeps its value across a call to C++
+   static bool isCallPreserved(const HostRegister &reg)
+   {
+      if (reg.regType != RegType::Gp) {
+         return false;
+      }
+
+#ifdef PLATFORM_WINDOWS
+      // RDI and RSI
+      if (reg.regId == 3 || reg.regId == 4) {
+         return true;
+      }
+#endif
+
+      // R12-R15
+      return reg.regId >= 9;
+   }
+
+   // Returns the guest GPR held in a host register, or -1 if it is not one
+   int getGprIndex(const HostRegister &reg) const
+   {
+      if (reg.content < gpr[0].offset || reg.content > gpr[31].offset) {
+         return -1;
+      }
+
+      return static_cast<int>((reg.content - gpr[0].offset) / gpr[0].size);
+   }
+
+   // Returns the guest FPR held in a host register, or -1 if it is not one
+   int getFprIndex(const HostRegister &reg) const
+   {
+      if (reg.content < fprps[0].offset || reg.content > fprps[31].offset) {
+         return -1;
+      }
+
+      return static_cast<int>((reg.content - fprps[0].offset) / fprps[0].size);
+   }
+
+   /**
+    * Returns how many instructions from the current one the guest register
+    * held in reg is next read.  Registers which are overwritten before they
+    * are read again are dead and return NextUseNever, anything we know
+    * nothing about is assumed to be used straight away.
+    */
+   uint32_t getNextUse(const HostRegister &reg) const
+   {
+      auto gprIndex = getGprIndex(reg);
+      auto fprIndex = getFprIndex(reg);
+
+      if ((gprIndex < 0 && fprIndex < 0) || genRegisterUses.empty()) {
+         return 0;
+      }
+
+      auto index = (genCia - genBlockStart) / 4;
+
+      for (auto i = index; i < genRegisterUses.size() && i - index < NextUseWindow; ++i) {
+         auto &uses = genRegisterUses[i];
+         auto read = gprIndex >= 0 ? uses.gprRead & (1u << gprIndex) : uses.fprRead & (1u << fprIndex);
+         auto write = gprIndex >= 0 ? uses.gprWrite & (1u << gprIndex) : uses.fprWrite & (1u << fprIndex);
+
+         // The current instruction is about to use whatever it writes
+         if (read || (write && i == index)) {
+            return i - index;
+         } else if (write) {
+            return NextUseNever;
+         }
+      }
+
+      return NextUseWindow;
+   }
+
+   /**
+    * Pick the best register to evict between two candidates, the one whose
+    * value is needed furthest in the future wins, then the one we do not
+    * have to write back, then the least recently used.
+    */
+   HostRegister * pickEviction(HostRegister *a, HostRegister *b) const
+   {
+      if (!a) {
+         return b;
+      }
+
+      auto aNext = getNextUse(*a);
+      auto bNext = getNextUse(*b);
+
+      if (aNext != bNext) {
+         return aNext > bNext ? a : b;
+      }
+
+      if (a->written != b->written) {
+         return a->written ? b : a;
+      }
 
-      // Pick a register from completely empty ones, track the
-      //  least-recently used register at the same time.
+      return a->lruValue <= b->lruValue ? a : b;
+   }
+
+   HostRegister * allocReg(RegType regType, bool forGuest = false) {
+      HostRegister *freeReg = nullptr;
+      HostRegister *evictReg = nullptr;
+
+      // Pick a register from completely empty ones, guest registers prefer
+      //  one which survives calls to C++ so they can stay cached across
+      //  fallbacks, temporaries take the first scratch register.
       for (auto i = 0; i < mRegs.size(); ++i) {
          auto &reg = mRegs[i];
-         if (reg.regType != regType) {
+         if (reg.regType != regType || reg.pinned || reg.useCount) {
             continue;
          }
-         if (!reg.useCount) {
-            if (reg.content == 0xFFFFFFFF) {
-               reg.useCount++;
-               return &reg;
-            }
 
-            if (reg.lruValue < lruValue) {
-               lruReg = i;
-               lruValue = reg.lruValue;
+         if (reg.content == 0xFFFFFFFF) {
+            if (!freeReg || (forGuest && isCallPreserved(reg) && !isCallPreserved(*freeReg))) {
+               freeReg = &reg;
             }
+         } else {
+            evictReg = pickEviction(evictReg, &reg);
          }
       }
 
-      // If we have an LRU register, lets evict it and use that one.
-      if (lruReg != 0xFFFFFFFF) {
-         auto &reg = mRegs[lruReg];
-         evictOne(&reg);
-         reg.useCount++;
-         return &reg;
+      if (freeReg) {
+         freeReg->useCount++;
+         return freeReg;
+      }
+
+      if (evictReg) {
+         evictOne(evictReg);
+         evictReg->useCount++;
+         return evictReg;
       }
 
       decaf_abort("Failed to locate a free host register to allocate");
@@ -549,19 +731,13 @@ public:
          decaf_check(reg->size == which.size);
          reg->useCount++;
       } else {
-         reg = allocReg(RegType::Gp);
+         reg = allocReg(RegType::Gp, true);
          reg->content = which.offset;
          reg->size = which.size;
       }
 
       if (shouldLoad && !reg->loaded) {
-         if (reg->size == 4) {
-            mov(mGpRegVals[reg->regId].r32(), asmjit::X86Mem(stateReg, which.offset, 4));
-         } else if (reg->size == 8) {
-            mov(mGpRegVals[reg->regId].r64(), asmjit::X86Mem(stateReg, which.offset, 8));
-         } else {
-            decaf_abort(fmt::format("Unexpected register size {}", reg->size));
-         }
+         loadOne(reg);
          reg->loaded = true;
       }
 
@@ -581,17 +757,13 @@ public:
          decaf_check(reg->size == which.size);
          reg->useCount++;
       } else {
-         reg = allocReg(RegType::Xmm);
+         reg = allocReg(RegType::Xmm, true);
          reg->content = which.offset;
          reg->size = which.size;
       }
 
       if (shouldLoad && !reg->loaded) {
-         if (reg->size == 16) {
-            movapd(mXmmRegVals[reg->regId], asmjit::X86Mem(stateReg, which.offset, 16));
-         } else {
-            decaf_abort(fmt::format("Unexpected register size {}", reg->size));
-         }
+         loadOne(reg);
          reg->loaded = true;
       }
 
@@ -647,31 +819,62 @@ public:
       return loadXmmRegisterReadWrite(which);
    }
 
-   void saveOne(HostRegister *reg)
+   // Emit a load of the register's content from Core
+   void loadOne(HostRegister *reg)
    {
-      decaf_check(reg->useCount == 0);
       decaf_check(reg->content != 0xFFFFFFFF);
 
-      if (reg->written) {
-         decaf_check(reg->loaded);
+      if (reg->regType == RegType::Gp) {
+         if (reg->size == 4) {
+            mov(mGpRegVals[reg->regId].r32(), asmjit::X86Mem(stateReg, reg->content, 4));
+         } else if (reg->size == 8) {
+            mov(mGpRegVals[reg->regId].r64(), asmjit::X86Mem(stateReg, reg->content, 8));
+         } else {
+            decaf_abort(fmt::format("Unexpected register size {}", reg->size));
+         }
+      } else if (reg->regType == RegType::Xmm) {
+         decaf_check(reg->size == 16);
+
+         movapd(mXmmRegVals[reg->regId], asmjit::X86Mem(stateReg, reg->content, 16));
+      } else {
+         decaf_abort(fmt::format("Unexpected register type {}", static_cast<int>(reg->regType)));
+      }
 
-         if (reg->regType == RegType::Gp) {
-            decaf_check(reg->size == 4 || reg->size == 8);
+      mCoreLoads++;
+   }
 
-            if (reg->size == 4) {
-               mov(asmjit::X86Mem(stateReg, reg->content, 4), mGpRegVals[reg->regId].r32());
-            } else if (reg->size == 8) {
-               mov(asmjit::X86Mem(stateReg, reg->content, 8), mGpRegVals[reg->regId].r64());
-            } else {
-               decaf_abort(fmt::format("Unexpected register size {}", reg->size));
-            }
-         } else if (reg->regType == RegType::Xmm) {
-            decaf_check(reg->size == 16);
+   // Emit a store of the register's content to Core
+   void storeOne(HostRegister *reg)
+   {
+      decaf_check(reg->content != 0xFFFFFFFF);
 
-            movapd(asmjit::X86Mem(stateReg, reg->content, 16), mXmmRegVals[reg->regId]);
+      if (reg->regType == RegType::Gp) {
+         if (reg->size == 4) {
+            mov(asmjit::X86Mem(stateReg, reg->content, 4), mGpRegVals[reg->regId].r32());
+         } else if (reg->size == 8) {
+            mov(asmjit::X86Mem(stateReg, reg->content, 8), mGpRegVals[reg->regId].r64());
          } else {
-            decaf_abort(fmt::format("Unexpected register type {}", static_cast<int>(reg->regType)));
+            decaf_abort(fmt::format("Unexpected register size {}", reg->size));
          }
+      } else if (reg->regType == RegType::Xmm) {
+         decaf_check(reg->size == 16);
+
+         movapd(asmjit::X86Mem(stateReg, reg->content, 16), mXmmRegVals[reg->regId]);
+      } else {
+         decaf_abort(fmt::format("Unexpected register type {}", static_cast<int>(reg->regType)));
+      }
+
+      mCoreStores++;
+   }
+
+   void saveOne(HostRegister *reg)
+   {
+      decaf_check(reg->useCount == 0);
+      decaf_check(reg->content != 0xFFFFFFFF);
+
+      if (reg->written) {
+         decaf_check(reg->loaded);
+         storeOne(reg);
       }
    }
 
@@ -684,10 +887,54 @@ public:
       }
    }
 
+   /**
+    * Write back everything before leaving the block, except the chained
+    * registers which are passed on to the next block in their host register
+    * instead.  This does not change the cache state, so may be used on a
+    * side exit.
+    */
+   void saveAllForExit()
+   {
+      for (auto i = 0; i < mRegs.size(); ++i) {
+         auto &reg = mRegs[i];
+
+         if (reg.pinned) {
+            if (!reg.loaded) {
+               loadOne(&reg);
+            }
+         } else if (reg.content != 0xFFFFFFFF) {
+            saveOne(&reg);
+         }
+      }
+   }
+
+   /**
+    * Reload every cached register from Core after calling C++ code which may
+    * have changed the guest state, the caller must saveAll before the call.
+    * This does not change the cache state, so may be used on a side path.
+    */
+   void reloadAll()
+   {
+      for (auto i = 0; i < mRegs.size(); ++i) {
+         auto &reg = mRegs[i];
+
+         if (reg.content != 0xFFFFFFFF && reg.loaded) {
+            loadOne(&reg);
+         }
+      }
+   }
+
    void evictOne(HostRegister *reg)
    {
       saveOne(reg);
 
+      if (reg->pinned) {
+         // Core now has the current value, reload it when next used
+         reg->loaded = false;
+         reg->written = false;
+         return;
+      }
+
       reg->content = 0xFFFFFFFF;
       reg->size = 0;
       reg->loaded = false;
@@ -726,6 +973,8 @@ struct JitBlock
       start = _start;
       end = _start;
       entry = nullptr;
+      code = nullptr;
+      codeSize = 0;
    }
 
    uint32_t start;
@@ -733,8 +982,36 @@ struct JitBlock
 
    JitCode entry;
    std::vector<std::pair<uint32_t, JitCode>> targets;
+
+   // Host memory allocated for this block
+   JitCode code;
+   size_t codeSize;
+
+   // Patchable jump slots for each direct branch out of the block
+   std::vector<std::pair<uint32_t, JitCode *>> relocs;
+
+   // Flags live after each instruction, empty if the pass was not run
+   std::vector<uint32_t> liveFlags;
+
+   // Registers accessed by each instruction, empty if the pass was not run
+   std::vector<RegisterUses> registerUses;
 };
 
+void
+calculateFlagLiveness(JitBlock &block);
+
+uint32_t
+getDeadCrMask(uint32_t liveFlags);
+
+uint32_t
+getDeadXerMask(uint32_t liveFlags);
+
+RegisterUses
+getRegisterUses(espresso::Instruction instr);
+
+void
+calculateRegisterUses(JitBlock &block);
+
 } // namespace jit
 
 } // namespace cpu
@@ -1,8 +1,13 @@
 #include "jit_insreg.h"
 #include <common/bitutils.h>
 #include <common/decaf_assert.h>
+#include <common/platform.h>
 #include <algorithm>
 
+#ifdef PLATFORM_WINDOWS
+#include <intrin.h>
+#endif
+
 using espresso::XERegisterBits;
 using espresso::ConditionRegisterFlag;
 
@@ -12,6 +17,100 @@ namespace cpu
 namespace jit
 {
 
+// Set at startup when the host can load and store big-endian values with movbe
+static bool
+sHostHasMovbe = false;
+
+static bool
+hostHasMovbe()
+{
+#ifdef PLATFORM_WINDOWS
+   int cpuInfo[4];
+   __cpuid(cpuInfo, 1);
+   return (cpuInfo[2] & (1 << 22)) != 0;
+#else
+   uint32_t eax, ecx;
+   __asm__("cpuid" : "=a" (eax), "=c" (ecx) : "0" (1) : "rbx", "rdx");
+   return (ecx & (1 << 22)) != 0;
+#endif
+}
+
+/**
+ * Calculate the effective address rA|0 + disp or rA|0 + rB into ea.
+ *
+ * The address is computed in 32 bits with lea so that it wraps like it does
+ * on the guest, the add of membaseReg is then folded into the memory operand
+ * by guestMemory.
+ */
+static void
+calculateEA(PPCEmuAssembler& a,
+            Instruction instr,
+            int32_t disp,
+            bool zeroRA,
+            bool indexed,
+            const PPCEmuAssembler::GpRegister& ea)
+{
+   if (zeroRA && instr.rA == 0) {
+      if (indexed) {
+         a.mov(ea.r32(), a.loadRegisterRead(a.gpr[instr.rB]));
+      } else {
+         a.mov(ea.r32(), disp);
+      }
+   } else if (indexed) {
+      auto ra = a.loadRegisterRead(a.gpr[instr.rA]);
+      auto rb = a.loadRegisterRead(a.gpr[instr.rB]);
+      a.lea(ea.r32(), asmjit::X86Mem(ra.r64(), rb.r64(), 0, 0));
+   } else if (disp != 0) {
+      auto ra = a.loadRegisterRead(a.gpr[instr.rA]);
+      a.lea(ea.r32(), asmjit::X86Mem(ra.r64(), disp));
+   } else {
+      a.mov(ea.r32(), a.loadRegisterRead(a.gpr[instr.rA]));
+   }
+}
+
+// [membase + ea + offset]
+static asmjit::X86Mem
+guestMemory(PPCEmuAssembler& a,
+            const PPCEmuAssembler::GpRegister& ea,
+            int32_t offset,
+            uint32_t size)
+{
+   return asmjit::X86Mem(a.membaseReg, ea.r64(), 0, offset, size);
+}
+
+// Load a 32 or 64 bit big-endian value
+static void
+loadSwapped(PPCEmuAssembler& a,
+            const asmjit::X86GpReg& reg,
+            const asmjit::X86Mem& mem)
+{
+   if (sHostHasMovbe) {
+      a.movbe(reg, mem);
+   } else {
+      a.mov(reg, mem);
+      a.bswap(reg);
+   }
+}
+
+// Store a 16, 32 or 64 bit value as big-endian, reg is clobbered without movbe
+static void
+storeSwapped(PPCEmuAssembler& a,
+             const asmjit::X86Mem& mem,
+             const asmjit::X86GpReg& reg)
+{
+   if (sHostHasMovbe) {
+      a.movbe(mem, reg);
+   } else {
+      if (reg.getSize() == 2) {
+         a.rol(reg, 8);
+      } else {
+         a.bswap(reg);
+      }
+
+      a.mov(mem, reg);
+   }
+}
+
 // Load
 enum LoadFlags
 {
@@ -29,93 +128,75 @@ loadGeneric(PPCEmuAssembler& a, Instruction instr)
 {
    static_assert(sizeof(Type) == 1 || sizeof(Type) == 2 || sizeof(Type) == 4 || sizeof(Type) == 8, "Unexpected type size");
 
-   auto src = a.allocGpTmp().r32();
+   auto ea = a.allocGpTmp();
+   calculateEA(a, instr, sign_extend<16, int32_t>(instr.d), !!(flags & LoadZeroRA), !!(flags & LoadIndexed), ea);
 
-   if ((flags & LoadZeroRA) && instr.rA == 0) {
-      a.mov(src, 0);
-   } else {
-      a.mov(src, a.loadRegisterRead(a.gpr[instr.rA]));
-   }
+   auto mem = guestMemory(a, ea, 0, sizeof(Type));
+   auto swap = !(flags & LoadByteReverse);
 
-   if (flags & LoadIndexed) {
-      a.add(src, a.loadRegisterRead(a.gpr[instr.rB]));
-   } else {
-      auto x = sign_extend<16, int32_t>(instr.d);
-      if (x != 0) {
-         a.add(src, x);
-      }
-   }
-
-   auto data = a.allocGpTmp().r64();
-
-   {
-      auto hostSrc = a.allocGpTmp().r64();
-      a.mov(hostSrc, src);
-      a.add(hostSrc, a.membaseReg);
+   if (std::is_floating_point<Type>::value) {
+      auto data = a.allocGpTmp();
+      auto tmp = a.allocXmmTmp();
+      auto dst = a.loadXmmRegisterReadWrite(a.fprps[instr.rD]);
 
-      if (sizeof(Type) == 1) {
-         a.mov(data, 0);
-         a.mov(data.r8(), asmjit::X86Mem(hostSrc, 0));
-      } else if (sizeof(Type) == 2) {
-         a.mov(data, 0);
-         a.mov(data.r16(), asmjit::X86Mem(hostSrc, 0));
-      } else if (sizeof(Type) == 4) {
-         a.mov(data.r32(), asmjit::X86Mem(hostSrc, 0));
-      } else if (sizeof(Type) == 8) {
-         a.mov(data, asmjit::X86Mem(hostSrc, 0));
+      if (sizeof(Type) == 4) {
+         loadSwapped(a, data.r32(), mem);
+         a.movq(tmp, data.r64());
+         a.cvtss2sd(dst, tmp);
+         a.movddup(dst, dst);  // Copy to ps1 as well
+      } else {
+         decaf_check(sizeof(Type) == 8);
+         loadSwapped(a, data.r64(), mem);
+         a.movq(tmp, data.r64());
+         a.movsd(dst, tmp);
       }
-   }
-
-   if (flags & LoadReserve) {
+   } else if (flags & LoadReserve) {
       static_assert(!(flags & LoadReserve) || sizeof(Type) == 4, "Reserved reads are only valid on 32-bit values");
 
+      // The reservation holds the value as it is in memory, stwcx compares
+      //  it against memory before swapping
+      auto data = a.allocGpTmp();
+      a.mov(data.r32(), mem);
+
       auto ppcreserve = a.loadRegisterWrite(a.reserve);
-      a.mov(ppcreserve, src);
+      a.mov(ppcreserve, ea.r64());
       a.shl(ppcreserve, 32);
-      a.or_(ppcreserve, data);
-   }
+      a.or_(ppcreserve, data.r64());
+
+      auto dst = a.loadGpRegisterWrite(a.gpr[instr.rD]);
+      a.bswap(data.r32());
+      a.mov(dst, data.r32());
+   } else {
+      auto dst = a.loadGpRegisterWrite(a.gpr[instr.rD]);
 
-   if (!(flags & LoadByteReverse)) {
       if (sizeof(Type) == 1) {
-         // No need to byte-swap 1 byte
+         a.movzx(dst, mem);
       } else if (sizeof(Type) == 2) {
-         a.shl(data, 8);
-         a.bswap(data.r32());
-         a.shr(data, 8);
-      } else if (sizeof(Type) == 4) {
-         a.bswap(data.r32());
-      } else if (sizeof(Type) == 8) {
-         a.bswap(data);
-      }
-   }
+         if (swap && sHostHasMovbe) {
+            a.movbe(dst.r16(), mem);
+         } else {
+            a.movzx(dst, mem);
+
+            if (swap) {
+               a.rol(dst.r16(), 8);
+            }
+         }
 
-   if (std::is_floating_point<Type>::value) {
-      if (sizeof(Type) == 4) {
-         auto tmp = a.allocXmmTmp();
-         auto dst = a.loadXmmRegisterReadWrite(a.fprps[instr.rD]);
-         a.movq(tmp, data);
-         a.cvtss2sd(dst, tmp);
-         a.movddup(dst, dst);  // Copy to ps1 as well
+         if (flags & LoadSignExtend) {
+            a.movsx(dst, dst.r16());
+         } else if (swap && sHostHasMovbe) {
+            a.movzx(dst, dst.r16());
+         }
+      } else if (swap) {
+         loadSwapped(a, dst, mem);
       } else {
-         decaf_check(sizeof(Type) == 8);
-         auto tmpData = a.allocXmmTmp();
-         auto dst = a.loadXmmRegisterReadWrite(a.fprps[instr.rD]);
-         a.movq(tmpData, data);
-         a.movsd(dst, tmpData);
+         a.mov(dst, mem);
       }
-   } else {
-      if (flags & LoadSignExtend) {
-         decaf_check(sizeof(Type) == 2);
-         a.movsx(data.r32(), data.r16());
-      }
-
-      auto dst = a.loadGpRegisterWrite(a.gpr[instr.rD]);
-      a.mov(dst, data);
    }
 
    if (flags & LoadUpdate) {
       auto addrDst = a.loadRegisterWrite(a.gpr[instr.rA]);
-      a.mov(addrDst, src);
+      a.mov(addrDst, ea.r32());
    }
 
    return true;
@@ -288,25 +369,22 @@ lfdx(PPCEmuAssembler& a, Instruction instr)
 static bool
 lmw(PPCEmuAssembler& a, Instruction instr)
 {
-   auto o = sign_extend<16, int32_t>(instr.d);
+   auto ea = a.allocGpTmp();
+   auto data = a.allocGpTmp();
+   calculateEA(a, instr, sign_extend<16, int32_t>(instr.d), true, false, ea);
 
-   auto src = a.allocGpTmp().r64();
+   for (int r = instr.rD, d = 0; r <= 31; ++r, d += 4) {
+      auto mem = guestMemory(a, ea, d, 4);
 
-   if (instr.rA) {
-      a.mov(src, a.loadRegisterRead(a.gpr[instr.rA]));
-      if (o != 0) {
-         a.add(src, o);
+      if (a.findReg(a.gpr[r])) {
+         auto dst = a.loadRegisterWrite(a.gpr[r]);
+         loadSwapped(a, dst, mem);
+      } else {
+         // Write registers which are not cached straight to the core state
+         //  rather than evicting cached ones to make room for them
+         loadSwapped(a, data.r32(), mem);
+         a.mov(asmjit::X86Mem(a.stateReg, a.gpr[r].offset, 4), data.r32());
       }
-   } else {
-      a.mov(src, o);
-   }
-
-   a.add(src, a.membaseReg);
-
-   for (int r = instr.rD, d = 0; r <= 31; ++r, d += 4) {
-      auto dst = a.loadRegisterWrite(a.gpr[r]);
-      a.mov(dst, asmjit::X86Mem(src, d));
-      a.bswap(dst);
    }
 
    return true;
@@ -348,130 +426,118 @@ enum StoreFlags
    StoreFloatAsInteger = 1 << 5, // stfiwx
 };
 
-template<typename Type, unsigned flags = 0>
+// Store Word Conditional, only writes if the reservation made by lwarx is
+//  still held and memory has not changed since
 static bool
-storeGeneric(PPCEmuAssembler& a, Instruction instr)
+storeConditional(PPCEmuAssembler& a, Instruction instr)
 {
-   static_assert(sizeof(Type) == 1 || sizeof(Type) == 2 || sizeof(Type) == 4 || sizeof(Type) == 8, "Unexpected type size");
-
    auto eaxLockout = a.lockRegister(asmjit::x86::rax);
 
-   auto dst = a.allocGpTmp().r32();
-   auto x = sign_extend<16, int32_t>(instr.d);
+   auto ea = a.allocGpTmp();
+   calculateEA(a, instr, 0, true, true, ea);
 
-   if ((flags & StoreZeroRA) && instr.rA == 0) {
-      if (flags & StoreIndexed) {
-         a.mov(dst, a.loadRegisterRead(a.gpr[instr.rB]));
-      } else {
-         a.mov(dst, x);
-      }
-   } else {
-      a.mov(dst, a.loadRegisterRead(a.gpr[instr.rA]));
+   auto data = a.allocGpTmp();
+   a.mov(data.r32(), a.loadRegisterRead(a.gpr[instr.rS]));
+   a.bswap(data.r32());
 
-      if (flags & StoreIndexed) {
-         a.add(dst, a.loadRegisterRead(a.gpr[instr.rB]));
-      } else {
+   auto failedWriteLbl = a.newLabel();
 
-         if (x != 0) {
-            a.add(dst, x);
-         }
-      }
+   constexpr uint32_t crId = 0;
+   constexpr uint32_t crshift = (7 - crId) * 4;
+   constexpr uint32_t crmask = ~(0xF << crshift);
+
+   auto ppccr = a.loadRegisterReadWrite(a.cr);
+
+   {
+      // clear cr0, but update summary overflow
+      auto ppcxer = a.loadRegisterRead(a.xer);
+      auto tmp = a.allocGpTmp().r32();
+      a.mov(tmp, ppcxer);
+      a.and_(tmp, XERegisterBits::StickyOV);
+      a.shr(tmp, XERegisterBits::StickyOVShift);
+      a.shl(tmp, ConditionRegisterFlag::SummaryOverflowShift + crshift);
+      a.and_(ppccr, crmask);
+      a.or_(ppccr, tmp);
    }
 
-   auto data = a.allocGpTmp().r64();
+   auto ppcreserve = a.loadRegisterReadWrite(a.reserve);
 
-   if (flags & StoreFloatAsInteger) {
-      decaf_check(sizeof(Type) == 4);
-      a.movd(data.r32(), a.loadRegisterRead(a.fprps[instr.rS]));
-   } else if (std::is_floating_point<Type>::value) {
-      if (sizeof(Type) == 4) {
+   a.mov(asmjit::x86::eax, ppcreserve.r32());
+   a.shr(ppcreserve, 32);
+
+   a.cmp(ea.r32(), ppcreserve.r32());
+   a.mov(ppcreserve, 0xffffffffffffffff);
+   a.jne(failedWriteLbl);
+
+   a.lock().cmpxchg(guestMemory(a, ea, 0, 4), data.r32());
+   a.jne(failedWriteLbl);
+
+   a.or_(ppccr, ConditionRegisterFlag::Equal << crshift);
+
+   a.bind(failedWriteLbl);
+
+   return true;
+}
+
+template<typename Type, unsigned flags = 0>
+static bool
+storeGeneric(PPCEmuAssembler& a, Instruction instr)
+{
+   static_assert(sizeof(Type) == 1 || sizeof(Type) == 2 || sizeof(Type) == 4 || sizeof(Type) == 8, "Unexpected type size");
+   static_assert(!(flags & StoreConditional) || sizeof(Type) == 4, "Reserved writes are only valid on 32-bit values");
+
+   if (flags & StoreConditional) {
+      return storeConditional(a, instr);
+   }
+
+   auto ea = a.allocGpTmp();
+   calculateEA(a, instr, sign_extend<16, int32_t>(instr.d), !!(flags & StoreZeroRA), !!(flags & StoreIndexed), ea);
+
+   auto mem = guestMemory(a, ea, 0, sizeof(Type));
+   auto swap = !(flags & StoreByteReverse);
+
+   if ((flags & StoreFloatAsInteger) || std::is_floating_point<Type>::value) {
+      auto data = a.allocGpTmp();
+
+      if (flags & StoreFloatAsInteger) {
+         decaf_check(sizeof(Type) == 4);
+         a.movd(data.r32(), a.loadRegisterRead(a.fprps[instr.rS]));
+      } else if (sizeof(Type) == 4) {
          auto tmp = a.allocXmmTmp();
          a.cvtsd2ss(tmp, a.loadRegisterRead(a.fprps[instr.rS]));
          a.movd(data.r32(), tmp);
       } else {
          decaf_check(sizeof(Type) == 8);
-         a.movq(data, a.loadRegisterRead(a.fprps[instr.rS]));
+         a.movq(data.r64(), a.loadRegisterRead(a.fprps[instr.rS]));
       }
-   } else {
-      a.mov(data.r32(), a.loadRegisterRead(a.gpr[instr.rS]));
-   }
 
-   if (!(flags & StoreByteReverse)) {
-      if (sizeof(Type) == 1) {
-         // Inverted reverse logic means we have
-         //    to check for this but do nothing.
-      } else if (sizeof(Type) == 2) {
-         a.shl(data, 8);
-         a.bswap(data.r32());
-         a.shr(data, 8);
-      } else if (sizeof(Type) == 4) {
-         a.bswap(data.r32());
-      } else if (sizeof(Type) == 8) {
-         a.bswap(data);
+      if (sizeof(Type) == 4) {
+         storeSwapped(a, mem, data.r32());
+      } else {
+         storeSwapped(a, mem, data.r64());
       }
-   }
-
-   auto failedWriteLbl = a.newLabel();
-
-   {
-      auto hostDst = a.allocGpTmp().r64();
-      a.mov(hostDst, dst);
-      a.add(hostDst, a.membaseReg);
-
-      if (flags & StoreConditional) {
-         static_assert(!(flags & StoreConditional) || sizeof(Type) == 4, "Reserved writes are only valid on 32-bit values");
-
-         constexpr uint32_t crId = 0;
-         constexpr uint32_t crshift = (7 - crId) * 4;
-         constexpr uint32_t crmask = ~(0xF << crshift);
-
-         auto ppccr = a.loadRegisterReadWrite(a.cr);
-
-         {
-            // clear cr0, but update summary overflow
-            auto ppcxer = a.loadRegisterRead(a.xer);
-            auto tmp = a.allocGpTmp().r32();
-            a.mov(tmp, ppcxer);
-            a.and_(tmp, XERegisterBits::StickyOV);
-            a.shr(tmp, XERegisterBits::StickyOVShift);
-            a.shl(tmp, ConditionRegisterFlag::SummaryOverflowShift + crshift);
-            a.and_(ppccr, crmask);
-            a.or_(ppccr, tmp);
-         }
-
-         auto ppcreserve = a.loadRegisterReadWrite(a.reserve);
-
-         a.mov(asmjit::x86::eax, ppcreserve.r32());
-         a.shr(ppcreserve, 32);
-
-         a.cmp(dst, ppcreserve);
-         a.mov(ppcreserve, 0xffffffffffffffff);
-         a.jne(failedWriteLbl);
-
-         a.lock().cmpxchg(asmjit::X86Mem(hostDst, 0), data.r32());
-         a.jne(failedWriteLbl);
+   } else {
+      auto src = a.loadRegisterRead(a.gpr[instr.rS]);
 
-         a.or_(ppccr, ConditionRegisterFlag::Equal << crshift);
+      if (sizeof(Type) == 1) {
+         a.mov(mem, src.r8());
+      } else if (!swap) {
+         a.mov(mem, sizeof(Type) == 2 ? src.r16() : src);
+      } else if (sHostHasMovbe) {
+         a.movbe(mem, sizeof(Type) == 2 ? src.r16() : src);
       } else {
-         if (sizeof(Type) == 1) {
-            a.mov(asmjit::X86Mem(hostDst, 0), data.r8());
-         } else if (sizeof(Type) == 2) {
-            a.mov(asmjit::X86Mem(hostDst, 0), data.r16());
-         } else if (sizeof(Type) == 4) {
-            a.mov(asmjit::X86Mem(hostDst, 0), data.r32());
-         } else if (sizeof(Type) == 8) {
-            a.mov(asmjit::X86Mem(hostDst, 0), data);
-         }
+         // The guest register must not be swapped in place
+         auto data = a.allocGpTmp();
+         a.mov(data.r32(), src);
+         storeSwapped(a, mem, sizeof(Type) == 2 ? data.r16() : data.r32());
       }
    }
 
    if (flags & StoreUpdate) {
       auto addrDst = a.loadRegisterWrite(a.gpr[instr.rA]);
-      a.mov(addrDst, dst);
+      a.mov(addrDst, ea.r32());
    }
 
-   a.bind(failedWriteLbl);
-
    return true;
 }
 
@@ -624,26 +690,27 @@ stfiwx(PPCEmuAssembler& a, Instruction instr)
 static bool
 stmw(PPCEmuAssembler& a, Instruction instr)
 {
-   auto o = sign_extend<16, int32_t>(instr.d);
+   auto ea = a.allocGpTmp();
+   auto data = a.allocGpTmp();
+   calculateEA(a, instr, sign_extend<16, int32_t>(instr.d), true, false, ea);
 
-   auto dst = a.allocGpTmp().r64();
+   for (int r = instr.rS, d = 0; r <= 31; ++r, d += 4) {
+      auto mem = guestMemory(a, ea, d, 4);
+      auto cached = a.findReg(a.gpr[r]);
 
-   if (instr.rA) {
-      a.mov(dst, a.loadRegisterRead(a.gpr[instr.rA]));
-      if (o != 0) {
-         a.add(dst, o);
+      if (cached && cached->loaded && sHostHasMovbe) {
+         a.movbe(mem, a.loadRegisterRead(a.gpr[r]));
+         continue;
       }
-   } else {
-      a.mov(dst, o);
-   }
 
-   a.add(dst, a.membaseReg);
+      if (cached && cached->loaded) {
+         a.mov(data.r32(), a.loadRegisterRead(a.gpr[r]));
+      } else {
+         // Read registers which are not cached straight from the core state
+         a.mov(data.r32(), asmjit::X86Mem(a.stateReg, a.gpr[r].offset, 4));
+      }
 
-   auto src = a.allocGpTmp().r32();
-   for (int r = instr.rS, d = 0; r <= 31; ++r, d += 4) {
-      a.mov(src, a.loadRegisterRead(a.gpr[r]));
-      a.bswap(src);
-      a.mov(asmjit::X86Mem(dst, d), src);
+      storeSwapped(a, mem, data.r32());
    }
 
    return true;
@@ -682,11 +749,64 @@ enum PsqLoadFlags
    PsqLoadIndexed = 1 << 2,
 };
 
+/**
+ * Paired single loads are inlined when GQR[i] selects the floating point
+ * type and handed to the interpreter for the quantized integer types.
+ *
+ * The type is only known at run time, so the register cache is flushed
+ * before the check and at the end of the inline path so both paths join
+ * with the same (empty) cache.
+ */
 template<unsigned flags = 0>
 static bool
 psqLoad(PPCEmuAssembler& a, Instruction instr)
 {
-   return jit_fallback(a, instr);
+   auto i = (flags & PsqLoadIndexed) ? instr.qi : instr.i;
+   auto w = (flags & PsqLoadIndexed) ? instr.qw : instr.w;
+   auto quantizedLbl = a.newLabel();
+   auto doneLbl = a.newLabel();
+
+   a.evictAll();
+   a.test(asmjit::X86Mem(a.stateReg, a.gqr[i].offset, 4), 0x7 << 16);
+   a.jnz(quantizedLbl);
+
+   {
+      auto ea = a.allocGpTmp();
+      auto data = a.allocGpTmp();
+      auto tmp = a.allocXmmTmp();
+      auto disp = (flags & PsqLoadIndexed) ? 0 : sign_extend<12, int32_t>(instr.qd);
+      calculateEA(a, instr, disp, !!(flags & PsqLoadZeroRA), !!(flags & PsqLoadIndexed), ea);
+
+      auto dst = a.loadXmmRegisterWrite(a.fprps[instr.frD]);
+
+      if (w == 0) {
+         // After the swap ps0 is in the high half, cvtps2pd wants it low
+         loadSwapped(a, data.r64(), guestMemory(a, ea, 0, 8));
+         a.rol(data.r64(), 32);
+         a.movq(tmp, data.r64());
+         a.cvtps2pd(dst, tmp);
+      } else {
+         loadSwapped(a, data.r32(), guestMemory(a, ea, 0, 4));
+         a.movq(tmp, data.r64());
+         a.cvtss2sd(dst, tmp);
+         a.mov(data.r64(), UINT64_C(0x3FF0000000000000));  // ps1 = 1.0
+         a.movq(tmp, data.r64());
+         a.unpcklpd(dst, tmp);
+      }
+
+      if (flags & PsqLoadUpdate) {
+         auto addrDst = a.loadRegisterWrite(a.gpr[instr.rA]);
+         a.mov(addrDst, ea.r32());
+      }
+   }
+
+   a.evictAll();
+   a.jmp(doneLbl);
+
+   a.bind(quantizedLbl);
+   jit_fallback(a, instr);
+   a.bind(doneLbl);
+   return true;
 }
 
 static bool
@@ -721,11 +841,54 @@ enum PsqStoreFlags
    PsqStoreIndexed = 1 << 2,
 };
 
+// Inlined for the floating point type only, the same as psqLoad
 template<unsigned flags = 0>
 static bool
 psqStore(PPCEmuAssembler& a, Instruction instr)
 {
-   return jit_fallback(a, instr);
+   auto i = (flags & PsqStoreIndexed) ? instr.qi : instr.i;
+   auto w = (flags & PsqStoreIndexed) ? instr.qw : instr.w;
+   auto quantizedLbl = a.newLabel();
+   auto doneLbl = a.newLabel();
+
+   a.evictAll();
+   a.test(asmjit::X86Mem(a.stateReg, a.gqr[i].offset, 4), 0x7);
+   a.jnz(quantizedLbl);
+
+   {
+      auto ea = a.allocGpTmp();
+      auto data = a.allocGpTmp();
+      auto tmp = a.allocXmmTmp();
+      auto disp = (flags & PsqStoreIndexed) ? 0 : sign_extend<12, int32_t>(instr.qd);
+      calculateEA(a, instr, disp, !!(flags & PsqStoreZeroRA), !!(flags & PsqStoreIndexed), ea);
+
+      auto src = a.loadXmmRegisterRead(a.fprps[instr.frS]);
+
+      if (w == 0) {
+         // Put ps0 in the high half so the swap stores it first
+         a.cvtpd2ps(tmp, src);
+         a.movq(data.r64(), tmp);
+         a.rol(data.r64(), 32);
+         storeSwapped(a, guestMemory(a, ea, 0, 8), data.r64());
+      } else {
+         a.cvtsd2ss(tmp, src);
+         a.movd(data.r32(), tmp);
+         storeSwapped(a, guestMemory(a, ea, 0, 4), data.r32());
+      }
+
+      if (flags & PsqStoreUpdate) {
+         auto addrDst = a.loadRegisterWrite(a.gpr[instr.rA]);
+         a.mov(addrDst, ea.r32());
+      }
+   }
+
+   a.evictAll();
+   a.jmp(doneLbl);
+
+   a.bind(quantizedLbl);
+   jit_fallback(a, instr);
+   a.bind(doneLbl);
+   return true;
 }
 
 static bool
@@ -737,7 +900,7 @@ psq_st(PPCEmuAssembler& a, Instruction instr)
 static bool
 psq_stu(PPCEmuAssembler& a, Instruction instr)
 {
-   return psqStore<PsqLoadUpdate>(a, instr);
+   return psqStore<PsqStoreUpdate>(a, instr);
 }
 
 static bool
@@ -755,6 +918,8 @@ psq_stux(PPCEmuAssembler& a, Instruction instr)
 void
 registerLoadStoreInstructions()
 {
+   sHostHasMovbe = hostHasMovbe();
+
    RegisterInstruction(lbz);
    RegisterInstruction(lbzu);
    RegisterInstruction(lbzx);
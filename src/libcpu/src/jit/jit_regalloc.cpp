@@ -0,0 +1,128 @@
+#include "espresso/espresso_instructionset.h"
+#include "jit_internal.h"
+#include "mem.h"
+
+using espresso::InstructionField;
+using espresso::InstructionID;
+
+namespace cpu
+{
+
+namespace jit
+{
+
+/*
+Register use analysis.
+
+The register cache used to evict the least recently used host register when
+it ran out, and threw everything away at every fallback.  Instead we record
+which guest GPRs and FPRs every instruction in the block reads and writes,
+this lets the allocator evict the value which is needed furthest in the
+future (or never again, when it is overwritten before it is read), and lets
+jit_fallback keep values cached across calls to the interpreter which do not
+touch them.
+
+Instructions which access a range of registers, or run C++ code which could
+look at any of them, are treated as reading and writing everything.
+*/
+
+static void
+addField(RegisterUses &uses,
+         espresso::Instruction instr,
+         InstructionField field,
+         bool write)
+{
+   auto &gprs = write ? uses.gprWrite : uses.gprRead;
+   auto &fprs = write ? uses.fprWrite : uses.fprRead;
+
+   switch (field) {
+   case InstructionField::rA:
+      gprs |= 1u << instr.rA;
+      break;
+   case InstructionField::rB:
+      gprs |= 1u << instr.rB;
+      break;
+   case InstructionField::rD:
+      gprs |= 1u << instr.rD;
+      break;
+   case InstructionField::rS:
+      gprs |= 1u << instr.rS;
+      break;
+   case InstructionField::frA:
+      fprs |= 1u << instr.frA;
+      break;
+   case InstructionField::frB:
+      fprs |= 1u << instr.frB;
+      break;
+   case InstructionField::frC:
+      fprs |= 1u << instr.frC;
+      break;
+   case InstructionField::frD:
+      fprs |= 1u << instr.frD;
+      break;
+   case InstructionField::frS:
+      fprs |= 1u << instr.frS;
+      break;
+   default:
+      break;
+   }
+}
+
+RegisterUses
+getRegisterUses(espresso::Instruction instr)
+{
+   auto data = espresso::decodeInstruction(instr);
+   RegisterUses uses;
+
+   if (data) {
+      switch (data->id) {
+      case InstructionID::kc:
+      case InstructionID::sc:
+      case InstructionID::tw:
+      case InstructionID::twi:
+      case InstructionID::rfi:
+      case InstructionID::lmw:
+      case InstructionID::stmw:
+      case InstructionID::lswi:
+      case InstructionID::lswx:
+      case InstructionID::stswi:
+      case InstructionID::stswx:
+         data = nullptr;
+         break;
+      default:
+         break;
+      }
+   }
+
+   if (!data) {
+      uses.gprRead = uses.gprWrite = 0xFFFFFFFF;
+      uses.fprRead = uses.fprWrite = 0xFFFFFFFF;
+      return uses;
+   }
+
+   for (auto field : data->read) {
+      addField(uses, instr, field, false);
+   }
+
+   for (auto field : data->write) {
+      addField(uses, instr, field, true);
+   }
+
+   return uses;
+}
+
+void
+calculateRegisterUses(JitBlock &block)
+{
+   auto numInstrs = (block.end - block.start) / 4;
+   block.registerUses.resize(numInstrs);
+
+   for (auto i = 0u; i < numInstrs; ++i) {
+      auto instr = mem::read<espresso::Instruction>(block.start + i * 4);
+      block.registerUses[i] = getRegisterUses(instr);
+   }
+}
+
+} // namespace jit
+
+} // namespace cpu
@@ -1,8 +1,10 @@
+#include <common/align.h>
 #include <common/decaf_assert.h>
 #include <common/bitutils.h>
 #include <common/log.h>
 #include "cpu_internal.h"
 #include "espresso/espresso_spr.h"
+#include "jit.h"
 #include "jit_insreg.h"
 
 using espresso::SPR;
@@ -13,10 +15,32 @@ namespace cpu
 namespace jit
 {
 
+static void
+icbi_stub(uint32_t addr)
+{
+   cpu::invalidateInstructionCache(align_down(addr, 32), 32);
+}
+
 // Instruction Cache Block Invalidate
 static bool
 icbi(PPCEmuAssembler& a, Instruction instr)
 {
+   // Evict all stored registers as we are calling into C++ code, this
+   //  also guarentees that nothing below is written back over our arg.
+   a.evictAll();
+
+   auto addr = a.allocGpTmp().r32();
+
+   if (instr.rA == 0) {
+      a.mov(addr, 0);
+   } else {
+      a.mov(addr, a.loadRegisterRead(a.gpr[instr.rA]));
+   }
+
+   a.add(addr, a.loadRegisterRead(a.gpr[instr.rB]));
+   a.mov(a.sysArgReg[0].r32(), addr);
+   a.evictAll();
+   a.call(asmjit::Ptr(&icbi_stub));
    return true;
 }
 
@@ -213,8 +237,11 @@ mtspr(PPCEmuAssembler& a, Instruction instr)
 static Core *
 kc_stub(cpu::KernelCallFunction func, void *userData)
 {
+   // The KC may switch fibers, keep the calling block alive until we return
+   auto epoch = pinEpoch();
    auto core = cpu::this_core::state();
    func(core, userData);
+   unpinEpoch(epoch);
    // We grab new core since it may have changed while executing!
    return cpu::this_core::state();
 }
@@ -247,6 +274,7 @@ kc(PPCEmuAssembler& a, Instruction instr)
    a.cmp(a.niaMem, a.genCia + 4);
    a.je(niaUnchangedLbl);
 
+   a.saveAllForExit();
    a.mov(a.finaleNiaArgReg, a.niaMem);
    a.mov(a.finaleJmpSrcArgReg, 0);
    a.jmp(asmjit::Ptr(gFinaleFn));
@@ -24,11 +24,18 @@ memoryLock;
 void
 insertVerifyCall(PPCEmuAssembler &a,
                  uint32_t instr,
-                 void *verifyWrapper)
+                 void *verifyWrapper,
+                 uint32_t ignoreCrMask,
+                 uint32_t ignoreXerMask)
 {
+   auto crMaskOffset = static_cast<int32_t>(40 + offsetof2(VerifyBuffer, ignoreCrMask));
+   auto xerMaskOffset = static_cast<int32_t>(40 + offsetof2(VerifyBuffer, ignoreXerMask));
+
    a.saveAll();
    a.mov(asmjit::X86Mem(asmjit::x86::rsp, 32, 4), a.genCia);
    a.mov(asmjit::X86Mem(asmjit::x86::rsp, 36, 4), instr);
+   a.mov(asmjit::X86Mem(asmjit::x86::rsp, crMaskOffset, 4), ignoreCrMask);
+   a.mov(asmjit::X86Mem(asmjit::x86::rsp, xerMaskOffset, 4), ignoreXerMask);
    a.call(asmjit::Ptr(verifyWrapper));
 }
 
@@ -106,6 +113,22 @@ isMemoryInstruction(uint32_t instr)
 ;
 }
 
+// Bytes per element stored by psq_st for a GQR store type
+static uint32_t
+getQuantizedSize(espresso::QuantizedDataType type)
+{
+   switch (type) {
+   case espresso::QuantizedDataType::Unsigned8:
+   case espresso::QuantizedDataType::Signed8:
+      return 1;
+   case espresso::QuantizedDataType::Unsigned16:
+   case espresso::QuantizedDataType::Signed16:
+      return 2;
+   default:
+      return 4;
+   }
+}
+
 static void
 lookupMemoryTarget(VerifyBuffer *verifyBuf,
                    espresso::Instruction instr)
@@ -175,9 +198,19 @@ lookupMemoryTarget(VerifyBuffer *verifyBuf,
 
    case espresso::InstructionID::psq_st:
    case espresso::InstructionID::psq_stu:
+   {
+      auto type = static_cast<espresso::QuantizedDataType>(coreRegs->gqr[instr.i].st_type);
+      verifyBuf->memorySize = getQuantizedSize(type) * (instr.w ? 1 : 2);
+      break;
+   }
+
    case espresso::InstructionID::psq_stx:
    case espresso::InstructionID::psq_stux:
-      // TODO (fall through to default for now)
+   {
+      auto type = static_cast<espresso::QuantizedDataType>(coreRegs->gqr[instr.qi].st_type);
+      verifyBuf->memorySize = getQuantizedSize(type) * (instr.qw ? 1 : 2);
+      break;
+   }
 
    default:
       verifyBuf->memorySize = 0;
@@ -248,9 +281,23 @@ lookupMemoryTarget(VerifyBuffer *verifyBuf,
 
    case espresso::InstructionID::psq_st:
    case espresso::InstructionID::psq_stu:
+      if (instr.rA == 0) {
+         verifyBuf->memoryAddress = 0;
+      } else {
+         verifyBuf->memoryAddress = coreRegs->gpr[instr.rA];
+      }
+      verifyBuf->memoryAddress += sign_extend<12, int32_t>(instr.qd);
+      break;
+
    case espresso::InstructionID::psq_stx:
    case espresso::InstructionID::psq_stux:
-      // TODO (fall through to default for now)
+      if (instr.rA == 0) {
+         verifyBuf->memoryAddress = 0;
+      } else {
+         verifyBuf->memoryAddress = coreRegs->gpr[instr.rA];
+      }
+      verifyBuf->memoryAddress += coreRegs->gpr[instr.rB];
+      break;
 
    default:
       decaf_abort("Missing memoryAddress calculation");
@@ -367,6 +414,13 @@ verifyPost(Core *core,
                             cia, disassemble(instr, cia),
                             core->ctr, coreCopy.ctr));
 
+   // Dead flag elimination means some CR / XER bits may legitimately not
+   //  have been written by the JIT, these will never be read by anyone.
+   coreCopy.cr.value = (coreCopy.cr.value & ~verifyBuf->ignoreCrMask)
+                     | (core->cr.value & verifyBuf->ignoreCrMask);
+   coreCopy.xer.value = (coreCopy.xer.value & ~verifyBuf->ignoreXerMask)
+                      | (core->xer.value & verifyBuf->ignoreXerMask);
+
    decaf_assert(core->cr.value == coreCopy.cr.value,
                 fmt::format("Wrong value in CR at 0x{:X}: {}\n      Found: 0x{:08X}\n   Expected: 0x{:08X}",
                             cia, disassemble(instr, cia),
@@ -12,6 +12,9 @@ VerifyBuffer
 {
    CoreRegs coreRegsCopy;       // Copy of core state before JIT execution
 
+   uint32_t ignoreCrMask;       // CR bits not written due to dead flag elimination
+   uint32_t ignoreXerMask;      // XER bits not written due to dead flag elimination
+
    uint32_t memoryAddress;      // Address accessed by instruction (if any)
    uint32_t memorySize;         // Number of bytes accessed by instruction
    uint8_t preJitBuffer[128];   // Copy of memory before JIT execution
@@ -21,7 +24,9 @@ VerifyBuffer
 void
 insertVerifyCall(PPCEmuAssembler &a,
                  uint32_t instr,
-                 void *verifyWrapper);
+                 void *verifyWrapper,
+                 uint32_t ignoreCrMask = 0,
+                 uint32_t ignoreXerMask = 0);
 
 void
 verifyPre(Core *core,
@@ -3,6 +3,8 @@
 #include <common/platform_memory.h>
 #include <asmjit/asmjit.h>
 #include <atomic>
+#include <cstring>
+#include <map>
 #include <mutex>
 
 namespace cpu
@@ -48,11 +50,23 @@ public:
       return mRootAddress;
    }
 
-   void * allocate(size_t size, size_t alignment = 4) noexcept
+   static size_t allocationSize(size_t size, size_t alignment)
    {
       // Calculate how much we need to allocate to guarentee we can
       //  align the pointer and still have sufficient room for our data.
-      size_t alignedSize = align_up(size + (alignment - 1), alignment);
+      return align_up(size + (alignment - 1), alignment);
+   }
+
+   void * allocate(size_t size, size_t alignment = 4) noexcept
+   {
+      size_t alignedSize = allocationSize(size, alignment);
+
+      // Reuse memory from previously released blocks if we can
+      if (mFreeBytes.load() >= alignedSize) {
+         if (auto ptr = allocateFromFreeList(alignedSize, alignment)) {
+            return ptr;
+         }
+      }
 
       // Try to grab some space
       asmjit::Ptr baseCurAddress = mCurAddress.fetch_add(alignedSize);
@@ -113,16 +127,118 @@ public:
 
    ASMJIT_API asmjit::Error release(void* p) noexcept override
    {
-      // We do not release memory
+      // We do not know the size of the allocation here, blocks must be
+      //  given back with free() instead.
       return asmjit::kErrorOk;
    }
 
+   // Give back memory from add(), codeSize must match the assembler code
+   //  size at the time of the add() call.  The caller must guarentee
+   //  that nobody is still executing from this memory.
+   void free(void *ptr, size_t codeSize) noexcept
+   {
+      std::unique_lock<std::mutex> lock(mMutex);
+      auto start = reinterpret_cast<asmjit::Ptr>(ptr);
+      auto size = allocationSize(codeSize, 8);
+
+      // Poison the memory so any stale jump into it is caught quickly
+      std::memset(ptr, 0xCC, size);
+
+      // Merge with the following free range
+      auto next = mFreeByAddr.lower_bound(start);
+      if (next != mFreeByAddr.end() && next->first == start + size) {
+         size += next->second;
+         eraseFreeRange(next);
+      }
+
+      // Merge with the preceding free range
+      auto prev = mFreeByAddr.lower_bound(start);
+      if (prev != mFreeByAddr.begin()) {
+         --prev;
+         if (prev->first + prev->second == start) {
+            start = prev->first;
+            size += prev->second;
+            eraseFreeRange(prev);
+         }
+      }
+
+      insertFreeRange(start, size);
+   }
+
+   size_t getFreeBytes() const
+   {
+      return mFreeBytes.load();
+   }
+
+   size_t getUsedBytes() const
+   {
+      return (mCurAddress.load() - mRootAddress) - mFreeBytes.load();
+   }
+
+private:
+   void * allocateFromFreeList(size_t alignedSize, size_t alignment) noexcept
+   {
+      std::unique_lock<std::mutex> lock(mMutex);
+
+      // Best fit, we ask for the worst case alignment padding to make
+      //  sure the aligned allocation fits in the range we pick.
+      auto itr = mFreeBySize.lower_bound(alignedSize + alignment - 1);
+      if (itr == mFreeBySize.end()) {
+         return nullptr;
+      }
+
+      auto start = itr->second;
+      auto size = itr->first;
+      eraseFreeRange(mFreeByAddr.find(start));
+
+      auto alignedAddress = align_up(start, alignment);
+      auto padding = alignedAddress - start;
+
+      if (padding) {
+         insertFreeRange(start, padding);
+      }
+
+      auto remaining = size - padding - alignedSize;
+      if (remaining) {
+         insertFreeRange(alignedAddress + alignedSize, remaining);
+      }
+
+      return reinterpret_cast<void *>(alignedAddress);
+   }
+
+   void insertFreeRange(asmjit::Ptr start, size_t size)
+   {
+      mFreeByAddr.emplace(start, size);
+      mFreeBySize.emplace(size, start);
+      mFreeBytes.fetch_add(size);
+   }
+
+   void eraseFreeRange(std::map<asmjit::Ptr, size_t>::iterator itr)
+   {
+      auto range = mFreeBySize.equal_range(itr->second);
+      for (auto i = range.first; i != range.second; ++i) {
+         if (i->second == itr->first) {
+            mFreeBySize.erase(i);
+            break;
+         }
+      }
+
+      mFreeBytes.fetch_sub(itr->second);
+      mFreeByAddr.erase(itr);
+   }
+
+public:
    std::mutex mMutex;
    asmjit::Ptr mRootAddress;
    size_t mIncreaseSize;
    std::atomic<asmjit::Ptr> mCurAddress;
    std::atomic<size_t> mCommittedSize;
 
+   // Released ranges, indexed by address for merging and size for reuse
+   std::map<asmjit::Ptr, size_t> mFreeByAddr;
+   std::multimap<size_t, asmjit::Ptr> mFreeBySize;
+   std::atomic<size_t> mFreeBytes { 0 };
+
 };
 
 } // namespace jit
@@ -51,6 +51,11 @@ struct Core : CoreRegs
    uint64_t reserve { 0xFFFFFFFFFFFFFFFF };
    std::chrono::steady_clock::time_point next_alarm;
 
+   // Set while the core is blocked in waitForInterrupt
+   std::atomic<uint32_t> sleeping { 0 };
+   std::atomic<uint64_t> wakeups { 0 };
+   std::atomic<uint64_t> spurious_wakeups { 0 };
+
    uint64_t tb();
 };
 
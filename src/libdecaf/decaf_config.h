@@ -30,6 +30,46 @@ extern bool debug;
 // TODO: should really be a std::set, but cereal doesn't support those...
 extern std::vector<unsigned> debug_filters;
 
+//! Number of threads to compile shaders on in the background, 0 compiles
+//! them on the GPU thread
+extern unsigned shader_compile_threads;
+
+//! Wait for shaders to finish compiling, set to false to skip draws which use
+//! them until they are ready instead of stalling the GPU thread
+extern bool strict_shaders;
+
+//! Directory to store compiled shader program binaries in, relative paths are
+//! resolved under the decaf config directory, empty to disable
+extern std::string shader_cache_path;
+
+//! Write color and depth buffers rendered by the host GPU back to guest
+//! memory when the CPU invalidates them or calls GX2DrawDone
+extern bool surface_writeback;
+
+enum class PresentMode
+{
+   //! Flip as soon as the host GPU has finished the frame
+   Immediate,
+
+   //! Flip at most once per 59.94 Hz refresh, honouring the swap interval
+   Paced,
+
+   //! Immediate, and guest flip waits do not wait for vsync
+   Unlimited,
+};
+
+//! When swapped frames are flipped, stored in the config file as
+//! "immediate", "paced" or "unlimited"
+extern PresentMode present_mode;
+
+std::string
+presentModeToString(PresentMode mode);
+
+//! Unknown strings are treated as "immediate", as the config is loaded before
+//! there is anywhere to log a warning
+PresentMode
+presentModeFromString(const std::string &mode);
+
 } // namespace gpu
 
 namespace gx2
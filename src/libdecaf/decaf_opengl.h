@@ -11,6 +11,7 @@ class OpenGLDriver : public GraphicsDriver
 {
 public:
    using SwapFunction = std::function<void(unsigned int, unsigned int)>;
+   using MakeContextCurrentFunction = std::function<bool(unsigned int)>;
 
    virtual ~OpenGLDriver()
    {
@@ -19,6 +20,13 @@ public:
    virtual void getSwapBuffers(unsigned int *tv, unsigned int *drc) = 0;
    virtual void syncPoll(const SwapFunction &swapFunc) = 0;
 
+   // Provide count GL contexts which share objects with the GPU thread's
+   //  context, used to compile shaders in the background.  makeCurrent is
+   //  called once on each compile thread with the index of the context it
+   //  should make current.  Must be called before the driver starts, drivers
+   //  which are never given any contexts compile shaders on the GPU thread.
+   virtual void setSharedContexts(unsigned int count, const MakeContextCurrentFunction &makeCurrent) { }
+
 };
 
 } // namespace decaf
@@ -4,6 +4,7 @@
 #include "debugger_ui_internal.h"
 #include "decaf_config.h"
 #include "gpu/pm4_capture.h"
+#include "kernel/kernel_hle.h"
 #include "kernel/kernel_loader.h"
 #include "modules/coreinit/coreinit_scheduler.h"
 #include <imgui.h>
@@ -255,6 +256,7 @@ draw()
 
          if (ImGui::MenuItem("Kernel Trace Enabled", nullptr, decaf::config::log::kernel_trace, true)) {
             decaf::config::log::kernel_trace = !decaf::config::log::kernel_trace;
+            kernel::relinkHleFunctions();
          }
 
          auto pm4Enable = false;
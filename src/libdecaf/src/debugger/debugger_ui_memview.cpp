@@ -1,5 +1,7 @@
 #include "debugger_ui_internal.h"
 #include "imgui_addrscroll.h"
+#include "libcpu/cpu.h"
+#include <cinttypes>
 #include <imgui.h>
 #include <sstream>
 
@@ -12,6 +14,11 @@ namespace ui
 namespace MemView
 {
 
+static const ImVec4 WatchColor = HEXTOIMV4(0xFF5722, 1.0f);
+
+static const char *
+WatchSizeNames[] = { "1", "2", "4", "8" };
+
 bool
 gIsVisible = true;
 
@@ -39,6 +46,21 @@ sAddressInput[32] = { 0 };
 static char
 sDataInput[32] = { 0 };
 
+static char
+sWatchInput[32] = { 0 };
+
+static int
+sWatchSizeIndex = 2;
+
+static bool
+sWatchRead = false;
+
+static bool
+sWatchWrite = true;
+
+static bool
+sWatchChange = false;
+
 static void
 gotoAddress(uint32_t address)
 {
@@ -46,6 +68,91 @@ gotoAddress(uint32_t address)
    sEditAddress = address;
 }
 
+static bool
+isWatched(const std::vector<cpu::Watchpoint> &watches,
+          uint32_t address)
+{
+   for (auto &watch : watches) {
+      if (address >= watch.address && address < watch.address + watch.size) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static void
+drawWatchpoints(const std::vector<cpu::Watchpoint> &watches)
+{
+   ImGui::AlignFirstTextHeightToWidgets();
+   ImGui::Text("Watch Address: ");
+   ImGui::SameLine();
+   ImGui::PushItemWidth(70);
+   ImGui::InputText("##watch", sWatchInput, 32, ImGuiInputTextFlags_CharsHexadecimal);
+   ImGui::PopItemWidth();
+   ImGui::SameLine();
+   ImGui::PushItemWidth(40);
+   ImGui::Combo("Size", &sWatchSizeIndex, WatchSizeNames, 4);
+   ImGui::PopItemWidth();
+   ImGui::SameLine();
+   ImGui::Checkbox("Read", &sWatchRead);
+   ImGui::SameLine();
+   ImGui::Checkbox("Write", &sWatchWrite);
+   ImGui::SameLine();
+   ImGui::Checkbox("Changed", &sWatchChange);
+   ImGui::SameLine();
+
+   if (ImGui::Button("Add Watch")) {
+      std::istringstream is(sWatchInput);
+      auto flags = 0u;
+      uint32_t address;
+
+      flags |= sWatchRead ? cpu::WATCH_READ : 0;
+      flags |= sWatchWrite ? cpu::WATCH_WRITE : 0;
+      flags |= sWatchChange ? cpu::WATCH_CHANGE : 0;
+
+      if ((is >> std::hex >> address)) {
+         cpu::addWatchpoint(address, 1u << sWatchSizeIndex, flags);
+      }
+   }
+
+   for (auto &watch : watches) {
+      ImGui::PushID(static_cast<int>(watch.address));
+
+      if (ImGui::SmallButton("Remove")) {
+         cpu::removeWatchpoint(watch.address);
+      }
+
+      ImGui::SameLine();
+
+      if (ImGui::SmallButton("Show")) {
+         gotoAddress(watch.address);
+      }
+
+      ImGui::SameLine();
+      ImGui::Text("%08X %d bytes %c%c%c, %" PRIu64 " hits",
+                  watch.address,
+                  static_cast<int>(watch.size),
+                  (watch.flags & cpu::WATCH_READ) ? 'R' : '-',
+                  (watch.flags & cpu::WATCH_WRITE) ? 'W' : '-',
+                  (watch.flags & cpu::WATCH_CHANGE) ? 'C' : '-',
+                  watch.hits);
+      ImGui::PopID();
+   }
+
+   auto hit = cpu::WatchpointHit { };
+
+   if (cpu::getLastWatchpointHit(hit)) {
+      ImGui::TextColored(WatchColor, "Last hit: %08X by core %d at %08X, access %08X, %" PRIX64 " -> %" PRIX64,
+                         hit.address,
+                         static_cast<int>(hit.coreId),
+                         hit.nia,
+                         hit.accessAddress,
+                         hit.oldValue,
+                         hit.newValue);
+   }
+}
+
 void
 displayAddress(uint32_t address)
 {
@@ -125,8 +232,13 @@ draw()
       }
    }
 
+   // Leave space for the bottom bar, the watch bar and the watchpoint list
+   auto watches = cpu::getWatchpoints();
+   auto hit = cpu::WatchpointHit { };
+   auto bottomLines = 2 + watches.size() + (cpu::getLastWatchpointHit(hit) ? 1 : 0);
+
    auto editAddress = sEditAddress;
-   sScroller.Begin(numColumns, ImVec2(0, -ImGui::GetItemsLineHeightWithSpacing()));
+   sScroller.Begin(numColumns, ImVec2(0, -ImGui::GetItemsLineHeightWithSpacing() * bottomLines));
 
    for (auto addr = sScroller.Reset(); sScroller.HasMore(); addr = sScroller.Advance()) {
       auto linePos = ImGui::GetCursorPos();
@@ -206,7 +318,11 @@ draw()
             ImGui::SetCursorPos(linePos);
 
             if (sScroller.IsValidOffset(i) && mem::valid(addr + i)) {
-               ImGui::Text("%02X ", mem::read<unsigned char>(addr + i));
+               if (isWatched(watches, addr + i)) {
+                  ImGui::TextColored(WatchColor, "%02X ", mem::read<unsigned char>(addr + i));
+               } else {
+                  ImGui::Text("%02X ", mem::read<unsigned char>(addr + i));
+               }
 
                if (sEditingEnabled && ImGui::IsItemHovered() && ImGui::IsMouseClicked(0)) {
                   sEditAddress = addr + i;
@@ -256,6 +372,9 @@ draw()
    ImGui::SameLine();
    ImGui::Text("Showing %d Columns", static_cast<int>(numColumns));
 
+   ImGui::Separator();
+   drawWatchpoints(watches);
+
    // End the memory view window
    ImGui::End();
 }
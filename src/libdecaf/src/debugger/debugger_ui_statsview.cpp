@@ -1,8 +1,16 @@
 #include "debugger_ui_internal.h"
+#include "gpu/gpu_commandqueue.h"
+#include "gpu/gpu_flush.h"
+#include "gpu/gpu_timing.h"
+#include "kernel/kernel_ipc.h"
 #include "libcpu/cpu.h"
 #include "libcpu/espresso/espresso_instructionid.h"
 #include "libcpu/espresso/espresso_instructionset.h"
+#include "modules/coreinit/coreinit_alarm.h"
+#include "modules/coreinit/coreinit_scheduler.h"
+#include "modules/coreinit/coreinit_spinlock.h"
 #include <algorithm>
+#include <cfloat>
 #include <chrono>
 #include <cinttypes>
 #include <imgui.h>
@@ -118,6 +126,305 @@ draw()
       ImGui::TreePop();
    }
 
+   if (ImGui::TreeNode("JIT Cache"))
+   {
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      auto jitStats = cpu::getJitStats();
+      auto drawStat = [](const char *name, uint64_t value) {
+         ImGui::Text("%s", name);
+         ImGui::NextColumn();
+         ImGui::Text("%" PRIu64, value);
+         ImGui::NextColumn();
+         ImGui::NextColumn();
+      };
+
+      drawStat("Live Blocks", jitStats.liveBlocks);
+      drawStat("Live Bytes", jitStats.liveBytes);
+      drawStat("Invalidated Blocks", jitStats.invalidatedBlocks);
+      drawStat("Dead Bytes Pending", jitStats.pendingBytes);
+      drawStat("Reclaimed Bytes", jitStats.reclaimedBytes);
+      drawStat("Free Bytes", jitStats.freeBytes);
+      drawStat("Core Loads Emitted", jitStats.coreLoads);
+      drawStat("Core Stores Emitted", jitStats.coreStores);
+
+      ImGui::TreePop();
+   }
+
+   if (ImGui::TreeNode("IPC Latency"))
+   {
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      for (auto &device : kernel::ipcGetDeviceStats()) {
+         auto &stats = device.second;
+         auto avgQueueUs = stats.requests ? (stats.totalQueueNs / stats.requests) / 1000.0f : 0.0f;
+         auto avgServiceUs = stats.requests ? (stats.totalServiceNs / stats.requests) / 1000.0f : 0.0f;
+
+         ImGui::Text("%s", device.first.c_str());
+         ImGui::NextColumn();
+         ImGui::Text("%" PRIu64, stats.requests);
+         ImGui::NextColumn();
+         ImGui::NextColumn();
+
+         ImGui::Text("  Avg Queue / Service (us)");
+         ImGui::NextColumn();
+         ImGui::Text("%.1f / %.1f", avgQueueUs, avgServiceUs);
+         ImGui::NextColumn();
+         ImGui::NextColumn();
+
+         ImGui::Text("  Max Latency (us)");
+         ImGui::NextColumn();
+         ImGui::Text("%.1f", stats.maxLatencyNs / 1000.0f);
+         ImGui::NextColumn();
+         ImGui::NextColumn();
+      }
+
+      ImGui::TreePop();
+   }
+
+   if (ImGui::TreeNode("Core Wakeups"))
+   {
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      for (auto i = 0; i < 3; ++i) {
+         auto interruptStats = cpu::getInterruptStats(i);
+
+         ImGui::Text("Core %d Wakeups / Spurious", i);
+         ImGui::NextColumn();
+         ImGui::Text("%" PRIu64 " / %" PRIu64, interruptStats.wakeups, interruptStats.spuriousWakeups);
+         ImGui::NextColumn();
+         ImGui::NextColumn();
+      }
+
+      ImGui::TreePop();
+   }
+
+   if (ImGui::TreeNode("Lock Contention"))
+   {
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      auto drawLock = [](const char *name, const AdaptiveLockStats &stats) {
+         ImGui::Text("%s Acquired / Contended / Parked", name);
+         ImGui::NextColumn();
+         ImGui::Text("%" PRIu64 " / %" PRIu64 " / %" PRIu64,
+                     stats.acquisitions.load(),
+                     stats.contentions.load(),
+                     stats.parks.load());
+         ImGui::NextColumn();
+         ImGui::NextColumn();
+
+         ImGui::Text("%s Max Hold (us)", name);
+         ImGui::NextColumn();
+         ImGui::Text("%.1f", stats.maxHoldNs.load() / 1000.0f);
+         ImGui::NextColumn();
+         ImGui::NextColumn();
+      };
+
+      drawLock("Scheduler", coreinit::internal::getSchedulerLockStats());
+      drawLock("Alarm", coreinit::internal::getAlarmLockStats());
+      drawLock("OSSpinLock", coreinit::internal::getSpinLockStats());
+
+      ImGui::TreePop();
+   }
+
+   if (ImGui::TreeNode("Alarm Jitter"))
+   {
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      auto alarmStats = coreinit::internal::getAlarmStats();
+      auto avgJitterUs = alarmStats.fired ? (alarmStats.totalJitterNs / alarmStats.fired) / 1000.0f : 0.0f;
+
+      ImGui::Text("Alarms Fired");
+      ImGui::NextColumn();
+      ImGui::Text("%" PRIu64, alarmStats.fired);
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      ImGui::Text("Avg / Max Jitter (us)");
+      ImGui::NextColumn();
+      ImGui::Text("%.1f / %.1f", avgJitterUs, alarmStats.maxJitterNs / 1000.0f);
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      ImGui::TreePop();
+   }
+
+   if (ImGui::TreeNode("GPU Idle"))
+   {
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      auto &idleStats = gpu::getIdleStats();
+      auto syncCompletions = idleStats.syncCompletions.load();
+      auto syncBatches = idleStats.syncBatches.load();
+
+      ImGui::Text("Spin Iterations / Blocked Waits");
+      ImGui::NextColumn();
+      ImGui::Text("%" PRIu64 " / %" PRIu64,
+                  idleStats.spinIterations.load(),
+                  idleStats.blockedWaits.load());
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      ImGui::Text("Blocked Time (ms)");
+      ImGui::NextColumn();
+      ImGui::Text("%.1f", idleStats.blockedNs.load() / 1000000.0f);
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      ImGui::Text("Sync Completions / Avg Batch");
+      ImGui::NextColumn();
+      ImGui::Text("%" PRIu64 " / %.1f", syncCompletions, syncBatches ? static_cast<float>(syncCompletions) / syncBatches : 0.0f);
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      ImGui::TreePop();
+   }
+
+   if (ImGui::TreeNode("GPU Data Uploads"))
+   {
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      auto &uploadStats = gpu::getDataUploadStats();
+
+      ImGui::Text("Uploaded (KiB) / Ranges");
+      ImGui::NextColumn();
+      ImGui::Text("%" PRIu64 " / %" PRIu64,
+                  uploadStats.uploadedBytes.load() / 1024,
+                  uploadStats.uploadedRanges.load());
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      ImGui::Text("Skipped Unchanged (KiB)");
+      ImGui::NextColumn();
+      ImGui::Text("%" PRIu64, uploadStats.skippedBytes.load() / 1024);
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      ImGui::TreePop();
+   }
+
+   if (ImGui::TreeNode("GPU Timeline"))
+   {
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      auto enabled = gpu::isTimingEnabled();
+      auto timing = gpu::FrameTiming { };
+
+      ImGui::Text("Timer Queries");
+      ImGui::NextColumn();
+      if (ImGui::Checkbox("Enabled", &enabled)) {
+         gpu::setTimingEnabled(enabled);
+      }
+      ImGui::NextColumn();
+      if (ImGui::Button("Dump JSON")) {
+         gpu::dumpFrameTimings("gpu_timing.json");
+      }
+      ImGui::NextColumn();
+
+      if (gpu::getLastFrameTiming(timing)) {
+         auto cpuMs = timing.cpuFrameNs / 1000000.0f;
+         auto gpuMs = timing.gpuBusyNs / 1000000.0f;
+
+         ImGui::Text("Frame");
+         ImGui::NextColumn();
+         ImGui::Text("%" PRIu64, timing.frame);
+         ImGui::NextColumn();
+         ImGui::NextColumn();
+
+         ImGui::Text("CPU Frame / GPU Frame (ms)");
+         ImGui::NextColumn();
+         ImGui::Text("%.2f / %.2f", cpuMs, timing.gpuFrameNs / 1000000.0f);
+         ImGui::NextColumn();
+         ImGui::NextColumn();
+
+         ImGui::Text("GPU Busy (ms)");
+         ImGui::NextColumn();
+         ImGui::Text("%.2f (%.0f%%)", gpuMs, cpuMs > 0.0f ? 100.0f * gpuMs / cpuMs : 0.0f);
+         ImGui::NextColumn();
+         // The GPU thread waits on the host GPU when it is the bottleneck,
+         //  so a frame mostly spent busy on the GPU is GPU bound.
+         ImGui::Text("%s", gpuMs >= cpuMs * 0.9f ? "GPU bound" : "CPU bound");
+         ImGui::NextColumn();
+
+         for (auto &pass : timing.passes) {
+            static const char *names[] = { "Command Buffer", "Render Target", "Draw Batch" };
+            auto depth = static_cast<size_t>(pass.type);
+
+            ImGui::Text("%*s%s %" PRIx64, static_cast<int>(depth * 2), "", names[depth], pass.id);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f ms", pass.durationNs / 1000000.0f);
+            ImGui::NextColumn();
+            ImGui::Text("%u draws", pass.draws);
+            ImGui::NextColumn();
+         }
+      }
+
+      ImGui::TreePop();
+   }
+
+   if (ImGui::TreeNode("Frame Pacing"))
+   {
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      auto pacing = gpu::getFramePacingStats();
+      auto &frameTimes = pacing.flipInterval;
+      auto &latencies = pacing.swapLatency;
+      auto averageMs = [](const gpu::FrameTimeHistogram &histogram) {
+         return histogram.frames ? histogram.totalNs / 1000000.0f / histogram.frames : 0.0f;
+      };
+
+      ImGui::Text("Flips / Swap Chain Stalls");
+      ImGui::NextColumn();
+      ImGui::Text("%" PRIu64 " / %" PRIu64, latencies.frames, pacing.chainStalls);
+      ImGui::NextColumn();
+      if (ImGui::Button("Reset")) {
+         gpu::resetFramePacingStats();
+      }
+      ImGui::NextColumn();
+
+      ImGui::Text("Frame Time Avg / Max (ms)");
+      ImGui::NextColumn();
+      ImGui::Text("%.2f / %.2f", averageMs(frameTimes), frameTimes.maxNs / 1000000.0f);
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      ImGui::Text("Swap To Flip Avg / Max (ms)");
+      ImGui::NextColumn();
+      ImGui::Text("%.2f / %.2f", averageMs(latencies), latencies.maxNs / 1000000.0f);
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      // One bar per millisecond, the last bar counts every longer frame
+      auto bars = std::vector<float>(frameTimes.buckets.begin(), frameTimes.buckets.end());
+
+      ImGui::Text("Frame Time Histogram");
+      ImGui::NextColumn();
+      ImGui::PlotHistogram("##frametimes", bars.data(), static_cast<int>(bars.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+      ImGui::NextColumn();
+      ImGui::Text("0 - %u ms", static_cast<unsigned>(gpu::FrameTimeBuckets * gpu::FrameTimeBucketUs / 1000));
+      ImGui::NextColumn();
+
+      ImGui::TreePop();
+   }
+
    ImGui::Columns(1);
    ImGui::End();
 }
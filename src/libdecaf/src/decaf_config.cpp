@@ -20,6 +20,37 @@ namespace gpu
 
 bool debug = false;
 std::vector<unsigned> debug_filters = {};
+unsigned shader_compile_threads = 2;
+bool strict_shaders = true;
+std::string shader_cache_path = "shader_cache";
+bool surface_writeback = false;
+PresentMode present_mode = PresentMode::Immediate;
+
+std::string
+presentModeToString(PresentMode mode)
+{
+   switch (mode) {
+   case PresentMode::Paced:
+      return "paced";
+   case PresentMode::Unlimited:
+      return "unlimited";
+   case PresentMode::Immediate:
+   default:
+      return "immediate";
+   }
+}
+
+PresentMode
+presentModeFromString(const std::string &mode)
+{
+   if (mode == "paced") {
+      return PresentMode::Paced;
+   } else if (mode == "unlimited") {
+      return PresentMode::Unlimited;
+   } else {
+      return PresentMode::Immediate;
+   }
+}
 
 } // namespace gpu
 
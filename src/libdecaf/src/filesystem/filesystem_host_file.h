@@ -1,6 +1,7 @@
 #pragma once
 #include "filesystem_file.h"
 #include "filesystem_host_filehandle.h"
+#include "filesystem_host_preadfilehandle.h"
 #include "filesystem_host_path.h"
 
 #include <string>
@@ -30,7 +31,12 @@ public:
          return nullptr;
       }
 
+#ifdef PLATFORM_POSIX
+      // Only map files which the guest has no way of truncating
+      auto handle = new HostPreadFileHandle { mPath.path(), mode, !checkPermission(Permissions::Write) };
+#else
       auto handle = new HostFileHandle { mPath.path(), mode };
+#endif
 
       if (!handle->open()) {
          delete handle;
@@ -0,0 +1,99 @@
+#pragma once
+#include <common/platform.h>
+
+#ifdef PLATFORM_POSIX
+#include "filesystem_file.h"
+#include "filesystem_filehandle.h"
+#include <string>
+
+namespace fs
+{
+
+/**
+ * A host file handle built on pread / pwrite instead of stdio.
+ *
+ * Read only files on folders the guest cannot write to, such as /vol/code
+ * and /vol/content, are memory mapped so reads copy straight from the page
+ * cache into the destination buffer. Sequential reads are detected and used
+ * to issue read-ahead hints to the host kernel.
+ */
+struct HostPreadFileHandle : public IFileHandle
+{
+   HostPreadFileHandle(const std::string &path,
+                       File::OpenMode mode,
+                       bool allowMapping);
+
+   virtual ~HostPreadFileHandle() override
+   {
+      close();
+   }
+
+   virtual bool
+   open() override;
+
+   virtual void
+   close() override;
+
+   virtual bool
+   eof() override;
+
+   virtual bool
+   flush() override;
+
+   virtual bool
+   seek(size_t position) override;
+
+   virtual size_t
+   size() override;
+
+   virtual size_t
+   tell() override;
+
+   virtual size_t
+   truncate() override;
+
+   virtual size_t
+   read(uint8_t *data,
+        size_t size,
+        size_t count) override;
+
+   virtual size_t
+   write(const uint8_t *data,
+         size_t size,
+         size_t count) override;
+
+private:
+   void
+   updateReadAhead(size_t position,
+                   size_t length);
+
+   void
+   adviseWillNeed(size_t position,
+                  size_t length);
+
+   void
+   adviseSequential(bool sequential);
+
+private:
+   int mFd = -1;
+   File::OpenMode mMode;
+   size_t mPosition = 0;
+   bool mEof = false;
+
+   //! Read only mapping of the whole file, or nullptr if not mapped
+   uint8_t *mMapping = nullptr;
+   size_t mMappingSize = 0;
+
+   //! Where the previous read ended, used to detect sequential access
+   size_t mLastReadEnd = 0;
+   unsigned mSequentialReads = 0;
+   bool mAdvisedSequential = false;
+
+   //! Current read-ahead window size and how far we have requested
+   size_t mReadAheadWindow = 0;
+   size_t mReadAheadEnd = 0;
+};
+
+} // namespace fs
+
+#endif // ifdef PLATFORM_POSIX
@@ -0,0 +1,417 @@
+#include "filesystem_host_preadfilehandle.h"
+#include <common/platform.h>
+
+#ifdef PLATFORM_POSIX
+#include <algorithm>
+#include <cerrno>
+#include <common/align.h>
+#include <common/decaf_assert.h>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs
+{
+
+//! Files smaller than this are not worth memory mapping
+static constexpr size_t MinMappedFileSize = 64 * 1024;
+
+//! Number of back to back reads before we consider access sequential
+static constexpr unsigned SequentialReadThreshold = 2;
+
+static constexpr size_t MinReadAheadWindow = 256 * 1024;
+static constexpr size_t MaxReadAheadWindow = 16 * 1024 * 1024;
+
+//! Size of the host buffer used when the kernel cannot access guest memory
+static constexpr size_t BounceBufferSize = 16 * 1024;
+
+static int
+translateMode(File::OpenMode mode)
+{
+   auto flags = 0;
+
+   if (mode & File::Update) {
+      flags = O_RDWR;
+   } else if (mode & (File::Write | File::Append)) {
+      flags = O_WRONLY;
+   } else {
+      flags = O_RDONLY;
+   }
+
+   if (mode & File::Write) {
+      flags |= O_CREAT | O_TRUNC;
+   }
+
+   if (mode & File::Append) {
+      flags |= O_CREAT | O_APPEND;
+   }
+
+   return flags | O_CLOEXEC;
+}
+
+
+/**
+ * A guest page protected by a memory watchpoint makes pread and pwrite fail
+ * with EFAULT rather than fault. These go through a host buffer instead, so
+ * the copy to or from guest memory faults in user space and the watchpoint
+ * sees the access.
+ */
+static ssize_t
+preadBounced(int fd,
+             uint8_t *data,
+             size_t length,
+             off_t offset)
+{
+   uint8_t buffer[BounceBufferSize];
+   auto result = ssize_t { 0 };
+
+   do {
+      result = pread(fd, buffer, std::min(length, BounceBufferSize), offset);
+   } while (result < 0 && errno == EINTR);
+
+   if (result > 0) {
+      std::memcpy(data, buffer, static_cast<size_t>(result));
+   }
+
+   return result;
+}
+
+static ssize_t
+pwriteBounced(int fd,
+              const uint8_t *data,
+              size_t length,
+              off_t offset,
+              bool append)
+{
+   uint8_t buffer[BounceBufferSize];
+   auto chunk = std::min(length, BounceBufferSize);
+   auto result = ssize_t { 0 };
+   std::memcpy(buffer, data, chunk);
+
+   do {
+      if (append) {
+         result = ::write(fd, buffer, chunk);
+      } else {
+         result = pwrite(fd, buffer, chunk, offset);
+      }
+   } while (result < 0 && errno == EINTR);
+
+   return result;
+}
+
+
+HostPreadFileHandle::HostPreadFileHandle(const std::string &path,
+                                         File::OpenMode mode,
+                                         bool allowMapping) :
+   mMode(mode)
+{
+   do {
+      mFd = ::open(path.c_str(), translateMode(mode), 0644);
+   } while (mFd < 0 && errno == EINTR);
+
+   if (mFd < 0 || mode != File::Read || !allowMapping) {
+      return;
+   }
+
+   // Map read only files so reads are a copy straight out of the page cache
+   struct stat st;
+
+   if (fstat(mFd, &st) == 0 && S_ISREG(st.st_mode)
+    && static_cast<size_t>(st.st_size) >= MinMappedFileSize) {
+      auto size = static_cast<size_t>(st.st_size);
+      auto mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, mFd, 0);
+
+      if (mapping != MAP_FAILED) {
+         mMapping = static_cast<uint8_t *>(mapping);
+         mMappingSize = size;
+      }
+   }
+}
+
+
+bool
+HostPreadFileHandle::open()
+{
+   return mFd >= 0;
+}
+
+
+void
+HostPreadFileHandle::close()
+{
+   if (mMapping) {
+      munmap(mMapping, mMappingSize);
+      mMapping = nullptr;
+      mMappingSize = 0;
+   }
+
+   if (mFd >= 0) {
+      ::close(mFd);
+   }
+
+   mFd = -1;
+}
+
+
+bool
+HostPreadFileHandle::eof()
+{
+   decaf_check(mFd >= 0);
+   return mEof;
+}
+
+
+bool
+HostPreadFileHandle::flush()
+{
+   // There is no user space buffering to flush
+   decaf_check(mFd >= 0);
+   return true;
+}
+
+
+bool
+HostPreadFileHandle::seek(size_t position)
+{
+   decaf_check(mFd >= 0);
+   mPosition = position;
+   mEof = false;
+   return true;
+}
+
+
+size_t
+HostPreadFileHandle::tell()
+{
+   decaf_check(mFd >= 0);
+   return mPosition;
+}
+
+
+size_t
+HostPreadFileHandle::size()
+{
+   decaf_check(mFd >= 0);
+   struct stat st;
+
+   if (fstat(mFd, &st) != 0) {
+      return 0;
+   }
+
+   return static_cast<size_t>(st.st_size);
+}
+
+
+size_t
+HostPreadFileHandle::truncate()
+{
+   decaf_check(mFd >= 0);
+   decaf_check((mMode & File::Write) || (mMode & File::Update));
+   auto length = size();
+
+   if (ftruncate(mFd, static_cast<off_t>(length))) {
+      return 0;
+   }
+
+   return length;
+}
+
+
+size_t
+HostPreadFileHandle::read(uint8_t *data,
+                          size_t size,
+                          size_t count)
+{
+   decaf_check(mFd >= 0);
+   decaf_check((mMode & File::Read) || (mMode & File::Update));
+   auto length = size * count;
+   auto position = mPosition;
+   auto bytesRead = size_t { 0 };
+
+   if (!length) {
+      return 0;
+   }
+
+   updateReadAhead(position, length);
+
+   // Copy what we can straight from the mapping. Touching a mapped page
+   //  beyond the current end of file raises SIGBUS, so if the host has
+   //  truncated the file since we opened it only copy up to its new size.
+   struct stat st;
+
+   if (mMapping && position < mMappingSize && fstat(mFd, &st) == 0) {
+      auto mappedSize = std::min(mMappingSize, static_cast<size_t>(st.st_size));
+
+      if (position < mappedSize) {
+         bytesRead = std::min(length, mappedSize - position);
+         std::memcpy(data, mMapping + position, bytesRead);
+      }
+   }
+
+   // Anything else, such as data beyond the end of the mapping if the
+   //  file has grown since we opened it, is read with pread.
+   while (bytesRead < length) {
+      auto result = pread(mFd,
+                          data + bytesRead,
+                          length - bytesRead,
+                          static_cast<off_t>(position + bytesRead));
+
+      if (result < 0 && errno == EFAULT) {
+         result = preadBounced(mFd,
+                               data + bytesRead,
+                               length - bytesRead,
+                               static_cast<off_t>(position + bytesRead));
+      }
+
+      if (result < 0 && errno == EINTR) {
+         continue;
+      } else if (result <= 0) {
+         break;
+      }
+
+      bytesRead += static_cast<size_t>(result);
+   }
+
+   if (bytesRead < length) {
+      mEof = true;
+   }
+
+   mPosition += bytesRead;
+   return bytesRead / size;
+}
+
+
+size_t
+HostPreadFileHandle::write(const uint8_t *data,
+                           size_t size,
+                           size_t count)
+{
+   decaf_check(mFd >= 0);
+   decaf_check((mMode & File::Write) || (mMode & File::Update));
+   auto length = size * count;
+   auto bytesWritten = size_t { 0 };
+
+   while (bytesWritten < length) {
+      auto result = ssize_t { 0 };
+
+      if (mMode & File::Append) {
+         // O_APPEND ignores the offset for pwrite on Linux, so use write
+         result = ::write(mFd, data + bytesWritten, length - bytesWritten);
+      } else {
+         result = pwrite(mFd,
+                         data + bytesWritten,
+                         length - bytesWritten,
+                         static_cast<off_t>(mPosition + bytesWritten));
+      }
+
+      if (result < 0 && errno == EFAULT) {
+         result = pwriteBounced(mFd,
+                                data + bytesWritten,
+                                length - bytesWritten,
+                                static_cast<off_t>(mPosition + bytesWritten),
+                                !!(mMode & File::Append));
+      }
+
+      if (result < 0 && errno == EINTR) {
+         continue;
+      } else if (result <= 0) {
+         break;
+      }
+
+      bytesWritten += static_cast<size_t>(result);
+   }
+
+   if (mMode & File::Append) {
+      mPosition = static_cast<size_t>(lseek(mFd, 0, SEEK_CUR));
+   } else {
+      mPosition += bytesWritten;
+   }
+
+   return bytesWritten / size;
+}
+
+
+/**
+ * Track the access pattern and keep a read-ahead window in front of
+ * sequential readers, the window doubles with each sequential read.
+ */
+void
+HostPreadFileHandle::updateReadAhead(size_t position,
+                                     size_t length)
+{
+   if (position == mLastReadEnd) {
+      mSequentialReads++;
+   } else {
+      mSequentialReads = 0;
+      mReadAheadWindow = 0;
+      mReadAheadEnd = 0;
+
+      if (mAdvisedSequential) {
+         adviseSequential(false);
+      }
+   }
+
+   mLastReadEnd = position + length;
+
+   if (mSequentialReads < SequentialReadThreshold) {
+      return;
+   }
+
+   if (!mAdvisedSequential) {
+      adviseSequential(true);
+   }
+
+   mReadAheadWindow = std::max(mReadAheadWindow * 2, length * 4);
+   mReadAheadWindow = std::min(std::max(mReadAheadWindow, MinReadAheadWindow), MaxReadAheadWindow);
+
+   // Only issue a new hint once the reader is half way through the window
+   if (mLastReadEnd + mReadAheadWindow / 2 > mReadAheadEnd) {
+      auto start = std::max(mReadAheadEnd, mLastReadEnd);
+      auto end = mLastReadEnd + mReadAheadWindow;
+      adviseWillNeed(start, end - start);
+      mReadAheadEnd = end;
+   }
+}
+
+
+void
+HostPreadFileHandle::adviseWillNeed(size_t position,
+                                    size_t length)
+{
+   if (mMapping) {
+      if (position >= mMappingSize) {
+         return;
+      }
+
+      auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+      auto start = align_down(position, pageSize);
+      auto end = std::min(position + length, mMappingSize);
+      madvise(mMapping + start, end - start, MADV_WILLNEED);
+   } else {
+#ifdef POSIX_FADV_WILLNEED
+      posix_fadvise(mFd, static_cast<off_t>(position), static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+#endif
+   }
+}
+
+
+void
+HostPreadFileHandle::adviseSequential(bool sequential)
+{
+   if (mMapping) {
+      madvise(mMapping, mMappingSize, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+   } else {
+#ifdef POSIX_FADV_SEQUENTIAL
+      posix_fadvise(mFd, 0, 0, sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_NORMAL);
+#endif
+   }
+
+   mAdvisedSequential = sequential;
+}
+
+} // namespace fs
+
+#endif // ifdef PLATFORM_POSIX
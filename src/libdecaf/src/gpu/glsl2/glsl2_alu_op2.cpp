@@ -287,6 +287,12 @@ AND(State &state, const ControlFlowInst &cf, const AluInst &alu)
    binaryOperator(state, cf, alu, " & ");
 }
 
+static void
+ASHR(State &state, const ControlFlowInst &cf, const AluInst &alu)
+{
+   binaryOperator(state, cf, alu, " >> ");
+}
+
 static void
 CEIL(State &state, const ControlFlowInst &cf, const AluInst &alu)
 {
@@ -354,7 +360,20 @@ LSHL(State &state, const ControlFlowInst &cf, const AluInst &alu)
 static void
 LSHR(State &state, const ControlFlowInst &cf, const AluInst &alu)
 {
-   binaryOperator(state, cf, alu, " >> ");
+   // LSHR_INT is flagged as an int instruction but the shift is logical
+   // dst = int(uint(src0) >> src1)
+   insertLineStart(state);
+   insertDestBegin(state, cf, alu, state.unit);
+
+   state.out << "int(uint(";
+   insertSource0(state, state.out, cf, alu);
+   state.out << ") >> ";
+   insertSource1(state, state.out, cf, alu);
+   state.out << ")";
+
+   insertDestEnd(state, cf, alu);
+   state.out << ';';
+   insertLineEnd(state);
 }
 
 static void
@@ -571,7 +590,7 @@ TRUNC(State &state, const ControlFlowInst &cf, const AluInst &alu)
 static void
 UINT_TO_FLT(State &state, const ControlFlowInst &cf, const AluInst &alu)
 {
-   unaryFunction(state, cf, alu, "uint");
+   unaryFunction(state, cf, alu, "float");
 }
 
 static void
@@ -586,7 +605,7 @@ registerOP2Functions()
    registerInstruction(latte::SQ_OP2_INST_ADD, ADD);
    registerInstruction(latte::SQ_OP2_INST_ADD_INT, ADD);
    registerInstruction(latte::SQ_OP2_INST_AND_INT, AND);
-   registerInstruction(latte::SQ_OP2_INST_ASHR_INT, LSHR);
+   registerInstruction(latte::SQ_OP2_INST_ASHR_INT, ASHR);
    registerInstruction(latte::SQ_OP2_INST_CEIL, CEIL);
    registerInstruction(latte::SQ_OP2_INST_COS, COS);
    registerInstruction(latte::SQ_OP2_INST_EXP_IEEE, EXP);
@@ -614,7 +633,7 @@ registerOP2Functions()
    registerInstruction(latte::SQ_OP2_INST_MAX_INT, MAX);
    registerInstruction(latte::SQ_OP2_INST_MAX_UINT, MAX);
    registerInstruction(latte::SQ_OP2_INST_MIN, MIN);
-   registerInstruction(latte::SQ_OP2_INST_MIN_DX10, MAX);
+   registerInstruction(latte::SQ_OP2_INST_MIN_DX10, MIN);
    registerInstruction(latte::SQ_OP2_INST_MIN_INT, MIN);
    registerInstruction(latte::SQ_OP2_INST_MIN_UINT, MIN);
    registerInstruction(latte::SQ_OP2_INST_MOV, MOV);
@@ -0,0 +1,168 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <gsl.h>
+#include <map>
+#include <utility>
+#include <vector>
+#include "gpu/microcode/latte_instructions.h"
+
+namespace glsl2
+{
+
+struct State;
+
+/*
+ * Typed SSA representation of a single ALU clause.
+ *
+ * Every register channel, PV and PS read in the clause resolves to the value
+ * which produced it, so moves between them disappear and only the final value
+ * of each register channel is stored at the end of the clause. Values are
+ * typed so the floatBitsToInt / intBitsToFloat pairs around integer
+ * instructions can be removed when one integer instruction feeds another.
+ *
+ * Clauses which use anything the builder does not understand (relative
+ * addressing, AR, predicates, kills, reductions other than DOT4) return false
+ * from buildAluClause and are translated one instruction at a time instead.
+ */
+namespace ir
+{
+
+enum class Type : uint8_t
+{
+   Bool,
+   Float,
+   Int,
+   Uint,
+};
+
+enum class Opcode : uint8_t
+{
+   Constant,
+   LoadRegister,
+   LoadUniformBlock,
+   LoadUniformRegister,
+   Move,
+   Bitcast,
+   Convert,
+   Neg,
+   Abs,
+   Clamp,
+   Add,
+   Sub,
+   Mul,
+   MulAdd,
+   Min,
+   Max,
+   Floor,
+   Ceil,
+   Fract,
+   Trunc,
+   RoundEven,
+   Exp2,
+   Log2,
+   Recip,
+   RecipSqrt,
+   Sqrt,
+   Sin,
+   Cos,
+   Dot4,
+   And,
+   Or,
+   Xor,
+   Not,
+   ShiftLeft,
+   ShiftRight,
+   CompareEqual,
+   CompareNotEqual,
+   CompareGreaterEqual,
+   CompareGreater,
+   Select,
+};
+
+using ValueId = uint32_t;
+
+static const ValueId InvalidValue = static_cast<ValueId>(-1);
+
+static const auto MaxOperands = 8u;
+
+struct Value
+{
+   Value(Opcode op, Type type) :
+      op(op),
+      type(type)
+   {
+      operands.fill(InvalidValue);
+   }
+
+   Opcode op;
+   Type type;
+   uint32_t numOperands = 0;
+   std::array<ValueId, MaxOperands> operands;
+
+   //! Raw bits of a Constant, Bool constants are 0 or 1
+   uint32_t constant = 0;
+
+   //! Register, kcache or uniform register index of a load
+   uint32_t index = 0;
+
+   //! Uniform block of a LoadUniformBlock
+   uint32_t bank = 0;
+
+   latte::SQ_CHAN channel = latte::SQ_CHAN::X;
+
+   //! Number of values and stores using this value, set by eliminateDeadCode
+   uint32_t uses = 0;
+};
+
+struct Store
+{
+   uint32_t gpr;
+   latte::SQ_CHAN channel;
+   ValueId value;
+};
+
+struct Clause
+{
+   //! Values in program order, operands always come before their users
+   std::vector<Value> values;
+
+   //! Final value of each register channel written by the clause
+   std::vector<Store> stores;
+};
+
+using RegisterKey = std::pair<uint32_t, latte::SQ_CHAN>;
+using LoadFunction = std::function<uint32_t(const Value &load)>;
+
+bool
+buildAluClause(const gsl::span<const uint8_t> &binary,
+               const latte::ControlFlowInst &cf,
+               Clause &clause);
+
+void
+propagateCopies(Clause &clause);
+
+void
+foldConstants(Clause &clause);
+
+void
+eliminateCommonSubexpressions(Clause &clause);
+
+void
+eliminateDeadCode(Clause &clause);
+
+void
+optimise(Clause &clause);
+
+std::map<RegisterKey, uint32_t>
+evaluateClause(const Clause &clause,
+               const LoadFunction &load);
+
+void
+emitClause(State &state,
+           const Clause &clause);
+
+} // namespace ir
+
+} // namespace glsl2
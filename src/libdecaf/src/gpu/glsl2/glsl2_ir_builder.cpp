@@ -0,0 +1,857 @@
+#include "glsl2_ir.h"
+#include "gpu/microcode/latte_decoders.h"
+
+#include <cstring>
+
+using namespace latte;
+
+namespace glsl2
+{
+
+namespace ir
+{
+
+struct Builder
+{
+   Builder(Clause &clause, const ControlFlowInst &cf) :
+      clause(clause),
+      cf(cf)
+   {
+      previousVector.fill(InvalidValue);
+   }
+
+   Clause &clause;
+   const ControlFlowInst &cf;
+   gsl::span<const uint32_t> literals;
+
+   //! Register channels as they were when the clause started
+   std::map<RegisterKey, ValueId> entryRegisters;
+
+   //! Register channels written by the clause so far
+   std::map<RegisterKey, ValueId> registers;
+
+   std::array<ValueId, 4> previousVector;
+   ValueId previousScalar = InvalidValue;
+};
+
+struct PendingWrite
+{
+   RegisterKey key;
+   ValueId value;
+};
+
+static ValueId
+addValue(Builder &builder,
+         Value value)
+{
+   builder.clause.values.push_back(value);
+   return static_cast<ValueId>(builder.clause.values.size() - 1);
+}
+
+static ValueId
+addConstant(Builder &builder,
+            Type type,
+            uint32_t bits)
+{
+   auto value = Value { Opcode::Constant, type };
+   value.constant = bits;
+   return addValue(builder, value);
+}
+
+static ValueId
+addFloatConstant(Builder &builder,
+                 float constant)
+{
+   auto bits = uint32_t { 0 };
+   std::memcpy(&bits, &constant, sizeof(bits));
+   return addConstant(builder, Type::Float, bits);
+}
+
+static ValueId
+addOp(Builder &builder,
+      Opcode op,
+      Type type,
+      std::initializer_list<ValueId> operands)
+{
+   auto value = Value { op, type };
+
+   for (auto operand : operands) {
+      value.operands[value.numOperands++] = operand;
+   }
+
+   return addValue(builder, value);
+}
+
+static Type
+getValueType(Builder &builder,
+             ValueId id)
+{
+   return builder.clause.values[id].type;
+}
+
+static ValueId
+readRegister(Builder &builder,
+             uint32_t gpr,
+             SQ_CHAN channel)
+{
+   auto key = RegisterKey { gpr, channel };
+   auto itr = builder.registers.find(key);
+
+   if (itr != builder.registers.end()) {
+      return itr->second;
+   }
+
+   auto entry = builder.entryRegisters.find(key);
+
+   if (entry != builder.entryRegisters.end()) {
+      return entry->second;
+   }
+
+   auto load = Value { Opcode::LoadRegister, Type::Float };
+   load.index = gpr;
+   load.channel = channel;
+
+   auto id = addValue(builder, load);
+   builder.entryRegisters.emplace(key, id);
+   return id;
+}
+
+/**
+ * Read an ALU source as the instruction's input type, or return
+ * InvalidValue if the builder does not support it.
+ */
+static ValueId
+readSource(Builder &builder,
+           const AluInst &inst,
+           Type type,
+           SQ_ALU_SRC sel,
+           SQ_REL rel,
+           SQ_CHAN chan,
+           bool abs,
+           bool neg)
+{
+   auto value = InvalidValue;
+   auto isStorage = false;
+
+   if (rel) {
+      return InvalidValue;
+   }
+
+   if (sel >= SQ_ALU_SRC::REGISTER_FIRST && sel <= SQ_ALU_SRC::REGISTER_LAST) {
+      value = readRegister(builder, sel - SQ_ALU_SRC::REGISTER_FIRST, chan);
+      isStorage = true;
+   } else if ((sel >= SQ_ALU_SRC::KCACHE_BANK0_FIRST && sel <= SQ_ALU_SRC::KCACHE_BANK0_LAST)
+           || (sel >= SQ_ALU_SRC::KCACHE_BANK1_FIRST && sel <= SQ_ALU_SRC::KCACHE_BANK1_LAST)) {
+      auto &cf = builder.cf;
+      auto load = Value { Opcode::LoadUniformBlock, Type::Float };
+      auto mode = SQ_CF_KCACHE_MODE::NOP;
+      auto addr = 0u;
+
+      if (sel < SQ_ALU_SRC::KCACHE_BANK1_FIRST) {
+         addr = cf.alu.word1.KCACHE_ADDR0();
+         load.bank = cf.alu.word0.KCACHE_BANK0();
+         mode = cf.alu.word0.KCACHE_MODE0();
+         load.index = addr * 16 + (sel - SQ_ALU_SRC::KCACHE_BANK0_FIRST);
+      } else {
+         addr = cf.alu.word1.KCACHE_ADDR1();
+         load.bank = cf.alu.word0.KCACHE_BANK1();
+         mode = cf.alu.word1.KCACHE_MODE1();
+         load.index = addr * 16 + (sel - SQ_ALU_SRC::KCACHE_BANK1_FIRST);
+      }
+
+      if (mode != SQ_CF_KCACHE_MODE::LOCK_1 && mode != SQ_CF_KCACHE_MODE::LOCK_2) {
+         return InvalidValue;
+      }
+
+      load.channel = chan;
+      value = addValue(builder, load);
+      isStorage = true;
+   } else if (sel >= SQ_ALU_SRC::CONST_FILE_FIRST && sel <= SQ_ALU_SRC::CONST_FILE_LAST) {
+      auto load = Value { Opcode::LoadUniformRegister, Type::Float };
+      load.index = sel - SQ_ALU_SRC::CONST_FILE_FIRST;
+      load.channel = chan;
+      value = addValue(builder, load);
+      isStorage = true;
+   } else {
+      switch (sel) {
+      case SQ_ALU_SRC::PV:
+         value = builder.previousVector[chan];
+         isStorage = true;
+         break;
+      case SQ_ALU_SRC::PS:
+         value = builder.previousScalar;
+         isStorage = true;
+         break;
+      case SQ_ALU_SRC::IMM_0:
+         value = addFloatConstant(builder, 0.0f);
+         break;
+      case SQ_ALU_SRC::IMM_1:
+         value = addFloatConstant(builder, 1.0f);
+         break;
+      case SQ_ALU_SRC::IMM_0_5:
+         value = addFloatConstant(builder, 0.5f);
+         break;
+      case SQ_ALU_SRC::IMM_1_INT:
+      case SQ_ALU_SRC::IMM_M_1_INT:
+      {
+         auto one = (sel == SQ_ALU_SRC::IMM_1_INT) ? 1 : -1;
+
+         if (type == Type::Float) {
+            value = addFloatConstant(builder, static_cast<float>(one));
+         } else {
+            value = addConstant(builder, type, static_cast<uint32_t>(one));
+         }
+         break;
+      }
+      case SQ_ALU_SRC::LITERAL:
+         value = addConstant(builder, type, builder.literals[chan]);
+         break;
+      default:
+         return InvalidValue;
+      }
+
+      // The float immediates are converted when used by integer instructions
+      if (!isStorage && getValueType(builder, value) != type) {
+         value = addOp(builder, Opcode::Convert, type, { value });
+      }
+   }
+
+   // PV and PS are not valid at the start of a clause
+   if (value == InvalidValue) {
+      return InvalidValue;
+   }
+
+   if (isStorage && type != Type::Float) {
+      value = addOp(builder, Opcode::Bitcast, type, { value });
+   }
+
+   if (abs) {
+      if (type == Type::Uint) {
+         return InvalidValue;
+      }
+
+      value = addOp(builder, Opcode::Abs, type, { value });
+   }
+
+   if (neg) {
+      value = addOp(builder, Opcode::Neg, type, { value });
+   }
+
+   return value;
+}
+
+static ValueId
+readSource0(Builder &builder,
+            const AluInst &inst,
+            Type type)
+{
+   auto abs = false;
+
+   if (inst.word1.ENCODING() == SQ_ALU_ENCODING::OP2) {
+      abs = inst.op2.SRC0_ABS();
+   }
+
+   return readSource(builder, inst, type,
+                     inst.word0.SRC0_SEL(),
+                     inst.word0.SRC0_REL(),
+                     inst.word0.SRC0_CHAN(),
+                     abs,
+                     inst.word0.SRC0_NEG());
+}
+
+static ValueId
+readSource1(Builder &builder,
+            const AluInst &inst,
+            Type type)
+{
+   auto abs = false;
+
+   if (inst.word1.ENCODING() == SQ_ALU_ENCODING::OP2) {
+      abs = inst.op2.SRC1_ABS();
+   }
+
+   return readSource(builder, inst, type,
+                     inst.word0.SRC1_SEL(),
+                     inst.word0.SRC1_REL(),
+                     inst.word0.SRC1_CHAN(),
+                     abs,
+                     inst.word0.SRC1_NEG());
+}
+
+static ValueId
+readSource2(Builder &builder,
+            const AluInst &inst,
+            Type type)
+{
+   return readSource(builder, inst, type,
+                     inst.op3.SRC2_SEL(),
+                     inst.op3.SRC2_REL(),
+                     inst.op3.SRC2_CHAN(),
+                     false,
+                     inst.op3.SRC2_NEG());
+}
+
+static bool
+readSources(Builder &builder,
+            const AluInst &inst,
+            Type type,
+            unsigned count,
+            std::array<ValueId, 3> &src)
+{
+   src.fill(InvalidValue);
+
+   if (count > 0) {
+      src[0] = readSource0(builder, inst, type);
+   }
+
+   if (count > 1) {
+      src[1] = readSource1(builder, inst, type);
+   }
+
+   if (count > 2) {
+      src[2] = readSource2(builder, inst, type);
+   }
+
+   for (auto i = 0u; i < count; ++i) {
+      if (src[i] == InvalidValue) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static Type
+getInputType(SQ_ALU_FLAGS flags)
+{
+   if (flags & SQ_ALU_FLAG_INT_IN) {
+      return Type::Int;
+   } else if (flags & SQ_ALU_FLAG_UINT_IN) {
+      return Type::Uint;
+   } else {
+      return Type::Float;
+   }
+}
+
+static Type
+getOutputType(SQ_ALU_FLAGS flags)
+{
+   if (flags & SQ_ALU_FLAG_INT_OUT) {
+      return Type::Int;
+   } else if (flags & SQ_ALU_FLAG_UINT_OUT) {
+      return Type::Uint;
+   } else {
+      return Type::Float;
+   }
+}
+
+/**
+ * SETcc: (src0 op src1) ? true : false, where true is 1.0f for float
+ * results and all bits set for integer results.
+ */
+static ValueId
+addCompareSet(Builder &builder,
+              Opcode compare,
+              Type outType,
+              ValueId src0,
+              ValueId src1)
+{
+   auto condition = addOp(builder, compare, Type::Bool, { src0, src1 });
+   auto trueValue = InvalidValue;
+   auto falseValue = InvalidValue;
+
+   if (outType == Type::Float) {
+      trueValue = addFloatConstant(builder, 1.0f);
+      falseValue = addFloatConstant(builder, 0.0f);
+   } else {
+      trueValue = addConstant(builder, outType, 0xFFFFFFFF);
+      falseValue = addConstant(builder, outType, 0);
+   }
+
+   return addOp(builder, Opcode::Select, outType, { condition, trueValue, falseValue });
+}
+
+/**
+ * CNDcc: (src0 op 0) ? src1 : src2
+ */
+static ValueId
+addConditionalMove(Builder &builder,
+                   Opcode compare,
+                   Type type,
+                   const std::array<ValueId, 3> &src)
+{
+   auto zero = addConstant(builder, type, 0);
+   auto condition = addOp(builder, compare, Type::Bool, { src[0], zero });
+   return addOp(builder, Opcode::Select, type, { condition, src[1], src[2] });
+}
+
+/**
+ * Add the values for a single OP2 instruction, result is InvalidValue
+ * for NOP.
+ */
+static bool
+translateOp2(Builder &builder,
+             const AluInst &inst,
+             Type inType,
+             Type outType,
+             ValueId &result)
+{
+   auto src = std::array<ValueId, 3> { };
+   result = InvalidValue;
+
+   auto unary = [&](Opcode op) {
+      if (!readSources(builder, inst, inType, 1, src)) {
+         return false;
+      }
+
+      result = addOp(builder, op, inType, { src[0] });
+      return true;
+   };
+
+   auto binary = [&](Opcode op) {
+      if (!readSources(builder, inst, inType, 2, src)) {
+         return false;
+      }
+
+      result = addOp(builder, op, inType, { src[0], src[1] });
+      return true;
+   };
+
+   auto compareSet = [&](Opcode op) {
+      if (!readSources(builder, inst, inType, 2, src)) {
+         return false;
+      }
+
+      result = addCompareSet(builder, op, outType, src[0], src[1]);
+      return true;
+   };
+
+   auto convert = [&]() {
+      if (!readSources(builder, inst, inType, 1, src)) {
+         return false;
+      }
+
+      result = addOp(builder, Opcode::Convert, outType, { src[0] });
+      return true;
+   };
+
+   switch (inst.op2.ALU_INST()) {
+   case SQ_OP2_INST_NOP:
+      return true;
+   case SQ_OP2_INST_MOV:
+      return unary(Opcode::Move);
+   case SQ_OP2_INST_ADD:
+   case SQ_OP2_INST_ADD_INT:
+      return binary(Opcode::Add);
+   case SQ_OP2_INST_SUB_INT:
+      return binary(Opcode::Sub);
+   case SQ_OP2_INST_MUL:
+   case SQ_OP2_INST_MUL_IEEE:
+   case SQ_OP2_INST_MULLO_INT:
+   case SQ_OP2_INST_MULLO_UINT:
+      return binary(Opcode::Mul);
+   case SQ_OP2_INST_MAX:
+   case SQ_OP2_INST_MAX_DX10:
+   case SQ_OP2_INST_MAX_INT:
+   case SQ_OP2_INST_MAX_UINT:
+      return binary(Opcode::Max);
+   case SQ_OP2_INST_MIN:
+   case SQ_OP2_INST_MIN_DX10:
+   case SQ_OP2_INST_MIN_INT:
+   case SQ_OP2_INST_MIN_UINT:
+      return binary(Opcode::Min);
+   case SQ_OP2_INST_AND_INT:
+      return binary(Opcode::And);
+   case SQ_OP2_INST_OR_INT:
+      return binary(Opcode::Or);
+   case SQ_OP2_INST_XOR_INT:
+      return binary(Opcode::Xor);
+   case SQ_OP2_INST_NOT_INT:
+      return unary(Opcode::Not);
+   case SQ_OP2_INST_LSHL_INT:
+      return binary(Opcode::ShiftLeft);
+   case SQ_OP2_INST_LSHR_INT:
+      // Flagged as an int instruction but the shift is logical
+      if (!readSources(builder, inst, inType, 2, src)) {
+         return false;
+      }
+
+      result = addOp(builder, Opcode::Bitcast, Type::Uint, { src[0] });
+      result = addOp(builder, Opcode::ShiftRight, Type::Uint, { result, src[1] });
+      result = addOp(builder, Opcode::Bitcast, inType, { result });
+      return true;
+   case SQ_OP2_INST_ASHR_INT:
+      return binary(Opcode::ShiftRight);
+   case SQ_OP2_INST_FLOOR:
+      return unary(Opcode::Floor);
+   case SQ_OP2_INST_CEIL:
+      return unary(Opcode::Ceil);
+   case SQ_OP2_INST_FRACT:
+      return unary(Opcode::Fract);
+   case SQ_OP2_INST_TRUNC:
+      return unary(Opcode::Trunc);
+   case SQ_OP2_INST_RNDNE:
+      return unary(Opcode::RoundEven);
+   case SQ_OP2_INST_EXP_IEEE:
+      return unary(Opcode::Exp2);
+   case SQ_OP2_INST_LOG_CLAMPED:
+   case SQ_OP2_INST_LOG_IEEE:
+      if (!readSources(builder, inst, inType, 1, src)) {
+         return false;
+      }
+
+      result = addOp(builder, Opcode::Abs, inType, { src[0] });
+      result = addOp(builder, Opcode::Log2, inType, { result });
+      return true;
+   case SQ_OP2_INST_RECIP_CLAMPED:
+   case SQ_OP2_INST_RECIP_IEEE:
+   case SQ_OP2_INST_RECIP_FF:
+   case SQ_OP2_INST_RECIP_INT:
+   case SQ_OP2_INST_RECIP_UINT:
+      return unary(Opcode::Recip);
+   case SQ_OP2_INST_RECIPSQRT_CLAMPED:
+   case SQ_OP2_INST_RECIPSQRT_IEEE:
+   case SQ_OP2_INST_RECIPSQRT_FF:
+      return unary(Opcode::RecipSqrt);
+   case SQ_OP2_INST_SQRT_IEEE:
+      return unary(Opcode::Sqrt);
+   case SQ_OP2_INST_SIN:
+      return unary(Opcode::Sin);
+   case SQ_OP2_INST_COS:
+      return unary(Opcode::Cos);
+   case SQ_OP2_INST_FLT_TO_INT:
+   case SQ_OP2_INST_FLT_TO_UINT:
+   case SQ_OP2_INST_INT_TO_FLT:
+   case SQ_OP2_INST_UINT_TO_FLT:
+      return convert();
+   case SQ_OP2_INST_SETE:
+   case SQ_OP2_INST_SETE_DX10:
+   case SQ_OP2_INST_SETE_INT:
+      return compareSet(Opcode::CompareEqual);
+   case SQ_OP2_INST_SETNE:
+   case SQ_OP2_INST_SETNE_DX10:
+   case SQ_OP2_INST_SETNE_INT:
+      return compareSet(Opcode::CompareNotEqual);
+   case SQ_OP2_INST_SETGE:
+   case SQ_OP2_INST_SETGE_DX10:
+   case SQ_OP2_INST_SETGE_INT:
+   case SQ_OP2_INST_SETGE_UINT:
+      return compareSet(Opcode::CompareGreaterEqual);
+   case SQ_OP2_INST_SETGT:
+   case SQ_OP2_INST_SETGT_DX10:
+   case SQ_OP2_INST_SETGT_INT:
+   case SQ_OP2_INST_SETGT_UINT:
+      return compareSet(Opcode::CompareGreater);
+   default:
+      return false;
+   }
+}
+
+static bool
+translateOp3(Builder &builder,
+             const AluInst &inst,
+             Type inType,
+             ValueId &result)
+{
+   auto src = std::array<ValueId, 3> { };
+   auto modifier = 0.0f;
+
+   if (!readSources(builder, inst, inType, 3, src)) {
+      return false;
+   }
+
+   switch (inst.op3.ALU_INST()) {
+   case SQ_OP3_INST_CNDE:
+   case SQ_OP3_INST_CNDE_INT:
+      result = addConditionalMove(builder, Opcode::CompareEqual, inType, src);
+      return true;
+   case SQ_OP3_INST_CNDGE:
+   case SQ_OP3_INST_CNDGE_INT:
+      result = addConditionalMove(builder, Opcode::CompareGreaterEqual, inType, src);
+      return true;
+   case SQ_OP3_INST_CNDGT:
+   case SQ_OP3_INST_CNDGT_INT:
+      result = addConditionalMove(builder, Opcode::CompareGreater, inType, src);
+      return true;
+   case SQ_OP3_INST_MULADD:
+   case SQ_OP3_INST_MULADD_IEEE:
+      break;
+   case SQ_OP3_INST_MULADD_M2:
+   case SQ_OP3_INST_MULADD_IEEE_M2:
+      modifier = 2.0f;
+      break;
+   case SQ_OP3_INST_MULADD_M4:
+   case SQ_OP3_INST_MULADD_IEEE_M4:
+      modifier = 4.0f;
+      break;
+   case SQ_OP3_INST_MULADD_D2:
+   case SQ_OP3_INST_MULADD_IEEE_D2:
+      modifier = 0.5f;
+      break;
+   default:
+      return false;
+   }
+
+   result = addOp(builder, Opcode::MulAdd, inType, { src[0], src[1], src[2] });
+
+   if (modifier != 0.0f) {
+      result = addOp(builder, Opcode::Mul, inType, { result, addFloatConstant(builder, modifier) });
+   }
+
+   return true;
+}
+
+/**
+ * Apply the output modifier and clamp, then convert the result to the
+ * float storage used by the register file and PV / PS.
+ */
+static ValueId
+addDestModifiers(Builder &builder,
+                 const AluInst &inst,
+                 Type outType,
+                 ValueId value)
+{
+   auto omod = SQ_ALU_OMOD::OFF;
+
+   if (inst.word1.ENCODING() == SQ_ALU_ENCODING::OP2) {
+      omod = inst.op2.OMOD();
+   }
+
+   if (omod != SQ_ALU_OMOD::OFF) {
+      auto factor = 1.0f;
+
+      if (outType != Type::Float) {
+         return InvalidValue;
+      }
+
+      switch (omod) {
+      case SQ_ALU_OMOD::M2:
+         factor = 2.0f;
+         break;
+      case SQ_ALU_OMOD::M4:
+         factor = 4.0f;
+         break;
+      case SQ_ALU_OMOD::D2:
+         factor = 0.5f;
+         break;
+      default:
+         return InvalidValue;
+      }
+
+      value = addOp(builder, Opcode::Mul, outType, { value, addFloatConstant(builder, factor) });
+   }
+
+   if (inst.word1.CLAMP()) {
+      value = addOp(builder, Opcode::Clamp, outType, { value });
+   }
+
+   if (outType != Type::Float) {
+      value = addOp(builder, Opcode::Bitcast, Type::Float, { value });
+   }
+
+   return value;
+}
+
+static bool
+hasWriteMask(const AluInst &inst)
+{
+   if (inst.word1.ENCODING() == SQ_ALU_ENCODING::OP2) {
+      return inst.op2.WRITE_MASK();
+   }
+
+   return true;
+}
+
+static SQ_ALU_FLAGS
+getFlags(const AluInst &inst)
+{
+   if (inst.word1.ENCODING() == SQ_ALU_ENCODING::OP2) {
+      return getInstructionFlags(inst.op2.ALU_INST());
+   } else {
+      return getInstructionFlags(inst.op3.ALU_INST());
+   }
+}
+
+/**
+ * DOT4 is the only reduction we build, the result goes to every PV channel
+ * and to the destination of each instruction with its write mask set.
+ */
+static bool
+translateDot4(Builder &builder,
+              const AluGroup &group,
+              std::array<ValueId, 4> &vectorOut,
+              std::vector<PendingWrite> &writes)
+{
+   auto units = AluGroupUnits { };
+   auto reduction = std::array<const AluInst *, 4> { };
+   auto operands = std::array<ValueId, 8> { };
+   reduction.fill(nullptr);
+
+   for (auto &inst : group.instructions) {
+      auto unit = units.addInstructionUnit(inst);
+
+      if (unit != SQ_CHAN::T) {
+         reduction[unit] = &inst;
+      }
+   }
+
+   for (auto inst : reduction) {
+      if (!inst || inst->word1.ENCODING() != SQ_ALU_ENCODING::OP2) {
+         return false;
+      }
+
+      auto id = inst->op2.ALU_INST();
+
+      if (id != SQ_OP2_INST_DOT4 && id != SQ_OP2_INST_DOT4_IEEE) {
+         return false;
+      }
+
+      if (inst->op2.OMOD() != reduction[0]->op2.OMOD()
+       || inst->word1.CLAMP() != reduction[0]->word1.CLAMP()
+       || inst->word1.DST_REL()) {
+         return false;
+      }
+   }
+
+   for (auto i = 0u; i < 4; ++i) {
+      operands[i] = readSource0(builder, *reduction[i], Type::Float);
+      operands[4 + i] = readSource1(builder, *reduction[i], Type::Float);
+   }
+
+   for (auto operand : operands) {
+      if (operand == InvalidValue) {
+         return false;
+      }
+   }
+
+   auto dot = Value { Opcode::Dot4, Type::Float };
+   dot.numOperands = 8;
+   dot.operands = operands;
+
+   auto result = addDestModifiers(builder, *reduction[0], Type::Float, addValue(builder, dot));
+
+   if (result == InvalidValue) {
+      return false;
+   }
+
+   for (auto inst : reduction) {
+      if (inst->op2.WRITE_MASK()) {
+         writes.push_back({ RegisterKey { inst->word1.DST_GPR(), inst->word1.DST_CHAN() }, result });
+      }
+   }
+
+   vectorOut.fill(result);
+   return true;
+}
+
+static bool
+isReduction(const AluInst &inst)
+{
+   return !!(getFlags(inst) & SQ_ALU_FLAG_REDUCTION);
+}
+
+/**
+ * Build the IR for an ALU clause, returns false if the clause uses anything
+ * the IR does not support.
+ */
+bool
+buildAluClause(const gsl::span<const uint8_t> &binary,
+               const ControlFlowInst &cf,
+               Clause &clause)
+{
+   auto addr = cf.alu.word0.ADDR();
+   auto count = cf.alu.word1.COUNT() + 1;
+   auto instructions = reinterpret_cast<const AluInst *>(binary.data() + 8 * addr);
+   auto builder = Builder { clause, cf };
+
+   if (8 * (addr + count) > static_cast<size_t>(binary.size())) {
+      return false;
+   }
+
+   clause.values.clear();
+   clause.stores.clear();
+
+   for (size_t slot = 0u; slot < count; ) {
+      auto units = AluGroupUnits { };
+      auto group = AluGroup { instructions + slot };
+      auto vectorOut = builder.previousVector;
+      auto scalarOut = builder.previousScalar;
+      auto writes = std::vector<PendingWrite> { };
+      auto didReduction = false;
+      builder.literals = group.literals;
+
+      for (auto &inst : group.instructions) {
+         auto unit = units.addInstructionUnit(inst);
+         auto flags = getFlags(inst);
+         auto inType = getInputType(flags);
+         auto outType = getOutputType(flags);
+         auto result = InvalidValue;
+
+         if (isReduction(inst)) {
+            if (!didReduction && !translateDot4(builder, group, vectorOut, writes)) {
+               return false;
+            }
+
+            didReduction = true;
+            continue;
+         }
+
+         if (inst.word1.DST_REL() || (flags & SQ_ALU_FLAG_PRED_SET)) {
+            return false;
+         }
+
+         if (inst.word1.ENCODING() == SQ_ALU_ENCODING::OP2) {
+            if (!translateOp2(builder, inst, inType, outType, result)) {
+               return false;
+            }
+
+            if (result == InvalidValue) {
+               // NOP
+               continue;
+            }
+         } else if (!translateOp3(builder, inst, inType, result)) {
+            return false;
+         }
+
+         if (builder.clause.values[result].type != outType) {
+            return false;
+         }
+
+         result = addDestModifiers(builder, inst, outType, result);
+
+         if (result == InvalidValue) {
+            return false;
+         }
+
+         if (unit == SQ_CHAN::T) {
+            scalarOut = result;
+         } else {
+            vectorOut[unit] = result;
+         }
+
+         if (hasWriteMask(inst)) {
+            writes.push_back({ RegisterKey { inst.word1.DST_GPR(), inst.word1.DST_CHAN() }, result });
+         }
+      }
+
+      // Registers written by a group are only visible to the next group
+      for (auto &write : writes) {
+         builder.registers[write.key] = write.value;
+      }
+
+      builder.previousVector = vectorOut;
+      builder.previousScalar = scalarOut;
+      slot = group.getNextSlot(slot);
+   }
+
+   // PV and PS do not survive the end of a clause, so only registers are stored
+   for (auto &reg : builder.registers) {
+      clause.stores.push_back({ reg.first.first, reg.first.second, reg.second });
+   }
+
+   return true;
+}
+
+} // namespace ir
+
+} // namespace glsl2
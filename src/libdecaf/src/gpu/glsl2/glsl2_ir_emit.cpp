@@ -0,0 +1,417 @@
+#include "glsl2_alu.h"
+#include "glsl2_ir.h"
+#include "glsl2_translate.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+using namespace latte;
+
+namespace glsl2
+{
+
+namespace ir
+{
+
+struct Emitter
+{
+   State &state;
+   const Clause &clause;
+
+   //! Values which are assigned to a temporary rather than inlined
+   std::vector<bool> isTemporary;
+};
+
+static const char *
+getTypeName(Type type)
+{
+   switch (type) {
+   case Type::Bool:
+      return "bool";
+   case Type::Int:
+      return "int";
+   case Type::Uint:
+      return "uint";
+   case Type::Float:
+   default:
+      return "float";
+   }
+}
+
+static std::string
+getChannelName(SQ_CHAN channel)
+{
+   fmt::MemoryWriter out;
+   insertChannel(out, channel);
+   return out.str();
+}
+
+/**
+ * Print a float with the fewest digits which still give back the same
+ * bits, unlike {:.6f} which loses small values and precision.
+ */
+static std::string
+getFloatConstant(uint32_t bits)
+{
+   auto value = 0.0f;
+   std::memcpy(&value, &bits, sizeof(value));
+
+   if (!std::isfinite(value)) {
+      return fmt::format("uintBitsToFloat(0x{:08X}u)", bits);
+   }
+
+   char buffer[64];
+
+   for (auto precision = 1; precision <= 9; ++precision) {
+      std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+
+      if (std::strtof(buffer, nullptr) == value) {
+         break;
+      }
+   }
+
+   auto result = std::string { buffer };
+
+   if (result.find_first_of(".e") == std::string::npos) {
+      result += ".0";
+   }
+
+   // 0.0 and -0.0 compare equal above
+   if (std::signbit(value) && result[0] != '-') {
+      result = "-" + result;
+   }
+
+   return result;
+}
+
+static std::string
+getConstant(const Value &value)
+{
+   switch (value.type) {
+   case Type::Bool:
+      return value.constant ? "true" : "false";
+   case Type::Int:
+      if (value.constant == 0x80000000u) {
+         return "int(0x80000000u)";
+      }
+
+      return fmt::format("{}", static_cast<int32_t>(value.constant));
+   case Type::Uint:
+      return fmt::format("{}u", value.constant);
+   case Type::Float:
+   default:
+      return getFloatConstant(value.constant);
+   }
+}
+
+static std::string
+getLoad(Emitter &emitter,
+        const Value &value)
+{
+   auto shader = emitter.state.shader;
+   auto channel = getChannelName(value.channel);
+
+   switch (value.op) {
+   case Opcode::LoadRegister:
+      return fmt::format("R[{}].{}", value.index, channel);
+   case Opcode::LoadUniformBlock:
+      if (shader) {
+         shader->usedUniformBlocks[value.bank] = true;
+      }
+
+      return fmt::format("UB_{}.values[{}].{}", value.bank, value.index, channel);
+   case Opcode::LoadUniformRegister:
+   default:
+      if (!shader) {
+         return fmt::format("UR[{}].{}", value.index, channel);
+      } else if (shader->type == Shader::PixelShader) {
+         return fmt::format("PR[{}].{}", value.index, channel);
+      } else if (shader->type == Shader::VertexShader) {
+         return fmt::format("VR[{}].{}", value.index, channel);
+      } else {
+         return fmt::format("GR[{}].{}", value.index, channel);
+      }
+   }
+}
+
+static const char *
+getBitcastName(Type from,
+               Type to)
+{
+   if (from == Type::Float) {
+      return (to == Type::Int) ? "floatBitsToInt" : "floatBitsToUint";
+   } else if (to == Type::Float) {
+      return (from == Type::Int) ? "intBitsToFloat" : "uintBitsToFloat";
+   } else {
+      return getTypeName(to);
+   }
+}
+
+static const char *
+getFunctionName(Opcode op)
+{
+   switch (op) {
+   case Opcode::Abs:
+      return "abs";
+   case Opcode::Min:
+      return "min";
+   case Opcode::Max:
+      return "max";
+   case Opcode::Floor:
+      return "floor";
+   case Opcode::Ceil:
+      return "ceil";
+   case Opcode::Fract:
+      return "fract";
+   case Opcode::Trunc:
+      return "trunc";
+   case Opcode::RoundEven:
+      return "roundEven";
+   case Opcode::Exp2:
+      return "exp2";
+   case Opcode::Log2:
+      return "log2";
+   case Opcode::RecipSqrt:
+      return "inversesqrt";
+   case Opcode::Sqrt:
+      return "sqrt";
+   case Opcode::Sin:
+      return "sin";
+   case Opcode::Cos:
+      return "cos";
+   default:
+      return nullptr;
+   }
+}
+
+static const char *
+getOperatorName(Opcode op)
+{
+   switch (op) {
+   case Opcode::Add:
+      return " + ";
+   case Opcode::Sub:
+      return " - ";
+   case Opcode::Mul:
+      return " * ";
+   case Opcode::And:
+      return " & ";
+   case Opcode::Or:
+      return " | ";
+   case Opcode::Xor:
+      return " ^ ";
+   case Opcode::ShiftLeft:
+      return " << ";
+   case Opcode::ShiftRight:
+      return " >> ";
+   case Opcode::CompareEqual:
+      return " == ";
+   case Opcode::CompareNotEqual:
+      return " != ";
+   case Opcode::CompareGreaterEqual:
+      return " >= ";
+   case Opcode::CompareGreater:
+      return " > ";
+   default:
+      return nullptr;
+   }
+}
+
+static std::string
+getExpression(Emitter &emitter,
+              ValueId id,
+              bool isOperand);
+
+static std::string
+getOperand(Emitter &emitter,
+           const Value &value,
+           unsigned index)
+{
+   return getExpression(emitter, value.operands[index], true);
+}
+
+static std::string
+getArgument(Emitter &emitter,
+            const Value &value,
+            unsigned index)
+{
+   return getExpression(emitter, value.operands[index], false);
+}
+
+/**
+ * Print the expression computing a value, operands which are not in a
+ * temporary are printed inline.  When isOperand is set anything which is
+ * not a name, literal or function call is wrapped in parentheses.
+ */
+static std::string
+getExpression(Emitter &emitter,
+              ValueId id,
+              bool isOperand)
+{
+   auto &value = emitter.clause.values[id];
+   auto result = std::string { };
+   auto isInfix = false;
+
+   if (emitter.isTemporary[id]) {
+      return fmt::format("v{}", id);
+   }
+
+   if (auto name = getFunctionName(value.op)) {
+      if (value.op == Opcode::Sin || value.op == Opcode::Cos) {
+         return fmt::format("{}({} / 0.1591549367)", name, getOperand(emitter, value, 0));
+      } else if (value.numOperands == 1) {
+         return fmt::format("{}({})", name, getArgument(emitter, value, 0));
+      } else {
+         return fmt::format("{}({}, {})", name, getArgument(emitter, value, 0), getArgument(emitter, value, 1));
+      }
+   }
+
+   if (auto name = getOperatorName(value.op)) {
+      result = getOperand(emitter, value, 0) + name + getOperand(emitter, value, 1);
+      isInfix = true;
+   } else {
+      switch (value.op) {
+      case Opcode::Constant:
+         result = getConstant(value);
+         isInfix = result[0] == '-';
+         break;
+      case Opcode::LoadRegister:
+      case Opcode::LoadUniformBlock:
+      case Opcode::LoadUniformRegister:
+         result = getLoad(emitter, value);
+         break;
+      case Opcode::Move:
+         return getExpression(emitter, value.operands[0], isOperand);
+      case Opcode::Bitcast:
+      {
+         auto from = emitter.clause.values[value.operands[0]].type;
+         result = fmt::format("{}({})", getBitcastName(from, value.type), getArgument(emitter, value, 0));
+         break;
+      }
+      case Opcode::Convert:
+         result = fmt::format("{}({})", getTypeName(value.type), getArgument(emitter, value, 0));
+         break;
+      case Opcode::Neg:
+         result = "-" + getOperand(emitter, value, 0);
+         isInfix = true;
+         break;
+      case Opcode::Not:
+         result = "~" + getOperand(emitter, value, 0);
+         isInfix = true;
+         break;
+      case Opcode::Clamp:
+         if (value.type == Type::Float) {
+            result = fmt::format("clamp({}, 0.0, 1.0)", getArgument(emitter, value, 0));
+         } else if (value.type == Type::Int) {
+            result = fmt::format("clamp({}, 0, 1)", getArgument(emitter, value, 0));
+         } else {
+            result = fmt::format("clamp({}, 0u, 1u)", getArgument(emitter, value, 0));
+         }
+         break;
+      case Opcode::MulAdd:
+         result = getOperand(emitter, value, 0) + " * " + getOperand(emitter, value, 1) + " + " + getOperand(emitter, value, 2);
+         isInfix = true;
+         break;
+      case Opcode::Recip:
+         if (value.type == Type::Float) {
+            result = "1.0 / " + getOperand(emitter, value, 0);
+         } else if (value.type == Type::Int) {
+            result = "1 / " + getOperand(emitter, value, 0);
+         } else {
+            result = "1u / " + getOperand(emitter, value, 0);
+         }
+         isInfix = true;
+         break;
+      case Opcode::Dot4:
+         result = fmt::format("dot(vec4({}, {}, {}, {}), vec4({}, {}, {}, {}))",
+                              getArgument(emitter, value, 0), getArgument(emitter, value, 1),
+                              getArgument(emitter, value, 2), getArgument(emitter, value, 3),
+                              getArgument(emitter, value, 4), getArgument(emitter, value, 5),
+                              getArgument(emitter, value, 6), getArgument(emitter, value, 7));
+         break;
+      case Opcode::Select:
+         result = getOperand(emitter, value, 0) + " ? " + getOperand(emitter, value, 1) + " : " + getOperand(emitter, value, 2);
+         isInfix = true;
+         break;
+      default:
+         throw translate_exception(fmt::format("Unexpected IR opcode {}", static_cast<unsigned>(value.op)));
+      }
+   }
+
+   if (isOperand && isInfix) {
+      return "(" + result + ")";
+   }
+
+   return result;
+}
+
+static bool
+isLoad(const Value &value)
+{
+   return value.op == Opcode::LoadRegister
+      || value.op == Opcode::LoadUniformBlock
+      || value.op == Opcode::LoadUniformRegister;
+}
+
+/**
+ * Print an optimised clause, the caller has already opened the clause's
+ * active mask condition.
+ *
+ * Register reads which are overwritten by the clause and values used more
+ * than once are assigned to temporaries first, then every register channel
+ * is written from them at the end of the clause.
+ */
+void
+emitClause(State &state,
+           const Clause &clause)
+{
+   auto emitter = Emitter { state, clause };
+   emitter.isTemporary.resize(clause.values.size(), false);
+
+   for (auto &store : clause.stores) {
+      for (auto &value : clause.values) {
+         if (value.op == Opcode::LoadRegister && value.index == store.gpr && value.channel == store.channel) {
+            emitter.isTemporary[&value - &clause.values[0]] = true;
+         }
+      }
+   }
+
+   for (auto id = ValueId { 0 }; id < clause.values.size(); ++id) {
+      auto &value = clause.values[id];
+
+      if (value.op == Opcode::Constant || value.op == Opcode::Move || isLoad(value)) {
+         continue;
+      }
+
+      if (value.uses > 1) {
+         emitter.isTemporary[id] = true;
+      }
+   }
+
+   for (auto id = ValueId { 0 }; id < clause.values.size(); ++id) {
+      if (!emitter.isTemporary[id]) {
+         continue;
+      }
+
+      // Print the expression before marking it so it is not printed as itself
+      emitter.isTemporary[id] = false;
+      auto expression = getExpression(emitter, id, false);
+      emitter.isTemporary[id] = true;
+
+      insertLineStart(state);
+      state.out.write("{} v{} = {};", getTypeName(clause.values[id].type), id, expression);
+      insertLineEnd(state);
+   }
+
+   for (auto &store : clause.stores) {
+      insertLineStart(state);
+      state.out.write("R[{}].{} = {};", store.gpr, getChannelName(store.channel), getExpression(emitter, store.value, false));
+      insertLineEnd(state);
+   }
+}
+
+} // namespace ir
+
+} // namespace glsl2
@@ -0,0 +1,680 @@
+#include "glsl2_ir.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <tuple>
+
+namespace glsl2
+{
+
+namespace ir
+{
+
+static float
+asFloat(uint32_t bits)
+{
+   auto value = 0.0f;
+   std::memcpy(&value, &bits, sizeof(value));
+   return value;
+}
+
+static uint32_t
+fromFloat(float value)
+{
+   auto bits = uint32_t { 0 };
+   std::memcpy(&bits, &value, sizeof(bits));
+   return bits;
+}
+
+static int32_t
+asInt(uint32_t bits)
+{
+   return static_cast<int32_t>(bits);
+}
+
+static ValueId
+resolveCopy(const Clause &clause,
+            ValueId id)
+{
+   while (clause.values[id].op == Opcode::Move) {
+      id = clause.values[id].operands[0];
+   }
+
+   return id;
+}
+
+static void
+makeConstant(Value &value,
+             uint32_t bits)
+{
+   value.op = Opcode::Constant;
+   value.numOperands = 0;
+   value.operands.fill(InvalidValue);
+   value.constant = bits;
+}
+
+static bool
+makeMove(Clause &clause,
+         Value &value,
+         ValueId source)
+{
+   if (clause.values[source].type != value.type) {
+      return false;
+   }
+
+   value.op = Opcode::Move;
+   value.numOperands = 1;
+   value.operands.fill(InvalidValue);
+   value.operands[0] = source;
+   return true;
+}
+
+/**
+ * Evaluate a single value from the bits of its operands.
+ *
+ * With exactOnly set, operations whose result may differ between the host
+ * and the GPU (transcendentals, fused multiply add, NaN handling, undefined
+ * shifts and conversions) are refused so constant folding never changes
+ * what the shader computes.
+ */
+static bool
+evaluate(const Clause &clause,
+         const Value &value,
+         const std::array<uint32_t, MaxOperands> &operands,
+         uint32_t &result,
+         bool exactOnly)
+{
+   auto a = operands[0];
+   auto b = operands[1];
+   auto c = operands[2];
+   auto fa = asFloat(a);
+   auto fb = asFloat(b);
+   auto fc = asFloat(c);
+   auto operandType = Type::Float;
+
+   if (value.numOperands > 0) {
+      operandType = clause.values[value.operands[0]].type;
+   }
+
+   auto isNaN = [&](unsigned count) {
+      for (auto i = 0u; i < count; ++i) {
+         if (std::isnan(asFloat(operands[i]))) {
+            return true;
+         }
+      }
+
+      return false;
+   };
+
+   switch (value.op) {
+   case Opcode::Move:
+   case Opcode::Bitcast:
+      result = a;
+      return true;
+   case Opcode::Convert:
+      if (operandType == Type::Float) {
+         auto limit = (value.type == Type::Int) ? 2147483648.0f : 4294967296.0f;
+         auto lower = (value.type == Type::Int) ? -2147483648.0f : 0.0f;
+
+         if (std::isnan(fa) || fa >= limit || std::trunc(fa) < lower) {
+            if (exactOnly) {
+               return false;
+            }
+
+            result = 0;
+            return true;
+         }
+
+         if (value.type == Type::Int) {
+            result = static_cast<uint32_t>(static_cast<int32_t>(fa));
+         } else if (value.type == Type::Uint) {
+            result = static_cast<uint32_t>(fa);
+         } else {
+            result = a;
+         }
+      } else if (value.type == Type::Float) {
+         if (operandType == Type::Int) {
+            result = fromFloat(static_cast<float>(asInt(a)));
+         } else {
+            result = fromFloat(static_cast<float>(a));
+         }
+      } else {
+         result = a;
+      }
+      return true;
+   case Opcode::Neg:
+      result = (value.type == Type::Float) ? (a ^ 0x80000000u) : (0u - a);
+      return true;
+   case Opcode::Abs:
+      if (value.type == Type::Float) {
+         result = a & 0x7FFFFFFFu;
+      } else {
+         result = asInt(a) < 0 ? (0u - a) : a;
+      }
+      return true;
+   case Opcode::Clamp:
+      if (value.type == Type::Float) {
+         if (exactOnly && isNaN(1)) {
+            return false;
+         }
+
+         result = fromFloat(std::min(std::max(fa, 0.0f), 1.0f));
+      } else if (value.type == Type::Int) {
+         result = static_cast<uint32_t>(std::min(std::max(asInt(a), 0), 1));
+      } else {
+         result = std::min(a, 1u);
+      }
+      return true;
+   case Opcode::Add:
+      result = (value.type == Type::Float) ? fromFloat(fa + fb) : (a + b);
+      return true;
+   case Opcode::Sub:
+      result = (value.type == Type::Float) ? fromFloat(fa - fb) : (a - b);
+      return true;
+   case Opcode::Mul:
+      result = (value.type == Type::Float) ? fromFloat(fa * fb) : (a * b);
+      return true;
+   case Opcode::MulAdd:
+      if (value.type == Type::Float) {
+         // The GPU may or may not fuse this
+         if (exactOnly) {
+            return false;
+         }
+
+         auto product = fa * fb;
+         result = fromFloat(product + fc);
+      } else {
+         result = a * b + c;
+      }
+      return true;
+   case Opcode::Min:
+   case Opcode::Max:
+   {
+      auto isLess = false;
+
+      if (value.type == Type::Float) {
+         if (exactOnly && isNaN(2)) {
+            return false;
+         }
+
+         isLess = fb < fa;
+      } else if (value.type == Type::Int) {
+         isLess = asInt(b) < asInt(a);
+      } else {
+         isLess = b < a;
+      }
+
+      if (value.op == Opcode::Min) {
+         result = isLess ? b : a;
+      } else {
+         result = isLess ? a : b;
+      }
+      return true;
+   }
+   case Opcode::Floor:
+      result = fromFloat(std::floor(fa));
+      return true;
+   case Opcode::Ceil:
+      result = fromFloat(std::ceil(fa));
+      return true;
+   case Opcode::Trunc:
+      result = fromFloat(std::trunc(fa));
+      return true;
+   case Opcode::RoundEven:
+      result = fromFloat(std::nearbyint(fa));
+      return true;
+   case Opcode::Fract:
+      if (exactOnly && !std::isfinite(fa)) {
+         return false;
+      }
+
+      result = fromFloat(fa - std::floor(fa));
+      return true;
+   case Opcode::Recip:
+      if (value.type == Type::Float) {
+         if (exactOnly) {
+            return false;
+         }
+
+         result = fromFloat(1.0f / fa);
+      } else if (a == 0) {
+         if (exactOnly) {
+            return false;
+         }
+
+         result = 0;
+      } else if (value.type == Type::Int) {
+         result = static_cast<uint32_t>(1 / asInt(a));
+      } else {
+         result = 1u / a;
+      }
+      return true;
+   case Opcode::Exp2:
+   case Opcode::Log2:
+   case Opcode::RecipSqrt:
+   case Opcode::Sqrt:
+   case Opcode::Sin:
+   case Opcode::Cos:
+   case Opcode::Dot4:
+      if (exactOnly) {
+         return false;
+      }
+
+      switch (value.op) {
+      case Opcode::Exp2:
+         result = fromFloat(std::exp2(fa));
+         break;
+      case Opcode::Log2:
+         result = fromFloat(std::log2(fa));
+         break;
+      case Opcode::RecipSqrt:
+         result = fromFloat(1.0f / std::sqrt(fa));
+         break;
+      case Opcode::Sqrt:
+         result = fromFloat(std::sqrt(fa));
+         break;
+      case Opcode::Sin:
+         result = fromFloat(std::sin(fa / 0.1591549367f));
+         break;
+      case Opcode::Cos:
+         result = fromFloat(std::cos(fa / 0.1591549367f));
+         break;
+      default:
+      {
+         auto sum = 0.0f;
+
+         for (auto i = 0u; i < 4; ++i) {
+            sum += asFloat(operands[i]) * asFloat(operands[4 + i]);
+         }
+
+         result = fromFloat(sum);
+      }
+      }
+      return true;
+   case Opcode::And:
+      result = a & b;
+      return true;
+   case Opcode::Or:
+      result = a | b;
+      return true;
+   case Opcode::Xor:
+      result = a ^ b;
+      return true;
+   case Opcode::Not:
+      result = ~a;
+      return true;
+   case Opcode::ShiftLeft:
+   case Opcode::ShiftRight:
+      if (b >= 32) {
+         if (exactOnly) {
+            return false;
+         }
+
+         result = 0;
+      } else if (value.op == Opcode::ShiftLeft) {
+         result = a << b;
+      } else if (value.type == Type::Int) {
+         result = static_cast<uint32_t>(asInt(a) >> b);
+      } else {
+         result = a >> b;
+      }
+      return true;
+   case Opcode::CompareEqual:
+   case Opcode::CompareNotEqual:
+   case Opcode::CompareGreaterEqual:
+   case Opcode::CompareGreater:
+   {
+      auto isEqual = false;
+      auto isGreater = false;
+
+      if (operandType == Type::Float) {
+         isEqual = fa == fb;
+         isGreater = fa > fb;
+      } else if (operandType == Type::Int) {
+         isEqual = a == b;
+         isGreater = asInt(a) > asInt(b);
+      } else {
+         isEqual = a == b;
+         isGreater = a > b;
+      }
+
+      if (value.op == Opcode::CompareEqual) {
+         result = isEqual ? 1 : 0;
+      } else if (value.op == Opcode::CompareNotEqual) {
+         result = (operandType == Type::Float) ? (fa != fb) : !isEqual;
+      } else if (value.op == Opcode::CompareGreaterEqual) {
+         result = (operandType == Type::Float) ? (fa >= fb) : (isEqual || isGreater);
+      } else {
+         result = isGreater ? 1 : 0;
+      }
+      return true;
+   }
+   case Opcode::Select:
+      result = a ? b : c;
+      return true;
+   default:
+      return false;
+   }
+}
+
+/**
+ * Replace every use of a Move with the value it copies.
+ */
+void
+propagateCopies(Clause &clause)
+{
+   for (auto &value : clause.values) {
+      for (auto i = 0u; i < value.numOperands; ++i) {
+         value.operands[i] = resolveCopy(clause, value.operands[i]);
+      }
+   }
+
+   for (auto &store : clause.stores) {
+      store.value = resolveCopy(clause, store.value);
+   }
+}
+
+static bool
+isConstant(const Clause &clause,
+           ValueId id,
+           uint32_t bits)
+{
+   auto &value = clause.values[id];
+   return value.op == Opcode::Constant && value.constant == bits;
+}
+
+/**
+ * Simplify a value whose operands are not all constant, returns true if
+ * it was changed.
+ */
+static bool
+simplify(Clause &clause,
+         Value &value)
+{
+   auto &ops = value.operands;
+   auto one = (value.type == Type::Float) ? fromFloat(1.0f) : 1u;
+
+   switch (value.op) {
+   case Opcode::Bitcast:
+   {
+      auto &source = clause.values[ops[0]];
+
+      if (source.type == value.type) {
+         return makeMove(clause, value, ops[0]);
+      }
+
+      // floatBitsToInt(intBitsToFloat(x)) is x
+      if (source.op == Opcode::Bitcast) {
+         ops[0] = source.operands[0];
+         return clause.values[ops[0]].type == value.type ? makeMove(clause, value, ops[0]) : true;
+      }
+
+      return false;
+   }
+   case Opcode::Neg:
+      if (clause.values[ops[0]].op == Opcode::Neg) {
+         return makeMove(clause, value, clause.values[ops[0]].operands[0]);
+      }
+      return false;
+   case Opcode::Abs:
+      if (clause.values[ops[0]].op == Opcode::Neg || clause.values[ops[0]].op == Opcode::Abs) {
+         ops[0] = clause.values[ops[0]].operands[0];
+         return true;
+      }
+      return false;
+   case Opcode::Clamp:
+      if (clause.values[ops[0]].op == Opcode::Clamp) {
+         return makeMove(clause, value, ops[0]);
+      }
+      return false;
+   case Opcode::Mul:
+      if (isConstant(clause, ops[1], one)) {
+         return makeMove(clause, value, ops[0]);
+      } else if (isConstant(clause, ops[0], one)) {
+         return makeMove(clause, value, ops[1]);
+      }
+      return false;
+   case Opcode::Add:
+   case Opcode::Or:
+   case Opcode::Xor:
+      if (value.type == Type::Float && value.op == Opcode::Add) {
+         // x + 0.0 is not x when x is -0.0
+         return false;
+      } else if (isConstant(clause, ops[1], 0)) {
+         return makeMove(clause, value, ops[0]);
+      } else if (isConstant(clause, ops[0], 0)) {
+         return makeMove(clause, value, ops[1]);
+      }
+      return false;
+   case Opcode::And:
+      if (isConstant(clause, ops[1], 0xFFFFFFFF)) {
+         return makeMove(clause, value, ops[0]);
+      } else if (isConstant(clause, ops[0], 0xFFFFFFFF)) {
+         return makeMove(clause, value, ops[1]);
+      }
+      return false;
+   case Opcode::Sub:
+   case Opcode::ShiftLeft:
+   case Opcode::ShiftRight:
+      if (value.type != Type::Float && isConstant(clause, ops[1], 0)) {
+         return makeMove(clause, value, ops[0]);
+      }
+      return false;
+   case Opcode::Select:
+      if (clause.values[ops[0]].op == Opcode::Constant) {
+         return makeMove(clause, value, clause.values[ops[0]].constant ? ops[1] : ops[2]);
+      } else if (ops[1] == ops[2]) {
+         return makeMove(clause, value, ops[1]);
+      }
+      return false;
+   default:
+      return false;
+   }
+}
+
+/**
+ * Evaluate values whose operands are all constant and apply algebraic
+ * identities which do not change the result, e.g. x * 1.0 or the
+ * bitcasts between two integer instructions.
+ */
+void
+foldConstants(Clause &clause)
+{
+   for (auto &value : clause.values) {
+      auto operands = std::array<uint32_t, MaxOperands> { };
+      auto isConstantOperands = value.numOperands > 0;
+
+      if (value.op == Opcode::Constant || value.op == Opcode::Move) {
+         continue;
+      }
+
+      for (auto i = 0u; i < value.numOperands; ++i) {
+         auto id = resolveCopy(clause, value.operands[i]);
+         auto &operand = clause.values[id];
+         value.operands[i] = id;
+
+         if (operand.op == Opcode::Constant) {
+            operands[i] = operand.constant;
+         } else {
+            isConstantOperands = false;
+         }
+      }
+
+      auto result = uint32_t { 0 };
+
+      if (isConstantOperands && evaluate(clause, value, operands, result, true)) {
+         if (value.type == Type::Bool) {
+            result = result ? 1 : 0;
+         }
+
+         makeConstant(value, result);
+      } else {
+         // Keep simplifying until nothing changes, e.g. a bitcast of a
+         // bitcast which then turns into a move
+         while (value.op != Opcode::Move && simplify(clause, value)) {
+         }
+      }
+   }
+}
+
+/**
+ * Merge values which compute the same thing from the same operands, this
+ * includes repeated constants, register reads and uniform reads.
+ */
+void
+eliminateCommonSubexpressions(Clause &clause)
+{
+   using Key = std::tuple<Opcode, Type, std::array<ValueId, MaxOperands>, uint32_t, uint32_t, uint32_t, latte::SQ_CHAN>;
+   auto known = std::map<Key, ValueId> { };
+   auto replacement = std::vector<ValueId>(clause.values.size());
+
+   for (auto id = ValueId { 0 }; id < clause.values.size(); ++id) {
+      auto &value = clause.values[id];
+      replacement[id] = id;
+
+      for (auto i = 0u; i < value.numOperands; ++i) {
+         value.operands[i] = replacement[value.operands[i]];
+      }
+
+      if (value.op == Opcode::Move) {
+         continue;
+      }
+
+      auto key = Key { value.op, value.type, value.operands, value.constant, value.index, value.bank, value.channel };
+      auto itr = known.find(key);
+
+      if (itr != known.end()) {
+         replacement[id] = itr->second;
+      } else {
+         known.emplace(key, id);
+      }
+   }
+
+   for (auto &store : clause.stores) {
+      store.value = replacement[store.value];
+   }
+}
+
+/**
+ * Drop stores which write back the value the register already had, then
+ * remove every value no store depends on and count the uses of the rest.
+ */
+void
+eliminateDeadCode(Clause &clause)
+{
+   auto live = std::vector<bool>(clause.values.size(), false);
+   auto remap = std::vector<ValueId>(clause.values.size(), InvalidValue);
+   auto stores = std::vector<Store> { };
+
+   for (auto &store : clause.stores) {
+      auto &value = clause.values[store.value];
+
+      if (value.op == Opcode::LoadRegister && value.index == store.gpr && value.channel == store.channel) {
+         continue;
+      }
+
+      stores.push_back(store);
+      live[store.value] = true;
+   }
+
+   // Operands always come before their users so one backwards pass is enough
+   for (auto id = clause.values.size(); id-- > 0; ) {
+      if (!live[id]) {
+         continue;
+      }
+
+      auto &value = clause.values[id];
+
+      for (auto i = 0u; i < value.numOperands; ++i) {
+         live[value.operands[i]] = true;
+      }
+   }
+
+   auto values = std::vector<Value> { };
+
+   for (auto id = ValueId { 0 }; id < clause.values.size(); ++id) {
+      if (!live[id]) {
+         continue;
+      }
+
+      auto value = clause.values[id];
+      value.uses = 0;
+
+      for (auto i = 0u; i < value.numOperands; ++i) {
+         value.operands[i] = remap[value.operands[i]];
+         values[value.operands[i]].uses++;
+      }
+
+      remap[id] = static_cast<ValueId>(values.size());
+      values.push_back(value);
+   }
+
+   for (auto &store : stores) {
+      store.value = remap[store.value];
+      values[store.value].uses++;
+   }
+
+   clause.values = std::move(values);
+   clause.stores = std::move(stores);
+}
+
+void
+optimise(Clause &clause)
+{
+   propagateCopies(clause);
+   foldConstants(clause);
+   propagateCopies(clause);
+   eliminateCommonSubexpressions(clause);
+   eliminateDeadCode(clause);
+}
+
+/**
+ * Run the clause on the host, load is called for every load in the clause
+ * and the register channels stored by the clause are returned.
+ */
+std::map<RegisterKey, uint32_t>
+evaluateClause(const Clause &clause,
+               const LoadFunction &load)
+{
+   auto results = std::vector<uint32_t>(clause.values.size(), 0);
+   auto registers = std::map<RegisterKey, uint32_t> { };
+
+   for (auto id = ValueId { 0 }; id < clause.values.size(); ++id) {
+      auto &value = clause.values[id];
+      auto operands = std::array<uint32_t, MaxOperands> { };
+
+      switch (value.op) {
+      case Opcode::Constant:
+         results[id] = value.constant;
+         continue;
+      case Opcode::LoadRegister:
+      case Opcode::LoadUniformBlock:
+      case Opcode::LoadUniformRegister:
+         results[id] = load(value);
+         continue;
+      default:
+         break;
+      }
+
+      for (auto i = 0u; i < value.numOperands; ++i) {
+         operands[i] = results[value.operands[i]];
+      }
+
+      evaluate(clause, value, operands, results[id], false);
+
+      if (value.type == Type::Bool) {
+         results[id] = results[id] ? 1 : 0;
+      }
+   }
+
+   for (auto &store : clause.stores) {
+      registers[RegisterKey { store.gpr, store.channel }] = results[store.value];
+   }
+
+   return registers;
+}
+
+} // namespace ir
+
+} // namespace glsl2
@@ -2,12 +2,14 @@
 #include <common/log.h>
 #include "glsl2_translate.h"
 #include "glsl2_cf.h"
+#include "glsl2_ir.h"
 #include "gpu/latte_constants.h"
 #include "gpu/microcode/latte_decoders.h"
 #include "gpu/microcode/latte_disassembler.h"
 #include "gpu/microcode/latte_instructions.h"
 #include "gpu/opengl/opengl_constants.h"
 #include <map>
+#include <mutex>
 
 using namespace latte;
 
@@ -239,6 +241,52 @@ isReductionInstruction(const AluInst &inst)
    return !!(flags & SQ_ALU_FLAG_REDUCTION);
 }
 
+/**
+ * Translate an ALU clause through the clause IR, returns false without
+ * printing anything if the clause has to be translated group by group.
+ */
+static bool
+translateOptimisedALU(State &state, const ControlFlowInst &cf)
+{
+   auto clause = ir::Clause { };
+
+   if (!state.shader || !state.shader->optimiseAluClauses) {
+      return false;
+   }
+
+   if (!ir::buildAluClause(state.binary, cf, clause)) {
+      return false;
+   }
+
+   ir::optimise(clause);
+
+   // Keep the disassembly so the output can still be read against it
+   auto addr = cf.alu.word0.ADDR();
+   auto count = cf.alu.word1.COUNT() + 1;
+   auto instructions = reinterpret_cast<const AluInst *>(state.binary.data() + 8 * addr);
+
+   for (size_t slot = 0u; slot < count; ) {
+      auto units = AluGroupUnits {};
+      auto group = AluGroup { instructions + slot };
+
+      for (auto j = 0u; j < group.instructions.size(); ++j) {
+         auto &inst = group.instructions[j];
+         auto unit = units.addInstructionUnit(inst);
+
+         insertLineStart(state);
+         state.out.write("// {:02} ", state.groupPC);
+         latte::disassembler::disassembleAluInstruction(state.out, cf, inst, state.groupPC, unit, group.literals);
+         insertLineEnd(state);
+      }
+
+      slot = group.getNextSlot(slot);
+      state.groupPC++;
+   }
+
+   ir::emitClause(state, clause);
+   return true;
+}
+
 static void
 translateControlFlowALU(State &state, const ControlFlowInst &cf)
 {
@@ -264,7 +312,9 @@ translateControlFlowALU(State &state, const ControlFlowInst &cf)
 
    condStart(state, latte::SQ_CF_COND::ACTIVE);
 
-   for (size_t slot = 0u; slot < count; ) {
+   auto didOptimise = translateOptimisedALU(state, cf);
+
+   for (size_t slot = 0u; slot < count && !didOptimise; ) {
       auto units = AluGroupUnits {};
       auto group = AluGroup { clause + slot };
       auto didReduction = false;
@@ -405,21 +455,19 @@ translateControlFlowALU(State &state, const ControlFlowInst &cf)
 static void
 initialise()
 {
-   static bool didRegister = false;
-
-   if (didRegister) {
-      return;
-   }
-
-   didRegister = true;
-   registerCfFunctions();
-   registerExpFunctions();
-   registerTexFunctions();
-   registerVtxFunctions();
-   registerOP2Functions();
-   registerOP3Functions();
-   registerOP2ReductionFunctions();
-   registerOP3ReductionFunctions();
+   static std::once_flag didRegister;
+
+   // Shaders may be translated on several threads at once
+   std::call_once(didRegister, []() {
+      registerCfFunctions();
+      registerExpFunctions();
+      registerTexFunctions();
+      registerVtxFunctions();
+      registerOP2Functions();
+      registerOP3Functions();
+      registerOP2ReductionFunctions();
+      registerOP3ReductionFunctions();
+   });
 }
 
 void
@@ -545,11 +593,17 @@ insertFileHeader(State &state)
 
    if (state.shader->uniformRegistersEnabled) {
       if (state.shader->type == Shader::PixelShader) {
-         out << "uniform vec4 PR[256];\n";
+         out << "layout (binding = " << PixelRegisterBinding << ", std140) uniform PixelRegisters {\n"
+             << "   vec4 PR[" << latte::MaxUniformRegisters << "];\n"
+             << "};\n";
       } else if (state.shader->type == Shader::VertexShader) {
-         out << "uniform vec4 VR[256];\n";
+         out << "layout (binding = " << VertexRegisterBinding << ", std140) uniform VertexRegisters {\n"
+             << "   vec4 VR[" << latte::MaxUniformRegisters << "];\n"
+             << "};\n";
       } else if (state.shader->type == Shader::GeometryShader) {
-         out << "uniform vec4 GR[256];\n";
+         out << "layout (binding = " << GeometryRegisterBinding << ", std140) uniform GeometryRegisters {\n"
+             << "   vec4 GR[" << latte::MaxUniformRegisters << "];\n"
+             << "};\n";
       }
    }
 
@@ -751,6 +805,11 @@ translate(Shader &shader, const gsl::span<const uint8_t> &binary)
          state.cfPC++;
       }
    } catch (translate_exception e) {
+      if (!shader.abortOnError) {
+         shader.error = e.what();
+         return false;
+      }
+
       auto assembly = disassemble(binary);
       gLog->critical("GLSL translate exception: {}\nDisassembly:\n{}", e.what(), assembly);
       decaf_abort(fmt::format("GLSL translate exception: {}", e.what()));
@@ -25,6 +25,12 @@ private:
    std::string mMessage;
 };
 
+// Uniform buffer bindings for the register files when uniformRegistersEnabled
+//  is set, these come after the bindings used for the uniform blocks.
+static const auto PixelRegisterBinding = 2 * latte::MaxUniformBlocks;
+static const auto VertexRegisterBinding = PixelRegisterBinding + 1;
+static const auto GeometryRegisterBinding = PixelRegisterBinding + 2;
+
 enum class SamplerUsage
 {
    Invalid,
@@ -61,6 +67,8 @@ struct Shader
    std::array<latte::SQ_TEX_DIM, 16> samplerDim;
    bool uniformRegistersEnabled = false;
    bool uniformBlocksEnabled = false;
+   bool optimiseAluClauses = true;
+   bool abortOnError = true;  // Otherwise translate returns false and sets error
 
    // Output (maybe)
    std::string fileHeader;
@@ -71,6 +79,7 @@ struct Shader
    std::array<SamplerUsage, latte::MaxSamplers> samplerUsage;
    std::array<bool, latte::MaxUniformBlocks> usedUniformBlocks;
    bool usesDiscard = false;
+   std::string error;
 };
 
 struct LoopState
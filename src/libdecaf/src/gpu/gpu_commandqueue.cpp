@@ -36,6 +36,19 @@ public:
       return next;
    }
 
+   pm4::Buffer *waitForBuffer(std::chrono::microseconds timeout)
+   {
+      std::unique_lock<std::mutex> lock { mQueueMutex };
+
+      if (!mQueueCV.wait_for(lock, timeout, [this]() { return !mQueue.empty(); })) {
+         return nullptr;
+      }
+
+      auto next = mQueue.front();
+      mQueue.pop();
+      return next;
+   }
+
    pm4::Buffer *waitForBuffer()
    {
       std::unique_lock<std::mutex> lock { mQueueMutex };
@@ -58,6 +71,9 @@ private:
 static CommandQueue
 gQueue;
 
+static IdleStats
+sIdleStats;
+
 void
 awaken()
 {
@@ -87,6 +103,21 @@ tryUnqueueCommandBuffer()
    return gQueue.dequeueBuffer();
 }
 
+/**
+ * Wait up to timeout for a command buffer, returns nullptr if none arrived.
+ */
+pm4::Buffer *
+unqueueCommandBuffer(std::chrono::microseconds timeout)
+{
+   return gQueue.waitForBuffer(timeout);
+}
+
+IdleStats &
+getIdleStats()
+{
+   return sIdleStats;
+}
+
 void
 retireCommandBuffer(pm4::Buffer *buf)
 {
@@ -1,4 +1,7 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 
 namespace pm4
 {
@@ -8,6 +11,24 @@ struct Buffer;
 namespace gpu
 {
 
+struct IdleStats
+{
+   //! Times the GPU thread found no commands and no completed sync objects.
+   std::atomic<uint64_t> spinIterations { 0 };
+
+   //! Times the GPU thread blocked on a fence or the command queue.
+   std::atomic<uint64_t> blockedWaits { 0 };
+
+   //! Total time spent blocked.
+   std::atomic<uint64_t> blockedNs { 0 };
+
+   //! Sync objects completed.
+   std::atomic<uint64_t> syncCompletions { 0 };
+
+   //! Sync object checks which completed at least one sync object.
+   std::atomic<uint64_t> syncBatches { 0 };
+};
+
 void
 awaken();
 
@@ -23,4 +44,10 @@ unqueueCommandBuffer();
 pm4::Buffer *
 tryUnqueueCommandBuffer();
 
+pm4::Buffer *
+unqueueCommandBuffer(std::chrono::microseconds timeout);
+
+IdleStats &
+getIdleStats();
+
 } // namespace gpu
@@ -5,6 +5,9 @@
 namespace gpu
 {
 
+static DataUploadStats
+sDataUploadStats;
+
 void
 notifyCpuFlush(void *ptr,
                uint32_t size)
@@ -21,4 +24,10 @@ notifyGpuFlush(void *ptr,
    decaf::getGraphicsDriver()->notifyGpuFlush(ptr, size);
 }
 
+DataUploadStats &
+getDataUploadStats()
+{
+   return sDataUploadStats;
+}
+
 } // namespace gpu
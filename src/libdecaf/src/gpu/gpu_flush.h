@@ -1,9 +1,22 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
 
 namespace gpu
 {
 
+struct DataUploadStats
+{
+   //! Bytes copied to host data buffers after a CPU flush.
+   std::atomic<uint64_t> uploadedBytes { 0 };
+
+   //! Bytes in flushed ranges which were unchanged and not copied.
+   std::atomic<uint64_t> skippedBytes { 0 };
+
+   //! Separate ranges copied, each one is a memcpy and flush.
+   std::atomic<uint64_t> uploadedRanges { 0 };
+};
+
 void
 notifyCpuFlush(void *addr,
                uint32_t size);
@@ -12,4 +25,7 @@ void
 notifyGpuFlush(void *addr,
                uint32_t size);
 
+DataUploadStats &
+getDataUploadStats();
+
 } // namespace gpu
@@ -0,0 +1,244 @@
+#include "gpu_timing.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <spdlog/fmt/fmt.h>
+
+namespace gpu
+{
+
+// Number of resolved frames kept for the JSON dump
+static const auto MaxFrameTimings = 120u;
+
+static std::atomic<bool>
+sTimingEnabled { false };
+
+static std::mutex
+sFrameTimingMutex;
+
+static std::deque<FrameTiming>
+sFrameTimings;
+
+// Written by the GPU thread and read by the debugger without locking
+struct AtomicHistogram
+{
+   std::array<std::atomic<uint64_t>, FrameTimeBuckets> buckets;
+   std::atomic<uint64_t> frames;
+   std::atomic<uint64_t> totalNs;
+   std::atomic<uint64_t> maxNs;
+};
+
+static AtomicHistogram
+sFlipIntervals;
+
+static AtomicHistogram
+sSwapLatencies;
+
+static std::atomic<uint64_t>
+sChainStalls { 0 };
+
+static const char *
+getPassTypeName(TimingPassType type)
+{
+   switch (type) {
+   case TimingPassType::CommandBuffer:
+      return "command_buffer";
+   case TimingPassType::RenderTarget:
+      return "render_target";
+   case TimingPassType::DrawBatch:
+      return "draw_batch";
+   default:
+      return "unknown";
+   }
+}
+
+static void
+addSample(AtomicHistogram &histogram,
+          uint64_t ns)
+{
+   auto bucket = std::min<uint64_t>(ns / (FrameTimeBucketUs * 1000), FrameTimeBuckets - 1);
+   histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+   histogram.frames.fetch_add(1, std::memory_order_relaxed);
+   histogram.totalNs.fetch_add(ns, std::memory_order_relaxed);
+
+   if (ns > histogram.maxNs.load(std::memory_order_relaxed)) {
+      histogram.maxNs.store(ns, std::memory_order_relaxed);
+   }
+}
+
+static FrameTimeHistogram
+readHistogram(AtomicHistogram &histogram)
+{
+   auto result = FrameTimeHistogram { };
+
+   for (auto i = 0u; i < FrameTimeBuckets; ++i) {
+      result.buckets[i] = histogram.buckets[i].load(std::memory_order_relaxed);
+   }
+
+   result.frames = histogram.frames.load(std::memory_order_relaxed);
+   result.totalNs = histogram.totalNs.load(std::memory_order_relaxed);
+   result.maxNs = histogram.maxNs.load(std::memory_order_relaxed);
+   return result;
+}
+
+static void
+resetHistogram(AtomicHistogram &histogram)
+{
+   for (auto &bucket : histogram.buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+   }
+
+   histogram.frames.store(0, std::memory_order_relaxed);
+   histogram.totalNs.store(0, std::memory_order_relaxed);
+   histogram.maxNs.store(0, std::memory_order_relaxed);
+}
+
+static void
+writeHistogram(fmt::MemoryWriter &out,
+               const char *name,
+               const FrameTimeHistogram &histogram)
+{
+   out.write("    \"{}\": {{ \"frames\": {}, \"total_ns\": {}, \"max_ns\": {}, \"buckets\": [",
+             name, histogram.frames, histogram.totalNs, histogram.maxNs);
+
+   for (auto i = 0u; i < histogram.buckets.size(); ++i) {
+      out.write("{}{}", i ? ", " : "", histogram.buckets[i]);
+   }
+
+   out << "] }";
+}
+
+/**
+ * Enable GPU timer queries, takes effect from the start of the next frame.
+ */
+void
+setTimingEnabled(bool enabled)
+{
+   sTimingEnabled.store(enabled);
+}
+
+bool
+isTimingEnabled()
+{
+   return sTimingEnabled.load();
+}
+
+/**
+ * Called by the graphics driver when the timer queries of a frame have
+ * been resolved.
+ */
+void
+addFrameTiming(FrameTiming &&frame)
+{
+   std::unique_lock<std::mutex> lock { sFrameTimingMutex };
+
+   if (sFrameTimings.size() >= MaxFrameTimings) {
+      sFrameTimings.pop_front();
+   }
+
+   sFrameTimings.emplace_back(std::move(frame));
+}
+
+bool
+getLastFrameTiming(FrameTiming &frame)
+{
+   std::unique_lock<std::mutex> lock { sFrameTimingMutex };
+
+   if (sFrameTimings.empty()) {
+      return false;
+   }
+
+   frame = sFrameTimings.back();
+   return true;
+}
+
+/**
+ * Called by the graphics driver for every flip, with the time since the
+ * previous flip and the time since the flipped frame was swapped.
+ */
+void
+addFlipTiming(uint64_t intervalNs,
+              uint64_t latencyNs)
+{
+   if (intervalNs) {
+      addSample(sFlipIntervals, intervalNs);
+   }
+
+   addSample(sSwapLatencies, latencyNs);
+}
+
+void
+addSwapChainStall()
+{
+   sChainStalls.fetch_add(1, std::memory_order_relaxed);
+}
+
+FramePacingStats
+getFramePacingStats()
+{
+   auto stats = FramePacingStats { };
+   stats.flipInterval = readHistogram(sFlipIntervals);
+   stats.swapLatency = readHistogram(sSwapLatencies);
+   stats.chainStalls = sChainStalls.load(std::memory_order_relaxed);
+   return stats;
+}
+
+void
+resetFramePacingStats()
+{
+   resetHistogram(sFlipIntervals);
+   resetHistogram(sSwapLatencies);
+   sChainStalls.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Write the recent frame timings and the frame time histograms to a JSON
+ * file, times are in nanoseconds.
+ */
+bool
+dumpFrameTimings(const std::string &path)
+{
+   fmt::MemoryWriter out;
+
+   {
+      std::unique_lock<std::mutex> lock { sFrameTimingMutex };
+      out << "{\n  \"frames\": [";
+
+      for (auto &frame : sFrameTimings) {
+         out << (&frame == &sFrameTimings.front() ? "\n" : ",\n");
+         out.write("    {{ \"frame\": {}, \"cpu_frame_ns\": {}, \"gpu_frame_ns\": {}, \"gpu_busy_ns\": {}, \"passes\": [",
+                   frame.frame, frame.cpuFrameNs, frame.gpuFrameNs, frame.gpuBusyNs);
+
+         for (auto i = 0u; i < frame.passes.size(); ++i) {
+            auto &pass = frame.passes[i];
+            out.write("{}\n      {{ \"type\": \"{}\", \"id\": {}, \"draws\": {}, \"start_ns\": {}, \"duration_ns\": {} }}",
+                      i ? "," : "", getPassTypeName(pass.type), pass.id, pass.draws, pass.startNs, pass.durationNs);
+         }
+
+         out << (frame.passes.empty() ? "] }" : "\n    ] }");
+      }
+
+      out << (sFrameTimings.empty() ? "]" : "\n  ]");
+   }
+
+   auto pacing = getFramePacingStats();
+   out.write(",\n  \"frame_pacing\": {{\n    \"bucket_us\": {},\n    \"chain_stalls\": {},\n",
+             FrameTimeBucketUs, pacing.chainStalls);
+   writeHistogram(out, "flip_interval", pacing.flipInterval);
+   out << ",\n";
+   writeHistogram(out, "swap_latency", pacing.swapLatency);
+   out << "\n  }\n}\n";
+
+   std::ofstream file { path, std::ofstream::out | std::ofstream::binary };
+
+   if (!file.is_open()) {
+      return false;
+   }
+
+   file << out.str();
+   return file.good();
+}
+
+} // namespace gpu
@@ -0,0 +1,106 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gpu
+{
+
+enum class TimingPassType : uint32_t
+{
+   CommandBuffer,
+   RenderTarget,
+   DrawBatch,
+   Max,
+};
+
+struct TimingPass
+{
+   TimingPassType type;
+
+   //! Submit time for command buffers, color buffer 0 address for render
+   //! targets and vertex shader hash for draw batches.
+   uint64_t id;
+
+   //! Draws made in the pass
+   uint32_t draws;
+
+   //! GPU time from the start of the frame to the start of the pass
+   uint64_t startNs;
+
+   //! GPU time from the start to the end of the pass
+   uint64_t durationNs;
+};
+
+struct FrameTiming
+{
+   uint64_t frame = 0;
+
+   //! Wall clock time the GPU thread took to process the frame
+   uint64_t cpuFrameNs = 0;
+
+   //! GPU time from the first to the last timestamp of the frame
+   uint64_t gpuFrameNs = 0;
+
+   //! GPU time spent inside command buffers
+   uint64_t gpuBusyNs = 0;
+
+   std::vector<TimingPass> passes;
+};
+
+//! Frame times are counted in buckets of this many microseconds
+static const uint32_t FrameTimeBucketUs = 1000;
+
+//! The last bucket counts every frame too long for the others
+static const size_t FrameTimeBuckets = 64;
+
+struct FrameTimeHistogram
+{
+   std::array<uint64_t, FrameTimeBuckets> buckets = { };
+   uint64_t frames = 0;
+   uint64_t totalNs = 0;
+   uint64_t maxNs = 0;
+};
+
+struct FramePacingStats
+{
+   //! Host time between consecutive flips
+   FrameTimeHistogram flipInterval;
+
+   //! Host time from the GPU thread processing a swap to its flip
+   FrameTimeHistogram swapLatency;
+
+   //! Swaps which had to wait for a free buffer in the swap chain
+   uint64_t chainStalls = 0;
+};
+
+void
+setTimingEnabled(bool enabled);
+
+bool
+isTimingEnabled();
+
+void
+addFrameTiming(FrameTiming &&frame);
+
+bool
+getLastFrameTiming(FrameTiming &frame);
+
+void
+addFlipTiming(uint64_t intervalNs,
+              uint64_t latencyNs);
+
+void
+addSwapChainStall();
+
+FramePacingStats
+getFramePacingStats();
+
+void
+resetFramePacingStats();
+
+bool
+dumpFrameTimings(const std::string &path);
+
+} // namespace gpu
@@ -1,10 +1,14 @@
 #ifndef DECAF_NOGL
 
+#include <common/byte_swap_array.h>
 #include <common/decaf_assert.h>
+#include <common/murmur3.h>
 #include "decaf_config.h"
 #include "opengl_driver.h"
+#include <cstring>
 #include <glbinding/gl/gl.h>
 #include <glbinding/Meta.h>
+#include <libcpu/mem.h>
 
 namespace gpu
 {
@@ -12,10 +16,20 @@ namespace gpu
 namespace opengl
 {
 
+// Index buffers whose contents change this many times are treated as
+//  dynamic and streamed through the upload ring instead of being cached.
+static const auto INDEX_BUFFER_MAX_CONVERSIONS = 4u;
+
+// Cached index buffers are released after this many frames without a draw.
+static const auto INDEX_BUFFER_EVICT_FRAMES = 300u;
+
 bool GLDriver::checkReadyDraw()
 {
    if (!checkActiveShader()) {
-      gLog->warn("Skipping draw with invalid shader.");
+      if (!mWaitingForShaders) {
+         gLog->warn("Skipping draw with invalid shader.");
+      }
+
       return false;
    }
 
@@ -63,6 +77,8 @@ bool GLDriver::checkReadyDraw()
       return false;
    }
 
+   auto framebufferChanged = mFramebufferChanged;
+
    if (mFramebufferChanged) {
       auto fbStatus = gl::glCheckFramebufferStatus(gl::GL_FRAMEBUFFER);
 
@@ -79,6 +95,7 @@ bool GLDriver::checkReadyDraw()
       return false;
    }
 
+   markTimingDraw(framebufferChanged);
    return true;
 }
 
@@ -107,101 +124,219 @@ getPrimitiveMode(latte::VGT_DI_PRIMITIVE_TYPE type)
    }
 }
 
-template<typename IndexType>
 static void
 drawPrimitives2(gl::GLenum mode,
                 uint32_t count,
-                const IndexType *indices,
+                bool indexed,
+                gl::GLenum indexType,
+                const void *indices,
                 uint32_t baseVertex,
                 uint32_t numInstances,
                 uint32_t baseInstance)
 {
    if (numInstances == 1) {
-      if (!indices) {
+      if (!indexed) {
          gl::glDrawArrays(mode, baseVertex, count);
-      } else if (std::is_same<IndexType, uint16_t>()) {
-         gl::glDrawElementsBaseVertex(mode, count, gl::GL_UNSIGNED_SHORT, indices, baseVertex);
-      } else if (std::is_same<IndexType, uint32_t>()) {
-         gl::glDrawElementsBaseVertex(mode, count, gl::GL_UNSIGNED_INT, indices, baseVertex);
+      } else {
+         gl::glDrawElementsBaseVertex(mode, count, indexType, indices, baseVertex);
       }
    } else {
-      if (!indices) {
+      if (!indexed) {
          gl::glDrawArraysInstancedBaseInstance(mode, 0, count, numInstances, baseInstance);
-      } else if (std::is_same<IndexType, uint16_t>()) {
-         gl::glDrawElementsInstancedBaseInstance(mode, count, gl::GL_UNSIGNED_SHORT, indices, numInstances, baseInstance);
-      } else if (std::is_same<IndexType, uint32_t>()) {
-         gl::glDrawElementsInstancedBaseInstance(mode, count, gl::GL_UNSIGNED_INT, indices, numInstances, baseInstance);
+      } else {
+         gl::glDrawElementsInstancedBaseInstance(mode, count, indexType, indices, numInstances, baseInstance);
       }
    }
 }
 
-template<bool IsRects, typename IndexType>
+static uint32_t
+getIndexBytes(latte::VGT_INDEX_TYPE indexFmt)
+{
+   return indexFmt == latte::VGT_INDEX_TYPE::INDEX_16 ? 2 : 4;
+}
+
+static bool
+isQuadPrimitive(latte::VGT_DI_PRIMITIVE_TYPE type)
+{
+   return type == latte::VGT_DI_PRIMITIVE_TYPE::QUADLIST
+       || type == latte::VGT_DI_PRIMITIVE_TYPE::RECTLIST;
+}
+
+// Quads and rects are rendered as two triangles each
+static uint32_t
+getHostIndexCount(uint32_t count,
+                  latte::VGT_DI_PRIMITIVE_TYPE type)
+{
+   return isQuadPrimitive(type) ? (count / 4) * 6 : count;
+}
+
+template<typename IndexType>
 static void
-unpackQuadRectList(uint32_t count,
-               const IndexType *src,
-               uint32_t baseVertex,
-               uint32_t numInstances,
-               uint32_t baseInstance)
+generateQuadList(IndexType *dst,
+                 uint32_t quadCount,
+                 bool isRects)
 {
-   auto tris = (count / 4) * 6;
-   auto unpacked = std::vector<IndexType>(tris);
-   auto dst = &unpacked[0];
-
-   // Unpack quad indices into triangle indices
-   if (src) {
-      for (auto i = 0u; i < count / 4; ++i) {
-         auto index_0 = *src++;
-         auto index_1 = *src++;
-         auto index_2 = *src++;
-         auto index_3 = *src++;
-
-         *(dst++) = index_0;
-         *(dst++) = index_1;
-         *(dst++) = index_2;
-
-         if (!IsRects) {
-            *(dst++) = index_0;
-            *(dst++) = index_2;
-            *(dst++) = index_3;
-         } else {
-            // Rectangles use a different winding order apparently...
-            *(dst++) = index_2;
-            *(dst++) = index_1;
-            *(dst++) = index_3;
-         }
+   // Rectangles use a different winding order apparently...
+   static const unsigned quadCorners[] = { 0, 1, 2, 0, 2, 3 };
+   static const unsigned rectCorners[] = { 0, 1, 2, 2, 1, 3 };
+   auto corners = isRects ? rectCorners : quadCorners;
+
+   for (auto i = 0u; i < quadCount; ++i) {
+      for (auto j = 0u; j < 6; ++j) {
+         *(dst++) = static_cast<IndexType>(i * 4 + corners[j]);
       }
+   }
+}
+
+/**
+ * Convert guest indices into the indices we draw with, byte swapping them
+ * and splitting quads and rects into triangles where needed.
+ *
+ * src may be null for quad and rect draws without an index buffer.
+ */
+static void
+convertIndices(void *dst,
+               const void *src,
+               uint32_t count,
+               latte::VGT_INDEX_TYPE indexFmt,
+               bool swap,
+               latte::VGT_DI_PRIMITIVE_TYPE type)
+{
+   auto is16 = indexFmt == latte::VGT_INDEX_TYPE::INDEX_16;
+
+   if (isQuadPrimitive(type)) {
+      auto isRects = type == latte::VGT_DI_PRIMITIVE_TYPE::RECTLIST;
+
+      if (!src && is16) {
+         generateQuadList(reinterpret_cast<uint16_t *>(dst), count / 4, isRects);
+      } else if (!src) {
+         generateQuadList(reinterpret_cast<uint32_t *>(dst), count / 4, isRects);
+      } else if (is16) {
+         expand_quad_list(reinterpret_cast<uint16_t *>(dst), reinterpret_cast<const uint16_t *>(src), count / 4, isRects, swap);
+      } else {
+         expand_quad_list(reinterpret_cast<uint32_t *>(dst), reinterpret_cast<const uint32_t *>(src), count / 4, isRects, swap);
+      }
+   } else if (!swap) {
+      std::memcpy(dst, src, count * getIndexBytes(indexFmt));
+   } else if (is16) {
+      byte_swap_array(reinterpret_cast<uint16_t *>(dst), reinterpret_cast<const uint16_t *>(src), count);
    } else {
-      auto index_0 = 0u;
-      auto index_1 = 1u;
-      auto index_2 = 2u;
-      auto index_3 = 3u;
-
-      for (auto i = 0u; i < count / 4; ++i) {
-         auto index = i * 4;
-         *(dst++) = index_0 + index;
-         *(dst++) = index_1 + index;
-         *(dst++) = index_2 + index;
-
-         if (!IsRects) {
-            *(dst++) = index_0 + index;
-            *(dst++) = index_2 + index;
-            *(dst++) = index_3 + index;
-         } else {
-            // Rectangles use a different winding order apparently...
-            *(dst++) = index_2 + index;
-            *(dst++) = index_1 + index;
-            *(dst++) = index_3 + index;
-         }
+      byte_swap_array(reinterpret_cast<uint32_t *>(dst), reinterpret_cast<const uint32_t *>(src), count);
+   }
+}
+
+/**
+ * Find the converted copy of an index buffer in guest memory, converting and
+ * uploading it if it is new or its memory has changed.
+ *
+ * Returns nullptr for index buffers which change too often to be worth
+ * caching, these are streamed through mUploadBuffer instead.
+ */
+IndexBuffer *
+GLDriver::getIndexBuffer(const void *indices,
+                         uint32_t count,
+                         latte::VGT_INDEX_TYPE indexFmt,
+                         bool swap,
+                         latte::VGT_DI_PRIMITIVE_TYPE type)
+{
+   // Only the primitive types we expand produce different host indices
+   auto expansion = isQuadPrimitive(type) ? static_cast<uint32_t>(type) : 0u;
+   auto address = mem::untranslate(indices);
+   auto size = count * getIndexBytes(indexFmt);
+   auto key = IndexBufferKey {
+      address,
+      count,
+      (static_cast<uint32_t>(indexFmt) << 16) | (swap ? 0x8000 : 0) | expansion
+   };
+
+   auto &buffer = mIndexBuffers[key];
+   buffer.lastUsedFrame = mIndexBufferFrame;
+
+   if (buffer.isDynamic || !getHostIndexCount(count, type)) {
+      return nullptr;
+   }
+
+   if (buffer.object && !buffer.dirtyMemory) {
+      return &buffer;
+   }
+
+   // Clear the flag before hashing so a flush while we hash is not lost
+   buffer.dirtyMemory = false;
+
+   uint64_t newHash[2] = { 0, 0 };
+   MurmurHash3_x64_128(indices, size, 0, newHash);
+
+   if (buffer.object) {
+      if (newHash[0] == buffer.cpuMemHash[0] && newHash[1] == buffer.cpuMemHash[1]) {
+         return &buffer;
+      }
+
+      if (++buffer.conversions >= INDEX_BUFFER_MAX_CONVERSIONS) {
+         mResourceMap.removeResource(&buffer);
+         gl::glDeleteBuffers(1, &buffer.object);
+         buffer.object = 0;
+         buffer.isDynamic = true;
+         return nullptr;
       }
    }
 
-   drawPrimitives2(gl::GL_TRIANGLES, tris, unpacked.data(), baseVertex, numInstances, baseInstance);
+   auto hostSize = getHostIndexCount(count, type) * getIndexBytes(indexFmt);
+
+   if (!buffer.object) {
+      buffer.cpuMemStart = address;
+      buffer.cpuMemEnd = address + size;
+      gl::glCreateBuffers(1, &buffer.object);
+      gl::glNamedBufferStorage(buffer.object, hostSize, nullptr, gl::GL_DYNAMIC_STORAGE_BIT);
+
+      if (decaf::config::gpu::debug) {
+         auto label = fmt::format("index buffer @ 0x{:08X}", address);
+         gl::glObjectLabel(gl::GL_BUFFER, buffer.object, -1, label.c_str());
+      }
+
+      mResourceMap.addResource(&buffer);
+   }
+
+   buffer.cpuMemHash[0] = newHash[0];
+   buffer.cpuMemHash[1] = newHash[1];
+
+   mIndexScratch.resize(hostSize);
+   convertIndices(mIndexScratch.data(), indices, count, indexFmt, swap, type);
+   gl::glNamedBufferSubData(buffer.object, 0, hostSize, mIndexScratch.data());
+   return &buffer;
+}
+
+/**
+ * Release index buffers which have not been drawn for a while, called once
+ * per frame.
+ */
+void
+GLDriver::evictIndexBuffers()
+{
+   ++mIndexBufferFrame;
+
+   for (auto itr = mIndexBuffers.begin(); itr != mIndexBuffers.end(); ) {
+      auto &buffer = itr->second;
+
+      if (mIndexBufferFrame - buffer.lastUsedFrame < INDEX_BUFFER_EVICT_FRAMES) {
+         ++itr;
+         continue;
+      }
+
+      if (buffer.object) {
+         mResourceMap.removeResource(&buffer);
+         gl::glDeleteBuffers(1, &buffer.object);
+      }
+
+      itr = mIndexBuffers.erase(itr);
+   }
 }
 
 void
 GLDriver::drawPrimitives(uint32_t count,
                          const void *indices,
-                         latte::VGT_INDEX_TYPE indexFmt)
+                         latte::VGT_INDEX_TYPE indexFmt,
+                         bool swap,
+                         bool isGuestMemory)
 {
    auto vgt_primitive_type = getRegister<latte::VGT_PRIMITIVE_TYPE>(latte::Register::VGT_PRIMITIVE_TYPE);
    auto vgt_dma_num_instances = getRegister<latte::VGT_DMA_NUM_INSTANCES>(latte::Register::VGT_DMA_NUM_INSTANCES);
@@ -216,6 +351,10 @@ GLDriver::drawPrimitives(uint32_t count,
 
    auto mode = getPrimitiveMode(primType);
 
+   if (indexFmt != latte::VGT_INDEX_TYPE::INDEX_16 && indexFmt != latte::VGT_INDEX_TYPE::INDEX_32) {
+      return;
+   }
+
    if (vgt_strmout_en.STREAMOUT()) {
       auto baseMode = mode;
 
@@ -236,23 +375,34 @@ GLDriver::drawPrimitives(uint32_t count,
       }
    }
 
-   if (primType == latte::VGT_DI_PRIMITIVE_TYPE::QUADLIST) {
-      if (indexFmt == latte::VGT_INDEX_TYPE::INDEX_16) {
-         unpackQuadRectList<false>(count, reinterpret_cast<const uint16_t*>(indices), baseVertex, numInstances, baseInstance);
-      } else if (indexFmt == latte::VGT_INDEX_TYPE::INDEX_32) {
-         unpackQuadRectList<false>(count, reinterpret_cast<const uint32_t*>(indices), baseVertex, numInstances, baseInstance);
-      }
-   } else if (primType == latte::VGT_DI_PRIMITIVE_TYPE::RECTLIST) {
-      if (indexFmt == latte::VGT_INDEX_TYPE::INDEX_16) {
-         unpackQuadRectList<true>(count, reinterpret_cast<const uint16_t*>(indices), baseVertex, numInstances, baseInstance);
-      } else if (indexFmt == latte::VGT_INDEX_TYPE::INDEX_32) {
-         unpackQuadRectList<true>(count, reinterpret_cast<const uint32_t*>(indices), baseVertex, numInstances, baseInstance);
-      }
+   auto indexType = indexFmt == latte::VGT_INDEX_TYPE::INDEX_16 ? gl::GL_UNSIGNED_SHORT : gl::GL_UNSIGNED_INT;
+   auto hostCount = getHostIndexCount(count, primType);
+   auto indexBuffer = static_cast<IndexBuffer *>(nullptr);
+
+   if (isGuestMemory && indices) {
+      indexBuffer = getIndexBuffer(indices, count, indexFmt, swap, primType);
+   }
+
+   if (!indices && !isQuadPrimitive(primType)) {
+      drawPrimitives2(mode, count, false, indexType, nullptr, baseVertex, numInstances, baseInstance);
+   } else if (indexBuffer) {
+      gl::glBindBuffer(gl::GL_ELEMENT_ARRAY_BUFFER, indexBuffer->object);
+      drawPrimitives2(mode, hostCount, true, indexType, nullptr, baseVertex, numInstances, baseInstance);
+      gl::glBindBuffer(gl::GL_ELEMENT_ARRAY_BUFFER, 0);
    } else {
-      if (indexFmt == latte::VGT_INDEX_TYPE::INDEX_16) {
-         drawPrimitives2(mode, count, reinterpret_cast<const uint16_t*>(indices), baseVertex, numInstances, baseInstance);
-      } else if (indexFmt == latte::VGT_INDEX_TYPE::INDEX_32) {
-         drawPrimitives2(mode, count, reinterpret_cast<const uint32_t*>(indices), baseVertex, numInstances, baseInstance);
+      // Convert straight into the upload ring if there is space
+      auto hostSize = hostCount * getIndexBytes(indexFmt);
+      auto upload = mUploadBuffer.allocate(hostSize, 4);
+
+      if (upload.ptr) {
+         convertIndices(upload.ptr, indices, count, indexFmt, swap, primType);
+         gl::glBindBuffer(gl::GL_ELEMENT_ARRAY_BUFFER, mUploadBuffer.object());
+         drawPrimitives2(mode, hostCount, true, indexType, reinterpret_cast<const void *>(upload.offset), baseVertex, numInstances, baseInstance);
+         gl::glBindBuffer(gl::GL_ELEMENT_ARRAY_BUFFER, 0);
+      } else {
+         mIndexScratch.resize(hostSize);
+         convertIndices(mIndexScratch.data(), indices, count, indexFmt, swap, primType);
+         drawPrimitives2(mode, hostCount, true, indexType, mIndexScratch.data(), baseVertex, numInstances, baseInstance);
       }
    }
 
@@ -263,51 +413,33 @@ GLDriver::drawPrimitives(uint32_t count,
 
 void
 GLDriver::drawPrimitivesIndexed(const void *buffer,
-                                uint32_t count)
+                                uint32_t count,
+                                bool isGuestMemory)
 {
    if (!checkReadyDraw()) {
       return;
    }
 
    auto vgt_dma_index_type = getRegister<latte::VGT_DMA_INDEX_TYPE>(latte::Register::VGT_DMA_INDEX_TYPE);
+   auto indexFmt = vgt_dma_index_type.INDEX_TYPE();
 
    // Swap and indexBytes are separate because you can have 32-bit swap,
-   //   but 16-bit indices in some cases...  This is also why we pre-swap
-   //   the data before intercepting QUAD and POLYGON draws.
+   //   but 16-bit indices in some cases...  This is also why we swap the
+   //   data in the same pass which expands QUAD and RECT draws.
    if (vgt_dma_index_type.SWAP_MODE() == latte::VGT_DMA_SWAP::SWAP_16_BIT) {
-      auto *src = reinterpret_cast<const uint16_t *>(buffer);
-      auto indices = std::vector<uint16_t>(count);
-
-      if (vgt_dma_index_type.INDEX_TYPE() != latte::VGT_INDEX_TYPE::INDEX_16) {
-         decaf_abort(fmt::format("Unexpected INDEX_TYPE {} for VGT_DMA_SWAP_16_BIT", vgt_dma_index_type.INDEX_TYPE()));
+      if (indexFmt != latte::VGT_INDEX_TYPE::INDEX_16) {
+         decaf_abort(fmt::format("Unexpected INDEX_TYPE {} for VGT_DMA_SWAP_16_BIT", indexFmt));
       }
 
-      for (auto i = 0u; i < count; ++i) {
-         indices[i] = byte_swap(src[i]);
-      }
-
-      drawPrimitives(count,
-                     indices.data(),
-                     vgt_dma_index_type.INDEX_TYPE());
+      drawPrimitives(count, buffer, indexFmt, true, isGuestMemory);
    } else if (vgt_dma_index_type.SWAP_MODE() == latte::VGT_DMA_SWAP::SWAP_32_BIT) {
-      auto *src = reinterpret_cast<const uint32_t *>(buffer);
-      auto indices = std::vector<uint32_t>(count);
-
-      if (vgt_dma_index_type.INDEX_TYPE() != latte::VGT_INDEX_TYPE::INDEX_32) {
-         decaf_abort(fmt::format("Unexpected INDEX_TYPE {} for VGT_DMA_SWAP_32_BIT", vgt_dma_index_type.INDEX_TYPE()));
-      }
-
-      for (auto i = 0u; i < count; ++i) {
-         indices[i] = byte_swap(src[i]);
+      if (indexFmt != latte::VGT_INDEX_TYPE::INDEX_32) {
+         decaf_abort(fmt::format("Unexpected INDEX_TYPE {} for VGT_DMA_SWAP_32_BIT", indexFmt));
       }
 
-      drawPrimitives(count,
-                     indices.data(),
-                     vgt_dma_index_type.INDEX_TYPE());
+      drawPrimitives(count, buffer, indexFmt, true, isGuestMemory);
    } else if (vgt_dma_index_type.SWAP_MODE() == latte::VGT_DMA_SWAP::NONE) {
-      drawPrimitives(count,
-                     buffer,
-                     vgt_dma_index_type.INDEX_TYPE());
+      drawPrimitives(count, buffer, indexFmt, false, isGuestMemory);
    } else {
       decaf_abort(fmt::format("Unimplemented vgt_dma_index_type.SWAP_MODE {}", vgt_dma_index_type.SWAP_MODE()));
    }
@@ -322,19 +454,21 @@ GLDriver::drawIndexAuto(const pm4::DrawIndexAuto &data)
 
    drawPrimitives(data.count,
                   nullptr,
-                  latte::VGT_INDEX_TYPE::INDEX_32);
+                  latte::VGT_INDEX_TYPE::INDEX_32,
+                  false,
+                  false);
 }
 
 void
 GLDriver::drawIndex2(const pm4::DrawIndex2 &data)
 {
-   drawPrimitivesIndexed(data.addr, data.count);
+   drawPrimitivesIndexed(data.addr, data.count, true);
 }
 
 void
 GLDriver::drawIndexImmd(const pm4::DrawIndexImmd &data)
 {
-   drawPrimitivesIndexed(data.indices.data(), data.count);
+   drawPrimitivesIndexed(data.indices.data(), data.count, false);
 }
 
 void
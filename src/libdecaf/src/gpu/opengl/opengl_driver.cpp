@@ -12,6 +12,7 @@
 #include "modules/gx2/gx2_enum.h"
 #include "opengl_constants.h"
 #include "opengl_driver.h"
+#include <algorithm>
 #include <fstream>
 #include <glbinding/gl/gl.h>
 #include <glbinding/Binding.h>
@@ -23,6 +24,13 @@ namespace gpu
 namespace opengl
 {
 
+// Size of the ring used to stream texture and index uploads to the GPU,
+//  anything larger than this is uploaded from client memory instead.
+static const auto UPLOAD_BUFFER_SIZE = 64 * 1024 * 1024;
+
+// Size of the ring used to stream uniform register files, each copy is 4KiB.
+static const auto UNIFORM_BUFFER_SIZE = 4 * 1024 * 1024;
+
 GLDriver::GLDriver()
 {
    mRegisters.fill(0);
@@ -39,7 +47,8 @@ GLDriver::initGL()
    mActiveShader = nullptr;
    mDrawBuffers.fill(gl::GL_NONE);
    mGLStateCache.blendEnable.fill(false);
-   mLastUniformUpdate.fill(0);
+   mDirtyUniformRegisters = ~0u;
+   mUniformRegisterCache.fill(UniformRegisterCache { });
 
    // We always use the scissor test
    gl::glEnable(gl::GL_SCISSOR_TEST);
@@ -52,6 +61,8 @@ GLDriver::initGL()
    gl::glDisable(gl::GL_DEPTH_CLAMP);
    gl::glDisable(gl::GL_PRIMITIVE_RESTART);
 
+   initSwapChain();
+
    // Create our blit framebuffer
    gl::glCreateFramebuffers(2, mBlitFrameBuffers);
 
@@ -76,6 +87,43 @@ GLDriver::initGL()
    gl::GLint value;
    gl::glGetIntegerv(gl::GL_MAX_UNIFORM_BLOCK_SIZE, &value);
    MaxUniformBlockSize = value;
+
+   // Create our upload ring
+   mUploadBuffer.create(UPLOAD_BUFFER_SIZE, "upload ring");
+
+   // Start compiling shaders in the background
+   mShaderCompiler.start();
+
+   // Create the ring for uniform registers, if that can not be mapped we
+   //  keep one buffer per register file which is updated in place
+   gl::glGetIntegerv(gl::GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &value);
+   mUniformBufferAlignment = std::max(value, 16);
+
+   if (!mUniformBuffer.create(UNIFORM_BUFFER_SIZE, "uniform register ring")) {
+      gl::glCreateBuffers(2, mUniformRegisterFallback.data());
+
+      for (auto object : mUniformRegisterFallback) {
+         gl::glNamedBufferStorage(object, latte::MaxUniformRegisters * 4 * 4, nullptr, gl::GL_DYNAMIC_STORAGE_BIT);
+      }
+   }
+}
+
+/**
+ * Release the persistent mappings made in initGL, must be called on the GPU
+ * thread while its context is still current.
+ */
+void
+GLDriver::shutdownGL()
+{
+   mShaderCompiler.stop();
+
+   mUploadBuffer.destroy();
+   mUniformBuffer.destroy();
+
+   if (mUniformRegisterFallback[0]) {
+      gl::glDeleteBuffers(2, mUniformRegisterFallback.data());
+      mUniformRegisterFallback.fill(0);
+   }
 }
 
 void
@@ -84,31 +132,17 @@ GLDriver::decafSetBuffer(const pm4::DecafSetBuffer &data)
    auto chain = data.isTv ? &mTvScanBuffers : &mDrcScanBuffers;
 
    // Destroy any old chain
-   if (chain->object) {
-      gl::glDeleteTextures(1, &chain->object);
-      chain->object = 0;
+   if (chain->objects[0]) {
+      gl::glDeleteTextures(static_cast<gl::GLsizei>(chain->objects.size()), chain->objects.data());
+      chain->objects.fill(0);
    }
 
-   // NOTE: A SwapBufferChain is not really a chain as we rely on OpenGL
-   //  to provide the buffering for us.  This means we do not always match
-   //  the games buffering mode, but in practice this is probably meaningless.
-
-   // Create the chain
-   gl::glCreateTextures(gl::GL_TEXTURE_2D, 1, &chain->object);
-   gl::glTextureParameteri(chain->object, gl::GL_TEXTURE_MAG_FILTER, static_cast<int>(gl::GL_NEAREST));
-   gl::glTextureParameteri(chain->object, gl::GL_TEXTURE_MIN_FILTER, static_cast<int>(gl::GL_NEAREST));
-   gl::glTextureParameteri(chain->object, gl::GL_TEXTURE_WRAP_S, static_cast<int>(gl::GL_CLAMP_TO_EDGE));
-   gl::glTextureParameteri(chain->object, gl::GL_TEXTURE_WRAP_T, static_cast<int>(gl::GL_CLAMP_TO_EDGE));
-   gl::glTextureStorage2D(chain->object, 1, gl::GL_RGBA8, data.width, data.height);
+   // Create the chain, see opengl_swapchain.cpp
+   gl::glCreateTextures(gl::GL_TEXTURE_2D, static_cast<gl::GLsizei>(chain->objects.size()), chain->objects.data());
 
    chain->width = data.width;
    chain->height = data.height;
 
-   if (decaf::config::gpu::debug) {
-      const char *label = data.isTv ? "TV framebuffer" : "DRC framebuffer";
-      gl::glObjectLabel(gl::GL_TEXTURE, chain->object, -1, label);
-   }
-
    // Initialize the pixels to a more useful color
 #define rf_to_ru(x) (static_cast<uint32_t>(x * 256) & 0xFF)
 #define rgbaf_to_rgbau(r,g,b,a) (rf_to_ru(r) | (rf_to_ru(g) << 8) | (rf_to_ru(b) << 16) | (rf_to_ru(a) << 24))
@@ -120,7 +154,20 @@ GLDriver::decafSetBuffer(const pm4::DecafSetBuffer &data)
       tmpClearBuf[i] = clearColor;
    }
 
-   gl::glTextureSubImage2D(chain->object, 0, 0, 0, data.width, data.height, gl::GL_RGBA, gl::GL_UNSIGNED_BYTE, tmpClearBuf);
+   for (auto object : chain->objects) {
+      gl::glTextureParameteri(object, gl::GL_TEXTURE_MAG_FILTER, static_cast<int>(gl::GL_NEAREST));
+      gl::glTextureParameteri(object, gl::GL_TEXTURE_MIN_FILTER, static_cast<int>(gl::GL_NEAREST));
+      gl::glTextureParameteri(object, gl::GL_TEXTURE_WRAP_S, static_cast<int>(gl::GL_CLAMP_TO_EDGE));
+      gl::glTextureParameteri(object, gl::GL_TEXTURE_WRAP_T, static_cast<int>(gl::GL_CLAMP_TO_EDGE));
+      gl::glTextureStorage2D(object, 1, gl::GL_RGBA8, data.width, data.height);
+      gl::glTextureSubImage2D(object, 0, 0, 0, data.width, data.height, gl::GL_RGBA, gl::GL_UNSIGNED_BYTE, tmpClearBuf);
+
+      if (decaf::config::gpu::debug) {
+         const char *label = data.isTv ? "TV framebuffer" : "DRC framebuffer";
+         gl::glObjectLabel(gl::GL_TEXTURE, object, -1, label);
+      }
+   }
+
    delete[] tmpClearBuf;
 }
 
@@ -145,7 +192,8 @@ GLDriver::decafCopyColorToScan(const pm4::DecafCopyColorToScan &data)
       return;
    }
 
-   gl::glNamedFramebufferTexture(mBlitFrameBuffers[0], gl::GL_COLOR_ATTACHMENT0, target->object, 0);
+   target->written = true;
+   gl::glNamedFramebufferTexture(mBlitFrameBuffers[0], gl::GL_COLOR_ATTACHMENT0, target->objects[mWriteSlot], 0);
    gl::glNamedFramebufferTexture(mBlitFrameBuffers[1], gl::GL_COLOR_ATTACHMENT0, buffer->active->object, 0);
 
    gl::glDisable(gl::GL_SCISSOR_TEST);
@@ -156,31 +204,6 @@ GLDriver::decafCopyColorToScan(const pm4::DecafCopyColorToScan &data)
    gl::glEnable(gl::GL_SCISSOR_TEST);
 }
 
-void
-GLDriver::decafSwapBuffers(const pm4::DecafSwapBuffers &data)
-{
-   static const auto weight = 0.9;
-
-   injectFence([=]() {
-      // TODO: We should have a render chain of 2 buffers so that we don't render stuff
-      //  until the game actually asked us to.
-
-      gx2::internal::onFlip();
-
-      auto now = std::chrono::system_clock::now();
-
-      if (mLastSwap.time_since_epoch().count()) {
-         mAverageFrameTime = weight * mAverageFrameTime + (1.0 - weight) * (now - mLastSwap);
-      }
-
-      mLastSwap = now;
-
-      if (mSwapFunc) {
-         mSwapFunc(mTvScanBuffers.object, mDrcScanBuffers.object);
-      }
-   });
-}
-
 void
 GLDriver::decafCapSyncRegisters(const pm4::DecafCapSyncRegisters &data)
 {
@@ -194,6 +217,18 @@ GLDriver::decafSetSwapInterval(const pm4::DecafSetSwapInterval &data)
    mSwapInterval = data.interval;
 }
 
+void
+GLDriver::decafWritebackSurfaces(const pm4::DecafWritebackSurfaces &data)
+{
+   // The readback fences are injected before the command buffer's retire
+   //  fence, so the surfaces are in memory by the time GX2DrawDone returns.
+   for (auto &surface : mSurfaces) {
+      if (surface.second.needWriteback) {
+         readbackSurface(&surface.second);
+      }
+   }
+}
+
 void
 GLDriver::decafDebugMarker(const pm4::DecafDebugMarker &data)
 {
@@ -203,21 +238,10 @@ GLDriver::decafDebugMarker(const pm4::DecafDebugMarker &data)
 void
 GLDriver::decafOSScreenFlip(const pm4::DecafOSScreenFlip &data)
 {
-   auto texture = 0u;
-   auto width = 0u;
-   auto height = 0u;
+   auto chain = data.screen == 0 ? &mTvScanBuffers : &mDrcScanBuffers;
+   chain->written = true;
 
-   if (data.screen == 0) {
-      texture = mTvScanBuffers.object;
-      width = mTvScanBuffers.width;
-      height = mTvScanBuffers.height;
-   } else {
-      texture = mDrcScanBuffers.object;
-      width = mDrcScanBuffers.width;
-      height = mDrcScanBuffers.height;
-   }
-
-   gl::glTextureSubImage2D(texture, 0, 0, 0, width, height, gl::GL_RGBA, gl::GL_UNSIGNED_BYTE, data.buffer);
+   gl::glTextureSubImage2D(chain->objects[mWriteSlot], 0, 0, 0, chain->width, chain->height, gl::GL_RGBA, gl::GL_UNSIGNED_BYTE, data.buffer);
    decafSwapBuffers(pm4::DecafSwapBuffers {});
 }
 
@@ -379,18 +403,15 @@ GLDriver::surfaceSync(const pm4::SurfaceSync &data)
                buffer->dirtyMemory = false;
             }
          }
+         break;
+
+      case Resource::INDEX_BUFFER:
+         // Index buffers are rehashed when they are next drawn with
+         break;
       }
    }
 }
 
-void
-GLDriver::getSwapBuffers(unsigned int *tv,
-                         unsigned int *drc)
-{
-   *tv = mTvScanBuffers.object;
-   *drc = mDrcScanBuffers.object;
-}
-
 float
 GLDriver::getAverageFPS()
 {
@@ -486,7 +507,7 @@ GLDriver::eventWrite(const pm4::EventWrite &data)
             mTotalSamplesPassed += value;
             writeData(mTotalSamplesPassed);
          };
-         mSyncWaits.emplace(wait);
+         mSyncWaits.emplace_back(wait);
       }
 
       gl::glGenQueries(1, &mOccQuery);
@@ -561,35 +582,61 @@ GLDriver::injectFence(std::function<void()> func)
    wait.type = SyncWaitType::Fence;
    wait.fence = object;
    wait.func = func;
-   mSyncWaits.emplace(wait);
+   mSyncWaits.emplace_back(wait);
 }
 
-void
+bool
+GLDriver::isFenceSignalled(gl::GLsync fence)
+{
+   gl::GLenum value;
+   gl::glGetSynciv(fence, gl::GL_SYNC_STATUS, 4, nullptr, reinterpret_cast<gl::GLint*>(&value));
+   return value != gl::GL_UNSIGNALED;
+}
+
+/**
+ * Run the callbacks of every completed sync object, returns how many
+ * completed.
+ */
+size_t
 GLDriver::checkSyncObjects()
 {
-   while (true) {
-      if (!mSyncWaits.size()) {
+   // Fences signal in submission order, so once the newest fence has
+   //  signalled everything queued before it is complete too and does not
+   //  need to be queried one at a time.
+   auto knownComplete = size_t { 0 };
+   auto completed = size_t { 0 };
+
+   for (auto i = mSyncWaits.size(); i > 0; --i) {
+      auto &wait = mSyncWaits[i - 1];
+
+      if (wait.type == SyncWaitType::Fence) {
+         if (isFenceSignalled(wait.fence)) {
+            knownComplete = i;
+         }
+
          break;
       }
+   }
 
+   while (mSyncWaits.size()) {
       auto &wait = mSyncWaits.front();
+      auto isComplete = completed < knownComplete;
 
       if (wait.type == SyncWaitType::Fence) {
-         gl::GLenum value;
-         gl::glGetSynciv(wait.fence, gl::GL_SYNC_STATUS, 4, nullptr, reinterpret_cast<gl::GLint*>(&value));
-
-         if (value == gl::GL_UNSIGNALED) {
+         if (!isComplete && !isFenceSignalled(wait.fence)) {
             break;
          }
 
          wait.func();
          glDeleteSync(wait.fence);
       } else if (wait.type == SyncWaitType::Query) {
-         gl::GLboolean value;
-         gl::glGetQueryObjectuiv(wait.query, gl::GL_QUERY_RESULT_AVAILABLE, reinterpret_cast<gl::GLuint*>(&value));
+         if (!isComplete) {
+            gl::GLboolean value;
+            gl::glGetQueryObjectuiv(wait.query, gl::GL_QUERY_RESULT_AVAILABLE, reinterpret_cast<gl::GLuint*>(&value));
 
-         if (value == gl::GL_FALSE) {
-            break;
+            if (value == gl::GL_FALSE) {
+               break;
+            }
          }
 
          wait.func();
@@ -598,8 +645,49 @@ GLDriver::checkSyncObjects()
          decaf_abort("GPU thread encountered unknown sync type");
       }
 
-      mSyncWaits.pop();
+      mSyncWaits.pop_front();
+      completed++;
    }
+
+   if (completed) {
+      auto &stats = gpu::getIdleStats();
+      stats.syncCompletions.fetch_add(completed, std::memory_order_relaxed);
+      stats.syncBatches.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   return completed;
+}
+
+/**
+ * Block until the oldest sync object may have completed or a command
+ * buffer arrives, whichever is first.
+ *
+ * A fence is waited on with glClientWaitSync, which cannot be woken by the
+ * command queue, so the wait is bounded to keep the latency of newly
+ * queued commands low.  Queries have no client wait so the command queue
+ * is waited on instead for the same bound.
+ */
+pm4::Buffer *
+GLDriver::waitForSyncObjects()
+{
+   static const auto WaitTimeout = std::chrono::microseconds { 500 };
+   auto &stats = gpu::getIdleStats();
+   auto &wait = mSyncWaits.front();
+   auto buffer = static_cast<pm4::Buffer *>(nullptr);
+   auto start = std::chrono::steady_clock::now();
+
+   if (wait.type == SyncWaitType::Fence) {
+      auto timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(WaitTimeout).count();
+      gl::glClientWaitSync(wait.fence, gl::GL_SYNC_FLUSH_COMMANDS_BIT, static_cast<gl::GLuint64>(timeout));
+      buffer = gpu::tryUnqueueCommandBuffer();
+   } else {
+      buffer = gpu::unqueueCommandBuffer(WaitTimeout);
+   }
+
+   auto blocked = std::chrono::steady_clock::now() - start;
+   stats.blockedWaits.fetch_add(1, std::memory_order_relaxed);
+   stats.blockedNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(blocked).count(), std::memory_order_relaxed);
+   return buffer;
 }
 
 void
@@ -609,7 +697,17 @@ GLDriver::executeBuffer(pm4::Buffer *buffer)
    runRemoteThreadTasks();
 
    // Execute command buffer
+   beginTimingPass(gpu::TimingPassType::CommandBuffer, buffer->submitTime);
    runCommandBuffer(buffer->buffer, buffer->curSize);
+   endTimingPass(gpu::TimingPassType::CommandBuffer);
+
+   if (mTimingFrame.swapped) {
+      endTimingFrame();
+   }
+
+   // Allow space used by this command buffer to be reused once it completes
+   mUploadBuffer.fence();
+   mUniformBuffer.fence();
 
    // Release command buffer
    injectFence([=]() {
@@ -630,7 +728,7 @@ GLDriver::runOnGLThread(std::function<void()> func)
    --taskIterator;
 
    gpu::awaken();
-   taskIterator->completionCV.wait(lock);
+   taskIterator->completionCV.wait(lock, [&]() { return taskIterator->completed; });
 
    mTaskList.erase(taskIterator);
 }
@@ -641,8 +739,12 @@ GLDriver::runRemoteThreadTasks()
    std::unique_lock<std::mutex> lock(mTaskListMutex);
 
    for (auto &i : mTaskList) {
-      i.func();
-      i.completionCV.notify_all();
+      // Tasks stay in the list until their caller wakes up to erase them
+      if (!i.completed) {
+         i.func();
+         i.completed = true;
+         i.completionCV.notify_all();
+      }
    }
 }
 
@@ -664,10 +766,40 @@ void
 GLDriver::notifyGpuFlush(void *ptr,
                          uint32_t size)
 {
-   std::unique_lock<std::mutex> lock(mOutputBufferMap.getMutex());
-
    auto memStart = mem::untranslate(ptr);
    auto memEnd = memStart + size;
+
+   if (decaf::config::gpu::surface_writeback) {
+      std::vector<SurfaceBuffer *> surfaces;
+
+      {
+         std::unique_lock<std::mutex> lock(mResourceMap.getMutex());
+         std::unique_lock<std::mutex> writebackLock(mWritebackMutex);
+         auto iter = mResourceMap.getIterator(memStart, size);
+
+         // Only go to the GPU thread for surfaces which memory is behind
+         Resource *resource;
+         while ((resource = iter.next()) != nullptr) {
+            if (resource->type == Resource::SURFACE) {
+               auto surface = reinterpret_cast<SurfaceBuffer *>(resource);
+
+               if (surface->needWriteback || surface->writebacksPending) {
+                  surfaces.push_back(surface);
+               }
+            }
+         }
+      }
+
+      if (!surfaces.empty()) {
+         runOnGLThread([&]() {
+            for (auto surface : surfaces) {
+               finishSurfaceWriteback(surface);
+            }
+         });
+      }
+   }
+
+   std::unique_lock<std::mutex> lock(mOutputBufferMap.getMutex());
    auto iter = mOutputBufferMap.getIterator(memStart, size);
 
    // This allows us to avoid downloading a buffer twice if we hit both its
@@ -704,6 +836,7 @@ GLDriver::syncPoll(const SwapFunction &swapFunc)
    }
 
    mSwapFunc = swapFunc;
+   runRemoteThreadTasks();
 
    while (auto buffer = gpu::tryUnqueueCommandBuffer()) {
       executeBuffer(buffer);
@@ -711,6 +844,14 @@ GLDriver::syncPoll(const SwapFunction &swapFunc)
    }
 
    checkSyncObjects();
+   presentSwapChain();
+}
+
+void
+GLDriver::setSharedContexts(unsigned int count,
+                            const MakeContextCurrentFunction &makeCurrent)
+{
+   mShaderCompiler.setSharedContexts(count, makeCurrent);
 }
 
 void
@@ -724,20 +865,39 @@ GLDriver::run()
    initGL();
 
    while (mRunState == RunState::Running) {
-      pm4::Buffer *buffer;
+      auto buffer = gpu::tryUnqueueCommandBuffer();
 
-      if (mSyncWaits.size() == 0) {
-         buffer = gpu::unqueueCommandBuffer();
-      } else {
-         buffer = gpu::tryUnqueueCommandBuffer();
+      // gpu::awaken queues a null buffer to wake us for a task, every wait
+      //  below returns to here once it has been taken from the queue.
+      runRemoteThreadTasks();
+
+      // Paced flips are due at a time rather than on a fence
+      presentSwapChain();
+
+      if (!buffer && checkSyncObjects()) {
+         continue;
+      }
+
+      if (!buffer) {
+         auto flipTimeout = getSwapChainTimeout();
+
+         if (mSyncWaits.size() != 0) {
+            buffer = waitForSyncObjects();
+         } else if (flipTimeout.count()) {
+            buffer = gpu::unqueueCommandBuffer(flipTimeout);
+         } else {
+            buffer = gpu::unqueueCommandBuffer();
+         }
       }
 
       if (buffer) {
          executeBuffer(buffer);
-      } else {
-         checkSyncObjects();
+      } else if (!checkSyncObjects()) {
+         gpu::getIdleStats().spinIterations.fetch_add(1, std::memory_order_relaxed);
       }
    }
+
+   shutdownGL();
 }
 
 void
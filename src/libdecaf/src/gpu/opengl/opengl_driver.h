@@ -2,7 +2,9 @@
 
 #ifndef DECAF_NOGL
 
+#include "decaf_config.h"
 #include "gpu/glsl2/glsl2_translate.h"
+#include "gpu/gpu_timing.h"
 #include "gpu/latte_constants.h"
 #include "gpu/latte_contextstate.h"
 #include "gpu/pm4_buffer.h"
@@ -11,17 +13,22 @@
 #include "libdecaf/decaf_graphics.h"
 #include "libdecaf/decaf_opengl.h"
 #include "opengl_resource.h"
+#include "opengl_shadercompiler.h"
+#include "opengl_streambuffer.h"
 
+#include <atomic>
 #include <chrono>
 #include <common/log.h>
 #include <common/platform.h>
 #include <condition_variable>
+#include <deque>
 #include <exception>
 #include <glbinding/gl/gl.h>
 #include <gsl.h>
 #include <libcpu/mem.h>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
@@ -84,7 +91,7 @@ struct FetchShader : public Shader
 struct VertexShader : public Shader
 {
    gl::GLuint object = 0;
-   gl::GLuint uniformRegisters = 0;
+   std::shared_ptr<ShaderCompiler::Program> program;  // Set until compiled
    gl::GLuint uniformViewport = 0;
    bool isScreenSpace = false;
    std::array<gl::GLuint, latte::MaxAttributes> attribLocations;
@@ -99,12 +106,11 @@ struct VertexShader : public Shader
 struct PixelShader : public Shader
 {
    gl::GLuint object = 0;
-   gl::GLuint uniformRegisters = 0;
+   std::shared_ptr<ShaderCompiler::Program> program;  // Set until compiled
    gl::GLuint uniformAlphaRef = 0;
    latte::SX_ALPHA_TEST_CONTROL sx_alpha_test_control;
    std::array<glsl2::SamplerUsage, latte::MaxSamplers> samplerUsage;
    std::array<bool, 16> usedUniformBlocks;
-   uint32_t lastUniformUpdate = 0;
    std::string code;
    std::string disassembly;
 };
@@ -117,6 +123,7 @@ struct ShaderPipeline
    FetchShader *fetch = nullptr;
    VertexShader *vertex = nullptr;
    PixelShader *pixel = nullptr;  // Null if rasterization is disabled
+   bool stagesReady = false;  // False until the programs are attached
    uint64_t fetchKey;
    uint64_t vertexKey;
    uint64_t pixelKey;
@@ -137,12 +144,33 @@ struct HostSurface
    HostSurface *next = nullptr;
 };
 
+// How a surface written by the GPU is laid out in guest memory
+struct SurfaceWriteback
+{
+   ppcaddr_t baseAddress = 0;
+   uint32_t swizzle = 0;
+   uint32_t pitch = 0;
+   uint32_t width = 0;
+   uint32_t height = 0;
+   uint32_t bpp = 0;
+   latte::SQ_DATA_FORMAT format;
+   latte::SQ_TILE_MODE tileMode;
+   bool isDepthBuffer = false;
+   gl::GLenum readFormat = gl::GL_INVALID_ENUM;
+   gl::GLenum readType = gl::GL_INVALID_ENUM;
+};
+
 struct SurfaceBuffer : public Resource
 {
    HostSurface *active = nullptr;
    HostSurface *master = nullptr;
    SurfaceUseState state = SurfaceUseState::None;
    bool needUpload = true;
+   bool needWriteback = false;  // GPU written since the last readback, see mWritebackMutex
+   unsigned writebacksPending = 0;  // Readbacks not yet in memory, see mWritebackMutex
+   gl::GLuint writebackObject = 0;  // Pixel pack buffer for readbacks
+   uint32_t writebackSize = 0;
+   SurfaceWriteback writeback;
    struct {
       latte::SQ_TEX_DIM dim;
       latte::SQ_DATA_FORMAT format;
@@ -154,13 +182,30 @@ struct SurfaceBuffer : public Resource
    SurfaceBuffer() : Resource(Resource::SURFACE) { }
 };
 
+//! Buffers in the swap chain, one is presented, one is ready to be
+//! presented and the rest are written to or waiting for the GPU.
+static const size_t SwapChainLength = 4;
+
 struct ScanBufferChain
 {
-   gl::GLuint object = 0;
-   uint32_t width;
-   uint32_t height;
+   std::array<gl::GLuint, SwapChainLength> objects = { };
+   uint32_t width = 0;
+   uint32_t height = 0;
+   bool written = false;  // Copied to since the last swap
+};
+
+using PresentMode = decaf::config::gpu::PresentMode;
+
+struct PendingSwap
+{
+   size_t slot;
+   bool complete = false;  // The swap's fence has signalled
+   std::chrono::steady_clock::time_point swapTime;
 };
 
+//! Granularity at which data buffer uploads detect changes
+static const uint32_t DataBufferBlockSize = 4096;
+
 struct DataBuffer : public Resource
 {
    gl::GLuint object = 0;
@@ -171,9 +216,25 @@ struct DataBuffer : public Resource
    bool dirtyMap = false;  // True if we need to glFlushMappedBufferRange
    uint32_t lastGpuFlush = 0;  // Last time we touched this buffer in notifyGpuFlush()
 
+   //! Hash of each DataBufferBlockSize block, two words per block
+   std::vector<uint64_t> blockHashes;
+
    DataBuffer() : Resource(Resource::DATA_BUFFER) { }
 };
 
+// Guest address, index count and conversion flags
+using IndexBufferKey = std::tuple<uint32_t, uint32_t, uint32_t>;
+
+struct IndexBuffer : public Resource
+{
+   gl::GLuint object = 0;
+   uint32_t conversions = 0;  // Number of times the contents have changed
+   uint32_t lastUsedFrame = 0;
+   bool isDynamic = false;  // Changes too often to cache, use the upload ring
+
+   IndexBuffer() : Resource(Resource::INDEX_BUFFER) { }
+};
+
 struct Sampler
 {
    gl::GLuint object = 0;
@@ -203,6 +264,27 @@ struct SyncWait
    std::function<void()> func;
 };
 
+struct TimingPassQueries
+{
+   gpu::TimingPassType type;
+   uint64_t id;
+   uint32_t draws = 0;
+   size_t startQuery;  // Index into TimingFrameState::queries
+   size_t endQuery;
+};
+
+struct TimingFrameState
+{
+   bool active = false;  // Timestamps are being written for this frame
+   bool swapped = false;  // A swap was processed in the current buffer
+   uint64_t frame = 0;
+   std::chrono::steady_clock::time_point cpuStart;
+   std::vector<gl::GLuint> queries;
+   std::vector<TimingPassQueries> passes;
+   std::array<int, static_cast<size_t>(gpu::TimingPassType::Max)> openPasses;  // Index into passes, or -1
+   uint64_t vertexKey = 0;  // Shader of the open draw batch
+};
+
 struct ColorBufferCache
 {
    gl::GLuint object = 0;
@@ -222,6 +304,17 @@ struct UniformBlockCache
    gl::GLuint psObject = 0;
 };
 
+struct UniformRegisterCache
+{
+   //! Offset of the last copy of the register file in the uniform ring
+   gl::GLintptr offset = 0;
+
+   //! Stream position of that copy, see StreamBuffer::position()
+   uint64_t position = 0;
+
+   bool valid = false;
+};
+
 struct TextureCache
 {
    gl::GLuint surfaceObject = 0;
@@ -281,6 +374,7 @@ struct RemoteThreadTask
 {
    std::function<void()> func;
    std::condition_variable completionCV;
+   bool completed = false;
 
    RemoteThreadTask(std::function<void()> func_) : func(func_)
    {
@@ -319,8 +413,13 @@ public:
    virtual void
    syncPoll(const SwapFunction &swapFunc) override;
 
+   virtual void
+   setSharedContexts(unsigned int count,
+                     const MakeContextCurrentFunction &makeCurrent) override;
+
 private:
    void initGL();
+   void shutdownGL();
    void executeBuffer(pm4::Buffer *buffer);
    uint64_t getGpuClock();
 
@@ -334,6 +433,7 @@ private:
    void decafOSScreenFlip(const pm4::DecafOSScreenFlip &data) override;
    void decafCopySurface(const pm4::DecafCopySurface &data) override;
    void decafSetSwapInterval(const pm4::DecafSetSwapInterval &data) override;
+   void decafWritebackSurfaces(const pm4::DecafWritebackSurfaces &data) override;
    void drawIndexAuto(const pm4::DrawIndexAuto &data) override;
    void drawIndex2(const pm4::DrawIndex2 &data) override;
    void drawIndexImmd(const pm4::DrawIndexImmd &data) override;
@@ -381,6 +481,12 @@ private:
                     bool forWrite,
                     bool discardData);
 
+   void
+   readbackSurface(SurfaceBuffer *surface);
+
+   void
+   finishSurfaceWriteback(SurfaceBuffer *surface);
+
    void
    setSurfaceSwizzle(SurfaceBuffer *surface,
                      gl::GLenum swizzleR,
@@ -418,6 +524,10 @@ private:
                  bool isInput,
                  bool isOutput);
    void
+   copyDataBufferRange(DataBuffer *buffer,
+                       uint32_t offset,
+                       uint32_t size);
+   void
    uploadDataBuffer(DataBuffer *buffer,
                     uint32_t offset,
                     uint32_t size);
@@ -432,9 +542,10 @@ private:
    void
    endTransformFeedback();
 
-   int
-   countModifiedUniforms(latte::Register firstReg,
-                         uint32_t lastUniformUpdate);
+   void
+   updateUniformRegisters(unsigned stage,
+                          latte::Register firstReg,
+                          gl::GLuint binding);
 
    bool
    parseFetchShader(FetchShader &shader,
@@ -457,23 +568,76 @@ private:
    void
    injectFence(std::function<void()> func);
 
-   void
+   size_t
    checkSyncObjects();
 
+   bool
+   isFenceSignalled(gl::GLsync fence);
+
+   pm4::Buffer *
+   waitForSyncObjects();
+
+   void
+   initSwapChain();
+
+   size_t
+   acquireSwapSlot();
+
+   void
+   completeSwap(size_t slot);
+
+   bool
+   presentSwapChain();
+
+   void
+   flipSwapChain(const PendingSwap &swap);
+
+   std::chrono::microseconds
+   getSwapChainTimeout();
+
    void
    runOnGLThread(std::function<void()> func);
 
+   bool
+   insertTimestamp();
+
+   void
+   beginTimingPass(gpu::TimingPassType type,
+                   uint64_t id);
+
+   bool
+   endTimingPass(gpu::TimingPassType type);
+
+   void
+   markTimingDraw(bool framebufferChanged);
+
+   void
+   endTimingFrame();
+
    void
    runRemoteThreadTasks();
 
+   IndexBuffer *
+   getIndexBuffer(const void *indices,
+                  uint32_t count,
+                  latte::VGT_INDEX_TYPE indexFmt,
+                  bool swap,
+                  latte::VGT_DI_PRIMITIVE_TYPE type);
+
+   void
+   evictIndexBuffers();
+
    void
    drawPrimitives(uint32_t count,
                   const void *indices,
-                  latte::VGT_INDEX_TYPE indexFmt);
+                  latte::VGT_INDEX_TYPE indexFmt,
+                  bool swap,
+                  bool isGuestMemory);
 
    void
    drawPrimitivesIndexed(const void *indices,
-                         uint32_t count);
+                         uint32_t count,
+                         bool isGuestMemory);
 
 private:
    enum class RunState
@@ -498,6 +662,8 @@ private:
    std::map<ShaderPipelineKey, ShaderPipeline> mShaderPipelines;
    std::unordered_map<uint64_t, SurfaceBuffer> mSurfaces;
    std::unordered_map<uint32_t, DataBuffer> mDataBuffers;
+   std::map<IndexBufferKey, IndexBuffer> mIndexBuffers;
+   uint32_t mIndexBufferFrame = 0;
 
    ResourceMemoryMap mResourceMap;
    ResourceMemoryMap mOutputBufferMap;
@@ -516,7 +682,34 @@ private:
    ScanBufferChain mTvScanBuffers;
    ScanBufferChain mDrcScanBuffers;
 
-   std::queue<SyncWait> mSyncWaits;
+   // Swap chain slots index both mTvScanBuffers and mDrcScanBuffers, see
+   //  opengl_swapchain.cpp.  Everything but mPresentSlot and mFrontSlot
+   //  belongs to the GPU thread.
+   PresentMode mPresentMode = PresentMode::Immediate;
+   size_t mWriteSlot = 0;  // Copies to the scan buffers go here
+   size_t mLastSwapSlot = 0;  // Slot of the newest swap
+   std::vector<size_t> mFreeSlots;
+   std::deque<PendingSwap> mPendingSwaps;  // Swapped but not yet flipped
+   std::atomic<size_t> mPresentSlot { 1 };  // Newest flip, for the presenter
+   size_t mFrontSlot = 0;  // Slot the presenter is drawing
+   std::chrono::steady_clock::time_point mNextFlipTime;
+   std::chrono::steady_clock::time_point mLastFlipTime;
+
+   std::deque<SyncWait> mSyncWaits;
+
+   // Timestamp queries of the frame being processed, see opengl_timing.cpp
+   TimingFrameState mTimingFrame;
+   std::vector<gl::GLuint> mTimingQueryPool;
+
+   ShaderCompiler mShaderCompiler;
+   bool mWaitingForShaders = false;  // Last draw was skipped for a compile
+
+   // Persistently mapped ring which untiled texture data and index data
+   //  are written into, see opengl_streambuffer.h
+   StreamBuffer mUploadBuffer;
+
+   // Index conversions which do not fit in mUploadBuffer are made here
+   std::vector<uint8_t> mIndexScratch;
 
    gl::GLuint mFeedbackQuery = 0;
    bool mFeedbackActive = false;
@@ -534,16 +727,25 @@ private:
    std::array<TextureCache, latte::MaxTextures> mPixelTextureCache;
    std::array<SamplerCache, latte::MaxSamplers> mPixelSamplerCache;
 
-   // Used to detect changes to uniform registers; see countModifiedUniforms()
-   uint32_t mUniformUpdateGen = 0;
-   std::array<uint32_t, (2 * latte::MaxUniformRegisters) / 16> mLastUniformUpdate;
+   // Uniform registers are tracked in blocks of 16 vectors, a bit is set
+   //  here when a block is written and cleared when the register file it
+   //  belongs to is next copied into mUniformBuffer.
+   static_assert(2 * latte::MaxUniformRegisters / 16 <= 32, "mDirtyUniformRegisters is too small");
+   uint32_t mDirtyUniformRegisters = 0;
+
+   // Ring which DX9-style uniform register files are streamed into, and the
+   //  last copy made for each of the pixel and vertex shader register files
+   StreamBuffer mUniformBuffer;
+   gl::GLuint mUniformBufferAlignment = 256;
+   std::array<UniformRegisterCache, 2> mUniformRegisterCache;
+   std::array<gl::GLuint, 2> mUniformRegisterFallback = { };
 
    using duration_system_clock = std::chrono::duration<double, std::chrono::system_clock::period>;
    using duration_ms = std::chrono::duration<double, std::chrono::milliseconds::period>;
-   std::chrono::time_point<std::chrono::system_clock> mLastSwap;
    duration_system_clock mAverageFrameTime;
 
    std::mutex mTaskListMutex;  // Protects mTaskList
+   std::mutex mWritebackMutex;  // Held by the GPU thread to change a surface's writeback state
    std::list<RemoteThreadTask> mTaskList;
 
 };
@@ -27,12 +27,13 @@ GLDriver::applyRegister(latte::Register reg)
 {
    auto value = getRegister<uint32_t>(reg);
 
-   // Handle optimization with uniform update generation tracking
+   // Uniform registers are uploaded from the register file on draw, so we
+   //  only need to mark which block of 16 vectors has changed
    if (reg >= latte::Register::AluConstRegisterBase &&
       reg < latte::Register::AluConstRegisterEnd)
    {
       auto offset = (reg - latte::Register::AluConstRegisterBase) / 4 / 4;
-      mLastUniformUpdate[offset / 16] = mUniformUpdateGen;
+      mDirtyUniformRegisters |= 1u << (offset / 16);
       return;
    }
 
@@ -29,6 +29,7 @@ struct Resource
    //! The type of resource (poor man's RTTI for surfaceSync())
    enum Type {
       DATA_BUFFER,
+      INDEX_BUFFER,
       SHADER,
       SURFACE,
    } type;
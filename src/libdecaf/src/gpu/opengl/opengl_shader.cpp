@@ -2,6 +2,7 @@
 
 #include "decaf_config.h"
 #include "gpu/glsl2/glsl2_translate.h"
+#include "gpu/gpu_flush.h"
 #include "gpu/gpu_utilities.h"
 #include "gpu/latte_registers.h"
 #include "gpu/microcode/latte_disassembler.h"
@@ -13,6 +14,7 @@
 #include <common/murmur3.h>
 #include <common/platform_dir.h>
 #include <common/strutils.h>
+#include <cstring>
 #include <fstream>
 #include <glbinding/gl/gl.h>
 #include <libcpu/mem.h>
@@ -112,16 +114,30 @@ deleteShaderObject(FetchShader *shader)
    gl::glDeleteVertexArrays(1, &shader->object);
 }
 
+template<typename ShaderType>
 static void
-deleteShaderObject(VertexShader *shader)
+deleteShaderProgram(ShaderType *shader)
 {
+   // Let a background compile finish so we can delete what it created
+   if (shader->program) {
+      ShaderCompiler::wait(*shader->program);
+      gl::glDeleteProgram(shader->program->object);
+      shader->program.reset();
+   }
+
    gl::glDeleteProgram(shader->object);
 }
 
+static void
+deleteShaderObject(VertexShader *shader)
+{
+   deleteShaderProgram(shader);
+}
+
 static void
 deleteShaderObject(PixelShader *shader)
 {
-   gl::glDeleteProgram(shader->object);
+   deleteShaderProgram(shader);
 }
 
 template <typename ShaderPtrType> static bool
@@ -167,6 +183,8 @@ invalidateShaderIfChanged(ShaderPtrType &shader,
 
 bool GLDriver::checkActiveShader()
 {
+   mWaitingForShaders = false;
+
    auto pgm_start_fs = getRegister<latte::SQ_PGM_START_FS>(latte::Register::SQ_PGM_START_FS);
    auto pgm_start_vs = getRegister<latte::SQ_PGM_START_VS>(latte::Register::SQ_PGM_START_VS);
    auto pgm_start_ps = getRegister<latte::SQ_PGM_START_PS>(latte::Register::SQ_PGM_START_PS);
@@ -269,14 +287,37 @@ bool GLDriver::checkActiveShader()
       }
    }
 
-   auto getProgramLog = [](auto program) {
-      gl::GLint logLength = 0;
-      std::string logMessage;
-      gl::glGetProgramiv(program, gl::GL_INFO_LOG_LENGTH, &logLength);
+   // Take the program from a finished background compile and run onReady
+   //  for it.  Returns false if the compile has not finished yet, in which
+   //  case we skip the draw unless strict_shaders is set.
+   auto finishProgram = [&](auto shader, const char *type, auto onReady) {
+      if (!shader->program) {
+         return true;
+      }
 
-      logMessage.resize(logLength);
-      gl::glGetProgramInfoLog(program, logLength, &logLength, &logMessage[0]);
-      return logMessage;
+      auto &program = *shader->program;
+
+      if (!ShaderCompiler::isReady(program)) {
+         if (!decaf::config::gpu::strict_shaders) {
+            mWaitingForShaders = true;
+            return false;
+         }
+
+         ShaderCompiler::wait(program);
+      }
+
+      if (program.linked) {
+         shader->object = program.object;
+         onReady();
+      } else {
+         gLog->error("OpenGL failed to compile {} shader:\n{}", type, program.log);
+         gLog->error("Shader Disassembly:\n{}\n", shader->disassembly);
+         gLog->error("Shader Code:\n{}\n", shader->code);
+         gl::glDeleteProgram(program.object);
+      }
+
+      shader->program.reset();
+      return true;
    };
 
    // Generate shader if needed
@@ -386,38 +427,8 @@ bool GLDriver::checkActiveShader()
 
          dumpTranslatedShader("vertex", vsPgmAddress, vertexShader->code);
 
-         // Create OpenGL Shader
-         const gl::GLchar *code[] = { vertexShader->code.c_str() };
-         vertexShader->object = gl::glCreateShaderProgramv(gl::GL_VERTEX_SHADER, 1, code);
-         if (decaf::config::gpu::debug) {
-            std::string label = fmt::format("vertex shader @ 0x{:08X}", vsPgmAddress);
-            gl::glObjectLabel(gl::GL_PROGRAM, vertexShader->object, -1, label.c_str());
-         }
-
-         // Check if shader compiled & linked properly
-         gl::GLint isLinked = 0;
-         gl::glGetProgramiv(vertexShader->object, gl::GL_LINK_STATUS, &isLinked);
-
-         if (!isLinked) {
-            auto log = getProgramLog(vertexShader->object);
-            gLog->error("OpenGL failed to compile vertex shader:\n{}", log);
-            gLog->error("Fetch Disassembly:\n{}\n", fetchShader->disassembly);
-            gLog->error("Shader Disassembly:\n{}\n", vertexShader->disassembly);
-            gLog->error("Shader Code:\n{}\n", vertexShader->code);
-            return false;
-         }
-
-         // Get uniform locations
-         vertexShader->uniformRegisters = gl::glGetUniformLocation(vertexShader->object, "VR");
-         vertexShader->uniformViewport = gl::glGetUniformLocation(vertexShader->object, "uViewport");
-
-         // Get attribute locations
-         vertexShader->attribLocations.fill(0);
-
-         for (auto &attrib : fetchShader->attribs) {
-            auto name = fmt::format("fs_out_{}", attrib.location);
-            vertexShader->attribLocations[attrib.location] = gl::glGetAttribLocation(vertexShader->object, name.c_str());
-         }
+         // Create OpenGL Shader, this is finished off below once it is ready
+         vertexShader->program = mShaderCompiler.compile(gl::GL_VERTEX_SHADER, vertexShader->code);
       }
 
       pipeline.vertex = vertexShader;
@@ -455,30 +466,8 @@ bool GLDriver::checkActiveShader()
 
             dumpTranslatedShader("pixel", psPgmAddress, pixelShader->code);
 
-            // Create OpenGL Shader
-            const gl::GLchar *code[] = { pixelShader->code.c_str() };
-            pixelShader->object = gl::glCreateShaderProgramv(gl::GL_FRAGMENT_SHADER, 1, code);
-
-            if (decaf::config::gpu::debug) {
-               std::string label = fmt::format("pixel shader @ 0x{:08X}", psPgmAddress);
-               gl::glObjectLabel(gl::GL_PROGRAM, pixelShader->object, -1, label.c_str());
-            }
-
-            // Check if shader compiled & linked properly
-            gl::GLint isLinked = 0;
-            gl::glGetProgramiv(pixelShader->object, gl::GL_LINK_STATUS, &isLinked);
-
-            if (!isLinked) {
-               auto log = getProgramLog(pixelShader->object);
-               gLog->error("OpenGL failed to compile pixel shader:\n{}", log);
-               gLog->error("Shader Disassembly:\n{}\n", pixelShader->disassembly);
-               gLog->error("Shader Code:\n{}\n", pixelShader->code);
-               return false;
-            }
-
-            // Get uniform locations
-            pixelShader->uniformRegisters = gl::glGetUniformLocation(pixelShader->object, "PR");
-            pixelShader->uniformAlphaRef = gl::glGetUniformLocation(pixelShader->object, "uAlphaRef");
+            // Create OpenGL Shader, this is finished off below once it is ready
+            pixelShader->program = mShaderCompiler.compile(gl::GL_FRAGMENT_SHADER, pixelShader->code);
             pixelShader->sx_alpha_test_control = sx_alpha_test_control;
          }
 
@@ -502,8 +491,56 @@ bool GLDriver::checkActiveShader()
          gl::glObjectLabel(gl::GL_PROGRAM_PIPELINE, pipeline.object, -1, label.c_str());
       }
 
+      pipeline.stagesReady = false;
+   }
+
+   // The pipeline's programs may still be compiling in the background, so
+   //  its stages are only attached once they are both ready
+   if (!pipeline.stagesReady) {
+      auto vertexReady = finishProgram(pipeline.vertex, "vertex", [&]() {
+         auto vertexShader = pipeline.vertex;
+
+         if (decaf::config::gpu::debug) {
+            std::string label = fmt::format("vertex shader @ 0x{:08X}", vertexShader->cpuMemStart);
+            gl::glObjectLabel(gl::GL_PROGRAM, vertexShader->object, -1, label.c_str());
+         }
+
+         // Get uniform locations
+         vertexShader->uniformViewport = gl::glGetUniformLocation(vertexShader->object, "uViewport");
+
+         // Get attribute locations
+         vertexShader->attribLocations.fill(0);
+
+         for (auto &attrib : pipeline.fetch->attribs) {
+            auto name = fmt::format("fs_out_{}", attrib.location);
+            vertexShader->attribLocations[attrib.location] = gl::glGetAttribLocation(vertexShader->object, name.c_str());
+         }
+      });
+
+      auto pixelReady = !pipeline.pixel || finishProgram(pipeline.pixel, "pixel", [&]() {
+         auto pixelShader = pipeline.pixel;
+
+         if (decaf::config::gpu::debug) {
+            std::string label = fmt::format("pixel shader @ 0x{:08X}", pixelShader->cpuMemStart);
+            gl::glObjectLabel(gl::GL_PROGRAM, pixelShader->object, -1, label.c_str());
+         }
+
+         // Get uniform locations
+         pixelShader->uniformAlphaRef = gl::glGetUniformLocation(pixelShader->object, "uAlphaRef");
+      });
+
+      if (!vertexReady || !pixelReady) {
+         return false;
+      }
+
+      // Shaders which failed to compile have no object
+      if (!pipeline.vertex->object || (pipeline.pixel && !pipeline.pixel->object)) {
+         return false;
+      }
+
       gl::glUseProgramStages(pipeline.object, gl::GL_VERTEX_SHADER_BIT, pipeline.vertex->object);
       gl::glUseProgramStages(pipeline.object, gl::GL_FRAGMENT_SHADER_BIT, pipeline.pixel ? pipeline.pixel->object : 0);
+      pipeline.stagesReady = true;
    }
 
    // Set active shader
@@ -522,31 +559,57 @@ bool GLDriver::checkActiveShader()
    return true;
 }
 
-int
-GLDriver::countModifiedUniforms(latte::Register firstReg,
-                                uint32_t lastUniformUpdate)
+/**
+ * Copy a uniform register file into the uniform ring and bind it, if any of
+ * its registers have changed since it was last copied.
+ *
+ * Registers are dirtied in blocks of 16 vectors by applyRegister(), so this
+ * does not need to scan the register file.  The whole file is copied as
+ * relative addressing means the shader can read any register.
+ */
+void
+GLDriver::updateUniformRegisters(unsigned stage,
+                                 latte::Register firstReg,
+                                 gl::GLuint binding)
 {
-   auto firstUniform = (firstReg - latte::Register::AluConstRegisterBase) / (4 * 4);
-   decaf_check(firstUniform == 0 || firstUniform == 256);
-
-   // We track uniforms in groups of 16 vectors, as a balance between the
-   //  cost of uploading many unchanged uniforms and the cost of checking
-   //  many individual uniforms for changes.
-   auto offset = firstUniform / 16;
-
-   for (auto i = 16u; i > 0; --i) {
-      // lastUniformUpdate is set to the newly incremented uniform update
-      //  generation at the time of the last upload, so any uniforms whose
-      //  update generation is at least that value need to be uploaded.
-      //  Need to be careful with this comparison in case of wraparound!
-      auto diff = mLastUniformUpdate[offset + (i-1)] - lastUniformUpdate;
-
-      if (diff <= 0x7FFFFFFF) {  // i.e. signed(diff) >= 0
-         return i * 16;
+   auto firstBlock = (firstReg - latte::Register::AluConstRegisterBase) / (4 * 4 * 16);
+   auto blockMask = 0xFFFFu << firstBlock;
+   auto &cache = mUniformRegisterCache[stage];
+   auto values = &mRegisters[firstReg / 4];
+   auto size = latte::MaxUniformRegisters * 4 * 4;
+
+   // A copy must be replaced before the ring wraps around onto it
+   if (cache.valid && mUniformBuffer.position() - cache.position > mUniformBuffer.size() / 2) {
+      cache.valid = false;
+   }
+
+   if (cache.valid && !(mDirtyUniformRegisters & blockMask)) {
+      return;
+   }
+
+   auto upload = mUniformBuffer.allocate(size, mUniformBufferAlignment);
+
+   if (upload.ptr) {
+      std::memcpy(upload.ptr, values, size);
+      gl::glBindBufferRange(gl::GL_UNIFORM_BUFFER, binding, mUniformBuffer.object(), upload.offset, size);
+      cache.offset = upload.offset;
+      cache.position = upload.position;
+   } else {
+      // Without a mapped ring, update just the changed blocks in place
+      auto object = mUniformRegisterFallback[stage];
+      auto dirty = cache.valid ? (mDirtyUniformRegisters & blockMask) >> firstBlock : 0xFFFFu;
+
+      for (auto i = 0u; i < 16; ++i) {
+         if (dirty & (1 << i)) {
+            gl::glNamedBufferSubData(object, i * 16 * 4 * 4, 16 * 4 * 4, values + i * 16 * 4);
+         }
       }
+
+      gl::glBindBufferBase(gl::GL_UNIFORM_BUFFER, binding, object);
    }
 
-   return 0;
+   cache.valid = true;
+   mDirtyUniformRegisters &= ~blockMask;
 }
 
 bool GLDriver::checkActiveUniforms()
@@ -560,25 +623,11 @@ bool GLDriver::checkActiveUniforms()
    if (sq_config.DX9_CONSTS()) {
       // Upload uniform registers
       if (mActiveShader->vertex && mActiveShader->vertex->object) {
-         auto uploadCount = countModifiedUniforms(latte::Register::SQ_ALU_CONSTANT0_256, mActiveShader->vertex->lastUniformUpdate);
-
-         if (uploadCount > 0) {
-            auto values = reinterpret_cast<float *>(&mRegisters[latte::Register::SQ_ALU_CONSTANT0_256 / 4]);
-            gl::glProgramUniform4fv(mActiveShader->vertex->object, mActiveShader->vertex->uniformRegisters, uploadCount, values);
-
-            mActiveShader->vertex->lastUniformUpdate = ++mUniformUpdateGen;
-         }
+         updateUniformRegisters(1, latte::Register::SQ_ALU_CONSTANT0_256, glsl2::VertexRegisterBinding);
       }
 
       if (mActiveShader->pixel && mActiveShader->pixel->object) {
-         auto uploadCount = countModifiedUniforms(latte::Register::SQ_ALU_CONSTANT0_0, mActiveShader->pixel->lastUniformUpdate);
-
-         if (uploadCount > 0) {
-            auto values = reinterpret_cast<float *>(&mRegisters[latte::Register::SQ_ALU_CONSTANT0_0 / 4]);
-            gl::glProgramUniform4fv(mActiveShader->pixel->object, mActiveShader->pixel->uniformRegisters, uploadCount, values);
-
-            mActiveShader->pixel->lastUniformUpdate = ++mUniformUpdateGen;
-         }
+         updateUniformRegisters(0, latte::Register::SQ_ALU_CONSTANT0_0, glsl2::PixelRegisterBinding);
       }
    } else {
       if (mActiveShader->vertex && mActiveShader->vertex->object) {
@@ -673,6 +722,7 @@ GLDriver::getDataBuffer(uint32_t address,
    buffer->cpuMemStart = address;
    buffer->cpuMemEnd = address + size;
    buffer->allocatedSize = size;
+   buffer->blockHashes.resize(2 * ((size + DataBufferBlockSize - 1) / DataBufferBlockSize), 0);
    buffer->mappedBuffer = nullptr;
    buffer->isInput |= isInput;
    buffer->isOutput |= isOutput;
@@ -779,44 +829,76 @@ GLDriver::downloadDataBuffer(DataBuffer *buffer,
    }
 }
 
+void
+GLDriver::copyDataBufferRange(DataBuffer *buffer,
+                              uint32_t offset,
+                              uint32_t size)
+{
+   if (buffer->mappedBuffer) {
+      memcpy(static_cast<char *>(buffer->mappedBuffer) + offset,
+             mem::translate<char>(buffer->cpuMemStart) + offset,
+             size);
+      gl::glFlushMappedNamedBufferRange(buffer->object, offset, size);
+      buffer->dirtyMap = true;
+   } else {
+      gl::glNamedBufferSubData(buffer->object, offset, size,
+                               mem::translate<char>(buffer->cpuMemStart) + offset);
+   }
+}
+
 void
 GLDriver::uploadDataBuffer(DataBuffer *buffer,
                            uint32_t offset,
                            uint32_t size)
 {
-   // Avoid uploading the data if it hasn't changed.
-   uint64_t newHash[2] = { 0, 0 };
-   MurmurHash3_x64_128(mem::translate(buffer->cpuMemStart), buffer->allocatedSize, 0, newHash);
-
-   if (newHash[0] != buffer->cpuMemHash[0] || newHash[1] != buffer->cpuMemHash[1]) {
-      buffer->cpuMemHash[0] = newHash[0];
-      buffer->cpuMemHash[1] = newHash[1];
-
-      // We currently can't detect where the change occurred, so upload
-      //  the entire buffer.  If we don't do this, the following sequence
-      //  will result in incorrect GPU-side data:
-      //     1) Client modifies two disjoint regions A and B of the buffer.
-      //     2) Client calls GX2Invalidate() on region A.
-      //     3) We detect that the hash has changed and upload region A.
-      //     4) Client calls GX2Invalidate() on region B.
-      //     5) We detect that the hash is unchanged and don't upload
-      //         region B.
-      //  Now region B has incorrect data on the host GPU.
-      // TODO: Find a better way to allow partial updates.
-      offset = 0;
-      size = buffer->allocatedSize;
-
-      if (buffer->mappedBuffer) {
-         memcpy(static_cast<char *>(buffer->mappedBuffer) + offset,
-                mem::translate<char>(buffer->cpuMemStart) + offset,
-                size);
-         gl::glFlushMappedNamedBufferRange(buffer->object, offset, size);
-         buffer->dirtyMap = true;
-      } else {
-         gl::glNamedBufferSubData(buffer->object, offset, size,
-                                  mem::translate<char>(buffer->cpuMemStart) + offset);
+   // Avoid uploading the data if it hasn't changed.  Each block keeps its
+   //  own hash, so a block which changed but was not in the range of an
+   //  earlier flush still differs from its hash when it is flushed later.
+   //  Blocks are uploaded whole, including any part outside the range.
+   auto &stats = gpu::getDataUploadStats();
+   auto firstBlock = offset / DataBufferBlockSize;
+   auto endBlock = (offset + size + DataBufferBlockSize - 1) / DataBufferBlockSize;
+   auto runStart = uint32_t { 0 };
+   auto runEnd = uint32_t { 0 };
+   auto skipped = uint32_t { 0 };
+   auto uploaded = uint32_t { 0 };
+
+   for (auto block = firstBlock; block < endBlock; ++block) {
+      auto blockStart = block * DataBufferBlockSize;
+      auto blockSize = std::min(DataBufferBlockSize, buffer->allocatedSize - blockStart);
+      auto hash = &buffer->blockHashes[block * 2];
+      uint64_t newHash[2] = { 0, 0 };
+      MurmurHash3_x64_128(mem::translate(buffer->cpuMemStart + blockStart), blockSize, 0, newHash);
+
+      if (newHash[0] == hash[0] && newHash[1] == hash[1]) {
+         skipped += blockSize;
+         continue;
+      }
+
+      hash[0] = newHash[0];
+      hash[1] = newHash[1];
+
+      // Merge adjacent changed blocks into a single copy and flush
+      if (runEnd != blockStart || runStart == runEnd) {
+         if (runStart != runEnd) {
+            copyDataBufferRange(buffer, runStart, runEnd - runStart);
+            stats.uploadedRanges++;
+         }
+
+         runStart = blockStart;
       }
+
+      runEnd = blockStart + blockSize;
+      uploaded += blockSize;
    }
+
+   if (runStart != runEnd) {
+      copyDataBufferRange(buffer, runStart, runEnd - runStart);
+      stats.uploadedRanges++;
+   }
+
+   stats.uploadedBytes += uploaded;
+   stats.skippedBytes += skipped;
 }
 
 bool
@@ -0,0 +1,337 @@
+#ifndef DECAF_NOGL
+
+#include "decaf.h"
+#include "decaf_config.h"
+#include "opengl_shadercompiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <common/log.h>
+#include <common/murmur3.h>
+#include <common/platform_dir.h>
+#include <common/platform_thread.h>
+#include <fstream>
+#include <iterator>
+
+namespace gpu
+{
+
+namespace opengl
+{
+
+ShaderCompiler::~ShaderCompiler()
+{
+   stop();
+}
+
+void
+ShaderCompiler::setSharedContexts(unsigned count,
+                                  const MakeContextCurrentFunction &makeCurrent)
+{
+   mNumContexts = count;
+   mMakeCurrent = makeCurrent;
+}
+
+/**
+ * Start the compile threads, must be called on the GPU thread.
+ */
+void
+ShaderCompiler::start()
+{
+   gl::GLint numBinaryFormats = 0;
+   gl::glGetIntegerv(gl::GL_NUM_PROGRAM_BINARY_FORMATS, &numBinaryFormats);
+
+   mCachePath = getCachePath();
+   mBinariesSupported = numBinaryFormats > 0 && !mCachePath.empty();
+
+   if (mBinariesSupported) {
+      platform::createDirectory(mCachePath);
+   }
+
+   auto numThreads = std::min(mNumContexts, decaf::config::gpu::shader_compile_threads);
+
+   if (!numThreads || !mMakeCurrent) {
+      return;
+   }
+
+   mRunning = true;
+
+   // Only keep the threads which managed to make their context current
+   auto started = std::vector<std::future<bool>> { };
+
+   for (auto i = 0u; i < numThreads; ++i) {
+      auto result = std::make_shared<std::promise<bool>>();
+      started.emplace_back(result->get_future());
+
+      mThreads.emplace_back([this, i, result]() {
+         auto ok = mMakeCurrent(i);
+         result->set_value(ok);
+
+         if (ok) {
+            workerThread();
+         }
+      });
+
+      platform::setThreadName(&mThreads.back(), fmt::format("Shader Thread {}", i));
+   }
+
+   for (auto i = 0u; i < mThreads.size(); ) {
+      if (started[i].get()) {
+         ++i;
+         continue;
+      }
+
+      gLog->warn("Failed to make a shared GL context current, shaders will be compiled on fewer threads");
+      mThreads[i].join();
+      mThreads.erase(mThreads.begin() + i);
+      started.erase(started.begin() + i);
+   }
+}
+
+void
+ShaderCompiler::stop()
+{
+   {
+      std::unique_lock<std::mutex> lock { mMutex };
+      mRunning = false;
+
+      // Nobody will be waiting to draw with these now
+      for (auto &program : mQueue) {
+         program->built.set_value();
+      }
+
+      mQueue.clear();
+   }
+
+   mQueueCV.notify_all();
+
+   for (auto &thread : mThreads) {
+      thread.join();
+   }
+
+   mThreads.clear();
+}
+
+/**
+ * Queue a program to be compiled, the returned program is ready to use once
+ * isReady returns true.
+ */
+std::shared_ptr<ShaderCompiler::Program>
+ShaderCompiler::compile(gl::GLenum type,
+                        const std::string &code)
+{
+   auto program = std::make_shared<Program>();
+   program->type = type;
+   program->code = code;
+   program->done = program->built.get_future();
+   MurmurHash3_x64_128(code.data(), static_cast<int>(code.size()), static_cast<uint32_t>(type), program->hash);
+
+   if (mThreads.empty()) {
+      build(*program);
+      program->built.set_value();
+      return program;
+   }
+
+   {
+      std::unique_lock<std::mutex> lock { mMutex };
+      mQueue.push_back(program);
+   }
+
+   mQueueCV.notify_one();
+   return program;
+}
+
+bool
+ShaderCompiler::isReady(const Program &program)
+{
+   return program.done.wait_for(std::chrono::seconds { 0 }) == std::future_status::ready;
+}
+
+void
+ShaderCompiler::wait(const Program &program)
+{
+   program.done.wait();
+}
+
+void
+ShaderCompiler::workerThread()
+{
+   while (true) {
+      auto program = std::shared_ptr<Program> { };
+
+      {
+         std::unique_lock<std::mutex> lock { mMutex };
+         mQueueCV.wait(lock, [&]() { return !mRunning || !mQueue.empty(); });
+
+         if (!mRunning) {
+            break;
+         }
+
+         program = mQueue.front();
+         mQueue.pop_front();
+      }
+
+      build(*program);
+
+      // The program must be complete before the GPU thread's context uses it
+      gl::glFinish();
+      program->built.set_value();
+   }
+}
+
+/**
+ * Link a program from its binary if we have one, otherwise compile it.
+ *
+ * This matches glCreateShaderProgramv, except that the program is marked
+ * retrievable before it is linked so its binary can be saved.
+ */
+void
+ShaderCompiler::build(Program &program)
+{
+   if (mBinariesSupported && loadBinary(program)) {
+      return;
+   }
+
+   const gl::GLchar *code[] = { program.code.c_str() };
+   auto shader = gl::glCreateShader(program.type);
+   gl::glShaderSource(shader, 1, code, nullptr);
+   gl::glCompileShader(shader);
+
+   program.object = gl::glCreateProgram();
+   gl::glProgramParameteri(program.object, gl::GL_PROGRAM_SEPARABLE, 1);
+
+   if (mBinariesSupported) {
+      gl::glProgramParameteri(program.object, gl::GL_PROGRAM_BINARY_RETRIEVABLE_HINT, 1);
+   }
+
+   gl::GLint isCompiled = 0;
+   gl::glGetShaderiv(shader, gl::GL_COMPILE_STATUS, &isCompiled);
+
+   if (isCompiled) {
+      gl::glAttachShader(program.object, shader);
+      gl::glLinkProgram(program.object);
+      gl::glDetachShader(program.object, shader);
+   }
+
+   gl::GLint isLinked = 0;
+   gl::GLint logLength = 0;
+   gl::glGetProgramiv(program.object, gl::GL_LINK_STATUS, &isLinked);
+   program.linked = !!isLinked;
+
+   if (!isCompiled) {
+      gl::glGetShaderiv(shader, gl::GL_INFO_LOG_LENGTH, &logLength);
+      program.log.resize(logLength);
+      gl::glGetShaderInfoLog(shader, logLength, &logLength, &program.log[0]);
+   } else if (!isLinked) {
+      gl::glGetProgramiv(program.object, gl::GL_INFO_LOG_LENGTH, &logLength);
+      program.log.resize(logLength);
+      gl::glGetProgramInfoLog(program.object, logLength, &logLength, &program.log[0]);
+   }
+
+   gl::glDeleteShader(shader);
+
+   if (program.linked && mBinariesSupported) {
+      saveBinary(program);
+   }
+}
+
+bool
+ShaderCompiler::loadBinary(Program &program)
+{
+   std::ifstream file { getBinaryPath(program), std::ifstream::in | std::ifstream::binary };
+
+   if (!file.is_open()) {
+      return false;
+   }
+
+   uint32_t format = 0;
+   file.read(reinterpret_cast<char *>(&format), sizeof(format));
+
+   if (!file) {
+      return false;
+   }
+
+   auto binary = std::vector<char> { std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> { } };
+
+   if (binary.empty()) {
+      return false;
+   }
+
+   program.object = gl::glCreateProgram();
+   gl::glProgramParameteri(program.object, gl::GL_PROGRAM_SEPARABLE, 1);
+   gl::glProgramBinary(program.object, static_cast<gl::GLenum>(format), binary.data(), static_cast<gl::GLsizei>(binary.size()));
+
+   // The driver rejects binaries from other driver versions or hardware
+   gl::GLint isLinked = 0;
+   gl::glGetProgramiv(program.object, gl::GL_LINK_STATUS, &isLinked);
+
+   if (!isLinked) {
+      gl::glDeleteProgram(program.object);
+      program.object = 0;
+      return false;
+   }
+
+   program.linked = true;
+   program.fromBinary = true;
+   return true;
+}
+
+void
+ShaderCompiler::saveBinary(Program &program)
+{
+   gl::GLint length = 0;
+   gl::glGetProgramiv(program.object, gl::GL_PROGRAM_BINARY_LENGTH, &length);
+
+   if (!length) {
+      return;
+   }
+
+   auto binary = std::vector<char>(length);
+   auto format = gl::GLenum { };
+   gl::glGetProgramBinary(program.object, length, &length, &format, binary.data());
+
+   std::ofstream file { getBinaryPath(program), std::ofstream::out | std::ofstream::binary };
+
+   if (!file.is_open()) {
+      return;
+   }
+
+   auto format32 = static_cast<uint32_t>(format);
+   file.write(reinterpret_cast<const char *>(&format32), sizeof(format32));
+   file.write(binary.data(), length);
+}
+
+std::string
+ShaderCompiler::getBinaryPath(const Program &program)
+{
+   return fmt::format("{}/{:016x}{:016x}.bin", mCachePath, program.hash[0], program.hash[1]);
+}
+
+/**
+ * Resolve shader_cache_path, relative paths live under the config directory
+ * so the cache does not depend on the current working directory.
+ */
+std::string
+ShaderCompiler::getCachePath()
+{
+   auto &path = decaf::config::gpu::shader_cache_path;
+
+   if (path.empty()) {
+      return { };
+   }
+
+   auto absolute = path[0] == '/' || path[0] == '\\'
+      || (path.size() > 1 && path[1] == ':');
+
+   if (absolute) {
+      return path;
+   }
+
+   return decaf::makeConfigPath(path);
+}
+
+} // namespace opengl
+
+} // namespace gpu
+
+#endif // DECAF_NOGL
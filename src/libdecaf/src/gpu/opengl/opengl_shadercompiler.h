@@ -0,0 +1,120 @@
+#pragma once
+
+#ifndef DECAF_NOGL
+
+#include "libdecaf/decaf_opengl.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <glbinding/gl/gl.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gpu
+{
+
+namespace opengl
+{
+
+/**
+ * Compiles and links separable GL programs on background threads.
+ *
+ * Each thread has its own context which shares objects with the GPU thread's
+ * context, these are provided by the frontend through
+ * decaf::OpenGLDriver::setSharedContexts.  Without them, or with no threads
+ * configured, programs are compiled immediately on the calling thread.
+ *
+ * Linked programs are stored as program binaries in
+ * decaf::config::gpu::shader_cache_path so later runs can skip the driver's
+ * GLSL compiler.  Binaries the driver no longer accepts are recompiled.
+ */
+class ShaderCompiler
+{
+public:
+   struct Program
+   {
+      //! GL_VERTEX_SHADER or GL_FRAGMENT_SHADER
+      gl::GLenum type;
+
+      std::string code;
+
+      //! Hash of code, which names the program binary
+      uint64_t hash[2] = { 0, 0 };
+
+      //! Only valid once done is ready
+      gl::GLuint object = 0;
+      bool linked = false;
+      bool fromBinary = false;
+      std::string log;
+
+      std::promise<void> built;
+      std::future<void> done;
+   };
+
+   using MakeContextCurrentFunction = decaf::OpenGLDriver::MakeContextCurrentFunction;
+
+public:
+   ~ShaderCompiler();
+
+   void
+   setSharedContexts(unsigned count,
+                     const MakeContextCurrentFunction &makeCurrent);
+
+   void
+   start();
+
+   void
+   stop();
+
+   std::shared_ptr<Program>
+   compile(gl::GLenum type,
+           const std::string &code);
+
+   static bool
+   isReady(const Program &program);
+
+   static void
+   wait(const Program &program);
+
+private:
+   void
+   workerThread();
+
+   void
+   build(Program &program);
+
+   bool
+   loadBinary(Program &program);
+
+   void
+   saveBinary(Program &program);
+
+   std::string
+   getBinaryPath(const Program &program);
+
+   std::string
+   getCachePath();
+
+private:
+   unsigned mNumContexts = 0;
+   MakeContextCurrentFunction mMakeCurrent;
+   bool mBinariesSupported = false;
+   std::string mCachePath;
+
+   std::vector<std::thread> mThreads;
+   std::mutex mMutex;
+   std::condition_variable mQueueCV;
+   std::deque<std::shared_ptr<Program>> mQueue;
+   bool mRunning = false;
+};
+
+} // namespace opengl
+
+} // namespace gpu
+
+#endif // DECAF_NOGL
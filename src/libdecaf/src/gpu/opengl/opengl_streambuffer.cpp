@@ -0,0 +1,150 @@
+#ifndef DECAF_NOGL
+
+#include "decaf_config.h"
+#include "opengl_streambuffer.h"
+
+#include <common/decaf_assert.h>
+#include <common/log.h>
+
+namespace gpu
+{
+
+namespace opengl
+{
+
+bool
+StreamBuffer::create(uint32_t size,
+                     const char *label)
+{
+   decaf_check(!mObject);
+
+   gl::glCreateBuffers(1, &mObject);
+
+   if (decaf::config::gpu::debug) {
+      gl::glObjectLabel(gl::GL_BUFFER, mObject, -1, label);
+   }
+
+   // We only ever write to the mapping, and use a coherent mapping so we
+   //  do not need to flush every allocation.  This is supported by every
+   //  driver with ARB_buffer_storage, including Mesa's software rasterisers.
+   auto usage = gl::BufferStorageMask::GL_NONE_BIT;
+   usage |= gl::GL_MAP_WRITE_BIT | gl::GL_MAP_PERSISTENT_BIT | gl::GL_MAP_COHERENT_BIT;
+   gl::glNamedBufferStorage(mObject, size, nullptr, usage);
+
+   auto access = gl::MapBufferAccessMask::GL_NONE_BIT;
+   access |= gl::GL_MAP_WRITE_BIT | gl::GL_MAP_PERSISTENT_BIT | gl::GL_MAP_COHERENT_BIT;
+   mMapped = static_cast<uint8_t *>(gl::glMapNamedBufferRange(mObject, 0, size, access));
+   mRing.reset(size);
+
+   if (!mMapped) {
+      gLog->warn("Failed to map {} stream buffer, falling back to client memory uploads", label);
+      return false;
+   }
+
+   return true;
+}
+
+void
+StreamBuffer::destroy()
+{
+   while (mRing.hasFences()) {
+      gl::glDeleteSync(mRing.oldestFence());
+      mRing.popFence();
+   }
+
+   if (mObject) {
+      if (mMapped) {
+         gl::glUnmapNamedBuffer(mObject);
+         mMapped = nullptr;
+      }
+
+      gl::glDeleteBuffers(1, &mObject);
+      mObject = 0;
+   }
+}
+
+StreamBuffer::Allocation
+StreamBuffer::allocate(uint32_t size,
+                       uint32_t alignment)
+{
+   auto result = Allocation { };
+
+   if (!mMapped || size > mRing.size()) {
+      return result;
+   }
+
+   auto start = mRing.allocate(size, alignment,
+                               [this]() { fence(); },
+                               [this]() { retireFences(true); });
+
+   result.position = start;
+   result.offset = static_cast<gl::GLintptr>(start % mRing.size());
+   result.ptr = mMapped + result.offset;
+   return result;
+}
+
+void
+StreamBuffer::fence()
+{
+   if (!mMapped || !mRing.hasUnfenced()) {
+      return;
+   }
+
+   mRing.pushFence(gl::glFenceSync(gl::GL_SYNC_GPU_COMMANDS_COMPLETE, gl::GL_NONE_BIT));
+
+   // Take the chance to release anything which has already completed
+   retireFences(false);
+}
+
+bool
+StreamBuffer::contains(const void *ptr) const
+{
+   auto bytes = static_cast<const uint8_t *>(ptr);
+   return mMapped && bytes >= mMapped && bytes < mMapped + mRing.size();
+}
+
+gl::GLintptr
+StreamBuffer::getOffset(const void *ptr) const
+{
+   decaf_check(contains(ptr));
+   return static_cast<const uint8_t *>(ptr) - mMapped;
+}
+
+/**
+ * Release signalled fences, if wait is true then block until at least the
+ * oldest fence has signalled.
+ */
+void
+StreamBuffer::retireFences(bool wait)
+{
+   while (mRing.hasFences()) {
+      auto sync = mRing.oldestFence();
+
+      if (wait) {
+         auto status = gl::glClientWaitSync(sync, gl::GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+
+         if (status == gl::GL_TIMEOUT_EXPIRED) {
+            continue;
+         }
+
+         decaf_check(status != gl::GL_WAIT_FAILED);
+         wait = false;
+      } else {
+         gl::GLenum value;
+         gl::glGetSynciv(sync, gl::GL_SYNC_STATUS, 4, nullptr, reinterpret_cast<gl::GLint*>(&value));
+
+         if (value == gl::GL_UNSIGNALED) {
+            break;
+         }
+      }
+
+      gl::glDeleteSync(sync);
+      mRing.popFence();
+   }
+}
+
+} // namespace opengl
+
+} // namespace gpu
+
+#endif // DECAF_NOGL
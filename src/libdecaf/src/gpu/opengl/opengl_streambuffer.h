@@ -0,0 +1,101 @@
+#pragma once
+
+#ifndef DECAF_NOGL
+
+#include "opengl_streamring.h"
+
+#include <cstdint>
+#include <glbinding/gl/gl.h>
+
+namespace gpu
+{
+
+namespace opengl
+{
+
+/**
+ * A persistently mapped buffer which is streamed into as a ring.
+ *
+ * Space is handed out linearly and wraps around at the end of the buffer.
+ * fence() marks everything allocated so far as in use by the commands issued
+ * so far, allocate() only waits on the GPU when it would overwrite data from
+ * a fence which has not yet signalled.
+ *
+ * If the buffer could not be persistently mapped, allocate() always fails
+ * and callers should fall back to uploading from client memory.
+ */
+class StreamBuffer
+{
+public:
+   struct Allocation
+   {
+      //! Pointer to the allocated space in the mapping, nullptr on failure.
+      uint8_t *ptr = nullptr;
+
+      //! Offset of the allocated space from the start of the buffer.
+      gl::GLintptr offset = 0;
+
+      //! Stream position of the allocated space, see position().
+      uint64_t position = 0;
+   };
+
+public:
+   bool
+   create(uint32_t size,
+          const char *label);
+
+   void
+   destroy();
+
+   Allocation
+   allocate(uint32_t size,
+            uint32_t alignment);
+
+   void
+   fence();
+
+   bool
+   contains(const void *ptr) const;
+
+   gl::GLintptr
+   getOffset(const void *ptr) const;
+
+   gl::GLuint
+   object() const
+   {
+      return mObject;
+   }
+
+   /**
+    * Returns the total number of bytes allocated so far.
+    *
+    * Space allocated at position P is not reused before position() has
+    * advanced past P + size().
+    */
+   uint64_t
+   position() const
+   {
+      return mRing.position();
+   }
+
+   uint64_t
+   size() const
+   {
+      return mRing.size();
+   }
+
+private:
+   void
+   retireFences(bool wait);
+
+private:
+   gl::GLuint mObject = 0;
+   uint8_t *mMapped = nullptr;
+   StreamRing<gl::GLsync> mRing;
+};
+
+} // namespace opengl
+
+} // namespace gpu
+
+#endif // DECAF_NOGL
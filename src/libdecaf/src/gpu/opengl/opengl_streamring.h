@@ -0,0 +1,162 @@
+#pragma once
+#include <common/decaf_assert.h>
+#include <cstdint>
+#include <queue>
+
+namespace gpu
+{
+
+namespace opengl
+{
+
+/**
+ * Space accounting for StreamBuffer, kept separate from the GL calls so the
+ * wrap and fence behaviour can be checked without a context.
+ *
+ * Stream positions increase monotonically, the buffer offset of a position
+ * is position % size().  Sync is the fence handle type, the ring only stores
+ * them and never waits on or deletes them itself.
+ */
+template<typename Sync>
+class StreamRing
+{
+public:
+   void
+   reset(uint64_t size)
+   {
+      decaf_check(mFences.empty());
+      mSize = size;
+      mHead = 0;
+      mRetired = 0;
+      mFenced = 0;
+   }
+
+   /**
+    * Reserve size bytes and return their stream position, alignment must
+    * divide the size of the ring so aligned positions are aligned offsets.
+    *
+    * If the space is still in use by the GPU, insertFence() is called when
+    * the data in flight has not been fenced yet and waitOldest() is called
+    * until enough fences have retired.  insertFence() must call pushFence()
+    * and waitOldest() must block on oldestFence() and then call popFence().
+    */
+   template<typename InsertFenceFunc, typename WaitOldestFunc>
+   uint64_t
+   allocate(uint32_t size,
+            uint32_t alignment,
+            InsertFenceFunc insertFence,
+            WaitOldestFunc waitOldest)
+   {
+      decaf_check(size <= mSize);
+      decaf_check(mSize % alignment == 0);
+      auto start = alignUp(mHead, alignment);
+
+      // Allocations never straddle the end of the buffer
+      if ((start % mSize) + size > mSize) {
+         start = alignUp(start, mSize);
+      }
+
+      // Wait until the GPU has finished with the space we are about to reuse
+      while (start + size > mRetired + mSize) {
+         if (mFences.empty()) {
+            if (mFenced == mHead) {
+               // Nothing is in flight, so the whole buffer is free
+               mRetired = start;
+               break;
+            }
+
+            // A single batch has used the whole buffer, fence it so we can wait
+            insertFence();
+            decaf_check(!mFences.empty());
+         }
+
+         waitOldest();
+      }
+
+      mHead = start + size;
+      return start;
+   }
+
+   //! Returns true if anything has been allocated since the last fence.
+   bool
+   hasUnfenced() const
+   {
+      return mHead != mFenced;
+   }
+
+   //! Record sync as covering everything allocated so far.
+   void
+   pushFence(Sync sync)
+   {
+      mFences.push({ mHead, sync });
+      mFenced = mHead;
+   }
+
+   bool
+   hasFences() const
+   {
+      return !mFences.empty();
+   }
+
+   Sync
+   oldestFence() const
+   {
+      return mFences.front().sync;
+   }
+
+   //! Release the oldest fence, its space may now be reused.
+   void
+   popFence()
+   {
+      mRetired = mFences.front().position;
+      mFences.pop();
+   }
+
+   uint64_t
+   position() const
+   {
+      return mHead;
+   }
+
+   //! Everything before this position has been consumed by the GPU.
+   uint64_t
+   retired() const
+   {
+      return mRetired;
+   }
+
+   uint64_t
+   size() const
+   {
+      return mSize;
+   }
+
+private:
+   static uint64_t
+   alignUp(uint64_t value,
+           uint64_t alignment)
+   {
+      return ((value + alignment - 1) / alignment) * alignment;
+   }
+
+private:
+   struct PendingFence
+   {
+      //! Stream position of the end of the data covered by this fence.
+      uint64_t position;
+      Sync sync;
+   };
+
+   uint64_t mSize = 0;
+   uint64_t mHead = 0;
+   uint64_t mRetired = 0;
+
+   //! Position of the most recently inserted fence.
+   uint64_t mFenced = 0;
+
+   std::queue<PendingFence> mFences;
+};
+
+} // namespace opengl
+
+} // namespace gpu
@@ -11,6 +11,7 @@
 
 #include <common/decaf_assert.h>
 #include <common/murmur3.h>
+#include <cstring>
 #include <libcpu/mem.h>
 #include <glbinding/gl/gl.h>
 #include <glbinding/Meta.h>
@@ -473,6 +474,76 @@ copyHostSurface(HostSurface* dest,
       copyWidth, copyHeight, copyDepth);
 }
 
+/**
+ * Get the format to read a surface back from the host in, returns false
+ * if the surface cannot be written back.
+ */
+static bool
+getWritebackFormat(latte::SQ_DATA_FORMAT format,
+                   latte::SQ_NUM_FORMAT numFormat,
+                   latte::SQ_FORMAT_COMP formatComp,
+                   uint32_t degamma,
+                   bool isDepthBuffer,
+                   gl::GLenum &readFormat,
+                   gl::GLenum &readType)
+{
+   if (isDepthBuffer) {
+      switch (format) {
+      case latte::SQ_DATA_FORMAT::FMT_16:
+         readFormat = gl::GL_DEPTH_COMPONENT;
+         readType = gl::GL_UNSIGNED_SHORT;
+         return true;
+      case latte::SQ_DATA_FORMAT::FMT_32_FLOAT:
+         readFormat = gl::GL_DEPTH_COMPONENT;
+         readType = gl::GL_FLOAT;
+         return true;
+      case latte::SQ_DATA_FORMAT::FMT_8_24:
+         readFormat = gl::GL_DEPTH_STENCIL;
+         readType = gl::GL_UNSIGNED_INT_24_8;
+         return true;
+      default:
+         return false;
+      }
+   }
+
+   switch (format) {
+   case latte::SQ_DATA_FORMAT::FMT_8_24:
+   case latte::SQ_DATA_FORMAT::FMT_8_24_FLOAT:
+   case latte::SQ_DATA_FORMAT::FMT_24_8:
+   case latte::SQ_DATA_FORMAT::FMT_24_8_FLOAT:
+   case latte::SQ_DATA_FORMAT::FMT_X24_8_32_FLOAT:
+      return false;
+   default:
+      if (getDataFormatIsCompressed(format)) {
+         return false;
+      }
+   }
+
+   readFormat = getGlFormat(format);
+   readType = getGlDataType(format, formatComp, degamma);
+
+   if (numFormat == latte::SQ_NUM_FORMAT::INT) {
+      switch (readFormat) {
+      case gl::GL_RED:
+         readFormat = gl::GL_RED_INTEGER;
+         break;
+      case gl::GL_RG:
+         readFormat = gl::GL_RG_INTEGER;
+         break;
+      case gl::GL_RGB:
+         readFormat = gl::GL_RGB_INTEGER;
+         break;
+      case gl::GL_RGBA:
+         readFormat = gl::GL_RGBA_INTEGER;
+         break;
+      default:
+         break;
+      }
+   }
+
+   return true;
+}
+
 static uint32_t
 getSurfaceBytes(uint32_t pitch,
                 uint32_t height,
@@ -572,12 +643,24 @@ GLDriver::uploadSurface(SurfaceBuffer *buffer,
       buffer->cpuMemHash[0] = newHash[0];
       buffer->cpuMemHash[1] = newHash[1];
 
-      std::vector<uint8_t> untiledImage, untiledMipmap;
-      untiledImage.resize(dstImageSize);
+      // Untile straight into the upload ring when there is space, the
+      //  texture is then sourced from it as a pixel unpack buffer.
+      std::vector<uint8_t> untiledImage;
+      auto upload = mUploadBuffer.allocate(dstImageSize, 16);
+      auto untiledData = upload.ptr;
+      const void *pixels = reinterpret_cast<const void *>(upload.offset);
+
+      if (untiledData) {
+         gl::glBindBuffer(gl::GL_PIXEL_UNPACK_BUFFER, mUploadBuffer.object());
+      } else {
+         untiledImage.resize(dstImageSize);
+         untiledData = untiledImage.data();
+         pixels = untiledData;
+      }
 
       // Untile
       gpu::convertFromTiled(
-         untiledImage.data(),
+         untiledData,
          uploadPitch,
          imagePtr,
          tileMode,
@@ -596,7 +679,7 @@ GLDriver::uploadSurface(SurfaceBuffer *buffer,
       auto target = getGlTarget(dim);
       auto textureDataType = gl::GL_INVALID_ENUM;
       auto textureFormat = getGlFormat(format);
-      auto size = untiledImage.size();
+      auto size = dstImageSize;
 
       if (compressed) {
          textureDataType = getGlCompressedDataType(format, formatComp, degamma);
@@ -617,7 +700,7 @@ GLDriver::uploadSurface(SurfaceBuffer *buffer,
                width,
                textureDataType,
                gsl::narrow_cast<gl::GLsizei>(size),
-               untiledImage.data());
+               pixels);
          } else {
             gl::glTextureSubImage1D(buffer->active->object,
                0, /* level */
@@ -625,7 +708,7 @@ GLDriver::uploadSurface(SurfaceBuffer *buffer,
                width,
                textureFormat,
                textureDataType,
-               untiledImage.data());
+               pixels);
          }
          break;
       case latte::SQ_TEX_DIM::DIM_2D:
@@ -637,7 +720,7 @@ GLDriver::uploadSurface(SurfaceBuffer *buffer,
                height,
                textureDataType,
                gsl::narrow_cast<gl::GLsizei>(size),
-               untiledImage.data());
+               pixels);
          } else {
             gl::glTextureSubImage2D(buffer->active->object,
                0, /* level */
@@ -645,7 +728,7 @@ GLDriver::uploadSurface(SurfaceBuffer *buffer,
                width, height,
                textureFormat,
                textureDataType,
-               untiledImage.data());
+               pixels);
          }
          break;
       case latte::SQ_TEX_DIM::DIM_3D:
@@ -656,7 +739,7 @@ GLDriver::uploadSurface(SurfaceBuffer *buffer,
                width, height, depth,
                textureDataType,
                gsl::narrow_cast<gl::GLsizei>(size),
-               untiledImage.data());
+               pixels);
          } else {
             gl::glTextureSubImage3D(buffer->active->object,
                0, /* level */
@@ -664,7 +747,7 @@ GLDriver::uploadSurface(SurfaceBuffer *buffer,
                width, height, depth,
                textureFormat,
                textureDataType,
-               untiledImage.data());
+               pixels);
          }
          break;
       case latte::SQ_TEX_DIM::DIM_CUBEMAP:
@@ -677,7 +760,7 @@ GLDriver::uploadSurface(SurfaceBuffer *buffer,
                width, height, uploadDepth,
                textureDataType,
                gsl::narrow_cast<gl::GLsizei>(size),
-               untiledImage.data());
+               pixels);
          } else {
             gl::glTextureSubImage3D(buffer->active->object,
                0, /* level */
@@ -685,12 +768,16 @@ GLDriver::uploadSurface(SurfaceBuffer *buffer,
                width, height, uploadDepth,
                textureFormat,
                textureDataType,
-               untiledImage.data());
+               pixels);
          }
          break;
       default:
          decaf_abort(fmt::format("Unsupported texture dim: {}", dim));
       }
+
+      if (upload.ptr) {
+         gl::glBindBuffer(gl::GL_PIXEL_UNPACK_BUFFER, 0);
+      }
    }
 }
 
@@ -755,6 +842,28 @@ GLDriver::getSurfaceBuffer(ppcaddr_t baseAddress,
 
    auto &buffer = mSurfaces[surfaceKey];
 
+   // Remember how the GPU lays out what it writes so it can be retiled
+   //  back into guest memory later.
+   if (forWrite && decaf::config::gpu::surface_writeback) {
+      auto &writeback = buffer.writeback;
+
+      if (dim == latte::SQ_TEX_DIM::DIM_2D && samples <= 1 && depth == 1
+       && getWritebackFormat(format, numFormat, formatComp, degamma, isDepthBuffer, writeback.readFormat, writeback.readType)) {
+         writeback.baseAddress = baseAddress;
+         writeback.swizzle = swizzle;
+         writeback.pitch = pitch;
+         writeback.width = width;
+         writeback.height = height;
+         writeback.bpp = getDataFormatBitsPerElement(format);
+         writeback.format = format;
+         writeback.tileMode = tileMode;
+         writeback.isDepthBuffer = isDepthBuffer;
+
+         std::unique_lock<std::mutex> lock { mWritebackMutex };
+         buffer.needWriteback = true;
+      }
+   }
+
    if (buffer.active &&
       buffer.active->width == width &&
       buffer.active->height == height &&
@@ -906,6 +1015,129 @@ GLDriver::getSurfaceBuffer(ppcaddr_t baseAddress,
    return &buffer;
 }
 
+/**
+ * Start reading a surface back into its pixel pack buffer.
+ *
+ * Nothing waits for the read here, a fence callback retiles the pixels into
+ * guest memory once the GPU has finished with it.  Only the newest of
+ * several readbacks in flight for one surface writes guest memory.
+ */
+void
+GLDriver::readbackSurface(SurfaceBuffer *buffer)
+{
+   auto writeback = buffer->writeback;
+   auto host = buffer->active;
+   auto width = std::min(writeback.width, host->width);
+   auto height = std::min(writeback.height, host->height);
+   auto size = width * height * writeback.bpp / 8;
+
+   if (buffer->writebackSize < size) {
+      // Readbacks still in flight on the old buffer are superseded by this
+      //  one, so they will not map it.
+      if (buffer->writebackObject) {
+         gl::glDeleteBuffers(1, &buffer->writebackObject);
+      }
+
+      gl::glCreateBuffers(1, &buffer->writebackObject);
+      gl::glNamedBufferStorage(buffer->writebackObject, size, nullptr, gl::GL_MAP_READ_BIT | gl::GL_CLIENT_STORAGE_BIT);
+      buffer->writebackSize = size;
+   }
+
+   auto object = buffer->writebackObject;
+   gl::glBindBuffer(gl::GL_PIXEL_PACK_BUFFER, object);
+   gl::glPixelStorei(gl::GL_PACK_ALIGNMENT, 1);
+   gl::glGetTextureSubImage(host->object, 0,
+                            0, 0, 0,
+                            width, height, 1,
+                            writeback.readFormat, writeback.readType,
+                            size, nullptr);
+   gl::glBindBuffer(gl::GL_PIXEL_PACK_BUFFER, 0);
+
+   {
+      std::unique_lock<std::mutex> lock { mWritebackMutex };
+      buffer->needWriteback = false;
+      buffer->writebacksPending++;
+   }
+
+   injectFence([=]() {
+      if (buffer->writebacksPending > 1) {
+         std::unique_lock<std::mutex> lock { mWritebackMutex };
+         --buffer->writebacksPending;
+         return;
+      }
+
+      auto pixels = static_cast<uint8_t *>(gl::glMapNamedBufferRange(object, 0, size, gl::GL_MAP_READ_BIT));
+      std::vector<uint8_t> converted;
+
+      if (writeback.readType == gl::GL_UNSIGNED_INT_24_8) {
+         // GL puts stencil in the low 8 bits, the GPU puts it in the high 8
+         converted.resize(size);
+         std::memcpy(converted.data(), pixels, size);
+
+         for (auto i = 0u; i < size; i += 4) {
+            auto value = uint32_t { 0 };
+            std::memcpy(&value, &converted[i], 4);
+            value = (value >> 8) | (value << 24);
+            std::memcpy(&converted[i], &value, 4);
+         }
+
+         pixels = converted.data();
+      }
+
+      gpu::convertToTiled(
+         mem::translate<uint8_t>(writeback.baseAddress),
+         pixels,
+         width,
+         writeback.tileMode,
+         writeback.swizzle,
+         writeback.pitch,
+         width,
+         height,
+         1,
+         0,
+         writeback.isDepthBuffer,
+         writeback.bpp
+      );
+
+      gl::glUnmapNamedBuffer(object);
+
+      // The host surface already matches memory, so don't upload it again
+      auto imageSize = writeback.pitch * writeback.height * writeback.bpp / 8;
+      MurmurHash3_x64_128(mem::translate(writeback.baseAddress), imageSize, 0, buffer->cpuMemHash);
+
+      // Only now is memory up to date for notifyGpuFlush to skip this surface
+      std::unique_lock<std::mutex> lock { mWritebackMutex };
+      --buffer->writebacksPending;
+   });
+}
+
+/**
+ * Make sure guest memory holds everything the GPU has written to a surface,
+ * waiting only for the fences of its readbacks.
+ */
+void
+GLDriver::finishSurfaceWriteback(SurfaceBuffer *buffer)
+{
+   if (buffer->needWriteback) {
+      readbackSurface(buffer);
+   }
+
+   while (buffer->writebacksPending) {
+      decaf_check(!mSyncWaits.empty());
+      auto &wait = mSyncWaits.front();
+
+      if (wait.type == SyncWaitType::Fence) {
+         gl::glClientWaitSync(wait.fence, gl::GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      } else {
+         // Reading the result blocks until the query is available
+         gl::GLuint64 value;
+         gl::glGetQueryObjectui64v(wait.query, gl::GL_QUERY_RESULT, &value);
+      }
+
+      checkSyncObjects();
+   }
+}
+
 void
 GLDriver::setSurfaceSwizzle(SurfaceBuffer *surface,
                             gl::GLenum swizzleR,
@@ -0,0 +1,239 @@
+#ifndef DECAF_NOGL
+
+#include <common/decaf_assert.h>
+#include "decaf_config.h"
+#include "gpu/gpu_timing.h"
+#include "modules/gx2/gx2_event.h"
+#include "opengl_driver.h"
+#include <algorithm>
+#include <glbinding/gl/gl.h>
+#include <thread>
+
+namespace gpu
+{
+
+namespace opengl
+{
+
+/*
+Swap chain.
+
+Scan buffer copies are made to the write slot of the chain.  A swap queues
+the write slot behind a fence and moves copies on to a free slot, once the
+fence has signalled the frame is flipped, immediately or on the next paced
+refresh depending on the present mode.
+
+A flip hands the slot to the presenter through mPresentSlot with a single
+atomic exchange, which gives back the slot it replaces.  That is either
+the presenter's previous frame, or a flipped frame it never picked up and
+which is dropped.  The presenter exchanges its front slot for a new frame
+the same way in getSwapBuffers, so neither side ever takes a lock.
+
+The GPU thread owns every slot but the front and ready ones, when all of
+them are in use a swap waits for a flip to free one, which is what limits
+how far the GPU runs ahead of the presented frame.
+*/
+
+// Set in mPresentSlot until the presenter picks up the flipped slot
+static const size_t NewFrameBit = 0x100;
+
+static const size_t SlotMask = 0xFF;
+
+// 59.94 Hz, the refresh rate of the TV and DRC
+static const auto RefreshPeriod = std::chrono::nanoseconds { 16683350 };
+
+void
+GLDriver::initSwapChain()
+{
+   mPresentMode = decaf::config::gpu::present_mode;
+
+   // Slot 0 starts at the front and slot 1 as the ready frame, which the
+   //  presenter and mPresentSlot are initialised to.
+   mWriteSlot = 2;
+   mLastSwapSlot = mWriteSlot;
+   mFreeSlots.clear();
+   mPendingSwaps.clear();
+
+   for (auto i = mWriteSlot + 1; i < SwapChainLength; ++i) {
+      mFreeSlots.push_back(i);
+   }
+}
+
+/**
+ * Take a free slot to copy the next frame to, waiting for a flip if the
+ * whole chain is in use.
+ */
+size_t
+GLDriver::acquireSwapSlot()
+{
+   if (mFreeSlots.empty()) {
+      gpu::addSwapChainStall();
+   }
+
+   while (mFreeSlots.empty()) {
+      decaf_check(!mPendingSwaps.empty());
+
+      if (checkSyncObjects() || presentSwapChain()) {
+         continue;
+      }
+
+      if (mPendingSwaps.front().complete) {
+         std::this_thread::sleep_for(getSwapChainTimeout());
+      } else if (mSyncWaits.size() && mSyncWaits.front().type == SyncWaitType::Fence) {
+         auto timeout = std::chrono::nanoseconds { std::chrono::milliseconds { 1 } }.count();
+         gl::glClientWaitSync(mSyncWaits.front().fence, gl::GL_SYNC_FLUSH_COMMANDS_BIT, static_cast<gl::GLuint64>(timeout));
+      } else {
+         std::this_thread::sleep_for(std::chrono::microseconds { 100 });
+      }
+   }
+
+   auto slot = mFreeSlots.back();
+   mFreeSlots.pop_back();
+   return slot;
+}
+
+/**
+ * Called when the fence of a swap has signalled.
+ */
+void
+GLDriver::completeSwap(size_t slot)
+{
+   for (auto &swap : mPendingSwaps) {
+      if (swap.slot == slot) {
+         swap.complete = true;
+      }
+   }
+
+   presentSwapChain();
+}
+
+/**
+ * Flip every completed swap which is due, returns true if any were.
+ *
+ * In paced mode at most one frame is flipped per swap interval, a swap
+ * interval of 0 flips as soon as the frame is complete.
+ */
+bool
+GLDriver::presentSwapChain()
+{
+   auto flipped = false;
+
+   while (mPendingSwaps.size() && mPendingSwaps.front().complete) {
+      if (mPresentMode == PresentMode::Paced && mSwapInterval) {
+         auto now = std::chrono::steady_clock::now();
+         auto interval = RefreshPeriod * mSwapInterval;
+
+         if (now < mNextFlipTime) {
+            break;
+         }
+
+         // Keep to the refresh phase unless we fell a whole interval behind
+         mNextFlipTime += interval;
+
+         if (mNextFlipTime <= now) {
+            mNextFlipTime = now + interval;
+         }
+      }
+
+      flipSwapChain(mPendingSwaps.front());
+      mPendingSwaps.pop_front();
+      flipped = true;
+   }
+
+   return flipped;
+}
+
+void
+GLDriver::flipSwapChain(const PendingSwap &swap)
+{
+   static const auto weight = 0.9;
+   auto now = std::chrono::steady_clock::now();
+   auto intervalNs = uint64_t { 0 };
+   auto latencyNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - swap.swapTime).count();
+
+   if (mLastFlipTime.time_since_epoch().count()) {
+      intervalNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - mLastFlipTime).count();
+      mAverageFrameTime = weight * mAverageFrameTime + (1.0 - weight) * duration_system_clock { now - mLastFlipTime };
+   }
+
+   mLastFlipTime = now;
+   gpu::addFlipTiming(intervalNs, latencyNs);
+
+   auto previous = mPresentSlot.exchange(swap.slot | NewFrameBit, std::memory_order_acq_rel);
+   mFreeSlots.push_back(previous & SlotMask);
+
+   gx2::internal::onFlip();
+
+   if (mSwapFunc) {
+      mSwapFunc(mTvScanBuffers.objects[swap.slot], mDrcScanBuffers.objects[swap.slot]);
+   }
+}
+
+/**
+ * How long the GPU thread can sleep before the next completed frame is
+ * due to be flipped, zero if there is none waiting.
+ */
+std::chrono::microseconds
+GLDriver::getSwapChainTimeout()
+{
+   if (mPendingSwaps.empty() || !mPendingSwaps.front().complete) {
+      return std::chrono::microseconds { 0 };
+   }
+
+   auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(mNextFlipTime - std::chrono::steady_clock::now());
+   return std::max(remaining, std::chrono::microseconds { 1 });
+}
+
+void
+GLDriver::decafSwapBuffers(const pm4::DecafSwapBuffers &data)
+{
+   evictIndexBuffers();
+   mTimingFrame.swapped = true;
+
+   // A screen which was not copied to since the last swap keeps showing
+   //  the previous frame.
+   for (auto chain : { &mTvScanBuffers, &mDrcScanBuffers }) {
+      if (!chain->written && chain->objects[mWriteSlot] && mLastSwapSlot != mWriteSlot) {
+         gl::glCopyImageSubData(chain->objects[mLastSwapSlot], gl::GL_TEXTURE_2D, 0, 0, 0, 0,
+                                chain->objects[mWriteSlot], gl::GL_TEXTURE_2D, 0, 0, 0, 0,
+                                chain->width, chain->height, 1);
+      }
+
+      chain->written = false;
+   }
+
+   auto swap = PendingSwap { };
+   auto slot = mWriteSlot;
+   swap.slot = slot;
+   swap.swapTime = std::chrono::steady_clock::now();
+   mPendingSwaps.push_back(swap);
+   mLastSwapSlot = slot;
+
+   injectFence([=]() {
+      completeSwap(slot);
+   });
+
+   mWriteSlot = acquireSwapSlot();
+}
+
+/**
+ * Called by the presenter to get the newest flipped frame, the returned
+ * textures are not written to until the next call.
+ */
+void
+GLDriver::getSwapBuffers(unsigned int *tv,
+                         unsigned int *drc)
+{
+   if (mPresentSlot.load(std::memory_order_acquire) & NewFrameBit) {
+      mFrontSlot = mPresentSlot.exchange(mFrontSlot, std::memory_order_acq_rel) & SlotMask;
+   }
+
+   *tv = mTvScanBuffers.objects[mFrontSlot];
+   *drc = mDrcScanBuffers.objects[mFrontSlot];
+}
+
+} // namespace opengl
+
+} // namespace gpu
+
+#endif // DECAF_NOGL
@@ -0,0 +1,224 @@
+#ifndef DECAF_NOGL
+
+#include "gpu/gpu_timing.h"
+#include "opengl_driver.h"
+#include <glbinding/gl/gl.h>
+
+namespace gpu
+{
+
+namespace opengl
+{
+
+// Timestamps written in one frame, passes past this are not timed.
+static const auto MaxTimingQueries = size_t { 4096 };
+
+/**
+ * Write a GPU timestamp for the current point in the command stream.
+ *
+ * Passes nest, which GL_TIME_ELAPSED queries cannot, so every pass is
+ * timed by a pair of timestamps instead.  Returns false if the frame has
+ * run out of queries.
+ */
+bool
+GLDriver::insertTimestamp()
+{
+   auto &frame = mTimingFrame;
+   auto query = gl::GLuint { 0 };
+
+   if (frame.queries.size() >= MaxTimingQueries) {
+      return false;
+   }
+
+   if (mTimingQueryPool.size()) {
+      query = mTimingQueryPool.back();
+      mTimingQueryPool.pop_back();
+   } else {
+      gl::glGenQueries(1, &query);
+   }
+
+   gl::glQueryCounter(query, gl::GL_TIMESTAMP);
+   frame.queries.push_back(query);
+   return true;
+}
+
+/**
+ * Start a pass, ending any open pass of the same or a deeper type.
+ */
+void
+GLDriver::beginTimingPass(gpu::TimingPassType type,
+                          uint64_t id)
+{
+   auto &frame = mTimingFrame;
+
+   if (!frame.active) {
+      return;
+   }
+
+   // The new pass starts on the timestamp which ended the previous one
+   if (!endTimingPass(type) && !insertTimestamp()) {
+      return;
+   }
+
+   auto pass = TimingPassQueries { };
+   pass.type = type;
+   pass.id = id;
+   pass.startQuery = frame.queries.size() - 1;
+   pass.endQuery = pass.startQuery;
+   frame.openPasses[static_cast<size_t>(type)] = static_cast<int>(frame.passes.size());
+   frame.passes.push_back(pass);
+}
+
+/**
+ * End the open pass of a type and every deeper pass inside it, they all
+ * share one timestamp.  Returns true if a timestamp was written.
+ */
+bool
+GLDriver::endTimingPass(gpu::TimingPassType type)
+{
+   auto &frame = mTimingFrame;
+   auto first = static_cast<size_t>(type);
+   auto isOpen = false;
+
+   if (!frame.active) {
+      return false;
+   }
+
+   for (auto i = first; i < frame.openPasses.size(); ++i) {
+      isOpen = isOpen || frame.openPasses[i] >= 0;
+   }
+
+   if (!isOpen) {
+      return false;
+   }
+
+   // Passes which run out of queries keep endQuery == startQuery and are
+   //  dropped when the frame is read back.
+   auto written = insertTimestamp();
+
+   for (auto i = first; i < frame.openPasses.size(); ++i) {
+      if (written && frame.openPasses[i] >= 0) {
+         frame.passes[frame.openPasses[i]].endQuery = frame.queries.size() - 1;
+      }
+
+      frame.openPasses[i] = -1;
+   }
+
+   return written;
+}
+
+/**
+ * Called for every draw which passed checkReadyDraw, starts a new render
+ * target pass when the framebuffer changed and a new draw batch when the
+ * shader did.
+ */
+void
+GLDriver::markTimingDraw(bool framebufferChanged)
+{
+   auto &frame = mTimingFrame;
+   auto renderTarget = static_cast<size_t>(gpu::TimingPassType::RenderTarget);
+   auto drawBatch = static_cast<size_t>(gpu::TimingPassType::DrawBatch);
+
+   if (!frame.active) {
+      return;
+   }
+
+   if (framebufferChanged || frame.openPasses[renderTarget] < 0) {
+      auto cb_color_base = getRegister<latte::CB_COLORN_BASE>(latte::Register::CB_COLOR0_BASE);
+      beginTimingPass(gpu::TimingPassType::RenderTarget, static_cast<uint64_t>(cb_color_base.BASE_256B()) << 8);
+   }
+
+   if (frame.openPasses[drawBatch] < 0 || frame.vertexKey != mActiveShader->vertexKey) {
+      frame.vertexKey = mActiveShader->vertexKey;
+      beginTimingPass(gpu::TimingPassType::DrawBatch, frame.vertexKey);
+   }
+
+   for (auto index : frame.openPasses) {
+      if (index >= 0) {
+         frame.passes[index].draws++;
+      }
+   }
+}
+
+/**
+ * Close the frame's passes and queue a read of its timestamps once the
+ * last one is available, then start timing the next frame if enabled.
+ */
+void
+GLDriver::endTimingFrame()
+{
+   auto &frame = mTimingFrame;
+   auto now = std::chrono::steady_clock::now();
+   auto cpuFrameNs = uint64_t { 0 };
+
+   if (frame.cpuStart.time_since_epoch().count()) {
+      cpuFrameNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - frame.cpuStart).count();
+   }
+
+   if (frame.active) {
+      endTimingPass(gpu::TimingPassType::CommandBuffer);
+   }
+
+   if (frame.active && frame.queries.size()) {
+      auto queries = std::move(frame.queries);
+      auto passes = std::move(frame.passes);
+      auto number = frame.frame;
+
+      SyncWait wait;
+      wait.type = SyncWaitType::Query;
+      wait.query = queries.back();
+      wait.func = [=]() {
+         auto timestamps = std::vector<uint64_t>(queries.size(), 0);
+         auto timing = gpu::FrameTiming { };
+
+         for (auto i = 0u; i < queries.size(); ++i) {
+            gl::glGetQueryObjectui64v(queries[i], gl::GL_QUERY_RESULT, &timestamps[i]);
+         }
+
+         timing.frame = number;
+         timing.cpuFrameNs = cpuFrameNs;
+         timing.gpuFrameNs = timestamps.back() - timestamps.front();
+
+         for (auto &pass : passes) {
+            auto result = gpu::TimingPass { };
+
+            if (pass.endQuery == pass.startQuery) {
+               continue;
+            }
+
+            result.type = pass.type;
+            result.id = pass.id;
+            result.draws = pass.draws;
+            result.startNs = timestamps[pass.startQuery] - timestamps.front();
+            result.durationNs = timestamps[pass.endQuery] - timestamps[pass.startQuery];
+
+            if (pass.type == gpu::TimingPassType::CommandBuffer) {
+               timing.gpuBusyNs += result.durationNs;
+            }
+
+            timing.passes.push_back(result);
+         }
+
+         gpu::addFrameTiming(std::move(timing));
+
+         // checkSyncObjects deletes the query which was waited on
+         mTimingQueryPool.insert(mTimingQueryPool.end(), queries.begin(), queries.end() - 1);
+      };
+
+      mSyncWaits.emplace_back(wait);
+   }
+
+   frame.queries.clear();
+   frame.passes.clear();
+   frame.openPasses.fill(-1);
+   frame.swapped = false;
+   frame.frame++;
+   frame.cpuStart = now;
+   frame.active = gpu::isTimingEnabled();
+}
+
+} // namespace opengl
+
+} // namespace gpu
+
+#endif // DECAF_NOGL
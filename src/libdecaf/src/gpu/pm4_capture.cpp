@@ -619,6 +619,9 @@ private:
       case pm4::type3::DECAF_SET_SWAP_INTERVAL:
          // Nothing to track!
          break;
+      case pm4::type3::DECAF_WRITEBACK_SURFACES:
+         // Nothing to track!
+         break;
       case pm4::type3::DRAW_INDEX_AUTO:
          trackReadyDraw();
          break;
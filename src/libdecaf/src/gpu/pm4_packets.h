@@ -38,6 +38,19 @@ struct DecafSetSwapInterval
    }
 };
 
+struct DecafWritebackSurfaces
+{
+   static const auto Opcode = type3::DECAF_WRITEBACK_SURFACES;
+
+   uint32_t dummy;
+
+   template<typename Serialiser>
+   void serialise(Serialiser &se)
+   {
+      se(dummy);
+   }
+};
+
 struct DecafCapSyncRegisters
 {
    static const auto Opcode = type3::DECAF_CAP_SYNC_REGISTERS;
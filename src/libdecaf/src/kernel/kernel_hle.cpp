@@ -1,3 +1,4 @@
+#include "decaf_config.h"
 #include "kernel_hle.h"
 #include "kernel_internal.h"
 #include "modules/camera/camera.h"
@@ -33,41 +34,52 @@ static std::map<std::string, HleModule*>
 sHleModules;
 
 static void
-kcstub(cpu::Core *state, void *data)
+unimplementedStub(cpu::Core *state, void *data)
 {
    auto func = static_cast<HleFunction *>(data);
+   gLog->warn("Unimplemented kernel function {}::{} called from 0x{:08X}", func->module, func->name, state->lr);
+}
 
+static cpu::KernelCallFunction
+selectCallHandler(HleFunction *func)
+{
    if (!func->valid) {
-      gLog->warn("Unimplemented kernel function {}::{} called from 0x{:08X}", func->module, func->name, state->lr);
-      return;
+      return &unimplementedStub;
    }
 
-   // Grab our core pointer
-   auto core = cpu::this_core::state();
-
-   // Save our original stack pointer for the backchain
-   auto backchainSp = core->gpr[1];
-
-   // Allocate callee backchain and lr space.
-   core->gpr[1] -= 2 * 4;
-
-   // Write the backchain pointer
-   mem::write(core->gpr[1], backchainSp);
+   auto trace = decaf::config::log::kernel_trace && func->traceEnabled;
+   return func->getCallHandler(trace, trace && decaf::config::log::kernel_trace_res);
+}
 
-   // Call our target
-   func->call(state);
+void
+registerHleFunc(HleFunction *func)
+{
+   func->syscallID = cpu::registerKernelCall({ selectCallHandler(func), func });
+}
 
-   // Grab the most recent core state as it may have changed.
-   core = cpu::this_core::state();
+void
+relinkHleFunc(HleFunction *func)
+{
+   cpu::updateKernelCall(func->syscallID, { selectCallHandler(func), func });
 
-   // Release callee backchain and lr space.
-   core->gpr[1] += 2 * 4;
+   // The JIT embeds the handler address in the thunk's code
+   if (func->ppcPtr) {
+      cpu::invalidateInstructionCache(mem::untranslate(func->ppcPtr), 8);
+   }
 }
 
 void
-registerHleFunc(HleFunction *func)
+relinkHleFunctions()
 {
-   func->syscallID = cpu::registerKernelCall({ kcstub, func });
+   for (auto &module : sHleModules) {
+      for (auto &pair : module.second->getSymbolMap()) {
+         auto symbol = pair.second;
+
+         if (symbol->type == HleSymbol::Function) {
+            relinkHleFunc(static_cast<HleFunction *>(symbol));
+         }
+      }
+   }
 }
 
 uint32_t
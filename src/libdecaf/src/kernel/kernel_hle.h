@@ -6,6 +6,7 @@ namespace kernel
 {
 
 class HleModule;
+struct HleFunction;
 
 void
 initialiseHleMmodules();
@@ -17,4 +18,10 @@ uint32_t
 registerUnimplementedHleFunc(const std::string &module,
                              const std::string &name);
 
+void
+relinkHleFunc(HleFunction *func);
+
+void
+relinkHleFunctions();
+
 } // namespace kernel
@@ -2,6 +2,7 @@
 #include <common/type_list.h>
 #include "decaf_config.h"
 #include "kernel_hlesymbol.h"
+#include "libcpu/mem.h"
 #include "libcpu/state.h"
 #include "ppcutils/ppcinvoke.h"
 #include <cstdint>
@@ -17,7 +18,11 @@ struct HleFunction : HleSymbol
    }
 
    virtual ~HleFunction() override = default;
-   virtual void call(cpu::Core *state) = 0;
+
+   //! Returns the kernel call handler for this function, the handler is a
+   //! plain function with the argument unpacking (and optionally tracing)
+   //! compiled in so it can be called without any virtual dispatch.
+   virtual cpu::KernelCallFunction getCallHandler(bool trace, bool traceResult) = 0;
 
    bool valid = false;
    bool traceEnabled = true;
@@ -30,22 +35,61 @@ namespace functions
 
 void kcTraceHandler(const std::string& str);
 
+// Allocate callee backchain and lr space on the guest stack
+inline void
+pushBackchain(cpu::Core *core)
+{
+   // Save our original stack pointer for the backchain
+   auto backchainSp = core->gpr[1];
+
+   // Allocate callee backchain and lr space.
+   core->gpr[1] -= 2 * 4;
+
+   // Write the backchain pointer
+   mem::write(core->gpr[1], backchainSp);
+}
+
+// Release callee backchain and lr space
+inline void
+popBackchain()
+{
+   // Grab the most recent core state as it may have changed.
+   auto core = cpu::this_core::state();
+   core->gpr[1] += 2 * 4;
+}
+
+template<typename FunctionType>
+inline cpu::KernelCallFunction
+selectCallHandler(bool trace, bool traceResult)
+{
+   if (!trace) {
+      return &FunctionType::template callHandler<false, false>;
+   } else if (!traceResult) {
+      return &FunctionType::template callHandler<true, false>;
+   } else {
+      return &FunctionType::template callHandler<true, true>;
+   }
+}
+
 template<typename ReturnType, typename... Args>
 struct HleFunctionImpl : HleFunction
 {
    ReturnType (*wrapped_function)(Args...);
 
-   virtual void call(cpu::Core *thread) override
+   template<bool Trace, bool TraceResult>
+   static void callHandler(cpu::Core *core, void *data)
    {
-      if (decaf::config::log::kernel_trace && traceEnabled) {
-         if (decaf::config::log::kernel_trace_res) {
-            ppctypes::invoke(kcTraceHandler, kcTraceHandler, thread, wrapped_function, name);
-         } else {
-            ppctypes::invoke(kcTraceHandler, nullptr, thread, wrapped_function, name);
-         }
-      } else {
-         ppctypes::invoke(nullptr, nullptr, thread, wrapped_function, name);
-      }
+      auto self = static_cast<HleFunctionImpl *>(data);
+      pushBackchain(core);
+      ppctypes::invoke(Trace ? kcTraceHandler : nullptr,
+                       TraceResult ? kcTraceHandler : nullptr,
+                       core, self->wrapped_function, self->name);
+      popBackchain();
+   }
+
+   virtual cpu::KernelCallFunction getCallHandler(bool trace, bool traceResult) override
+   {
+      return selectCallHandler<HleFunctionImpl>(trace, traceResult);
    }
 };
 
@@ -54,17 +98,20 @@ struct HleMemberFunctionImpl : HleFunction
 {
    ReturnType (ObjectType::*wrapped_function)(Args...);
 
-   virtual void call(cpu::Core *thread) override
+   template<bool Trace, bool TraceResult>
+   static void callHandler(cpu::Core *core, void *data)
+   {
+      auto self = static_cast<HleMemberFunctionImpl *>(data);
+      pushBackchain(core);
+      ppctypes::invokeMemberFn(Trace ? kcTraceHandler : nullptr,
+                               TraceResult ? kcTraceHandler : nullptr,
+                               core, self->wrapped_function, self->name);
+      popBackchain();
+   }
+
+   virtual cpu::KernelCallFunction getCallHandler(bool trace, bool traceResult) override
    {
-      if (decaf::config::log::kernel_trace && traceEnabled) {
-         if (decaf::config::log::kernel_trace_res) {
-            ppctypes::invokeMemberFn(kcTraceHandler, kcTraceHandler, thread, wrapped_function, name);
-         } else {
-            ppctypes::invokeMemberFn(kcTraceHandler, nullptr, thread, wrapped_function, name);
-         }
-      } else {
-         ppctypes::invokeMemberFn(nullptr, nullptr, thread, wrapped_function, name);
-      }
+      return selectCallHandler<HleMemberFunctionImpl>(trace, traceResult);
    }
 };
 
@@ -76,17 +123,20 @@ struct HleConstructorFunctionImpl : HleFunction
       new (object) ObjectType(args...);
    }
 
-   virtual void call(cpu::Core *thread) override
+   template<bool Trace, bool TraceResult>
+   static void callHandler(cpu::Core *core, void *data)
    {
-      if (decaf::config::log::kernel_trace && traceEnabled) {
-         if (decaf::config::log::kernel_trace_res) {
-            ppctypes::invoke(kcTraceHandler, kcTraceHandler, thread, &trampFunction, name);
-         } else {
-            ppctypes::invoke(kcTraceHandler, nullptr, thread, &trampFunction, name);
-         }
-      } else {
-         ppctypes::invoke(nullptr, nullptr, thread, &trampFunction, name);
-      }
+      auto self = static_cast<HleConstructorFunctionImpl *>(data);
+      pushBackchain(core);
+      ppctypes::invoke(Trace ? kcTraceHandler : nullptr,
+                       TraceResult ? kcTraceHandler : nullptr,
+                       core, &trampFunction, self->name);
+      popBackchain();
+   }
+
+   virtual cpu::KernelCallFunction getCallHandler(bool trace, bool traceResult) override
+   {
+      return selectCallHandler<HleConstructorFunctionImpl>(trace, traceResult);
    }
 };
 
@@ -98,17 +148,20 @@ struct HleDestructorFunctionImpl : HleFunction
       object->~ObjectType();
    }
 
-   virtual void call(cpu::Core *thread) override
+   template<bool Trace, bool TraceResult>
+   static void callHandler(cpu::Core *core, void *data)
+   {
+      auto self = static_cast<HleDestructorFunctionImpl *>(data);
+      pushBackchain(core);
+      ppctypes::invoke(Trace ? kcTraceHandler : nullptr,
+                       TraceResult ? kcTraceHandler : nullptr,
+                       core, &trampFunction, self->name);
+      popBackchain();
+   }
+
+   virtual cpu::KernelCallFunction getCallHandler(bool trace, bool traceResult) override
    {
-      if (decaf::config::log::kernel_trace && traceEnabled) {
-         if (decaf::config::log::kernel_trace_res) {
-            ppctypes::invoke(kcTraceHandler, kcTraceHandler, thread, &trampFunction, name);
-         } else {
-            ppctypes::invoke(kcTraceHandler, nullptr, thread, &trampFunction, name);
-         }
-      } else {
-         ppctypes::invoke(nullptr, nullptr, thread, &trampFunction, name);
-      }
+      return selectCallHandler<HleDestructorFunctionImpl>(trace, traceResult);
    }
 };
 
@@ -3,7 +3,9 @@
 #include "kernel_ios_device.h"
 #include "kernel_ios_fsadevice.h"
 
+#include <atomic>
 #include <map>
+#include <mutex>
 #include <string>
 #include <spdlog/fmt/fmt.h>
 
@@ -23,6 +25,11 @@ static std::map<IOSHandle, IOSDevice *>
 sOpenDeviceMap;
 
 
+//! Protects sOpenDeviceMap, requests are handled on multiple IPC threads.
+static std::mutex
+sOpenDeviceMutex;
+
+
 static IOSError
 iosOpen(const char *name,
         size_t nameLen,
@@ -108,7 +115,7 @@ iosOpen(const char *name,
         size_t nameLen,
         IOSOpenMode mode)
 {
-   static IOSHandle DeviceHandles = 1;
+   static std::atomic<IOSHandle> DeviceHandles { 1 };
    auto deviceName = std::string { name };
 
    // Lookup device by name
@@ -132,6 +139,9 @@ iosOpen(const char *name,
    // Open succeeded, register device to a unique handle
    auto handle = DeviceHandles++;
    device->setHandle(handle);
+   device->setName(deviceName);
+
+   std::unique_lock<std::mutex> lock { sOpenDeviceMutex };
    sOpenDeviceMap[handle] = device;
    return static_cast<IOSError>(handle);
 }
@@ -152,7 +162,12 @@ iosClose(IOSHandle handle)
    }
 
    auto reply = device->close();
-   sOpenDeviceMap.erase(device->handle());
+
+   {
+      std::unique_lock<std::mutex> lock { sOpenDeviceMutex };
+      sOpenDeviceMap.erase(device->handle());
+   }
+
    delete device;
    return reply;
 }
@@ -167,6 +182,7 @@ iosClose(IOSHandle handle)
 IOSDevice *
 iosGetDevice(IOSHandle handle)
 {
+   std::unique_lock<std::mutex> lock { sOpenDeviceMutex };
    auto deviceItr = sOpenDeviceMap.find(handle);
    if (deviceItr == sOpenDeviceMap.end()) {
       return nullptr;
@@ -176,6 +192,25 @@ iosGetDevice(IOSHandle handle)
 }
 
 
+/**
+ * Find the name of the device which is open for a handle.
+ *
+ * \return
+ * Returns an empty string if the handle is not open.
+ */
+std::string
+iosGetDeviceName(IOSHandle handle)
+{
+   std::unique_lock<std::mutex> lock { sOpenDeviceMutex };
+   auto deviceItr = sOpenDeviceMap.find(handle);
+   if (deviceItr == sOpenDeviceMap.end()) {
+      return {};
+   }
+
+   return deviceItr->second->name();
+}
+
+
 template<typename DeviceType>
 static IOSDevice *
 createDevice()
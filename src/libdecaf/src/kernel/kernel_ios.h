@@ -5,6 +5,7 @@
 #include <common/be_ptr.h>
 #include <common/be_val.h>
 #include <common/structsize.h>
+#include <string>
 
 namespace kernel
 {
@@ -46,6 +47,9 @@ iosDispatchIpcRequest(IPCBuffer *buffer);
 IOSDevice *
 iosGetDevice(IOSHandle handle);
 
+std::string
+iosGetDeviceName(IOSHandle handle);
+
 void
 iosInitDevices();
 
@@ -2,6 +2,7 @@
 #include "kernel_ios.h"
 
 #include <cstdint>
+#include <string>
 
 namespace kernel
 {
@@ -68,8 +69,21 @@ public:
       mHandle = handle;
    }
 
+   const std::string &
+   name() const
+   {
+      return mName;
+   }
+
+   void
+   setName(const std::string &name)
+   {
+      mName = name;
+   }
+
 private:
    IOSHandle mHandle;
+   std::string mName;
 };
 
 } // namespace kernel
@@ -5,6 +5,7 @@
 #include "modules/coreinit/coreinit_fsa_response.h"
 
 #include <cstring>
+#include <mutex>
 
 namespace kernel
 {
@@ -18,6 +19,35 @@ using coreinit::FSStatFlags;
 using coreinit::FSWriteFlag;
 using coreinit::FSQueryInfoType;
 
+//! Serialises commands which touch the shared filesystem tree, each FSA
+//! handle may be serviced by a different IPC worker thread.
+static std::mutex
+sFilesystemMutex;
+
+
+/**
+ * Returns true if the command only touches a file which is already open on
+ * this device, these are safe to run concurrently with other devices.
+ */
+static bool
+isOpenFileCommand(FSACommand command)
+{
+   switch (command) {
+   case FSACommand::CloseFile:
+   case FSACommand::FlushFile:
+   case FSACommand::GetPosFile:
+   case FSACommand::IsEof:
+   case FSACommand::ReadFile:
+   case FSACommand::SetPosFile:
+   case FSACommand::StatFile:
+   case FSACommand::TruncateFile:
+   case FSACommand::WriteFile:
+      return true;
+   default:
+      return false;
+   }
+}
+
 IOSError
 FSADevice::open(IOSOpenMode mode)
 {
@@ -66,6 +96,12 @@ FSADevice::ioctl(uint32_t cmd,
       return static_cast<IOSError>(request->emulatedError.value());
    }
 
+   std::unique_lock<std::mutex> lock { sFilesystemMutex, std::defer_lock };
+
+   if (!isOpenFileCommand(static_cast<FSACommand>(cmd))) {
+      lock.lock();
+   }
+
    switch (static_cast<FSACommand>(cmd)) {
    case FSACommand::ChangeDir:
       result = changeDir(&request->changeDir);
@@ -146,6 +182,12 @@ FSADevice::ioctlv(uint32_t cmd,
       return static_cast<IOSError>(request->emulatedError.value());
    }
 
+   std::unique_lock<std::mutex> lock { sFilesystemMutex, std::defer_lock };
+
+   if (!isOpenFileCommand(static_cast<FSACommand>(cmd))) {
+      lock.lock();
+   }
+
    switch (static_cast<FSACommand>(cmd)) {
    case FSACommand::ReadFile:
    {
@@ -2,65 +2,119 @@
 #include "kernel_ipc.h"
 #include "modules/coreinit/coreinit_ipc.h"
 
+#include <algorithm>
+#include <chrono>
+#include <common/mpscqueue.h>
+#include <common/platform_thread.h>
 #include <condition_variable>
+#include <deque>
 #include <libcpu/cpu.h>
+#include <map>
 #include <mutex>
-#include <queue>
+#include <spdlog/fmt/fmt.h>
 
 namespace kernel
 {
 
-static std::thread
-sIpcThread;
+//! Number of threads servicing IOS requests.
+static constexpr auto IpcWorkerCount = 4u;
+
+struct IpcRequest
+{
+   IPCBuffer *buffer;
+   std::chrono::steady_clock::time_point submitTime;
+};
+
+/**
+ * An IOS worker thread.
+ *
+ * Requests for a given IOSHandle are always routed to the same worker so
+ * they are processed in the order they were submitted.
+ */
+struct IpcWorker
+{
+   std::thread thread;
+   std::mutex mutex;
+   std::condition_variable cond;
+   std::deque<IpcRequest> requests;
+};
 
 static std::atomic_bool
 sIpcThreadRunning;
 
-static std::mutex
-sIpcMutex;
-
-static std::condition_variable
-sIpcCond;
+static std::atomic<uint32_t>
+sIpcNextOpenWorker;
 
-static std::queue<IPCBuffer *>
-sIpcRequests;
+static IpcWorker
+sIpcWorkers[IpcWorkerCount];
 
-static std::queue<IPCBuffer *>
+static MpscQueue<IPCBuffer *>
 sIpcResponses[3];
 
+static std::mutex
+sIpcStatsMutex;
+
+static std::map<std::string, IpcDeviceStats>
+sIpcDeviceStats;
+
 static void
-ipcThreadEntry();
+ipcThreadEntry(IpcWorker *worker);
 
 
 /**
- * Start the IPC thread.
+ * Start the IPC threads.
  */
 void
 ipcStart()
 {
-   std::unique_lock<std::mutex> lock { sIpcMutex };
    sIpcThreadRunning.store(true);
-   sIpcThread = std::thread { ipcThreadEntry };
+
+   for (auto i = 0u; i < IpcWorkerCount; ++i) {
+      auto &worker = sIpcWorkers[i];
+      worker.thread = std::thread { ipcThreadEntry, &worker };
+      platform::setThreadName(&worker.thread, fmt::format("IOS Worker {}", i));
+   }
 }
 
 
 /**
- * Stop the IPC thread.
+ * Stop the IPC threads.
  */
 void
 ipcShutdown()
 {
-   std::unique_lock<std::mutex> lock { sIpcMutex };
+   if (!sIpcThreadRunning.exchange(false)) {
+      return;
+   }
 
-   if (sIpcThreadRunning.exchange(false)) {
-      sIpcCond.notify_all();
-      lock.unlock();
+   for (auto &worker : sIpcWorkers) {
+      std::unique_lock<std::mutex> lock { worker.mutex };
+      worker.cond.notify_all();
+   }
 
-      sIpcThread.join();
+   for (auto &worker : sIpcWorkers) {
+      worker.thread.join();
    }
 }
 
 
+/**
+ * Pick which worker should handle a request.
+ */
+static IpcWorker &
+ipcRouteRequest(IPCBuffer *buffer)
+{
+   if (buffer->command == IOSCommand::Open) {
+      // There is no handle yet, so there is nothing to order against
+      auto index = sIpcNextOpenWorker.fetch_add(1) % IpcWorkerCount;
+      return sIpcWorkers[index];
+   }
+
+   auto handle = static_cast<uint32_t>(buffer->handle.value());
+   return sIpcWorkers[handle % IpcWorkerCount];
+}
+
+
 /**
  * Submit an buffer to the IPC queue.
  */
@@ -81,10 +135,10 @@ ipcDriverKernelSubmitRequest(IPCBuffer *buffer)
       decaf_abort("Unexpected core id");
    }
 
-   sIpcMutex.lock();
-   sIpcRequests.push(buffer);
-   sIpcCond.notify_all();
-   sIpcMutex.unlock();
+   auto &worker = ipcRouteRequest(buffer);
+   std::unique_lock<std::mutex> lock { worker.mutex };
+   worker.requests.push_back({ buffer, std::chrono::steady_clock::now() });
+   worker.cond.notify_one();
 }
 
 
@@ -98,15 +152,10 @@ ipcDriverKernelHandleInterrupt()
    auto &responses = sIpcResponses[driver->coreId];
 
    // Copy respones to IPCDriver structure
-   sIpcMutex.lock();
-
-   while (responses.size()) {
-      driver->responses[driver->numResponses] = responses.front();
+   responses.popAll([&](IPCBuffer *buffer) {
+      driver->responses[driver->numResponses] = buffer;
       driver->numResponses++;
-      responses.pop();
-   }
-
-   sIpcMutex.unlock();
+   });
 
    // Call userland IPCDriver callback
    coreinit::internal::ipcDriverProcessResponses();
@@ -114,54 +163,116 @@ ipcDriverKernelHandleInterrupt()
 
 
 /**
- * Main thread entry point for the IPC thread.
+ * Send a completed request back to the core it came from.
+ */
+static void
+ipcSendResponse(IPCBuffer *buffer)
+{
+   switch (buffer->cpuId) {
+   case IOSCpuId::PPC0:
+      sIpcResponses[0].push(buffer);
+      cpu::interrupt(0, cpu::IPC_INTERRUPT);
+      break;
+   case IOSCpuId::PPC1:
+      sIpcResponses[1].push(buffer);
+      cpu::interrupt(1, cpu::IPC_INTERRUPT);
+      break;
+   case IOSCpuId::PPC2:
+      sIpcResponses[2].push(buffer);
+      cpu::interrupt(2, cpu::IPC_INTERRUPT);
+      break;
+   default:
+      decaf_abort("Unexpected cpu id");
+   }
+}
+
+
+/**
+ * Find the name of the device which a request is for.
+ */
+static std::string
+ipcGetRequestDeviceName(IPCBuffer *buffer)
+{
+   if (buffer->command == IOSCommand::Open) {
+      return reinterpret_cast<const char *>(buffer->buffer1.get());
+   }
+
+   return iosGetDeviceName(buffer->handle);
+}
+
+
+/**
+ * Record how long a request spent waiting in the queue and being serviced.
+ */
+static void
+ipcRecordLatency(const std::string &device,
+                 std::chrono::steady_clock::duration queueTime,
+                 std::chrono::steady_clock::duration serviceTime)
+{
+   using std::chrono::duration_cast;
+   using std::chrono::nanoseconds;
+
+   auto queueNs = static_cast<uint64_t>(duration_cast<nanoseconds>(queueTime).count());
+   auto serviceNs = static_cast<uint64_t>(duration_cast<nanoseconds>(serviceTime).count());
+
+   std::unique_lock<std::mutex> lock { sIpcStatsMutex };
+   auto &stats = sIpcDeviceStats[device];
+   stats.requests++;
+   stats.totalQueueNs += queueNs;
+   stats.totalServiceNs += serviceNs;
+   stats.maxLatencyNs = std::max(stats.maxLatencyNs, queueNs + serviceNs);
+}
+
+
+/**
+ * Get the per device IPC latency statistics.
+ */
+std::map<std::string, IpcDeviceStats>
+ipcGetDeviceStats()
+{
+   std::unique_lock<std::mutex> lock { sIpcStatsMutex };
+   return sIpcDeviceStats;
+}
+
+
+/**
+ * Main thread entry point for the IPC worker threads.
  *
- * This thread represents the IOS side of the IPC mechanism.
+ * These threads represent the IOS side of the IPC mechanism.
  *
  * Responsible for receiving IPC requests and dispatching them to the
  * correct IOS device.
  */
 void
-ipcThreadEntry()
+ipcThreadEntry(IpcWorker *worker)
 {
-   std::unique_lock<std::mutex> lock { sIpcMutex };
+   std::unique_lock<std::mutex> lock { worker->mutex };
 
    while (true) {
-      if (!sIpcRequests.empty()) {
-         auto request = sIpcRequests.front();
-         sIpcRequests.pop();
+      if (!worker->requests.empty()) {
+         auto request = worker->requests.front();
+         worker->requests.pop_front();
          lock.unlock();
-         iosDispatchIpcRequest(request);
-         lock.lock();
 
-         switch (request->cpuId) {
-         case IOSCpuId::PPC0:
-            sIpcResponses[0].push(request);
-            cpu::interrupt(0, cpu::IPC_INTERRUPT);
-            break;
-         case IOSCpuId::PPC1:
-            sIpcResponses[1].push(request);
-            cpu::interrupt(1, cpu::IPC_INTERRUPT);
-            break;
-         case IOSCpuId::PPC2:
-            sIpcResponses[2].push(request);
-            cpu::interrupt(2, cpu::IPC_INTERRUPT);
-            break;
-         default:
-            decaf_abort("Unexpected cpu id");
-         }
+         auto device = ipcGetRequestDeviceName(request.buffer);
+         auto startTime = std::chrono::steady_clock::now();
+         iosDispatchIpcRequest(request.buffer);
+         auto endTime = std::chrono::steady_clock::now();
+
+         ipcRecordLatency(device,
+                          startTime - request.submitTime,
+                          endTime - startTime);
+         ipcSendResponse(request.buffer);
+         lock.lock();
+         continue;
       }
 
       if (!sIpcThreadRunning.load()) {
          break;
       }
 
-      if (sIpcRequests.empty()) {
-         sIpcCond.wait(lock);
-      }
+      worker->cond.wait(lock);
    }
-
-   sIpcThreadRunning.store(false);
 }
 
 } // namespace kernel
@@ -5,6 +5,8 @@
 #include <common/be_val.h>
 #include <common/be_ptr.h>
 #include <common/structsize.h>
+#include <map>
+#include <string>
 
 namespace kernel
 {
@@ -84,6 +86,21 @@ CHECK_SIZE(IPCBuffer, 0x80);
 
 #pragma pack(pop)
 
+struct IpcDeviceStats
+{
+   //! Number of requests completed
+   uint64_t requests = 0;
+
+   //! Total time requests spent waiting for a worker
+   uint64_t totalQueueNs = 0;
+
+   //! Total time spent inside the device handling requests
+   uint64_t totalServiceNs = 0;
+
+   //! Longest time from submission to completion of a request
+   uint64_t maxLatencyNs = 0;
+};
+
 void
 ipcStart();
 
@@ -96,6 +113,9 @@ ipcDriverKernelSubmitRequest(IPCBuffer *buffer);
 void
 ipcDriverKernelHandleInterrupt();
 
+std::map<std::string, IpcDeviceStats>
+ipcGetDeviceStats();
+
 /** @} */
 
 } // namespace kernel
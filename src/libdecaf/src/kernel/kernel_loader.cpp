@@ -20,6 +20,7 @@
 #include <common/teenyheap.h>
 #include <common/strutils.h>
 #include <gsl.h>
+#include <libcpu/cpu.h>
 #include <libcpu/mem.h>
 #include <map>
 #include <unordered_map>
@@ -447,6 +448,11 @@ loadHleModule(const std::string &moduleName,
    // Process kernel_trace_filters
    processKernelTraceFilters(moduleName, funcSymbols);
 
+   // Pick the kernel call handlers now that we know which functions are traced
+   for (auto func : funcSymbols) {
+      kernel::relinkHleFunc(func);
+   }
+
    // Create module
    auto loadedMod = new LoadedModule {};
    sLoadedModules.emplace(moduleName, loadedMod);
@@ -1135,6 +1141,10 @@ loadRPL(const std::string &moduleName,
 
          if (section.header.flags & elf::SHF_EXECINSTR) {
             type = LoadedSectionType::Code;
+
+            // Make sure we do not run stale JIT code from a previous
+            //  occupant of this memory.
+            cpu::invalidateInstructionCache(start, end - start);
          }
 
          loadedMod->sections.emplace_back(LoadedSection { sectionName, type, start, end });
@@ -1142,6 +1152,7 @@ loadRPL(const std::string &moduleName,
    }
 
    if (trampSeg.second > trampSeg.first) {
+      cpu::invalidateInstructionCache(trampSeg.first, trampSeg.second - trampSeg.first);
       loadedMod->sections.emplace_back(LoadedSection { "loader_thunks", LoadedSectionType::Code, trampSeg.first, trampSeg.second });
    }
 
@@ -1244,16 +1255,17 @@ loadRPL(const std::string &name)
    return res;
 }
 
+// An owner of 0 means unlocked, so offset the core id
 void
 lockLoader()
 {
-   coreinit::internal::acquireIdLock(sLoaderLock, cpu::this_core::id());
+   coreinit::internal::acquireIdLock(sLoaderLock, cpu::this_core::id() + 1);
 }
 
 void
 unlockLoader()
 {
-   coreinit::internal::releaseIdLock(sLoaderLock, cpu::this_core::id());
+   coreinit::internal::releaseIdLock(sLoaderLock, cpu::this_core::id() + 1);
 }
 
 LoadedModule *
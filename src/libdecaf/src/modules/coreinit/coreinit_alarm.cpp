@@ -10,9 +10,13 @@
 #include "coreinit_internal_idlock.h"
 #include "ppcutils/wfunc_call.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <common/decaf_assert.h>
+#include <common/timerwheel.h>
 #include <libcpu/cpu.h>
+#include <vector>
 
 namespace coreinit
 {
@@ -49,6 +53,81 @@ sAlarmCallbackThread;
 static std::array<OSThreadQueue *, CoreCount>
 sAlarmCallbackThreadQueue;
 
+/**
+ * Host side index of the alarms in each core's alarm queue by nextFire.
+ *
+ * A wheel unit is 2^12 timebase ticks, roughly 66us.
+ */
+using AlarmWheel = TimerWheel<OSAlarm, 12>;
+
+static std::array<AlarmWheel, CoreCount>
+sAlarmWheel;
+
+static std::atomic<uint64_t>
+sAlarmsFired { 0 };
+
+static std::atomic<uint64_t>
+sAlarmTotalJitter { 0 };
+
+static std::atomic<uint64_t>
+sAlarmMaxJitter { 0 };
+
+
+/**
+ * Add an alarm to a core's alarm queue.
+ */
+static void
+insertAlarmNoLock(uint32_t core,
+                  OSAlarm *alarm)
+{
+   auto queue = sAlarmQueue[core];
+   alarm->alarmQueue = queue;
+   internal::AlarmQueue::append(queue, alarm);
+
+   auto nextFire = std::max<OSTime>(alarm->nextFire, 0);
+   sAlarmWheel[core].insert(alarm, static_cast<uint64_t>(nextFire));
+}
+
+
+/**
+ * Remove an alarm from whichever queue it is in.
+ */
+static void
+removeAlarmNoLock(OSAlarm *alarm)
+{
+   OSAlarmQueue *queue = alarm->alarmQueue;
+
+   if (!queue) {
+      return;
+   }
+
+   internal::AlarmQueue::erase(queue, alarm);
+   alarm->alarmQueue = nullptr;
+
+   for (auto i = 0u; i < CoreCount; ++i) {
+      if (queue == sAlarmQueue[i]) {
+         sAlarmWheel[i].erase(alarm);
+         break;
+      }
+   }
+}
+
+static void
+recordAlarmJitter(OSTime now,
+                  OSTime nextFire)
+{
+   auto late = std::max<OSTime>(now - nextFire, 0);
+   auto jitter = std::chrono::duration_cast<std::chrono::nanoseconds>(cpu::TimerDuration(late)).count();
+   auto maxJitter = sAlarmMaxJitter.load(std::memory_order_relaxed);
+
+   sAlarmsFired.fetch_add(1, std::memory_order_relaxed);
+   sAlarmTotalJitter.fetch_add(jitter, std::memory_order_relaxed);
+
+   while (static_cast<uint64_t>(jitter) > maxJitter
+       && !sAlarmMaxJitter.compare_exchange_weak(maxJitter, jitter, std::memory_order_relaxed)) {
+   }
+}
+
 /**
  * Internal alarm cancel.
  *
@@ -68,12 +147,7 @@ cancelAlarmNoAlarmLock(OSAlarm *alarm)
    alarm->state = OSAlarmState::None;
    alarm->nextFire = 0;
    alarm->period = 0;
-
-   if (alarm->alarmQueue) {
-      internal::AlarmQueue::erase(alarm->alarmQueue, alarm);
-      alarm->alarmQueue = nullptr;
-   }
-
+   removeAlarmNoLock(alarm);
    return TRUE;
 }
 
@@ -252,20 +326,12 @@ OSSetPeriodicAlarm(OSAlarm *alarm,
    alarm->state = OSAlarmState::Set;
 
    // Erase from old alarm queue
-   if (alarm->alarmQueue) {
-      internal::AlarmQueue::erase(alarm->alarmQueue, alarm);
-      alarm->alarmQueue = nullptr;
-   }
+   removeAlarmNoLock(alarm);
 
    // Add to this core's alarm queue
-   auto core = OSGetCoreId();
-   auto queue = sAlarmQueue[core];
-   alarm->alarmQueue = queue;
-   internal::AlarmQueue::append(queue, alarm);
+   insertAlarmNoLock(OSGetCoreId(), alarm);
 
    // Set the interrupt timer in processor
-   // TODO: Store the last set CPU alarm time, and simply check this
-   // alarm against that time to make finding the soonest alarm cheaper.
    internal::updateCpuAlarmNoALock();
 
    internal::releaseIdLock(sAlarmLock, alarm);
@@ -340,7 +406,6 @@ uint32_t
 AlarmCallbackThreadEntry(uint32_t core_id,
                          void *arg2)
 {
-   auto queue = sAlarmQueue[core_id];
    auto cbQueue = sAlarmCallbackQueue[core_id];
    auto threadQueue = sAlarmCallbackThreadQueue[core_id];
 
@@ -362,8 +427,7 @@ AlarmCallbackThreadEntry(uint32_t core_id,
       if (alarm->period) {
          alarm->nextFire = alarm->nextFire + alarm->period;
          alarm->state = OSAlarmState::Set;
-         internal::AlarmQueue::append(queue, alarm);
-         alarm->alarmQueue = queue;
+         insertAlarmNoLock(core_id, alarm);
          internal::updateCpuAlarmNoALock();
       }
 
@@ -447,25 +511,31 @@ cancelAlarm(OSAlarm *alarm)
    return result == TRUE;
 }
 
+const AdaptiveLockStats &
+getAlarmLockStats()
+{
+   return sAlarmLock.lock.stats();
+}
+
+AlarmStats
+getAlarmStats()
+{
+   auto stats = AlarmStats { };
+   stats.fired = sAlarmsFired.load(std::memory_order_relaxed);
+   stats.totalJitterNs = sAlarmTotalJitter.load(std::memory_order_relaxed);
+   stats.maxJitterNs = sAlarmMaxJitter.load(std::memory_order_relaxed);
+   return stats;
+}
+
 void
 updateCpuAlarmNoALock()
 {
-   auto queue = sAlarmQueue[cpu::this_core::id()];
+   auto nextFire = sAlarmWheel[cpu::this_core::id()].nextDeadline();
    auto next = std::chrono::steady_clock::time_point::max();
 
-   for (OSAlarm *alarm = queue->head; alarm; ) {
-      auto nextAlarm = alarm->link.next;
-
-      // Update next if its not past yet
-      if (alarm->state == OSAlarmState::Set && alarm->nextFire) {
-         auto nextFire = cpu::tbToTimePoint(alarm->nextFire - internal::getBaseTime());
-
-         if (nextFire < next) {
-            next = nextFire;
-         }
-      }
-
-      alarm = nextAlarm;
+   if (nextFire != UINT64_MAX) {
+      auto ticks = static_cast<OSTime>(nextFire) - internal::getBaseTime();
+      next = cpu::tbToTimePoint(std::max<OSTime>(ticks, 0));
    }
 
    cpu::this_core::setNextAlarm(next);
@@ -478,48 +548,53 @@ handleAlarmInterrupt(OSContext *context)
    auto queue = sAlarmQueue[core_id];
    auto cbQueue = sAlarmCallbackQueue[core_id];
    auto cbThreadQueue = sAlarmCallbackThreadQueue[core_id];
+   auto expired = std::vector<OSAlarm *> { };
 
    auto now = OSGetTime();
-   auto next = std::chrono::time_point<std::chrono::system_clock>::max();
-   bool callbacksNeeded = false;
 
    internal::lockScheduler();
    acquireIdLock(sAlarmLock);
 
-   for (OSAlarm *alarm = queue->head; alarm; ) {
-      auto nextAlarm = alarm->link.next;
+   // Take every alarm which is due from the wheel, in nextFire order
+   sAlarmWheel[core_id].advance(static_cast<uint64_t>(std::max<OSTime>(now, 0)), expired);
 
-      // Expire it if its past its nextFire time
-      if (alarm->nextFire <= now) {
-         decaf_check(alarm->state == OSAlarmState::Set);
+   // Unlink the whole batch before running any callback, so a callback which
+   //  cancels or sets one of the other expired alarms sees it as Expired
+   for (auto alarm : expired) {
+      decaf_check(alarm->state == OSAlarmState::Set);
+      recordAlarmJitter(now, alarm->nextFire);
 
-         internal::AlarmQueue::erase(queue, alarm);
-         alarm->alarmQueue = nullptr;
+      internal::AlarmQueue::erase(queue, alarm);
+      alarm->alarmQueue = nullptr;
 
-         alarm->state = OSAlarmState::Expired;
-         alarm->context = context;
+      alarm->state = OSAlarmState::Expired;
+      alarm->context = context;
+   }
 
-         if (alarm->threadQueue.head) {
-            wakeupThreadNoLock(&alarm->threadQueue);
-            rescheduleOtherCoreNoLock();
-         }
+   for (auto alarm : expired) {
+      // Skip alarms which an earlier callback has set again
+      if (alarm->state != OSAlarmState::Expired || alarm->alarmQueue) {
+         continue;
+      }
 
-         if (alarm->group == 0xFFFFFFFF) {
-            // System-internal alarm
-            if (alarm->callback) {
-               auto originalMask = cpu::this_core::setInterruptMask(0);
-               alarm->callback(alarm, context);
-               cpu::this_core::setInterruptMask(originalMask);
-            }
-         } else {
-            internal::AlarmQueue::append(cbQueue, alarm);
-            alarm->alarmQueue = cbQueue;
+      if (alarm->threadQueue.head) {
+         wakeupThreadNoLock(&alarm->threadQueue);
+         rescheduleOtherCoreNoLock();
+      }
 
-            wakeupThreadNoLock(cbThreadQueue);
+      if (alarm->group == 0xFFFFFFFF) {
+         // System-internal alarm
+         if (alarm->callback) {
+            auto originalMask = cpu::this_core::setInterruptMask(0);
+            alarm->callback(alarm, context);
+            cpu::this_core::setInterruptMask(originalMask);
          }
-      }
+      } else {
+         internal::AlarmQueue::append(cbQueue, alarm);
+         alarm->alarmQueue = cbQueue;
 
-      alarm = nextAlarm;
+         wakeupThreadNoLock(cbThreadQueue);
+      }
    }
 
    internal::updateCpuAlarmNoALock();
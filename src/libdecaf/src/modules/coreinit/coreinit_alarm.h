@@ -5,6 +5,7 @@
 #include "ppcutils/wfunc_ptr.h"
 
 #include <cstdint>
+#include <common/adaptivelock.h>
 #include <common/be_ptr.h>
 #include <common/be_val.h>
 #include <common/cbool.h>
@@ -179,6 +180,24 @@ OSWaitAlarm(OSAlarm *alarm);
 namespace internal
 {
 
+struct AlarmStats
+{
+   //! Number of alarms which have expired.
+   uint64_t fired;
+
+   //! Sum of the time between each alarm's nextFire and when it expired.
+   uint64_t totalJitterNs;
+
+   //! Largest time between an alarm's nextFire and when it expired.
+   uint64_t maxJitterNs;
+};
+
+AlarmStats
+getAlarmStats();
+
+const AdaptiveLockStats &
+getAlarmLockStats();
+
 void
 startAlarmCallbackThreads();
 
@@ -3,6 +3,9 @@
 #include "gpu/gpu_flush.h"
 
 #include <common/align.h>
+#include <common/memory_copy.h>
+#include <libcpu/cpu.h>
+#include <libcpu/mem.h>
 
 namespace coreinit
 {
@@ -79,7 +82,7 @@ DCZeroRange(void *addr, uint32_t size)
 {
    addr = align_down(addr, 32);
    size = align_up(size, 32);
-   memset(addr, 0, size);
+   memory_set(addr, 0, size);
 }
 
 
@@ -92,6 +95,17 @@ DCTouchRange(void *addr, uint32_t size)
    // TODO: DCTouchRange
 }
 
+/**
+ * Equivalent to icbi, sync, isync.
+ *
+ * Discards any JIT compiled code for the range so modified code is picked up.
+ */
+void
+ICInvalidateRange(void *addr, uint32_t size)
+{
+   cpu::invalidateInstructionCache(mem::untranslate(addr), size);
+}
+
 BOOL
 OSIsAddressRangeDCValid(void *addr,
                         uint32_t size)
@@ -116,6 +130,7 @@ Module::registerCacheFunctions()
    RegisterKernelFunction(DCStoreRangeNoSync);
    RegisterKernelFunction(DCZeroRange);
    RegisterKernelFunction(DCTouchRange);
+   RegisterKernelFunction(ICInvalidateRange);
    RegisterKernelFunction(OSIsAddressRangeDCValid);
    RegisterKernelFunction(OSCoherencyBarrier);
 }
@@ -1,5 +1,6 @@
 #include "coreinit_internal_idlock.h"
 #include "libcpu/mem.h"
+#include <common/decaf_assert.h>
 
 namespace coreinit
 {
@@ -10,17 +11,14 @@ namespace internal
 void
 acquireIdLock(IdLock &lock, uint32_t id)
 {
-   uint32_t expected = 0;
-
-   while (!lock.owner.compare_exchange_weak(expected, id, std::memory_order_acquire)) {
-      expected = 0;
-   }
+   lock.lock.lock(id);
 }
 
 void
 releaseIdLock(IdLock &lock, uint32_t id)
 {
-   lock.owner.store(0, std::memory_order_release);
+   auto owner = lock.lock.unlock();
+   decaf_check(owner == id);
 }
 
 void
@@ -1,5 +1,5 @@
 #pragma once
-#include <atomic>
+#include <common/adaptivelock.h>
 #include <cstdint>
 
 namespace coreinit
@@ -10,7 +10,7 @@ namespace internal
 
 struct IdLock
 {
-   std::atomic<uint32_t> owner { 0 };
+   AdaptiveLock lock;
 };
 
 void
@@ -4,6 +4,7 @@
 #include "coreinit_thread.h"
 #include "gpu/gpu_flush.h"
 #include "libcpu/mem.h"
+#include <common/memory_copy.h>
 #include <common/teenyheap.h>
 #include <array>
 
@@ -161,7 +162,7 @@ LCLoadDMABlocks(void *dst,
       size = 128;
    }
 
-   std::memcpy(dst, src, size * 32);
+   memory_copy(dst, src, size * 32);
 }
 
 
@@ -179,7 +180,7 @@ LCStoreDMABlocks(void *dst,
       size = 128;
    }
 
-   std::memcpy(dst, src, size * 32);
+   memory_copy(dst, src, size * 32);
 
    // Also signal the memory store to the GPU, as with DCFlushRange().
    gpu::notifyCpuFlush(dst, size);
@@ -1,9 +1,17 @@
 #include "coreinit.h"
 #include "coreinit_memexpheap.h"
 
+#include <array>
 #include <common/align.h>
 #include <common/bitfield.h>
+#include <common/bitutils.h>
 #include <libcpu/mem.h>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 namespace coreinit
 {
@@ -41,19 +49,6 @@ getUsedMemBlock(void * mem)
    return block;
 }
 
-static bool
-listContainsBlock(MEMExpHeapBlockList *list,
-                  MEMExpHeapBlock *block)
-{
-   for (auto i = list->head; i; i = i->next) {
-      if (i == block) {
-         return true;
-      }
-   }
-
-   return false;
-}
-
 static void
 insertBlock(MEMExpHeapBlockList *list,
             MEMExpHeapBlock *prev,
@@ -85,8 +80,6 @@ static void
 removeBlock(MEMExpHeapBlockList *list,
             MEMExpHeapBlock *block)
 {
-   decaf_check(listContainsBlock(list, block));
-
    if (block->prev) {
       block->prev->next = block->next;
    } else {
@@ -103,6 +96,149 @@ removeBlock(MEMExpHeapBlockList *list,
    block->next = nullptr;
 }
 
+
+/**
+ * Host side index of an expanded heap.
+ *
+ * The guest free and used lists are still maintained exactly as before, so
+ * the guest visible block layout and list order do not change, but every
+ * lookup which used to walk a list goes through this index instead.
+ *
+ * Free blocks are segregated into size classes, each ordered by address,
+ * which is what a first fit search needs. Best fit searches and largest
+ * block queries use a tree ordered by size.
+ */
+static constexpr unsigned
+SizeClassSubdivisions = 4;
+
+static constexpr unsigned
+MinSizeClassShift = 6;
+
+static constexpr unsigned
+NumSizeClasses = (1 << MinSizeClassShift) / 16 + (32 - MinSizeClassShift) * SizeClassSubdivisions;
+
+struct ExpHeapIndex
+{
+   //! All free blocks ordered by address, mirrors heap->freeList
+   std::set<MEMExpHeapBlock *> freeBlocks;
+
+   //! Free blocks segregated by size class, each ordered by address
+   std::array<std::set<MEMExpHeapBlock *>, NumSizeClasses> sizeClasses;
+
+   //! Free blocks ordered by size and then address
+   std::set<std::pair<uint32_t, MEMExpHeapBlock *>> freeBySize;
+
+   //! Blocks which are currently in heap->usedList
+   std::unordered_set<MEMExpHeapBlock *> usedBlocks;
+
+   //! Sum of blockSize for all free blocks
+   uint32_t totalFreeSize = 0;
+};
+
+static std::mutex
+sExpHeapIndexMutex;
+
+static std::unordered_map<MEMExpHeap *, std::unique_ptr<ExpHeapIndex>>
+sExpHeapIndices;
+
+
+/**
+ * Size classes are linear in 16 byte steps below 64 bytes, and then each
+ * power of two is split into SizeClassSubdivisions linear classes.
+ */
+static unsigned
+getSizeClass(uint32_t size)
+{
+   if (size < (1 << MinSizeClassShift)) {
+      return size / 16;
+   }
+
+   auto log2 = 31 - clz(size);
+   auto sub = (size >> (log2 - 2)) & (SizeClassSubdivisions - 1);
+   return (1 << MinSizeClassShift) / 16 + (log2 - MinSizeClassShift) * SizeClassSubdivisions + sub;
+}
+
+static ExpHeapIndex *
+getExpHeapIndex(MEMExpHeap *heap)
+{
+   std::unique_lock<std::mutex> lock { sExpHeapIndexMutex };
+   auto itr = sExpHeapIndices.find(heap);
+   decaf_check(itr != sExpHeapIndices.end());
+   return itr->second.get();
+}
+
+static void
+indexAddFreeBlock(ExpHeapIndex *index,
+                  MEMExpHeapBlock *block)
+{
+   auto size = static_cast<uint32_t>(block->blockSize);
+   index->freeBlocks.insert(block);
+   index->sizeClasses[getSizeClass(size)].insert(block);
+   index->freeBySize.emplace(size, block);
+   index->totalFreeSize += size;
+}
+
+static void
+indexRemoveFreeBlock(ExpHeapIndex *index,
+                     MEMExpHeapBlock *block)
+{
+   auto size = static_cast<uint32_t>(block->blockSize);
+   auto erased = index->freeBlocks.erase(block);
+   decaf_check(erased);
+
+   index->sizeClasses[getSizeClass(size)].erase(block);
+   index->freeBySize.erase({ size, block });
+   index->totalFreeSize -= size;
+}
+
+static void
+insertFreeBlock(MEMExpHeap *heap,
+                ExpHeapIndex *index,
+                MEMExpHeapBlock *prev,
+                MEMExpHeapBlock *block)
+{
+   insertBlock(&heap->freeList, prev, block);
+   indexAddFreeBlock(index, block);
+}
+
+static void
+removeFreeBlock(MEMExpHeap *heap,
+                ExpHeapIndex *index,
+                MEMExpHeapBlock *block)
+{
+   indexRemoveFreeBlock(index, block);
+   removeBlock(&heap->freeList, block);
+}
+
+static void
+resizeFreeBlock(ExpHeapIndex *index,
+                MEMExpHeapBlock *block,
+                uint32_t size)
+{
+   indexRemoveFreeBlock(index, block);
+   block->blockSize = size;
+   indexAddFreeBlock(index, block);
+}
+
+static void
+insertUsedBlock(MEMExpHeap *heap,
+                ExpHeapIndex *index,
+                MEMExpHeapBlock *block)
+{
+   insertBlock(&heap->usedList, nullptr, block);
+   index->usedBlocks.insert(block);
+}
+
+static void
+removeUsedBlock(MEMExpHeap *heap,
+                ExpHeapIndex *index,
+                MEMExpHeapBlock *block)
+{
+   auto erased = index->usedBlocks.erase(block);
+   decaf_check(erased);
+   removeBlock(&heap->usedList, block);
+}
+
 static uint32_t
 getAlignedBlockSize(MEMExpHeapBlock *block,
                     uint32_t alignment,
@@ -135,6 +271,7 @@ getAlignedBlockSize(MEMExpHeapBlock *block,
 
 static MEMExpHeapBlock *
 createUsedBlockFromFreeBlock(MEMExpHeap *heap,
+                             ExpHeapIndex *index,
                              MEMExpHeapBlock *freeBlock,
                              uint32_t size,
                              uint32_t alignment,
@@ -150,7 +287,7 @@ createUsedBlockFromFreeBlock(MEMExpHeap *heap,
 
    // Free blocks should never have alignment...
    decaf_check(!freeBlockAttribs.alignment());
-   removeBlock(&heap->freeList, freeBlock);
+   removeFreeBlock(heap, index, freeBlock);
 
    // Find where we are going to start
    uint8_t *alignedDataStart = nullptr;
@@ -184,8 +321,11 @@ createUsedBlockFromFreeBlock(MEMExpHeap *heap,
          freeBlock->prev = nullptr;
          freeBlock->tag = FreeTag;
 
-         insertBlock(&heap->freeList, freeBlockPrev, freeBlock);
+         insertFreeBlock(heap, index, freeBlockPrev, freeBlock);
          topSpaceRemain = 0;
+
+         // Keep the free list in address order if we also release the bottom space
+         freeBlockPrev = freeBlock;
       }
    }
 
@@ -201,7 +341,7 @@ createUsedBlockFromFreeBlock(MEMExpHeap *heap,
          freeBlock->prev = nullptr;
          freeBlock->tag = FreeTag;
 
-         insertBlock(&heap->freeList, freeBlockPrev, freeBlock);
+         insertFreeBlock(heap, index, freeBlockPrev, freeBlock);
          bottomSpaceRemain = 0;
       }
    }
@@ -215,7 +355,7 @@ createUsedBlockFromFreeBlock(MEMExpHeap *heap,
    alignedBlock->next = nullptr;
    alignedBlock->tag = UsedTag;
 
-   insertBlock(&heap->usedList, nullptr, alignedBlock);
+   insertUsedBlock(heap, index, alignedBlock);
 
    if (heapAttribs.zeroAllocated()) {
       memset(alignedDataStart, 0, size);
@@ -227,8 +367,9 @@ createUsedBlockFromFreeBlock(MEMExpHeap *heap,
    return alignedBlock;
 }
 
-void
+static void
 releaseMemory(MEMExpHeap *heap,
+              ExpHeapIndex *index,
               uint8_t *memStart,
               uint8_t *memEnd)
 {
@@ -241,17 +382,17 @@ releaseMemory(MEMExpHeap *heap,
       memset(memStart, fillVal, memEnd - memStart);
    }
 
-   // Find the preceeding block to the memory we are releasing
+   // Find the free blocks either side of the memory we are releasing
    MEMExpHeapBlock *prevBlock = nullptr;
-   MEMExpHeapBlock *nextBlock = heap->freeList.head;
+   MEMExpHeapBlock *nextBlock = nullptr;
+   auto itr = index->freeBlocks.lower_bound(reinterpret_cast<MEMExpHeapBlock *>(memStart));
 
-   for (auto block = heap->freeList.head; block; block = block->next) {
-      if (getBlockMemStart(block) < memStart) {
-         prevBlock = block;
-         nextBlock = block->next;
-      } else if (block >= prevBlock) {
-         break;
-      }
+   if (itr != index->freeBlocks.end()) {
+      nextBlock = *itr;
+   }
+
+   if (itr != index->freeBlocks.begin()) {
+      prevBlock = *std::prev(itr);
    }
 
    MEMExpHeapBlock *freeBlock = nullptr;
@@ -263,7 +404,8 @@ releaseMemory(MEMExpHeap *heap,
 
       if (memStart == prevMemEnd) {
          // Previous block absorbs the new memory
-         prevBlock->blockSize += memEnd - memStart;
+         resizeFreeBlock(index, prevBlock,
+                         static_cast<uint32_t>(prevBlock->blockSize + (memEnd - memStart)));
 
          // Our free block becomes the previous one
          freeBlock = prevBlock;
@@ -280,7 +422,7 @@ releaseMemory(MEMExpHeap *heap,
       freeBlock->prev = nullptr;
       freeBlock->tag = FreeTag;
 
-      insertBlock(&heap->freeList, prevBlock, freeBlock);
+      insertFreeBlock(heap, index, prevBlock, freeBlock);
    }
 
    if (nextBlock) {
@@ -292,11 +434,82 @@ releaseMemory(MEMExpHeap *heap,
          // The next block needs to be merged into the freeBlock, as they
          //  are directly adjacent to each other in memory.
          auto nextBlockEnd = getBlockMemEnd(nextBlock);
-         freeBlock->blockSize += nextBlockEnd - nextBlockStart;
+         removeFreeBlock(heap, index, nextBlock);
+         resizeFreeBlock(index, freeBlock,
+                         static_cast<uint32_t>(freeBlock->blockSize + (nextBlockEnd - nextBlockStart)));
+      }
+   }
+}
+
+/**
+ * Find the free block an allocation should be made from.
+ *
+ * This returns the same block the old walk of the free list did: in
+ * FirstFree mode the lowest addressed block which fits, and in NearSize
+ * mode the block with the smallest aligned size, preferring the lowest
+ * address when there are several.
+ */
+static MEMExpHeapBlock *
+findFreeBlock(ExpHeapIndex *index,
+              MEMExpHeapMode mode,
+              uint32_t size,
+              uint32_t alignment,
+              MEMExpHeapDirection dir)
+{
+   MEMExpHeapBlock *foundBlock = nullptr;
+
+   if (mode == MEMExpHeapMode::FirstFree) {
+      // A block from a lower size class can never fit the allocation, for
+      //  the rest we take the lowest addressed fit from each class.
+      for (auto i = getSizeClass(size); i < NumSizeClasses; ++i) {
+         for (auto block : index->sizeClasses[i]) {
+            if (foundBlock && block >= foundBlock) {
+               break;
+            }
 
-         removeBlock(&heap->freeList, nextBlock);
+            if (getAlignedBlockSize(block, alignment, dir) >= size) {
+               foundBlock = block;
+               break;
+            }
+         }
+      }
+   } else {
+      // Block data is always 4 byte aligned, so aligning the allocation
+      //  can waste at most alignment - 4 bytes of a block.
+      auto maxAlignWaste = alignment - 4;
+      auto bestAlignedSize = 0xFFFFFFFFu;
+
+      for (auto itr = index->freeBySize.lower_bound({ size, nullptr }); itr != index->freeBySize.end(); ++itr) {
+         auto blockSize = itr->first;
+         auto block = itr->second;
+
+         if (foundBlock) {
+            auto minAlignedSize = blockSize > maxAlignWaste ? blockSize - maxAlignWaste : 0u;
+
+            if (minAlignedSize > bestAlignedSize) {
+               break;
+            }
+
+            if (!maxAlignWaste && minAlignedSize == bestAlignedSize) {
+               // Same size as the block we found, but at a higher address
+               break;
+            }
+         }
+
+         auto alignedSize = getAlignedBlockSize(block, alignment, dir);
+
+         if (alignedSize < size) {
+            continue;
+         }
+
+         if (alignedSize < bestAlignedSize || (alignedSize == bestAlignedSize && block < foundBlock)) {
+            foundBlock = block;
+            bestAlignedSize = alignedSize;
+         }
       }
    }
+
+   return foundBlock;
 }
 
 MEMExpHeap *
@@ -343,6 +556,14 @@ MEMCreateExpHeapEx(void *base,
    heap->groupId = 0;
    heap->attribs = MEMExpHeapAttribs::get(0);
 
+   auto index = std::make_unique<ExpHeapIndex>();
+   indexAddFreeBlock(index.get(), firstBlock);
+
+   {
+      std::unique_lock<std::mutex> lock { sExpHeapIndexMutex };
+      sExpHeapIndices[heap] = std::move(index);
+   }
+
    return heap;
 }
 
@@ -352,6 +573,12 @@ MEMDestroyExpHeap(MEMExpHeap *heap)
    decaf_check(heap);
    decaf_check(heap->header.tag == MEMHeapTag::ExpandedHeap);
    internal::unregisterHeap(&heap->header);
+
+   {
+      std::unique_lock<std::mutex> lock { sExpHeapIndexMutex };
+      sExpHeapIndices.erase(heap);
+   }
+
    return heap;
 }
 
@@ -370,62 +597,29 @@ MEMAllocFromExpHeapEx(MEMExpHeap *heap,
    decaf_check(alignment != 0);
 
    internal::HeapLock lock(&heap->header);
+   auto index = getExpHeapIndex(heap);
+   auto direction = MEMExpHeapDirection::FromStart;
    MEMExpHeapBlock *newBlock = nullptr;
 
    size = align_up(size, 4);
 
    if (alignment > 0) {
-      MEMExpHeapBlock *foundBlock = nullptr;
-      uint32_t bestAlignedSize = 0xFFFFFFFF;
-
       alignment = std::max(4, alignment);
-      decaf_check((alignment & 0x3) == 0);
-
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block, alignment, MEMExpHeapDirection::FromStart);
-
-         if (alignedSize >= size) {
-            if (expHeapFlags.allocMode() == MEMExpHeapMode::FirstFree) {
-               foundBlock = block;
-               break;
-            } else {
-               if (alignedSize < bestAlignedSize) {
-                  foundBlock = block;
-                  bestAlignedSize = alignedSize;
-               }
-            }
-         }
-      }
-
-      if (foundBlock) {
-         newBlock = createUsedBlockFromFreeBlock(heap, foundBlock, size, alignment, MEMExpHeapDirection::FromStart);
-      }
    } else {
       alignment = std::max(4, -alignment);
-      decaf_check((alignment & 0x3) == 0);
-
-      MEMExpHeapBlock *foundBlock = nullptr;
-      auto bestAlignedSize = 0xFFFFFFFFu;
+      direction = MEMExpHeapDirection::FromEnd;
+   }
 
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block, alignment, MEMExpHeapDirection::FromEnd);
+   decaf_check((alignment & 0x3) == 0);
 
-         if (alignedSize >= size) {
-            if (expHeapFlags.allocMode() == MEMExpHeapMode::FirstFree) {
-               foundBlock = block;
-               break;
-            } else {
-               if (alignedSize < bestAlignedSize) {
-                  foundBlock = block;
-                  bestAlignedSize = alignedSize;
-               }
-            }
-         }
-      }
+   auto foundBlock = findFreeBlock(index,
+                                   expHeapFlags.allocMode(),
+                                   size,
+                                   static_cast<uint32_t>(alignment),
+                                   direction);
 
-      if (foundBlock) {
-         newBlock = createUsedBlockFromFreeBlock(heap, foundBlock, size, alignment, MEMExpHeapDirection::FromEnd);
-      }
+   if (foundBlock) {
+      newBlock = createUsedBlockFromFreeBlock(heap, index, foundBlock, size, alignment, direction);
    }
 
    if (!newBlock) {
@@ -447,6 +641,7 @@ MEMFreeToExpHeap(MEMExpHeap *heap,
    }
 
    internal::HeapLock lock(&heap->header);
+   auto index = getExpHeapIndex(heap);
 
    // Find the block
    auto dataStart = reinterpret_cast<uint8_t *>(mem);
@@ -457,10 +652,10 @@ MEMFreeToExpHeap(MEMExpHeap *heap,
    auto memEnd = getBlockMemEnd(block);
 
    // Remove the block from the used list
-   removeBlock(&heap->usedList, block);
+   removeUsedBlock(heap, index, block);
 
    // Release the memory back to the heap free list
-   releaseMemory(heap, memStart, memEnd);
+   releaseMemory(heap, index, memStart, memEnd);
 }
 
 MEMExpHeapMode
@@ -487,6 +682,7 @@ uint32_t
 MEMAdjustExpHeap(MEMExpHeap *heap)
 {
    internal::HeapLock lock(&heap->header);
+   auto index = getExpHeapIndex(heap);
    auto lastFreeBlock = heap->freeList.tail;
 
    if (!lastFreeBlock) {
@@ -500,16 +696,13 @@ MEMAdjustExpHeap(MEMExpHeap *heap)
       return 0;
    }
 
-   // Remove the block from the free list
-   decaf_check(!lastFreeBlock->next);
-
-   if (lastFreeBlock->prev) {
-      lastFreeBlock->prev->next = nullptr;
-   }
-
    // Move the heaps end pointer to the true start point of this block
    heap->header.dataEnd = getBlockMemStart(lastFreeBlock);
 
+   // Remove the block from the free list
+   decaf_check(!lastFreeBlock->next);
+   removeFreeBlock(heap, index, lastFreeBlock);
+
    auto heapMemStart = reinterpret_cast<uint8_t*>(heap);
    auto heapMemEnd = reinterpret_cast<uint8_t*>(heap->header.dataEnd.get());
    return static_cast<uint32_t>(heapMemEnd - heapMemStart);
@@ -521,6 +714,7 @@ MEMResizeForMBlockExpHeap(MEMExpHeap *heap,
                           uint32_t size)
 {
    internal::HeapLock lock(&heap->header);
+   auto index = getExpHeapIndex(heap);
    size = align_up(size, 4);
 
    auto heapAttribs = heap->header.attribs.value();
@@ -535,37 +729,27 @@ MEMResizeForMBlockExpHeap(MEMExpHeap *heap,
 
          block->blockSize -= releasedSpace;
 
-         releaseMemory(heap, releasedMemStart, releasedMemEnd);
+         releaseMemory(heap, index, releasedMemStart, releasedMemEnd);
       }
    } else if (size > block->blockSize) {
       auto blockMemEnd = getBlockMemEnd(block);
 
-      MEMExpHeapBlock *freeBlock = nullptr;
-      for (auto i = heap->freeList.head; i; i = i->next) {
-         auto freeBlockMemStart = getBlockMemStart(i);
+      // Free blocks have no alignment, so the header is the start of their memory
+      auto itr = index->freeBlocks.find(reinterpret_cast<MEMExpHeapBlock *>(blockMemEnd));
 
-         if (freeBlockMemStart == blockMemEnd) {
-            freeBlock = i;
-            break;
-         }
-
-         // Free list is sorted, so we only need to search a little bit
-         if (freeBlockMemStart > blockMemEnd) {
-            break;
-         }
-      }
-
-      if (!freeBlock) {
+      if (itr == index->freeBlocks.end()) {
          return 0;
       }
 
+      auto freeBlock = *itr;
+
       // Grab the data we need from the free block
       auto freeBlockMemStart = getBlockMemStart(freeBlock);
       auto freeBlockMemEnd = getBlockMemEnd(freeBlock);
       auto freeMemSize = freeBlockMemEnd - freeBlockMemStart;
 
       // Drop the free block from the list of free regions
-      removeBlock(&heap->freeList, freeBlock);
+      removeFreeBlock(heap, index, freeBlock);
 
       // Adjust the sizing of the free area and the block
       auto newAllocSize = (size - block->blockSize);
@@ -583,7 +767,7 @@ MEMResizeForMBlockExpHeap(MEMExpHeap *heap,
       //  the memory back to the heap.  Otherwise we just tack the remainder
       //  onto the end of the block we resized.
       if (freeMemSize >= sizeof(MEMExpHeapBlock) + 0x4) {
-         releaseMemory(heap, freeBlockMemEnd - freeMemSize, freeBlockMemEnd);
+         releaseMemory(heap, index, freeBlockMemEnd - freeMemSize, freeBlockMemEnd);
       } else {
          block->blockSize += freeMemSize;
       }
@@ -596,13 +780,8 @@ uint32_t
 MEMGetTotalFreeSizeForExpHeap(MEMExpHeap *heap)
 {
    internal::HeapLock lock(&heap->header);
-   auto freeSize = 0u;
-
-   for (auto block = heap->freeList.head; block; block = block->next) {
-      freeSize += block->blockSize;
-   }
-
-   return freeSize;
+   auto index = getExpHeapIndex(heap);
+   return index->totalFreeSize;
 }
 
 uint32_t
@@ -610,29 +789,28 @@ MEMGetAllocatableSizeForExpHeapEx(MEMExpHeap *heap,
                                   int32_t alignment)
 {
    internal::HeapLock lock(&heap->header);
+   auto index = getExpHeapIndex(heap);
    auto largestFree = 0u;
+   auto direction = MEMExpHeapDirection::FromStart;
 
-   if (alignment > 0) {
-      decaf_check((alignment & 0x3) == 0);
+   if (alignment < 0) {
+      alignment = -alignment;
+      direction = MEMExpHeapDirection::FromEnd;
+   }
 
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block, alignment, MEMExpHeapDirection::FromStart);
+   decaf_check((alignment & 0x3) == 0);
 
-         if (alignedSize > largestFree) {
-            largestFree = alignedSize;
-         }
+   // Walk from the largest block down, a block can never have an aligned
+   //  size larger than its real size so we can stop early.
+   for (auto itr = index->freeBySize.rbegin(); itr != index->freeBySize.rend(); ++itr) {
+      if (itr->first <= largestFree) {
+         break;
       }
-   } else {
-      alignment = -alignment;
 
-      decaf_check((alignment & 0x3) == 0);
+      auto alignedSize = getAlignedBlockSize(itr->second, alignment, direction);
 
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block, alignment, MEMExpHeapDirection::FromEnd);
-
-         if (alignedSize > largestFree) {
-            largestFree = alignedSize;
-         }
+      if (alignedSize > largestFree) {
+         largestFree = alignedSize;
       }
    }
 
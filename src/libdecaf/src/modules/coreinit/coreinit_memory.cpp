@@ -3,6 +3,7 @@
 #include "coreinit_core.h"
 #include "kernel/kernel_memory.h"
 
+#include <common/memory_copy.h>
 #include <common/platform_memory.h>
 #include <common/teenyheap.h>
 #include <libcpu/mem.h>
@@ -59,7 +60,7 @@ OSBlockMove(void *dst,
             uint32_t size,
             BOOL flush)
 {
-   std::memmove(dst, src, size);
+   memory_move(dst, src, size);
    return dst;
 }
 
@@ -68,7 +69,7 @@ OSBlockSet(void *dst,
            uint8_t val,
            uint32_t size)
 {
-   std::memset(dst, val, size);
+   memory_set(dst, val, size);
    return dst;
 }
 
@@ -77,7 +78,7 @@ coreinit_memmove(void *dst,
                  const void *src,
                  uint32_t size)
 {
-   std::memmove(dst, src, size);
+   memory_move(dst, src, size);
    return dst;
 }
 
@@ -86,7 +87,7 @@ coreinit_memcpy(void *dst,
                 const void *src,
                 uint32_t size)
 {
-   std::memcpy(dst, src, size);
+   memory_copy(dst, src, size);
    return dst;
 }
 
@@ -95,7 +96,7 @@ coreinit_memset(void *dst,
                 int val,
                 uint32_t size)
 {
-   std::memset(dst, val, size);
+   memory_set(dst, static_cast<uint8_t>(val), size);
    return dst;
 }
 
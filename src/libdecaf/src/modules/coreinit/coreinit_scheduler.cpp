@@ -19,6 +19,7 @@
 #include "libcpu/trace.h"
 #include "ppcutils/wfunc_call.h"
 #include "ppcutils/stackobject.h"
+#include <common/adaptivelock.h>
 #include <common/decaf_assert.h>
 
 namespace coreinit
@@ -30,8 +31,8 @@ SchedulerLockNonCpuCoreId = 1u << 31;
 static bool
 sSchedulerEnabled[3];
 
-static std::atomic<uint32_t>
-sSchedulerLock { 0 };
+static AdaptiveLock
+sSchedulerLock;
 
 static OSThreadQueue *
 sActiveThreads;
@@ -104,7 +105,6 @@ getCurrentThread()
 void
 lockScheduler()
 {
-   uint32_t expected = 0;
    auto id = cpu::this_core::id();
    auto core = 1 << id;
 
@@ -112,9 +112,7 @@ lockScheduler()
       core = SchedulerLockNonCpuCoreId;
    }
 
-   while (!sSchedulerLock.compare_exchange_weak(expected, core, std::memory_order_acquire)) {
-      expected = 0;
-   }
+   sSchedulerLock.lock(core);
 }
 
 bool
@@ -127,7 +125,7 @@ isSchedulerLocked()
       core = SchedulerLockNonCpuCoreId;
    }
 
-   return sSchedulerLock.load(std::memory_order_acquire) == core;
+   return sSchedulerLock.owner() == core;
 }
 
 void
@@ -140,10 +138,16 @@ unlockScheduler()
       core = SchedulerLockNonCpuCoreId;
    }
 
-   auto oldCore = sSchedulerLock.exchange(0, std::memory_order_release);
+   auto oldCore = sSchedulerLock.unlock();
    decaf_check(oldCore == core);
 }
 
+const AdaptiveLockStats &
+getSchedulerLockStats()
+{
+   return sSchedulerLock.stats();
+}
+
 bool
 isSchedulerEnabled()
 {
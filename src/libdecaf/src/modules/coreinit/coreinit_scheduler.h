@@ -1,5 +1,6 @@
 #pragma once
 #include "coreinit_thread.h"
+#include <common/adaptivelock.h>
 #include <cstdint>
 
 namespace coreinit
@@ -38,6 +39,9 @@ isSchedulerLocked();
 void
 unlockScheduler();
 
+const AdaptiveLockStats &
+getSchedulerLockStats();
+
 bool
 isSchedulerEnabled();
 
@@ -4,12 +4,27 @@
 #include "coreinit_scheduler.h"
 #include "coreinit_thread.h"
 #include "libcpu/mem.h"
+#include <common/adaptivelock.h>
 #include <common/decaf_assert.h>
 #include <atomic>
 
 namespace coreinit
 {
 
+//! Contention counters shared by every guest spin lock
+static AdaptiveLockStats
+sSpinLockStats;
+
+/**
+ * The guest owner word, the futex only cares that it is 32 bits wide.
+ */
+static std::atomic<uint32_t> *
+getSpinLockWord(OSSpinLock *spinlock)
+{
+   static_assert(sizeof(spinlock->owner) == sizeof(std::atomic<uint32_t>), "Unexpected OSSpinLock owner size");
+   return reinterpret_cast<std::atomic<uint32_t> *>(&spinlock->owner);
+}
+
 static void
 increaseSpinLockCount(OSThread *thread)
 {
@@ -39,11 +54,12 @@ spinAcquireLock(OSSpinLock *spinlock)
       return false;
    }
 
-   auto expected = be_val<uint32_t> { 0 };
-
-   while (!spinlock->owner.compare_exchange_weak(expected, owner, std::memory_order_release, std::memory_order_relaxed)) {
-      expected = 0;
-   }
+   adaptive_lock::acquire(getSpinLockWord(spinlock),
+                          [&]() {
+                             auto expected = be_val<uint32_t> { 0 };
+                             return spinlock->owner.compare_exchange_weak(expected, owner, std::memory_order_acquire, std::memory_order_relaxed);
+                          },
+                          &sSpinLockStats);
 
    increaseSpinLockCount(thread);
    return true;
@@ -90,6 +106,7 @@ spinTryLockWithTimeout(OSSpinLock *spinlock,
          return false;
       }
 
+      adaptive_lock::pause();
       expected = 0;
    }
 
@@ -108,6 +125,7 @@ spinReleaseLock(OSSpinLock *spinlock)
       return false;
    } else if (spinlock->owner.load(std::memory_order_acquire) == owner) {
       spinlock->owner = 0u;
+      adaptive_lock::unpark(getSpinLockWord(spinlock));
       decreaseSpinLockCount(thread);
       return true;
    }
@@ -259,6 +277,17 @@ OSUninterruptibleSpinLock_Release(OSSpinLock *spinlock)
 }
 
 
+namespace internal
+{
+
+const AdaptiveLockStats &
+getSpinLockStats()
+{
+   return sSpinLockStats;
+}
+
+} // namespace internal
+
 void
 Module::registerSpinLockFunctions()
 {
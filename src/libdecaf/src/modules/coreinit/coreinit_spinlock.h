@@ -2,6 +2,7 @@
 #include "coreinit_thread.h"
 
 #include <atomic>
+#include <common/adaptivelock.h>
 #include <common/be_val.h>
 #include <common/cbool.h>
 #include <common/structsize.h>
@@ -86,4 +87,12 @@ struct ScopedSpinLock
 
 /** @} */
 
+namespace internal
+{
+
+const AdaptiveLockStats &
+getSpinLockStats();
+
+} // namespace internal
+
 } // namespace coreinit
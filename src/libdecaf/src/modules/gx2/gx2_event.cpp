@@ -1,6 +1,8 @@
+#include "decaf_config.h"
 #include "gx2.h"
 #include "gx2_event.h"
 #include "gx2_state.h"
+#include "gpu/pm4_writer.h"
 #include "modules/coreinit/coreinit_alarm.h"
 #include "modules/coreinit/coreinit_memheap.h"
 #include "modules/coreinit/coreinit_mutex.h"
@@ -66,10 +68,14 @@ sEventCallbacks[GX2EventType::Max];
 /**
  * Sleep the current thread until the last submitted command buffer
  * has been processed by the driver.
+ *
+ * Surfaces rendered by the host GPU are written back to memory first, if
+ * the driver has surface writeback enabled.
  */
 BOOL
 GX2DrawDone()
 {
+   pm4::write(pm4::DecafWritebackSurfaces {});
    GX2Flush();
    return GX2WaitTimeStamp(GX2GetLastSubmittedTimeStamp());
 }
@@ -334,16 +340,30 @@ onSwap()
 
 /**
  * This is called by the GPU flip interrupt handler.
- * Will wakeup any threads waiting for a flip.
+ *
+ * Flips are normally counted on the next vsync, with the unlimited present
+ * mode they are counted here so threads waiting for a flip do not wait for
+ * vsync as well.
  */
 void
 handleGpuFlipInterrupt()
 {
+   if (decaf::config::gpu::present_mode != decaf::config::gpu::PresentMode::Unlimited) {
+      return;
+   }
+
+   auto framesReady = sFramesReady.load();
+
+   if (framesReady > sFlipCount) {
+      sFlipCount.store(framesReady);
+      sLastFlip.store(OSGetSystemTime(), std::memory_order_release);
+      OSWakeupThread(sFlipThreadQueue);
+   }
 }
 
 
 /**
- * Called when a swap is performed by the driver.
+ * Called by the driver when a swapped frame is flipped to the screen.
  */
 void
 onFlip()
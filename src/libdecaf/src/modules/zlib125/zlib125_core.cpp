@@ -3,16 +3,20 @@
 #include "ppcutils/wfunc_call.h"
 #include "zlib125.h"
 
+#include <array>
+#include <atomic>
+#include <common/checksum.h>
 #include <common/decaf_assert.h>
+#include <common/inflate.h>
+#include <common/log.h>
 #include <libcpu/mem.h>
+#include <mutex>
+#include <vector>
 #include <zlib.h>
 
 namespace zlib125
 {
 
-static std::map<uint32_t, z_stream>
-gStreamMap;
-
 // WiiU games will be using a 32bit zlib where stuff is in big endian order in memory
 // this means all structures like z_streamp have to be swapped endian to a temp structure
 
@@ -30,7 +34,9 @@ struct WZStream
    be_val<uint32_t> total_out;
 
    be_ptr<char> msg;
-   be_ptr<struct internal_state> state;
+
+   //! Index + 1 of the HostStream in sStreamChunks, this is private to zlib
+   be_val<uint32_t> state;
 
    ZlibAllocFunc::be zalloc;
    ZlibFreeFunc::be zfree;
@@ -85,27 +91,61 @@ zlibFreeWrapper(void *opaque,
    }
 }
 
-z_stream *
-getZStream(WZStream *in)
+enum class StreamType
 {
-   auto zstream = &gStreamMap[mem::untranslate(in)];
-   zstream->opaque = in;
-   zstream->zalloc = &zlibAllocWrapper;
-   zstream->zfree = &zlibFreeWrapper;
-   return zstream;
-}
+   None,
+   Deflate,
+   Inflate,
+};
 
-void
-eraseZStream(WZStream *in)
+/**
+ * Host zlib stream for a guest WZStream.
+ *
+ * Streams live in a table indexed directly from the guest stream's state
+ * field. Each stream is only used by one guest thread at a time, so only
+ * allocating and freeing them takes sStreamMutex.
+ */
+struct HostStream
 {
-   gStreamMap.erase(mem::untranslate(in));
-}
+   z_stream zstream;
 
-static int
-zlib125_deflate(WZStream *wstrm,
-                int32_t flush)
+   //! Guest address of the WZStream this belongs to, 0 if free
+   std::atomic<uint32_t> owner;
+
+   StreamType type;
+   int windowBits;
+
+   //! Nothing has been inflated since the stream was initialised or reset
+   bool inflateStart;
+
+   //! The whole stream was inflated by inflate_buffer
+   bool inflateDone;
+};
+
+static const uint32_t
+StreamsPerChunk = 256;
+
+static const uint32_t
+MaxStreamChunks = 4096;
+
+//! The table grows a chunk at a time so streams never move while another
+//!  thread is using them, the limit is far beyond what guest memory allows.
+static std::array<std::atomic<HostStream *>, MaxStreamChunks>
+sStreamChunks;
+
+static std::mutex
+sStreamMutex;
+
+static std::vector<uint32_t>
+sFreeStreams;
+
+static uint32_t
+sNumStreamsUsed = 0;
+
+static void
+copyStreamIn(z_stream *zstrm,
+             WZStream *wstrm)
 {
-   auto zstrm = getZStream(wstrm);
    zstrm->next_in = wstrm->next_in;
    zstrm->avail_in = wstrm->avail_in;
    zstrm->total_in = wstrm->total_in;
@@ -116,9 +156,12 @@ zlib125_deflate(WZStream *wstrm,
 
    zstrm->data_type = wstrm->data_type;
    zstrm->adler = wstrm->adler;
+}
 
-   auto result = deflate(zstrm, flush);
-
+static void
+copyStreamOut(WZStream *wstrm,
+              z_stream *zstrm)
+{
    wstrm->next_in = zstrm->next_in;
    wstrm->avail_in = zstrm->avail_in;
    wstrm->total_in = zstrm->total_in;
@@ -129,7 +172,195 @@ zlib125_deflate(WZStream *wstrm,
 
    wstrm->data_type = zstrm->data_type;
    wstrm->adler = zstrm->adler;
+}
+
+static HostStream *
+getStream(WZStream *wstrm)
+{
+   auto index = static_cast<uint32_t>(wstrm->state) - 1;
+   auto chunk = index / StreamsPerChunk;
+
+   if (chunk >= MaxStreamChunks) {
+      return nullptr;
+   }
+
+   auto streams = sStreamChunks[chunk].load(std::memory_order_acquire);
+
+   if (!streams) {
+      return nullptr;
+   }
+
+   auto &stream = streams[index % StreamsPerChunk];
+
+   if (stream.owner.load(std::memory_order_acquire) != mem::untranslate(wstrm)) {
+      return nullptr;
+   }
+
+   return &stream;
+}
+
+static void
+endStream(HostStream *stream)
+{
+   if (stream->type == StreamType::Deflate) {
+      deflateEnd(&stream->zstream);
+   } else if (stream->type == StreamType::Inflate) {
+      inflateEnd(&stream->zstream);
+   }
+
+   stream->type = StreamType::None;
+}
+
+/**
+ * Get a host stream for a guest stream which is being initialised, a
+ * guest stream initialised again without being ended keeps its stream.
+ */
+static HostStream *
+createStream(WZStream *wstrm,
+             StreamType type)
+{
+   auto stream = getStream(wstrm);
+
+   if (stream) {
+      endStream(stream);
+   } else {
+      std::unique_lock<std::mutex> lock { sStreamMutex };
+      auto index = uint32_t { 0 };
+
+      if (!sFreeStreams.empty()) {
+         index = sFreeStreams.back();
+         sFreeStreams.pop_back();
+      } else if (sNumStreamsUsed < StreamsPerChunk * MaxStreamChunks) {
+         index = sNumStreamsUsed++;
+      } else {
+         gLog->error("Too many zlib streams, could not create stream for {:08X}", mem::untranslate(wstrm));
+         return nullptr;
+      }
+
+      auto &chunk = sStreamChunks[index / StreamsPerChunk];
+      auto streams = chunk.load(std::memory_order_relaxed);
+
+      if (!streams) {
+         streams = new HostStream[StreamsPerChunk] { };
+         chunk.store(streams, std::memory_order_release);
+      }
+
+      stream = &streams[index % StreamsPerChunk];
+      stream->owner.store(mem::untranslate(wstrm), std::memory_order_release);
+      wstrm->state = index + 1;
+   }
+
+   stream->zstream = z_stream { };
+   stream->zstream.opaque = wstrm;
+   stream->zstream.zalloc = &zlibAllocWrapper;
+   stream->zstream.zfree = &zlibFreeWrapper;
+   stream->type = type;
+   stream->windowBits = MAX_WBITS;
+   stream->inflateStart = true;
+   stream->inflateDone = false;
+
+   // Keep any buffers the guest set before initialising the stream
+   copyStreamIn(&stream->zstream, wstrm);
+   return stream;
+}
+
+static void
+destroyStream(WZStream *wstrm,
+              HostStream *stream)
+{
+   auto index = static_cast<uint32_t>(wstrm->state) - 1;
+   endStream(stream);
+   stream->owner.store(0, std::memory_order_release);
+   wstrm->state = 0u;
+
+   std::unique_lock<std::mutex> lock { sStreamMutex };
+   sFreeStreams.push_back(index);
+}
+
+/**
+ * Try to inflate the whole of a stream with inflate_buffer, which is much
+ * faster than zlib when all of the input and room for all of the output is
+ * given to the first inflate call, as most titles do.
+ *
+ * Returns false if the stream could not be inflated in one go, in which
+ * case it is left for zlib to inflate from the start.
+ */
+static bool
+inflateWholeStream(WZStream *wstrm,
+                   HostStream *stream)
+{
+   auto src = wstrm->next_in.get();
+   auto dst = wstrm->next_out.get();
+   auto srcSize = static_cast<uint32_t>(wstrm->avail_in);
+   auto dstSize = static_cast<uint32_t>(wstrm->avail_out);
+   auto format = InflateFormat::Raw;
+   auto windowBits = stream->windowBits;
+
+   if (!src || !dst) {
+      return false;
+   }
+
+   // Same choice of header as zlib's inflateReset2
+   if (windowBits >= 0) {
+      auto wrap = (windowBits >> 4) + 1;
+      windowBits &= 15;
+
+      if ((wrap & 2) && srcSize >= 2 && src[0] == 0x1F && src[1] == 0x8B) {
+         format = InflateFormat::Gzip;
+      } else if (wrap & 1) {
+         format = InflateFormat::Zlib;
+      } else {
+         return false;
+      }
+   } else {
+      windowBits = -windowBits;
+   }
+
+   if (windowBits < 8 || windowBits > MAX_WBITS) {
+      return false;
+   }
+
+   auto result = InflateResult { };
+
+   if (inflate_buffer(dst, dstSize, src, srcSize, format, windowBits, result) != InflateStatus::Success) {
+      return false;
+   }
+
+   wstrm->next_in = src + result.inputUsed;
+   wstrm->avail_in = static_cast<uint32_t>(srcSize - result.inputUsed);
+   wstrm->total_in += static_cast<uint32_t>(result.inputUsed);
+
+   wstrm->next_out = dst + result.outputUsed;
+   wstrm->avail_out = static_cast<uint32_t>(dstSize - result.outputUsed);
+   wstrm->total_out += static_cast<uint32_t>(result.outputUsed);
+
+   if (format != InflateFormat::Raw) {
+      wstrm->adler = result.check;
+   }
+
+   // zlib reports the bits left in its bit buffer, plus 64 after the last
+   //  block, plus 128 when stopped at a block boundary.  At Z_STREAM_END
+   //  it has dropped the rest of the last block's final byte and read any
+   //  trailer, leaving no bits, and is past the block boundary state, so
+   //  a whole stream always ends with exactly 64.
+   wstrm->data_type = 64;
+   return true;
+}
+
+static int
+zlib125_deflate(WZStream *wstrm,
+                int32_t flush)
+{
+   auto stream = getStream(wstrm);
+
+   if (!stream) {
+      return Z_STREAM_ERROR;
+   }
 
+   auto zstrm = &stream->zstream;
+   copyStreamIn(zstrm, wstrm);
+   auto result = deflate(zstrm, flush);
+   copyStreamOut(wstrm, zstrm);
    return result;
 }
 
@@ -141,9 +372,21 @@ zlib125_deflateInit_(WZStream *wstrm,
 {
    decaf_check(sizeof(WZStream) == stream_size);
 
-   auto zstrm = getZStream(wstrm);
-   auto result = deflateInit_(zstrm, level, version, sizeof(z_stream));
+   auto stream = createStream(wstrm, StreamType::Deflate);
+
+   if (!stream) {
+      return Z_MEM_ERROR;
+   }
+
+   auto result = deflateInit_(&stream->zstream, level, version, sizeof(z_stream));
 
+   if (result != Z_OK) {
+      stream->type = StreamType::None;
+      destroyStream(wstrm, stream);
+      return result;
+   }
+
+   copyStreamOut(wstrm, &stream->zstream);
    wstrm->msg = nullptr;
    return result;
 }
@@ -160,9 +403,21 @@ zlib125_deflateInit2_(WZStream *wstrm,
 {
    decaf_check(sizeof(WZStream) == stream_size);
 
-   auto zstrm = getZStream(wstrm);
-   auto result = deflateInit2_(zstrm, level, method, windowBits, memLevel, strategy, version, sizeof(z_stream));
+   auto stream = createStream(wstrm, StreamType::Deflate);
+
+   if (!stream) {
+      return Z_MEM_ERROR;
+   }
+
+   auto result = deflateInit2_(&stream->zstream, level, method, windowBits, memLevel, strategy, version, sizeof(z_stream));
 
+   if (result != Z_OK) {
+      stream->type = StreamType::None;
+      destroyStream(wstrm, stream);
+      return result;
+   }
+
+   copyStreamOut(wstrm, &stream->zstream);
    wstrm->msg = nullptr;
    return result;
 }
@@ -171,53 +426,70 @@ static uint32_t
 zlib125_deflateBound(WZStream *wstrm,
                      uint32_t sourceLen)
 {
-   auto zstrm = getZStream(wstrm);
-   return deflateBound(zstrm, sourceLen);
+   // zlib gives a conservative bound for a stream it does not know
+   auto stream = getStream(wstrm);
+   return static_cast<uint32_t>(deflateBound(stream ? &stream->zstream : nullptr, sourceLen));
 }
 
 static int
 zlib125_deflateReset(WZStream *wstrm)
 {
-   auto zstrm = getZStream(wstrm);
-   return deflateReset(zstrm);
+   auto stream = getStream(wstrm);
+
+   if (!stream) {
+      return Z_STREAM_ERROR;
+   }
+
+   copyStreamIn(&stream->zstream, wstrm);
+   auto result = deflateReset(&stream->zstream);
+   copyStreamOut(wstrm, &stream->zstream);
+   return result;
 }
 
 static int
 zlib125_deflateEnd(WZStream *wstrm)
 {
-   auto zstrm = getZStream(wstrm);
-   return deflateEnd(zstrm);
+   auto stream = getStream(wstrm);
+
+   if (!stream) {
+      return Z_STREAM_ERROR;
+   }
+
+   auto result = deflateEnd(&stream->zstream);
+   stream->type = StreamType::None;
+   destroyStream(wstrm, stream);
+   return result;
 }
 
 static int
 zlib125_inflate(WZStream *wstrm,
                 int32_t flush)
 {
-   auto zstrm = getZStream(wstrm);
-   zstrm->next_in = wstrm->next_in;
-   zstrm->avail_in = wstrm->avail_in;
-   zstrm->total_in = wstrm->total_in;
+   auto stream = getStream(wstrm);
 
-   zstrm->next_out = wstrm->next_out;
-   zstrm->avail_out = wstrm->avail_out;
-   zstrm->total_out = wstrm->total_out;
-
-   zstrm->data_type = wstrm->data_type;
-   zstrm->adler = wstrm->adler;
+   if (!stream) {
+      return Z_STREAM_ERROR;
+   }
 
-   auto result = inflate(zstrm, flush);
+   if (stream->inflateDone) {
+      return Z_STREAM_END;
+   }
 
-   wstrm->next_in = zstrm->next_in;
-   wstrm->avail_in = zstrm->avail_in;
-   wstrm->total_in = zstrm->total_in;
+   // Z_BLOCK and Z_TREES stop at block boundaries, which inflate_buffer
+   //  does not, so leave those to zlib.
+   if (stream->inflateStart && wstrm->avail_in && flush != Z_BLOCK && flush != Z_TREES) {
+      stream->inflateStart = false;
 
-   wstrm->next_out = zstrm->next_out;
-   wstrm->avail_out = zstrm->avail_out;
-   wstrm->total_out = zstrm->total_out;
-
-   wstrm->data_type = zstrm->data_type;
-   wstrm->adler = zstrm->adler;
+      if (inflateWholeStream(wstrm, stream)) {
+         stream->inflateDone = true;
+         return Z_STREAM_END;
+      }
+   }
 
+   auto zstrm = &stream->zstream;
+   copyStreamIn(zstrm, wstrm);
+   auto result = inflate(zstrm, flush);
+   copyStreamOut(wstrm, zstrm);
    return result;
 }
 
@@ -228,9 +500,21 @@ zlib125_inflateInit_(WZStream *wstrm,
 {
    decaf_check(sizeof(WZStream) == stream_size);
 
-   auto zstrm = getZStream(wstrm);
-   auto result = inflateInit_(zstrm, version, sizeof(z_stream));
+   auto stream = createStream(wstrm, StreamType::Inflate);
+
+   if (!stream) {
+      return Z_MEM_ERROR;
+   }
+
+   auto result = inflateInit_(&stream->zstream, version, sizeof(z_stream));
+
+   if (result != Z_OK) {
+      stream->type = StreamType::None;
+      destroyStream(wstrm, stream);
+      return result;
+   }
 
+   copyStreamOut(wstrm, &stream->zstream);
    wstrm->msg = nullptr;
    return result;
 }
@@ -243,9 +527,22 @@ zlib125_inflateInit2_(WZStream *wstrm,
 {
    decaf_check(sizeof(WZStream) == stream_size);
 
-   auto zstrm = getZStream(wstrm);
-   auto result = inflateInit2_(zstrm, windowBits, version, sizeof(z_stream));
+   auto stream = createStream(wstrm, StreamType::Inflate);
 
+   if (!stream) {
+      return Z_MEM_ERROR;
+   }
+
+   auto result = inflateInit2_(&stream->zstream, windowBits, version, sizeof(z_stream));
+
+   if (result != Z_OK) {
+      stream->type = StreamType::None;
+      destroyStream(wstrm, stream);
+      return result;
+   }
+
+   stream->windowBits = windowBits;
+   copyStreamOut(wstrm, &stream->zstream);
    wstrm->msg = nullptr;
    return result;
 }
@@ -253,23 +550,58 @@ zlib125_inflateInit2_(WZStream *wstrm,
 static int
 zlib125_inflateReset(WZStream *wstrm)
 {
-   auto zstrm = getZStream(wstrm);
-   return inflateReset(zstrm);
+   auto stream = getStream(wstrm);
+
+   if (!stream) {
+      return Z_STREAM_ERROR;
+   }
+
+   copyStreamIn(&stream->zstream, wstrm);
+   auto result = inflateReset(&stream->zstream);
+
+   if (result == Z_OK) {
+      stream->inflateStart = true;
+      stream->inflateDone = false;
+   }
+
+   copyStreamOut(wstrm, &stream->zstream);
+   return result;
 }
 
 static int
 zlib125_inflateReset2(WZStream *wstrm, int32_t windowBits)
 {
-   auto zstrm = getZStream(wstrm);
-   return inflateReset2(zstrm, windowBits);
+   auto stream = getStream(wstrm);
+
+   if (!stream) {
+      return Z_STREAM_ERROR;
+   }
+
+   copyStreamIn(&stream->zstream, wstrm);
+   auto result = inflateReset2(&stream->zstream, windowBits);
+
+   if (result == Z_OK) {
+      stream->windowBits = windowBits;
+      stream->inflateStart = true;
+      stream->inflateDone = false;
+   }
+
+   copyStreamOut(wstrm, &stream->zstream);
+   return result;
 }
 
 static int
 zlib125_inflateEnd(WZStream *wstrm)
 {
-   auto zstrm = getZStream(wstrm);
-   auto result = inflateEnd(zstrm);
-   eraseZStream(wstrm);
+   auto stream = getStream(wstrm);
+
+   if (!stream) {
+      return Z_STREAM_ERROR;
+   }
+
+   auto result = inflateEnd(&stream->zstream);
+   stream->type = StreamType::None;
+   destroyStream(wstrm, stream);
    return result;
 }
 
@@ -278,7 +610,12 @@ zlib125_adler32(uint32_t adler,
                 const uint8_t *buf,
                 uint32_t len)
 {
-   return static_cast<uint32_t>(adler32(adler, buf, len));
+   // A null buffer asks for the initial value
+   if (!buf) {
+      return 1;
+   }
+
+   return checksum_adler32(adler, buf, len);
 }
 
 static uint32_t
@@ -286,7 +623,11 @@ zlib125_crc32(uint32_t crc,
               const uint8_t *buf,
               uint32_t len)
 {
-   return static_cast<uint32_t>(crc32(crc, buf, len));
+   if (!buf) {
+      return 0;
+   }
+
+   return checksum_crc32(crc, buf, len);
 }
 
 static int
@@ -313,6 +654,13 @@ zlib125_uncompress(uint8_t *dest,
                    const uint8_t* source,
                    uint32_t sourceLen)
 {
+   auto inflated = InflateResult { };
+
+   if (inflate_buffer(dest, *destLen, source, sourceLen, InflateFormat::Zlib, MAX_WBITS, inflated) == InflateStatus::Success) {
+      *destLen = static_cast<uint32_t>(inflated.outputUsed);
+      return Z_OK;
+   }
+
    unsigned long realDestLen = *destLen;
    auto result = uncompress(dest, &realDestLen, source, sourceLen);
    *destLen = realDestLen;
@@ -0,0 +1,43 @@
+#version 450 core
+#extension GL_ARB_texture_gather : enable
+#define PUSH(stack, stackIndex, activeMask) stack[stackIndex++] = activeMask
+#define POP(stack, stackIndex, activeMask) activeMask = stack[--stackIndex]
+#define Active 0
+#define InactiveBranch 1
+#define InactiveBreak 2
+#define InactiveContinue 3
+
+int activeMask;
+bool predicateRegister;
+int stackIndex;
+int stack[16];
+
+vec4 R[128];
+vec4 PV;
+vec4 PVo;
+float PS;
+float PSo;
+vec4 texTmp;
+ivec4 AR;
+int AL;
+vec4 exp_pixel_0;
+
+activeMask = Active;
+stackIndex = 0;
+// 00 ALU ADDR(2) CNT(9)
+if (activeMask == Active) {
+  // 00 MUL R1.x, (0x40000000, 2), (0x40400000, 3)
+  // 00 MUL R1.y, R0.x, 1.0f
+  // 00 ADD R1.z, R0.y, (0x3DCCCCCD, 0.1)
+  // 00 MOV R1.w, (0x33D6BF95, 1e-07)
+  // 01 ADD R1.x, PV0.x, (0x3F000000, 0.5)
+  // 01 FLOOR R1.w, PV0.z
+  float v3 = R[0].y + 0.1;
+  R[1].x = 6.5;
+  R[1].y = R[0].x;
+  R[1].z = v3;
+  R[1].w = floor(v3);
+}
+// 01 EXP_DONE PIXEL0, R1.xyzw
+exp_pixel_0.xyzw = R[1].xyzw;
+
@@ -0,0 +1,48 @@
+#version 450 core
+#extension GL_ARB_texture_gather : enable
+#define PUSH(stack, stackIndex, activeMask) stack[stackIndex++] = activeMask
+#define POP(stack, stackIndex, activeMask) activeMask = stack[--stackIndex]
+#define Active 0
+#define InactiveBranch 1
+#define InactiveBreak 2
+#define InactiveContinue 3
+
+int activeMask;
+bool predicateRegister;
+int stackIndex;
+int stack[16];
+
+vec4 R[128];
+vec4 PV;
+vec4 PVo;
+float PS;
+float PSo;
+vec4 texTmp;
+ivec4 AR;
+int AL;
+vec4 exp_pixel_0;
+
+activeMask = Active;
+stackIndex = 0;
+// 00 ALU ADDR(2) CNT(8)
+if (activeMask == Active) {
+  // 00 MOV R1.x, R0.x
+  // 00 MOV R1.y, R0.y
+  // 01 MOV R2.x, PV0.x
+  // 01 MOV R2.y, PV0.y
+  // 02 MUL R3.x, R2.x, R1.y
+  // 02 MOV R3.y, R1.x
+  // 02 MOV R3.z, PV1.y
+  // 02 MOV R3.w, 1.0f
+  R[1].x = R[0].x;
+  R[1].y = R[0].y;
+  R[2].x = R[0].x;
+  R[2].y = R[0].y;
+  R[3].x = R[0].x * R[0].y;
+  R[3].y = R[0].x;
+  R[3].z = R[0].y;
+  R[3].w = 1.0;
+}
+// 01 EXP_DONE PIXEL0, R3.xyzw
+exp_pixel_0.xyzw = R[3].xyzw;
+
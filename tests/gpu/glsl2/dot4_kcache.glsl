@@ -0,0 +1,48 @@
+#version 450 core
+#extension GL_ARB_texture_gather : enable
+#define PUSH(stack, stackIndex, activeMask) stack[stackIndex++] = activeMask
+#define POP(stack, stackIndex, activeMask) activeMask = stack[--stackIndex]
+#define Active 0
+#define InactiveBranch 1
+#define InactiveBreak 2
+#define InactiveContinue 3
+
+int activeMask;
+bool predicateRegister;
+int stackIndex;
+int stack[16];
+
+layout (binding = 17) uniform UniformBlock_1 {
+   vec4 values[0];
+} UB_1;
+vec4 R[128];
+vec4 PV;
+vec4 PVo;
+float PS;
+float PSo;
+vec4 texTmp;
+ivec4 AR;
+int AL;
+vec4 exp_pixel_0;
+
+activeMask = Active;
+stackIndex = 0;
+// 00 ALU ADDR(2) CNT(8) KCACHE0(cb1, 0 to 15)
+if (activeMask == Active) {
+  // 00 DOT4 R1.x, R0.x, KCACHE0[0].x
+  // 00 DOT4 ____, R0.y, KCACHE0[0].y
+  // 00 DOT4 ____, R0.z, KCACHE0[0].z
+  // 00 DOT4 ____, R0.w, KCACHE0[0].w
+  // 01 MULADD R1.y, PV0.x, KCACHE0[1].x, KCACHE0[1].y
+  // 01 MAX R1.z, PV0.x, 0.0f CLAMP
+  // 01 CNDGT R1.w, PV0.x, KCACHE0[0].x, KCACHE0[1].y
+  // 02 MUL R1.x, R1.x, KCACHE0[0].x OMOD_M2
+  float v8 = dot(vec4(R[0].x, R[0].y, R[0].z, R[0].w), vec4(UB_1.values[0].x, UB_1.values[0].y, UB_1.values[0].z, UB_1.values[0].w));
+  R[1].x = (v8 * UB_1.values[0].x) * 2.0;
+  R[1].y = v8 * UB_1.values[1].x + UB_1.values[1].y;
+  R[1].z = clamp(max(v8, 0.0), 0.0, 1.0);
+  R[1].w = (v8 > 0.0) ? UB_1.values[0].x : UB_1.values[1].y;
+}
+// 01 EXP_DONE PIXEL0, R1.xyzw
+exp_pixel_0.xyzw = R[1].xyzw;
+
@@ -0,0 +1,45 @@
+#version 450 core
+#extension GL_ARB_texture_gather : enable
+#define PUSH(stack, stackIndex, activeMask) stack[stackIndex++] = activeMask
+#define POP(stack, stackIndex, activeMask) activeMask = stack[--stackIndex]
+#define Active 0
+#define InactiveBranch 1
+#define InactiveBreak 2
+#define InactiveContinue 3
+
+int activeMask;
+bool predicateRegister;
+int stackIndex;
+int stack[16];
+
+vec4 R[128];
+vec4 PV;
+vec4 PVo;
+float PS;
+float PSo;
+vec4 texTmp;
+ivec4 AR;
+int AL;
+vec4 exp_pixel_0;
+
+activeMask = Active;
+stackIndex = 0;
+// 00 ALU ADDR(2) CNT(2)
+if (activeMask == Active) {
+  // 00 KILLGT R0.x, R0.x, 0.0f
+  if (R[0].x > 0.0f) {
+    discard;
+  } else {
+    PVo.x = 0.0f;
+  }
+  // 00 MOV R1.y, R0.y
+  PVo.y = R[0].y;
+  // 00 --
+  R[0].x = PVo.x;
+  R[1].y = PVo.y;
+  PV = PVo;
+
+}
+// 01 EXP_DONE PIXEL0, R0.xyzw
+exp_pixel_0.xyzw = R[0].xyzw;
+
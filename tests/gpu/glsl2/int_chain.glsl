@@ -0,0 +1,57 @@
+#version 450 core
+#extension GL_ARB_texture_gather : enable
+#define PUSH(stack, stackIndex, activeMask) stack[stackIndex++] = activeMask
+#define POP(stack, stackIndex, activeMask) activeMask = stack[--stackIndex]
+#define Active 0
+#define InactiveBranch 1
+#define InactiveBreak 2
+#define InactiveContinue 3
+
+int activeMask;
+bool predicateRegister;
+int stackIndex;
+int stack[16];
+
+vec4 R[128];
+vec4 PV;
+vec4 PVo;
+float PS;
+float PSo;
+vec4 texTmp;
+ivec4 AR;
+int AL;
+vec4 exp_pixel_0;
+
+activeMask = Active;
+stackIndex = 0;
+// 00 ALU ADDR(2) CNT(13)
+if (activeMask == Active) {
+  // 00 FLT_TO_INT R2.x, R0.x SCL_210
+  // 01 ADD_INT R2.y, PS0, (0x00000005, 7e-45)
+  // 01 LSHR_INT R2.z, R2.x, (0x00000003, 4e-45)
+  // 01 AND_INT R2.w, R2.x, (0x000000FF, 3.57e-43)
+  // 02 SUB_INT R2.x, PV1.y, PV1.w
+  // 02 SETGT_INT R2.y, PV1.z, PV1.w
+  // 03 INT_TO_FLT R1.x, PV2.x SCL_210
+  // 03 MOV R1.y, R2.y
+  // 03 CNDGE_INT R1.z, R2.y, (0x3F800000, 1), (0xBF800000, -1)
+  // 04 MOV R1.w, PS3
+  int v1 = int(R[0].x);
+  uint v6 = uint(v1) >> 3;
+  int v10 = v1 & 255;
+  int v12 = (v1 + 5) - v10;
+  int v17 = (int(v6) > v10) ? (-1) : 0;
+  float v18 = intBitsToFloat(v17);
+  float v19 = float(v12);
+  R[1].x = v19;
+  R[1].y = v18;
+  R[1].z = intBitsToFloat((v17 >= 0) ? 1065353216 : (-1082130432));
+  R[1].w = v19;
+  R[2].x = intBitsToFloat(v12);
+  R[2].y = v18;
+  R[2].z = uintBitsToFloat(v6);
+  R[2].w = intBitsToFloat(v10);
+}
+// 01 EXP_DONE PIXEL0, R1.xyzw
+exp_pixel_0.xyzw = R[1].xyzw;
+
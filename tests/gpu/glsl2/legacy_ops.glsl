@@ -0,0 +1,51 @@
+#version 450 core
+#extension GL_ARB_texture_gather : enable
+#define PUSH(stack, stackIndex, activeMask) stack[stackIndex++] = activeMask
+#define POP(stack, stackIndex, activeMask) activeMask = stack[--stackIndex]
+#define Active 0
+#define InactiveBranch 1
+#define InactiveBreak 2
+#define InactiveContinue 3
+
+int activeMask;
+bool predicateRegister;
+int stackIndex;
+int stack[16];
+
+vec4 R[128];
+vec4 PV;
+vec4 PVo;
+float PS;
+float PSo;
+vec4 texTmp;
+ivec4 AR;
+int AL;
+vec4 exp_pixel_0;
+
+activeMask = Active;
+stackIndex = 0;
+// 00 ALU ADDR(2) CNT(4)
+if (activeMask == Active) {
+  // 00 MIN_DX10 R1.x, R0.x, R0.y
+  PVo.x = min(R[0].x, R[0].y);
+  // 00 LSHR_INT R1.y, R0.z, R0.w
+  PVo.y = intBitsToFloat(int(uint(floatBitsToInt(R[0].z)) >> floatBitsToInt(R[0].w)));
+  // 00 UINT_TO_FLT R1.z, R0.x SCL_210
+  PSo   = float(floatBitsToUint(R[0].x));
+  // 00 --
+  R[1].x = PVo.x;
+  R[1].y = PVo.y;
+  R[1].z = PSo;
+  PV = PVo;
+  PS = PSo;
+
+  // 01 ASHR_INT R1.w, R0.z, R0.w
+  PVo.w = intBitsToFloat(floatBitsToInt(R[0].z) >> floatBitsToInt(R[0].w));
+  // 01 --
+  R[1].w = PVo.w;
+  PV = PVo;
+
+}
+// 01 EXP_DONE PIXEL0, R1.xyzw
+exp_pixel_0.xyzw = R[1].xyzw;
+
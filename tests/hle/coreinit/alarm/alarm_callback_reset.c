@@ -0,0 +1,63 @@
+#include <hle_test.h>
+#include <coreinit/alarm.h>
+#include <coreinit/systeminfo.h>
+#include <coreinit/time.h>
+
+OSAlarm sFirstAlarm;
+OSAlarm sSecondAlarm;
+
+int sFirstFiredCount = 0;
+int sSecondFiredCount = 0;
+OSTime sSecondResetTime = 0;
+
+void
+SecondAlarmCallback(OSAlarm *alarm, OSContext *context)
+{
+   test_assert(alarm == &sSecondAlarm);
+   test_report("SecondAlarmCallback called.");
+   sSecondFiredCount++;
+
+   // Must only fire for the time it was set to from FirstAlarmCallback
+   test_assert(OSGetTime() >= sSecondResetTime + OSMilliseconds(20));
+}
+
+void
+FirstAlarmCallback(OSAlarm *alarm, OSContext *context)
+{
+   test_assert(alarm == &sFirstAlarm);
+   test_report("FirstAlarmCallback called.");
+   sFirstFiredCount++;
+
+   if (sFirstFiredCount == 1) {
+      // The second alarm is due just after this one, so it has usually
+      //  expired in the same interrupt, cancel it and set it again.
+      OSCancelAlarm(&sSecondAlarm);
+      sSecondResetTime = OSGetTime();
+      OSSetAlarm(&sSecondAlarm, OSMilliseconds(20), &SecondAlarmCallback);
+
+      // Set this alarm again from inside its own callback
+      OSSetAlarm(&sFirstAlarm, OSMilliseconds(10), &FirstAlarmCallback);
+   }
+}
+
+int main(int argc, char **argv)
+{
+   OSTime start = OSGetTime() + OSMilliseconds(10);
+
+   OSCreateAlarmEx(&sFirstAlarm, "FirstAlarm");
+   OSCreateAlarmEx(&sSecondAlarm, "SecondAlarm");
+   OSSetPeriodicAlarm(&sFirstAlarm, start, 0, &FirstAlarmCallback);
+   OSSetPeriodicAlarm(&sSecondAlarm, start + 1, 0, &SecondAlarmCallback);
+
+   // Wait for 100ms to allow both alarms to fire again.
+   OSAlarm alarm;
+   OSCreateAlarmEx(&alarm, "TestAlarm");
+   OSSetAlarm(&alarm, OSMilliseconds(100), NULL);
+   OSWaitAlarm(&alarm);
+
+   test_report("First alarm fired count: %d", sFirstFiredCount);
+   test_report("Second alarm fired count: %d", sSecondFiredCount);
+   test_assert(sFirstFiredCount == 2);
+   test_assert(sSecondFiredCount == 1);
+   return 0;
+}
@@ -0,0 +1,186 @@
+#include "filesystem/filesystem_host_filehandle.h"
+#include "filesystem/filesystem_host_preadfilehandle.h"
+#include <algorithm>
+#include <chrono>
+#include <excmd.h>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+struct BenchmarkOptions
+{
+   std::string path;
+   size_t blockSize;
+   unsigned passes;
+   bool random;
+   bool dropCache;
+};
+
+/**
+ * Ask the kernel to drop its cached pages for the file, so each pass reads
+ * from the disk rather than the page cache.
+ */
+static void
+dropFileCache(const std::string &path)
+{
+#ifdef POSIX_FADV_DONTNEED
+   auto fd = open(path.c_str(), O_RDONLY);
+
+   if (fd >= 0) {
+      fdatasync(fd);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+   }
+#endif
+}
+
+/**
+ * Read the whole file through a handle in the same way FSADevice::readFile
+ * does, a seek followed by a read for every block.
+ *
+ * \return
+ * Returns the number of bytes read per second.
+ */
+static double
+benchmarkHandle(fs::IFileHandle *handle,
+                const BenchmarkOptions &options)
+{
+   auto fileSize = handle->size();
+   auto blockCount = (fileSize + options.blockSize - 1) / options.blockSize;
+   auto buffer = std::vector<uint8_t>(options.blockSize);
+   auto order = std::vector<size_t>(blockCount);
+
+   for (auto i = 0u; i < blockCount; ++i) {
+      order[i] = i;
+   }
+
+   if (options.random) {
+      std::mt19937 rng { 0x5EED };
+      std::shuffle(order.begin(), order.end(), rng);
+   }
+
+   auto start = std::chrono::steady_clock::now();
+   auto bytesRead = size_t { 0 };
+
+   for (auto block : order) {
+      handle->seek(block * options.blockSize);
+      bytesRead += handle->read(buffer.data(), 1, buffer.size());
+   }
+
+   auto end = std::chrono::steady_clock::now();
+   auto seconds = std::chrono::duration<double>(end - start).count();
+
+   if (bytesRead != fileSize) {
+      std::cout << "Warning: read " << bytesRead << " of " << fileSize << " bytes" << std::endl;
+   }
+
+   return static_cast<double>(bytesRead) / seconds;
+}
+
+template<typename HandleType, typename... HandleArgs>
+static bool
+runBenchmark(const char *name,
+             const BenchmarkOptions &options,
+             HandleArgs... handleArgs)
+{
+   auto total = 0.0;
+
+   for (auto pass = 0u; pass < options.passes; ++pass) {
+      if (options.dropCache) {
+         dropFileCache(options.path);
+      }
+
+      auto handle = std::make_unique<HandleType>(options.path, fs::File::Read, handleArgs...);
+
+      if (!handle->open()) {
+         std::cout << "Failed to open " << options.path << std::endl;
+         return false;
+      }
+
+      total += benchmarkHandle(handle.get(), options);
+   }
+
+   auto mbPerSecond = (total / options.passes) / (1024.0 * 1024.0);
+   std::cout << std::left << std::setw(24) << name
+             << std::fixed << std::setprecision(1) << mbPerSecond << " MB/s" << std::endl;
+   return true;
+}
+
+int main(int argc, char **argv)
+{
+   excmd::parser parser;
+   excmd::option_state options;
+   using excmd::description;
+   using excmd::default_value;
+   using excmd::value;
+
+   gLog = spdlog::stdout_logger_st("fs-benchmark");
+
+   parser.global_options()
+      .add_option("h,help",
+                  description { "Show the help." })
+      .add_option("block-size",
+                  description { "Size of each read in KiB." },
+                  default_value<uint32_t> { 1024 })
+      .add_option("passes",
+                  description { "Number of times to read the file with each handle." },
+                  default_value<uint32_t> { 3 })
+      .add_option("random",
+                  description { "Read blocks in a random order instead of sequentially." })
+      .add_option("drop-cache",
+                  description { "Drop the file from the host page cache before each pass." });
+
+   parser.add_command("run")
+      .add_argument("file", value<std::string> { });
+
+   try {
+      options = parser.parse(argc, argv);
+   } catch (excmd::exception ex) {
+      std::cout << "Error parsing command line: " << ex.what() << std::endl;
+      std::exit(-1);
+   }
+
+   if (argc == 1 || options.has("help") || !options.has("run")) {
+      std::cout << parser.format_help("fs-benchmark") << std::endl;
+      std::exit(0);
+   }
+
+   auto benchmarkOptions = BenchmarkOptions { };
+   benchmarkOptions.path = options.get<std::string>("file");
+   benchmarkOptions.blockSize = options.get<uint32_t>("block-size") * 1024;
+   benchmarkOptions.passes = std::max(1u, options.get<uint32_t>("passes"));
+   benchmarkOptions.random = options.has("random");
+   benchmarkOptions.dropCache = options.has("drop-cache");
+
+   if (!benchmarkOptions.blockSize) {
+      std::cout << "Block size must not be zero" << std::endl;
+      return -1;
+   }
+
+   std::cout << "Reading " << benchmarkOptions.path
+             << (benchmarkOptions.random ? " randomly" : " sequentially")
+             << " in " << (benchmarkOptions.blockSize / 1024) << " KiB blocks" << std::endl;
+
+   if (!runBenchmark<fs::HostFileHandle>("HostFileHandle", benchmarkOptions)) {
+      return -1;
+   }
+
+   if (!runBenchmark<fs::HostPreadFileHandle>("HostPreadFileHandle", benchmarkOptions, false)) {
+      return -1;
+   }
+
+   if (!runBenchmark<fs::HostPreadFileHandle>("HostPreadFileHandle mmap", benchmarkOptions, true)) {
+      return -1;
+   }
+
+   return 0;
+}
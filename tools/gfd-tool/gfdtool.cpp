@@ -1,9 +1,16 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
 #include <excmd.h>
 #include <fstream>
 #include <gsl.h>
 #include <iostream>
 #include <spdlog/spdlog.h>
+#include <thread>
+#include <common/platform.h>
+#include <common/platform_dir.h>
 #include <common/teenyheap.h>
 #include "libcpu/mem.h"
 #include "gpu/gfd.h"
@@ -1074,6 +1081,302 @@ convertTexture(const std::string &path)
    return true;
 }
 
+#ifdef PLATFORM_WINDOWS
+static const auto NullDevice = "NUL";
+#else
+static const auto NullDevice = "/dev/null";
+#endif
+
+struct BatchShader
+{
+   std::string filename;
+   uint32_t index;
+   glsl2::Shader::Type type;
+   bool uniformBlocks;
+   std::array<latte::SQ_TEX_DIM, 16> samplerDim;
+   gsl::span<uint8_t> program;
+
+   // Results
+   bool translated = false;
+   bool validated = false;
+   std::string error;
+   std::chrono::nanoseconds duration;
+   size_t outputSize = 0;
+};
+
+struct BatchOptions
+{
+   std::string directory;
+   std::string validator;
+   std::string output;
+   unsigned threads;
+   bool optimise;
+};
+
+template<typename Type>
+static void
+setBatchShaderInputs(BatchShader &batch,
+                     Type *header)
+{
+   batch.uniformBlocks = (header->mode == gx2::GX2ShaderMode::UniformBlock);
+   batch.samplerDim.fill(latte::SQ_TEX_DIM::DIM_2D);
+
+   for (auto i = 0u; i < header->samplerVarCount; ++i) {
+      auto &var = header->samplerVars[i];
+
+      if (var.location >= batch.samplerDim.size()) {
+         continue;
+      }
+
+      switch (var.type) {
+      case gx2::GX2SamplerVarType::Sampler1D:
+         batch.samplerDim[var.location] = latte::SQ_TEX_DIM::DIM_1D;
+         break;
+      case gx2::GX2SamplerVarType::Sampler3D:
+         batch.samplerDim[var.location] = latte::SQ_TEX_DIM::DIM_3D;
+         break;
+      case gx2::GX2SamplerVarType::SamplerCube:
+         batch.samplerDim[var.location] = latte::SQ_TEX_DIM::DIM_CUBEMAP;
+         break;
+      default:
+         break;
+      }
+   }
+}
+
+/**
+ * Collect the vertex and pixel shader programs from a gsh file, geometry
+ * shaders are skipped as the GL backend does not translate them with glsl2.
+ */
+static bool
+readBatchShaders(const std::string &path,
+                 HeapData &fileData,
+                 std::vector<BatchShader> &shaders)
+{
+   gfd::Reader reader;
+   std::ifstream file(path, std::ifstream::binary | std::ifstream::in);
+   std::map<uint32_t, BatchShader> vertexShaders;
+   std::map<uint32_t, BatchShader> pixelShaders;
+
+   if (!file.is_open()) {
+      return false;
+   }
+
+   file.seekg(0, std::ifstream::end);
+   auto fileSize = static_cast<size_t>(file.tellg());
+   file.seekg(0, std::ifstream::beg);
+
+   fileData = heapAllocate(fileSize);
+   file.read(reinterpret_cast<char*>(fileData.data), fileData.size);
+
+   if (!reader.parse(fileData.data, fileData.size)) {
+      return false;
+   }
+
+   for (auto &block : reader.blocks) {
+      auto index = static_cast<uint32_t>(block.header->index);
+
+      switch (block.header->type) {
+      case gfd::BlockType::VertexShaderHeader:
+         setBatchShaderInputs(vertexShaders[index], reinterpret_cast<gx2::GX2VertexShader *>(block.data));
+         break;
+      case gfd::BlockType::VertexShaderProgram:
+         vertexShaders[index].program = gsl::make_span(block.data, block.header->dataSize);
+         break;
+      case gfd::BlockType::PixelShaderHeader:
+         setBatchShaderInputs(pixelShaders[index], reinterpret_cast<gx2::GX2PixelShader *>(block.data));
+         break;
+      case gfd::BlockType::PixelShaderProgram:
+         pixelShaders[index].program = gsl::make_span(block.data, block.header->dataSize);
+         break;
+      default:
+         break;
+      }
+   }
+
+   for (auto &pair : vertexShaders) {
+      pair.second.filename = getFilename(path);
+      pair.second.index = pair.first;
+      pair.second.type = glsl2::Shader::VertexShader;
+      shaders.push_back(pair.second);
+   }
+
+   for (auto &pair : pixelShaders) {
+      pair.second.filename = getFilename(path);
+      pair.second.index = pair.first;
+      pair.second.type = glsl2::Shader::PixelShader;
+      shaders.push_back(pair.second);
+   }
+
+   return true;
+}
+
+/**
+ * Run an external glslangValidator over a translated shader, the translated
+ * code is wrapped in main() the same way the GL backend does it.
+ */
+static bool
+validateBatchShader(const BatchOptions &options,
+                    const BatchShader &batch,
+                    const glsl2::Shader &shader,
+                    unsigned thread)
+{
+   auto extension = (batch.type == glsl2::Shader::VertexShader) ? "vert" : "frag";
+   auto directory = options.output.empty() ? std::string { "." } : options.output;
+   auto path = fmt::format("{}/{}.{}.{}", directory, batch.filename, batch.index, extension);
+
+   if (options.output.empty()) {
+      path = fmt::format("gfdtool_validate_{}.{}", thread, extension);
+   }
+
+   {
+      std::ofstream file { path, std::ofstream::out | std::ofstream::binary };
+      file << shader.fileHeader
+           << "void main()\n"
+           << "{\n"
+           << shader.codeHeader
+           << '\n' << shader.codeBody << '\n'
+           << "}\n";
+   }
+
+   auto command = fmt::format("\"{}\" \"{}\" > {} 2>&1", options.validator, path, NullDevice);
+   auto result = std::system(command.c_str());
+
+   if (options.output.empty()) {
+      std::remove(path.c_str());
+   }
+
+   return result == 0;
+}
+
+static void
+translateBatchShader(const BatchOptions &options,
+                     BatchShader &batch,
+                     unsigned thread)
+{
+   glsl2::Shader shader;
+   shader.type = batch.type;
+   shader.samplerDim = batch.samplerDim;
+   shader.uniformBlocksEnabled = batch.uniformBlocks;
+   shader.uniformRegistersEnabled = !batch.uniformBlocks;
+   shader.optimiseAluClauses = options.optimise;
+   shader.abortOnError = false;
+
+   auto start = std::chrono::steady_clock::now();
+   batch.translated = glsl2::translate(shader, batch.program);
+   batch.duration = std::chrono::steady_clock::now() - start;
+
+   if (!batch.translated) {
+      batch.error = shader.error;
+      return;
+   }
+
+   batch.outputSize = shader.fileHeader.size() + shader.codeHeader.size() + shader.codeBody.size();
+
+   if (!options.validator.empty()) {
+      batch.validated = validateBatchShader(options, batch, shader, thread);
+   } else if (!options.output.empty()) {
+      auto extension = (batch.type == glsl2::Shader::VertexShader) ? "vert" : "frag";
+      std::ofstream file { fmt::format("{}/{}.{}.{}", options.output, batch.filename, batch.index, extension) };
+      file << shader.fileHeader << shader.codeHeader << shader.codeBody;
+   }
+}
+
+/**
+ * Translate every shader in a directory of gsh files across a pool of
+ * threads, then report the time and output size of each.
+ */
+static bool
+translateBatch(const BatchOptions &options)
+{
+   std::vector<std::string> names;
+   std::vector<HeapData> files;
+   std::vector<BatchShader> shaders;
+   auto unreadable = 0u;
+
+   if (!platform::listDirectory(options.directory, names)) {
+      std::cout << "Could not open directory " << options.directory << std::endl;
+      return false;
+   }
+
+   std::sort(names.begin(), names.end());
+
+   // The heap is not thread safe so all files are read up front
+   for (auto &name : names) {
+      if (getExtension(name) != ".gsh") {
+         continue;
+      }
+
+      files.emplace_back();
+
+      if (!readBatchShaders(options.directory + "/" + name, files.back(), shaders)) {
+         std::cout << "Could not read " << name << std::endl;
+         unreadable++;
+      }
+   }
+
+   if (!options.output.empty()) {
+      platform::createDirectory(options.output);
+   }
+
+   std::atomic<size_t> next { 0 };
+   auto threads = std::vector<std::thread> { };
+   auto start = std::chrono::steady_clock::now();
+
+   for (auto i = 0u; i < options.threads; ++i) {
+      threads.emplace_back([&options, &shaders, &next, i]() {
+         for (auto index = next++; index < shaders.size(); index = next++) {
+            translateBatchShader(options, shaders[index], i);
+         }
+      });
+   }
+
+   for (auto &thread : threads) {
+      thread.join();
+   }
+
+   auto wallTime = std::chrono::steady_clock::now() - start;
+   auto totalTime = std::chrono::nanoseconds { 0 };
+   auto totalSize = size_t { 0 };
+   auto failed = 0u;
+   auto invalid = 0u;
+
+   for (auto &batch : shaders) {
+      auto type = (batch.type == glsl2::Shader::VertexShader) ? "vertex" : "pixel";
+      auto micros = std::chrono::duration_cast<std::chrono::microseconds>(batch.duration).count();
+
+      totalTime += batch.duration;
+      totalSize += batch.outputSize;
+
+      if (!batch.translated) {
+         failed++;
+         std::cout << fmt::format("{} {}[{}] FAILED {}us: {}", batch.filename, type, batch.index, micros, batch.error) << std::endl;
+         continue;
+      }
+
+      auto status = std::string { "ok" };
+
+      if (!options.validator.empty() && !batch.validated) {
+         invalid++;
+         status = "INVALID";
+      }
+
+      std::cout << fmt::format("{} {}[{}] {} {}us {} bytes", batch.filename, type, batch.index, status, micros, batch.outputSize) << std::endl;
+   }
+
+   auto totalMs = std::chrono::duration_cast<std::chrono::milliseconds>(totalTime).count();
+   auto wallMs = std::chrono::duration_cast<std::chrono::milliseconds>(wallTime).count();
+   auto wallSeconds = std::chrono::duration_cast<std::chrono::duration<double>>(wallTime).count();
+
+   std::cout << std::endl;
+   std::cout << fmt::format("{} shaders from {} files on {} threads", shaders.size(), files.size(), options.threads) << std::endl;
+   std::cout << fmt::format("{} failed to translate, {} failed validation, {} files unreadable", failed, invalid, unreadable) << std::endl;
+   std::cout << fmt::format("{} ms translating, {} ms wall, {:.1f} shaders/s, {} KiB of GLSL", totalMs, wallMs,
+                            wallSeconds > 0 ? shaders.size() / wallSeconds : 0.0, totalSize / 1024) << std::endl;
+
+   return !failed && !invalid && !unreadable;
+}
+
 int main(int argc, char **argv)
 {
    int result = -1;
@@ -1093,6 +1396,20 @@ int main(int argc, char **argv)
    parser.add_command("info")
       .add_argument("file in", excmd::value<std::string> { });
 
+   parser.add_command("batch")
+      .add_option("threads",
+                  excmd::description { "Number of translation threads, 0 for one per core." },
+                  excmd::default_value<unsigned> { 0 })
+      .add_option("validate",
+                  excmd::description { "Path to glslangValidator to check each translated shader with." },
+                  excmd::value<std::string> { })
+      .add_option("output",
+                  excmd::description { "Directory to write the translated shaders to." },
+                  excmd::value<std::string> { })
+      .add_option("no-optimise",
+                  excmd::description { "Translate ALU clauses group by group without the clause optimiser." })
+      .add_argument("directory", excmd::value<std::string> { });
+
    // TODO: Fix texture convert
    //parser.add_command("convert")
    //   .add_argument("src", excmd::value<std::string> { });
@@ -1119,6 +1436,25 @@ int main(int argc, char **argv)
    if (options.has("info")) {
       auto in = options.get<std::string>("file in");
       result = printInfo(in) ? 0 : -1;
+   } else if (options.has("batch")) {
+      auto batchOptions = BatchOptions { };
+      batchOptions.directory = options.get<std::string>("directory");
+      batchOptions.threads = options.get<unsigned>("threads");
+      batchOptions.optimise = !options.has("no-optimise");
+
+      if (options.has("validate")) {
+         batchOptions.validator = options.get<std::string>("validate");
+      }
+
+      if (options.has("output")) {
+         batchOptions.output = options.get<std::string>("output");
+      }
+
+      if (!batchOptions.threads) {
+         batchOptions.threads = std::max(1u, std::thread::hardware_concurrency());
+      }
+
+      result = translateBatch(batchOptions) ? 0 : -1;
    } else if (options.has("convert")) {
       auto src = options.get<std::string>("src");
       result = convertTexture(src) ? 0 : -1;
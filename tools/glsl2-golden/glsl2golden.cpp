@@ -0,0 +1,308 @@
+#include <cmath>
+#include <cstring>
+#include <excmd.h>
+#include <fstream>
+#include <gsl.h>
+#include <iostream>
+#include <sstream>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+#include "gpu/glsl2/glsl2_ir.h"
+#include "gpu/glsl2/glsl2_translate.h"
+#include "gpu/microcode/latte_instructions.h"
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+struct CorpusShader
+{
+   glsl2::Shader::Type type = glsl2::Shader::PixelShader;
+   bool optimise = true;
+   std::vector<uint32_t> binary;
+};
+
+static bool
+readFile(const std::string &path,
+         std::string &text)
+{
+   std::ifstream file { path, std::ifstream::in | std::ifstream::binary };
+
+   if (!file.is_open()) {
+      return false;
+   }
+
+   std::stringstream stream;
+   stream << file.rdbuf();
+   text = stream.str();
+   return true;
+}
+
+/**
+ * Parse a .latte corpus file, this is a list of hex dwords with # comments,
+ * an optional "type vertex|pixel|geometry" line and an optional "optimise off"
+ * line to translate with the per group translator only.
+ */
+static bool
+parseShader(const std::string &path,
+            CorpusShader &shader)
+{
+   std::ifstream file { path };
+   std::string line;
+
+   if (!file.is_open()) {
+      std::cout << "Could not open " << path << std::endl;
+      return false;
+   }
+
+   while (std::getline(file, line)) {
+      auto comment = line.find('#');
+
+      if (comment != std::string::npos) {
+         line.erase(comment);
+      }
+
+      std::istringstream words { line };
+      std::string word;
+
+      while (words >> word) {
+         if (word == "type") {
+            words >> word;
+
+            if (word == "vertex") {
+               shader.type = glsl2::Shader::VertexShader;
+            } else if (word == "pixel") {
+               shader.type = glsl2::Shader::PixelShader;
+            } else if (word == "geometry") {
+               shader.type = glsl2::Shader::GeometryShader;
+            } else {
+               std::cout << path << ": unknown shader type " << word << std::endl;
+               return false;
+            }
+
+            continue;
+         }
+
+         if (word == "optimise") {
+            words >> word;
+            shader.optimise = (word != "off");
+            continue;
+         }
+
+         try {
+            shader.binary.push_back(static_cast<uint32_t>(std::stoul(word, nullptr, 16)));
+         } catch (std::exception &) {
+            std::cout << path << ": invalid dword " << word << std::endl;
+            return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+static std::string
+translateShader(const CorpusShader &corpus)
+{
+   auto shader = glsl2::Shader { };
+   shader.type = corpus.type;
+   shader.samplerDim.fill(latte::SQ_TEX_DIM::DIM_2D);
+   shader.uniformBlocksEnabled = true;
+   shader.optimiseAluClauses = corpus.optimise;
+
+   auto binary = gsl::make_span(reinterpret_cast<const uint8_t *>(corpus.binary.data()), corpus.binary.size() * sizeof(uint32_t));
+   glsl2::translate(shader, binary);
+   return shader.fileHeader + shader.codeHeader + shader.codeBody;
+}
+
+/**
+ * Deterministic value for a load, mostly small floats so compares and
+ * conditional moves take both paths, with some raw bit patterns.
+ */
+static uint32_t
+getLoadValue(const glsl2::ir::Value &load,
+             uint32_t seed)
+{
+   auto hash = seed * 0x9E3779B9u;
+   hash ^= static_cast<uint32_t>(load.op) * 0x85EBCA6Bu;
+   hash ^= (load.index + 1) * 0xC2B2AE35u;
+   hash ^= (load.bank + 1) * 0x27D4EB2Fu;
+   hash ^= (static_cast<uint32_t>(load.channel) + 1) * 0x165667B1u;
+   hash ^= hash >> 15;
+   hash *= 0x2C1B3C6Du;
+   hash ^= hash >> 12;
+
+   if ((hash & 7) == 0) {
+      return hash;
+   } else if ((hash & 7) == 1) {
+      return hash & 0xFF;
+   }
+
+   auto value = static_cast<float>(static_cast<int32_t>(hash >> 8) % 33 - 16) * 0.25f;
+   auto bits = uint32_t { 0 };
+   std::memcpy(&bits, &value, sizeof(bits));
+   return bits;
+}
+
+static bool
+isSameResult(uint32_t a,
+             uint32_t b)
+{
+   auto fa = 0.0f;
+   auto fb = 0.0f;
+   std::memcpy(&fa, &a, sizeof(fa));
+   std::memcpy(&fb, &b, sizeof(fb));
+   return a == b || (std::isnan(fa) && std::isnan(fb));
+}
+
+/**
+ * Check that optimising each ALU clause does not change the values it
+ * writes to registers.
+ */
+static bool
+checkClauses(const std::string &name,
+             const CorpusShader &corpus)
+{
+   using namespace latte;
+   auto binary = gsl::make_span(reinterpret_cast<const uint8_t *>(corpus.binary.data()), corpus.binary.size() * sizeof(uint32_t));
+   auto result = true;
+
+   for (auto i = 0u; i + sizeof(ControlFlowInst) <= binary.size(); i += sizeof(ControlFlowInst)) {
+      auto cf = *reinterpret_cast<const ControlFlowInst *>(binary.data() + i);
+      auto type = cf.word1.CF_INST_TYPE();
+
+      if (type == SQ_CF_INST_TYPE_ALU || type == SQ_CF_INST_TYPE_ALU_EXTENDED) {
+         auto reference = glsl2::ir::Clause { };
+         auto optimised = glsl2::ir::Clause { };
+
+         if (!glsl2::ir::buildAluClause(binary, cf, reference)) {
+            continue;
+         }
+
+         glsl2::ir::buildAluClause(binary, cf, optimised);
+         glsl2::ir::optimise(optimised);
+
+         for (auto seed = 0u; seed < 16; ++seed) {
+            auto load = [seed](const glsl2::ir::Value &value) { return getLoadValue(value, seed); };
+            auto expected = glsl2::ir::evaluateClause(reference, load);
+            auto actual = glsl2::ir::evaluateClause(optimised, load);
+
+            for (auto &write : expected) {
+               auto itr = actual.find(write.first);
+               auto value = write.second;
+
+               if (itr != actual.end()) {
+                  value = itr->second;
+               } else {
+                  // Stores of the value already in the register are removed
+                  auto unchanged = glsl2::ir::Value { glsl2::ir::Opcode::LoadRegister, glsl2::ir::Type::Float };
+                  unchanged.index = write.first.first;
+                  unchanged.channel = write.first.second;
+                  value = load(unchanged);
+               }
+
+               if (!isSameResult(value, write.second)) {
+                  std::cout << name << ": clause at CF " << (i / sizeof(ControlFlowInst))
+                            << " writes R[" << write.first.first << "]." << "xyzw"[write.first.second]
+                            << " = 0x" << std::hex << value << " instead of 0x" << write.second << std::dec
+                            << " with seed " << seed << std::endl;
+                  result = false;
+               }
+            }
+         }
+      }
+
+      if (type == SQ_CF_INST_TYPE_NORMAL || type == SQ_CF_INST_TYPE_EXPORT) {
+         if (cf.word1.END_OF_PROGRAM()) {
+            break;
+         }
+      }
+   }
+
+   return result;
+}
+
+static bool
+checkShader(const std::string &corpus,
+            const std::string &name,
+            bool update)
+{
+   auto shader = CorpusShader { };
+   auto glslPath = corpus + "/" + name + ".glsl";
+   auto expected = std::string { };
+
+   if (!parseShader(corpus + "/" + name + ".latte", shader)) {
+      return false;
+   }
+
+   auto result = checkClauses(name, shader);
+   auto glsl = translateShader(shader);
+
+   if (update) {
+      std::ofstream file { glslPath, std::ofstream::out | std::ofstream::binary };
+      file << glsl;
+   } else if (!readFile(glslPath, expected)) {
+      std::cout << name << ": missing " << glslPath << ", run with --update to create it" << std::endl;
+      result = false;
+   } else if (expected != glsl) {
+      std::cout << name << ": translation does not match " << glslPath << std::endl;
+      std::cout << glsl << std::endl;
+      result = false;
+   }
+
+   return result;
+}
+
+int main(int argc, char **argv)
+{
+   excmd::parser parser;
+   excmd::option_state options;
+   using excmd::description;
+   using excmd::default_value;
+
+   gLog = spdlog::stdout_logger_st("glsl2-golden");
+
+   parser.global_options()
+      .add_option("h,help",
+                  description { "Show the help." })
+      .add_option("corpus",
+                  description { "Directory containing corpus.txt and the shaders it lists." },
+                  default_value<std::string> { "tests/gpu/glsl2" })
+      .add_option("update",
+                  description { "Write the current translations as the expected output." });
+
+   try {
+      options = parser.parse(argc, argv);
+   } catch (excmd::exception ex) {
+      std::cout << "Error parsing command line: " << ex.what() << std::endl;
+      std::exit(-1);
+   }
+
+   if (options.has("help")) {
+      std::cout << parser.format_help("glsl2-golden") << std::endl;
+      std::exit(0);
+   }
+
+   auto corpus = options.get<std::string>("corpus");
+   auto update = options.has("update");
+   std::ifstream list { corpus + "/corpus.txt" };
+   std::string name;
+   auto passed = 0u;
+   auto failed = 0u;
+
+   if (!list.is_open()) {
+      std::cout << "Could not open " << corpus << "/corpus.txt" << std::endl;
+      return -1;
+   }
+
+   while (list >> name) {
+      if (checkShader(corpus, name, update)) {
+         passed++;
+      } else {
+         failed++;
+      }
+   }
+
+   std::cout << passed << " passed, " << failed << " failed" << std::endl;
+   return failed ? -1 : 0;
+}
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <common/byte_swap.h>
+#include <common/byte_swap_array.h>
+#include <excmd.h>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <vector>
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+template<typename Type>
+static void
+referenceSwap(Type *dst,
+              const Type *src,
+              size_t count)
+{
+   for (auto i = 0u; i < count; ++i) {
+      dst[i] = byte_swap(src[i]);
+   }
+}
+
+template<typename Type>
+static void
+referenceExpand(Type *dst,
+                const Type *src,
+                size_t quadCount,
+                bool isRects,
+                bool swap)
+{
+   static const unsigned quadCorners[] = { 0, 1, 2, 0, 2, 3 };
+   static const unsigned rectCorners[] = { 0, 1, 2, 2, 1, 3 };
+   auto corners = isRects ? rectCorners : quadCorners;
+
+   for (auto i = 0u; i < quadCount; ++i) {
+      for (auto j = 0u; j < 6; ++j) {
+         auto index = src[i * 4 + corners[j]];
+         dst[i * 6 + j] = swap ? byte_swap(index) : index;
+      }
+   }
+}
+
+template<typename Type>
+static std::vector<Type>
+randomIndices(size_t count,
+              std::mt19937 &rng)
+{
+   auto indices = std::vector<Type>(count);
+
+   for (auto &index : indices) {
+      index = static_cast<Type>(rng());
+   }
+
+   return indices;
+}
+
+/**
+ * Compare the kernels against a scalar reference for every length up to
+ * maxCount, at every source alignment, with guard values after the output
+ * to catch overruns.
+ */
+template<typename Type>
+static bool
+verify(size_t maxCount)
+{
+   static const auto Guard = static_cast<Type>(0xCDCDCDCD);
+   std::mt19937 rng { 0x5EED };
+   auto failed = 0u;
+
+   for (auto count = size_t { 0 }; count <= maxCount; ++count) {
+      for (auto misalign = 0u; misalign < 4; ++misalign) {
+         auto src = randomIndices<Type>(count + misalign, rng);
+         auto srcPtr = src.data() + misalign;
+
+         // byte_swap_array
+         auto expected = std::vector<Type>(count);
+         auto actual = std::vector<Type>(count + 16, Guard);
+         referenceSwap(expected.data(), srcPtr, count);
+         byte_swap_array(actual.data(), srcPtr, count);
+
+         if (!std::equal(expected.begin(), expected.end(), actual.begin())
+          || std::any_of(actual.begin() + count, actual.end(), [](Type value) { return value != Guard; })) {
+            std::cout << "byte_swap_array mismatch, " << sizeof(Type) * 8 << " bit, count " << count << std::endl;
+            ++failed;
+         }
+
+         // byte_swap_array in place
+         auto inPlace = std::vector<Type>(srcPtr, srcPtr + count);
+         byte_swap_array(inPlace.data(), inPlace.data(), count);
+
+         if (inPlace != expected) {
+            std::cout << "byte_swap_array in place mismatch, " << sizeof(Type) * 8 << " bit, count " << count << std::endl;
+            ++failed;
+         }
+
+         // expand_quad_list
+         auto quadCount = count / 4;
+
+         for (auto isRects : { false, true }) {
+            for (auto swap : { false, true }) {
+               auto expectedQuads = std::vector<Type>(quadCount * 6);
+               auto actualQuads = std::vector<Type>(quadCount * 6 + 16, Guard);
+               referenceExpand(expectedQuads.data(), srcPtr, quadCount, isRects, swap);
+               expand_quad_list(actualQuads.data(), srcPtr, quadCount, isRects, swap);
+
+               if (!std::equal(expectedQuads.begin(), expectedQuads.end(), actualQuads.begin())
+                || std::any_of(actualQuads.begin() + quadCount * 6, actualQuads.end(), [](Type value) { return value != Guard; })) {
+                  std::cout << "expand_quad_list mismatch, " << sizeof(Type) * 8 << " bit, "
+                            << quadCount << " quads, rects " << isRects << ", swap " << swap << std::endl;
+                  ++failed;
+               }
+            }
+         }
+      }
+   }
+
+   return failed == 0;
+}
+
+template<typename Func>
+static double
+measure(unsigned iterations,
+        size_t bytes,
+        Func func)
+{
+   auto start = std::chrono::steady_clock::now();
+
+   for (auto i = 0u; i < iterations; ++i) {
+      func();
+   }
+
+   auto end = std::chrono::steady_clock::now();
+   auto seconds = std::chrono::duration<double>(end - start).count();
+   return (static_cast<double>(bytes) * iterations) / seconds / (1024.0 * 1024.0 * 1024.0);
+}
+
+static void
+printResult(const char *name,
+            double reference,
+            double optimised)
+{
+   std::cout << std::left << std::setw(28) << name
+             << std::right << std::fixed << std::setprecision(2)
+             << std::setw(8) << reference << " GiB/s"
+             << std::setw(10) << optimised << " GiB/s"
+             << std::setw(8) << (optimised / reference) << "x" << std::endl;
+}
+
+/**
+ * Benchmark against the scalar reference, which is what the GL driver did
+ * for every indexed draw before the kernels were added.
+ */
+template<typename Type>
+static void
+benchmark(size_t count,
+          unsigned iterations)
+{
+   std::mt19937 rng { 0x5EED };
+   auto src = randomIndices<Type>(count, rng);
+   auto dst = std::vector<Type>(count / 4 * 6);
+   auto bytes = count * sizeof(Type);
+   auto bits = sizeof(Type) * 8;
+
+   auto swapReference = measure(iterations, bytes, [&]() { referenceSwap(dst.data(), src.data(), count); });
+   auto swapOptimised = measure(iterations, bytes, [&]() { byte_swap_array(dst.data(), src.data(), count); });
+   printResult(bits == 16 ? "swap 16 bit" : "swap 32 bit", swapReference, swapOptimised);
+
+   auto quadReference = measure(iterations, bytes, [&]() { referenceExpand(dst.data(), src.data(), count / 4, false, true); });
+   auto quadOptimised = measure(iterations, bytes, [&]() { expand_quad_list(dst.data(), src.data(), count / 4, false, true); });
+   printResult(bits == 16 ? "swap + expand quads 16 bit" : "swap + expand quads 32 bit", quadReference, quadOptimised);
+
+   auto rectReference = measure(iterations, bytes, [&]() { referenceExpand(dst.data(), src.data(), count / 4, true, true); });
+   auto rectOptimised = measure(iterations, bytes, [&]() { expand_quad_list(dst.data(), src.data(), count / 4, true, true); });
+   printResult(bits == 16 ? "swap + expand rects 16 bit" : "swap + expand rects 32 bit", rectReference, rectOptimised);
+}
+
+int main(int argc, char **argv)
+{
+   excmd::parser parser;
+   excmd::option_state options;
+   using excmd::description;
+   using excmd::default_value;
+
+   gLog = spdlog::stdout_logger_st("index-benchmark");
+
+   parser.global_options()
+      .add_option("h,help",
+                  description { "Show the help." })
+      .add_option("count",
+                  description { "Number of indices per conversion." },
+                  default_value<uint32_t> { 65536 })
+      .add_option("iterations",
+                  description { "Number of conversions to time for each kernel." },
+                  default_value<uint32_t> { 2000 })
+      .add_option("verify-only",
+                  description { "Only check the kernels against the reference implementation." });
+
+   try {
+      options = parser.parse(argc, argv);
+   } catch (excmd::exception ex) {
+      std::cout << "Error parsing command line: " << ex.what() << std::endl;
+      std::exit(-1);
+   }
+
+   if (options.has("help")) {
+      std::cout << parser.format_help("index-benchmark") << std::endl;
+      std::exit(0);
+   }
+
+   if (!verify<uint16_t>(256) || !verify<uint32_t>(256)) {
+      std::cout << "FAILED" << std::endl;
+      return -1;
+   }
+
+   std::cout << "Kernels match the reference implementation" << std::endl;
+
+   if (options.has("verify-only")) {
+      return 0;
+   }
+
+   auto count = std::max(4u, options.get<uint32_t>("count"));
+   auto iterations = std::max(1u, options.get<uint32_t>("iterations"));
+
+   std::cout << std::left << std::setw(28) << ""
+             << std::right << std::setw(14) << "scalar"
+             << std::setw(16) << "simd"
+             << std::setw(9) << "speedup" << std::endl;
+   benchmark<uint16_t>(count, iterations);
+   benchmark<uint32_t>(count, iterations);
+   return 0;
+}
@@ -0,0 +1,577 @@
+#include <algorithm>
+#include <chrono>
+#include <common/checksum.h>
+#include <common/inflate.h>
+#include <cstring>
+#include <excmd.h>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+static const size_t
+CorpusSize = 8 * 1024 * 1024;
+
+// Titles decompress both small files and whole archives
+static const size_t
+ChunkSizes[] = {
+   4 * 1024,
+   64 * 1024,
+   CorpusSize,
+};
+
+static const int
+CompressionLevels[] = { 1, 6, 9 };
+
+struct Corpus
+{
+   std::string name;
+   std::vector<uint8_t> data;
+};
+
+struct ZlibResult
+{
+   int status;
+   size_t inputUsed;
+   size_t outputUsed;
+   uint32_t check;
+};
+
+static int
+windowBitsFor(InflateFormat format)
+{
+   switch (format) {
+   case InflateFormat::Raw:
+      return -MAX_WBITS;
+   case InflateFormat::Gzip:
+      return MAX_WBITS + 16;
+   default:
+      return MAX_WBITS;
+   }
+}
+
+static const char *
+formatName(InflateFormat format)
+{
+   switch (format) {
+   case InflateFormat::Raw:
+      return "raw";
+   case InflateFormat::Gzip:
+      return "gzip";
+   default:
+      return "zlib";
+   }
+}
+
+static std::vector<uint8_t>
+compressData(const uint8_t *data,
+             size_t size,
+             int level,
+             InflateFormat format)
+{
+   z_stream stream { };
+   deflateInit2(&stream, level, Z_DEFLATED, windowBitsFor(format), 8, Z_DEFAULT_STRATEGY);
+
+   auto output = std::vector<uint8_t>(deflateBound(&stream, static_cast<uLong>(size)) + 32);
+   stream.next_in = const_cast<uint8_t *>(data);
+   stream.avail_in = static_cast<uInt>(size);
+   stream.next_out = output.data();
+   stream.avail_out = static_cast<uInt>(output.size());
+   deflate(&stream, Z_FINISH);
+   output.resize(stream.total_out);
+   deflateEnd(&stream);
+   return output;
+}
+
+static ZlibResult
+zlibInflate(uint8_t *dst,
+            size_t dstSize,
+            const uint8_t *src,
+            size_t srcSize,
+            InflateFormat format)
+{
+   z_stream stream { };
+   inflateInit2(&stream, windowBitsFor(format));
+   stream.next_in = const_cast<uint8_t *>(src);
+   stream.avail_in = static_cast<uInt>(srcSize);
+   stream.next_out = dst;
+   stream.avail_out = static_cast<uInt>(dstSize);
+
+   auto result = ZlibResult { };
+   result.status = inflate(&stream, Z_FINISH);
+   result.inputUsed = stream.total_in;
+   result.outputUsed = stream.total_out;
+   result.check = static_cast<uint32_t>(stream.adler);
+   inflateEnd(&stream);
+   return result;
+}
+
+/**
+ * Scene description and script text.
+ */
+static std::vector<uint8_t>
+generateText(std::mt19937 &rng)
+{
+   static const char *words[] = {
+      "<node", " name=\"", "model_", "texture_", "\" position=\"", "\" scale=\"",
+      "/>\n", "</node>\n", "enemy", "player", "camera", "light", "shader",
+      "if (", ") {\n", "}\n", "return ", "local ", " = ", ";\n", "    ",
+   };
+
+   auto data = std::vector<uint8_t> { };
+
+   while (data.size() < CorpusSize) {
+      auto word = std::string { words[rng() % (sizeof(words) / sizeof(words[0]))] };
+
+      if (rng() % 4 == 0) {
+         word += std::to_string(rng() % 1000) + "." + std::to_string(rng() % 100);
+      }
+
+      data.insert(data.end(), word.begin(), word.end());
+   }
+
+   data.resize(CorpusSize);
+   return data;
+}
+
+/**
+ * Big endian vertex data, a position, normal and texture coordinate for
+ * each vertex of a smooth surface.
+ */
+static std::vector<uint8_t>
+generateMesh(std::mt19937 &rng)
+{
+   auto data = std::vector<uint8_t> { };
+   auto noise = std::uniform_real_distribution<float> { -0.01f, 0.01f };
+
+   auto pushFloat = [&](float value) {
+      uint32_t bits;
+      std::memcpy(&bits, &value, 4);
+
+      for (auto shift : { 24, 16, 8, 0 }) {
+         data.push_back(static_cast<uint8_t>(bits >> shift));
+      }
+   };
+
+   for (auto i = 0u; data.size() < CorpusSize; ++i) {
+      auto x = static_cast<float>(i % 256);
+      auto z = static_cast<float>(i / 256);
+      pushFloat(x);
+      pushFloat(0.25f * x + 0.5f * z + noise(rng));
+      pushFloat(z);
+      pushFloat(0.0f);
+      pushFloat(1.0f + noise(rng));
+      pushFloat(0.0f);
+      pushFloat(x / 256.0f);
+      pushFloat(z / 256.0f);
+   }
+
+   data.resize(CorpusSize);
+   return data;
+}
+
+/**
+ * BC1 style compressed texture blocks, two colour endpoints which follow a
+ * gradient and 2 bit indices.
+ */
+static std::vector<uint8_t>
+generateTexture(std::mt19937 &rng)
+{
+   auto data = std::vector<uint8_t>(CorpusSize);
+
+   for (auto i = size_t { 0 }; i + 8 <= data.size(); i += 8) {
+      auto block = i / 8;
+      auto colour0 = static_cast<uint16_t>((block / 64) & 0xFFFF);
+      auto colour1 = static_cast<uint16_t>(colour0 + (rng() % 4) * 0x0821);
+      auto indices = (rng() % 8) ? 0x55555555u * (rng() % 4) : static_cast<uint32_t>(rng());
+      std::memcpy(data.data() + i, &colour0, 2);
+      std::memcpy(data.data() + i + 2, &colour1, 2);
+      std::memcpy(data.data() + i + 4, &indices, 4);
+   }
+
+   return data;
+}
+
+/**
+ * Table of increasing 32 bit values, mostly short matches.
+ */
+static std::vector<uint8_t>
+generateTable(std::mt19937 &rng)
+{
+   auto data = std::vector<uint8_t>(CorpusSize);
+
+   for (auto i = size_t { 0 }; i + 4 <= data.size(); i += 4) {
+      auto value = static_cast<uint32_t>((i / 4) * 3 + rng() % 3);
+      std::memcpy(data.data() + i, &value, 4);
+   }
+
+   return data;
+}
+
+static std::vector<uint8_t>
+generateRandom(std::mt19937 &rng)
+{
+   auto data = std::vector<uint8_t>(CorpusSize);
+
+   for (auto &byte : data) {
+      byte = static_cast<uint8_t>(rng());
+   }
+
+   return data;
+}
+
+static bool
+readFile(const std::string &path,
+         std::vector<uint8_t> &data)
+{
+   std::ifstream file(path, std::ifstream::binary | std::ifstream::in);
+
+   if (!file.is_open()) {
+      return false;
+   }
+
+   file.seekg(0, std::ifstream::end);
+   data.resize(static_cast<size_t>(file.tellg()));
+   file.seekg(0, std::ifstream::beg);
+   file.read(reinterpret_cast<char *>(data.data()), data.size());
+   return true;
+}
+
+/**
+ * Returns true if inflate_buffer and zlib agree on src, either both
+ * decoding the whole stream to the same result, or inflate_buffer failing.
+ */
+static bool
+compareWithZlib(const uint8_t *src,
+                size_t srcSize,
+                size_t dstSize,
+                InflateFormat format)
+{
+   auto expected = std::vector<uint8_t>(dstSize + 1);
+   auto actual = std::vector<uint8_t>(dstSize + 1);
+   auto result = InflateResult { };
+   auto reference = zlibInflate(expected.data(), dstSize, src, srcSize, format);
+   auto status = inflate_buffer(actual.data(), dstSize, src, srcSize, format, MAX_WBITS, result);
+
+   if (status != InflateStatus::Success) {
+      return true;
+   }
+
+   return reference.status == Z_STREAM_END
+       && reference.outputUsed == result.outputUsed
+       && reference.inputUsed == result.inputUsed
+       && (format == InflateFormat::Raw || reference.check == result.check)
+       && std::memcmp(expected.data(), actual.data(), result.outputUsed) == 0;
+}
+
+static bool
+verifyChecksums(std::mt19937 &rng)
+{
+   auto data = generateRandom(rng);
+   auto failed = 0u;
+
+   for (auto i = 0u; i < 2000; ++i) {
+      auto size = static_cast<size_t>(rng() % (i < 1000 ? 300 : 100000));
+      auto offset = static_cast<size_t>(rng() % 64);
+      auto adler = static_cast<uint32_t>(adler32(0, nullptr, 0));
+      auto crc = static_cast<uint32_t>(rng());
+
+      // All 0xFF is the worst case for Adler-32 overflow
+      if (i % 3 == 0) {
+         std::fill(data.begin() + offset, data.begin() + offset + size, 0xFF);
+      }
+
+      if (checksum_adler32(adler, data.data() + offset, size) != adler32(adler, data.data() + offset, static_cast<uInt>(size))) {
+         std::cout << "checksum_adler32 mismatch, size " << size << ", offset " << offset << std::endl;
+         ++failed;
+      }
+
+      if (checksum_crc32(crc, data.data() + offset, size) != crc32(crc, data.data() + offset, static_cast<uInt>(size))) {
+         std::cout << "checksum_crc32 mismatch, size " << size << ", offset " << offset << std::endl;
+         ++failed;
+      }
+   }
+
+   return failed == 0;
+}
+
+/**
+ * Check every corpus inflates exactly, then that inflate_buffer agrees with
+ * zlib on corrupted, truncated and undersized streams.
+ */
+static bool
+verify(const std::vector<Corpus> &corpora,
+       unsigned fuzzCount,
+       std::mt19937 &rng)
+{
+   auto failed = 0u;
+
+   if (!verifyChecksums(rng)) {
+      ++failed;
+   }
+
+   for (auto &corpus : corpora) {
+      for (auto level : CompressionLevels) {
+         for (auto format : { InflateFormat::Raw, InflateFormat::Zlib, InflateFormat::Gzip }) {
+            auto compressed = compressData(corpus.data.data(), corpus.data.size(), level, format);
+            auto output = std::vector<uint8_t>(corpus.data.size());
+            auto result = InflateResult { };
+            auto status = inflate_buffer(output.data(), output.size(), compressed.data(), compressed.size(), format, MAX_WBITS, result);
+
+            if (status != InflateStatus::Success
+             || result.outputUsed != corpus.data.size()
+             || result.inputUsed != compressed.size()
+             || output != corpus.data) {
+               std::cout << "inflate_buffer failed on " << corpus.name << ", level " << level << ", " << formatName(format) << std::endl;
+               ++failed;
+            }
+         }
+      }
+   }
+
+   for (auto i = 0u; i < fuzzCount; ++i) {
+      auto &corpus = corpora[rng() % corpora.size()];
+      auto size = std::min<size_t>(corpus.data.size(), rng() % 65536);
+      auto offset = static_cast<size_t>(rng() % (corpus.data.size() - size + 1));
+      auto format = static_cast<InflateFormat>(rng() % 3);
+      auto compressed = compressData(corpus.data.data() + offset, size, 1 + rng() % 9, format);
+      auto dstSize = size;
+
+      switch (i % 4) {
+      case 1:
+         for (auto flips = 1 + rng() % 3; flips && compressed.size(); --flips) {
+            compressed[rng() % compressed.size()] ^= static_cast<uint8_t>(1 << (rng() % 8));
+         }
+         break;
+      case 2:
+         compressed.resize(rng() % (compressed.size() + 1));
+         break;
+      case 3:
+         dstSize = size ? rng() % size : 0;
+         break;
+      }
+
+      if (!compareWithZlib(compressed.data(), compressed.size(), dstSize, format)) {
+         std::cout << "inflate_buffer disagrees with zlib on " << corpus.name << ", case " << i << std::endl;
+         ++failed;
+      }
+   }
+
+   return failed == 0;
+}
+
+static double
+measure(uint64_t totalBytes,
+        size_t bytesPerCall,
+        const std::function<void()> &func)
+{
+   auto iterations = std::max<uint64_t>(1, totalBytes / bytesPerCall);
+   func();
+
+   auto start = std::chrono::steady_clock::now();
+
+   for (auto i = uint64_t { 0 }; i < iterations; ++i) {
+      func();
+   }
+
+   auto end = std::chrono::steady_clock::now();
+   auto seconds = std::chrono::duration<double>(end - start).count();
+   return (static_cast<double>(bytesPerCall) * iterations) / seconds / (1024.0 * 1024.0);
+}
+
+static std::string
+formatSize(size_t size)
+{
+   if (size >= 1024 * 1024) {
+      return std::to_string(size / (1024 * 1024)) + " MiB";
+   } else if (size >= 1024) {
+      return std::to_string(size / 1024) + " KiB";
+   } else {
+      return std::to_string(size) + " B";
+   }
+}
+
+static void
+printResult(const std::string &name,
+            const std::string &detail,
+            double reference,
+            double optimised)
+{
+   std::cout << std::left << std::setw(10) << name
+             << std::setw(18) << detail
+             << std::right << std::fixed << std::setprecision(0)
+             << std::setw(8) << reference << " MiB/s"
+             << std::setw(8) << optimised << " MiB/s"
+             << std::setprecision(2)
+             << std::setw(8) << (optimised / reference) << "x" << std::endl;
+}
+
+/**
+ * Inflate every chunk of the compressed corpus, comparing zlib against
+ * inflate_buffer in the zlib format most titles use.
+ */
+static void
+benchmark(const Corpus &corpus,
+          uint64_t totalBytes)
+{
+   auto lastChunkSize = size_t { 0 };
+
+   for (auto chunkSize : ChunkSizes) {
+      auto chunks = std::vector<std::vector<uint8_t>> { };
+      auto output = std::vector<uint8_t>(chunkSize);
+
+      // A small input file is only one chunk
+      chunkSize = std::min(chunkSize, corpus.data.size());
+
+      if (chunkSize == lastChunkSize) {
+         continue;
+      }
+
+      lastChunkSize = chunkSize;
+
+      for (auto offset = size_t { 0 }; offset < corpus.data.size(); offset += chunkSize) {
+         auto size = std::min(chunkSize, corpus.data.size() - offset);
+         chunks.push_back(compressData(corpus.data.data() + offset, size, 6, InflateFormat::Zlib));
+      }
+
+      auto compressedSize = size_t { 0 };
+
+      for (auto &chunk : chunks) {
+         compressedSize += chunk.size();
+      }
+
+      auto reference = measure(totalBytes, corpus.data.size(), [&]() {
+         for (auto &chunk : chunks) {
+            zlibInflate(output.data(), output.size(), chunk.data(), chunk.size(), InflateFormat::Zlib);
+         }
+      });
+
+      auto optimised = measure(totalBytes, corpus.data.size(), [&]() {
+         auto result = InflateResult { };
+
+         for (auto &chunk : chunks) {
+            inflate_buffer(output.data(), output.size(), chunk.data(), chunk.size(), InflateFormat::Zlib, MAX_WBITS, result);
+         }
+      });
+
+      std::ostringstream detail;
+      detail << formatSize(chunkSize) << " ratio "
+             << std::fixed << std::setprecision(1)
+             << (static_cast<double>(corpus.data.size()) / compressedSize);
+      printResult(corpus.name, detail.str(), reference, optimised);
+   }
+}
+
+static void
+benchmarkChecksums(const Corpus &corpus,
+                   uint64_t totalBytes)
+{
+   auto data = corpus.data.data();
+   auto size = corpus.data.size();
+   auto sink = uint32_t { 0 };
+
+   auto adlerReference = measure(totalBytes, size, [&]() { sink += static_cast<uint32_t>(adler32(1, data, static_cast<uInt>(size))); });
+   auto adlerOptimised = measure(totalBytes, size, [&]() { sink += checksum_adler32(1, data, size); });
+   printResult("adler32", formatSize(size), adlerReference, adlerOptimised);
+
+   auto crcReference = measure(totalBytes, size, [&]() { sink += static_cast<uint32_t>(crc32(0, data, static_cast<uInt>(size))); });
+   auto crcOptimised = measure(totalBytes, size, [&]() { sink += checksum_crc32(0, data, size); });
+   printResult("crc32", formatSize(size), crcReference, crcOptimised);
+
+   // Keep the checksums from being optimised away
+   if (sink == 0x12345678) {
+      std::cout << std::endl;
+   }
+}
+
+int main(int argc, char **argv)
+{
+   excmd::parser parser;
+   excmd::option_state options;
+   using excmd::description;
+   using excmd::default_value;
+   using excmd::value;
+
+   gLog = spdlog::stdout_logger_st("inflate-benchmark");
+
+   parser.global_options()
+      .add_option("h,help",
+                  description { "Show the help." })
+      .add_option("megabytes",
+                  description { "Number of megabytes to decompress for each corpus and chunk size." },
+                  default_value<uint32_t> { 256 })
+      .add_option("fuzz",
+                  description { "Number of damaged streams to compare against zlib." },
+                  default_value<uint32_t> { 2000 })
+      .add_option("input",
+                  description { "Also benchmark the contents of this file, such as a title's asset." },
+                  value<std::string> { })
+      .add_option("verify-only",
+                  description { "Only check the decoder against zlib." });
+
+   try {
+      options = parser.parse(argc, argv);
+   } catch (excmd::exception ex) {
+      std::cout << "Error parsing command line: " << ex.what() << std::endl;
+      std::exit(-1);
+   }
+
+   if (options.has("help")) {
+      std::cout << parser.format_help("inflate-benchmark") << std::endl;
+      std::exit(0);
+   }
+
+   std::mt19937 rng { 0x5EED };
+   auto corpora = std::vector<Corpus> {
+      { "text", generateText(rng) },
+      { "mesh", generateMesh(rng) },
+      { "texture", generateTexture(rng) },
+      { "table", generateTable(rng) },
+      { "random", generateRandom(rng) },
+   };
+
+   if (options.has("input")) {
+      auto path = options.get<std::string>("input");
+      auto corpus = Corpus { "input", { } };
+
+      if (!readFile(path, corpus.data) || corpus.data.empty()) {
+         std::cout << "Could not read " << path << std::endl;
+         return -1;
+      }
+
+      corpora.push_back(std::move(corpus));
+   }
+
+   if (!verify(corpora, options.get<uint32_t>("fuzz"), rng)) {
+      std::cout << "FAILED" << std::endl;
+      return -1;
+   }
+
+   std::cout << "Decoder matches zlib" << std::endl;
+
+   if (options.has("verify-only")) {
+      return 0;
+   }
+
+   auto totalBytes = static_cast<uint64_t>(std::max(1u, options.get<uint32_t>("megabytes"))) * 1024 * 1024;
+   std::cout << std::left << std::setw(28) << ""
+             << std::right << std::setw(14) << "zlib"
+             << std::setw(14) << "inflate"
+             << std::setw(9) << "speedup" << std::endl;
+
+   for (auto &corpus : corpora) {
+      benchmark(corpus, totalBytes);
+   }
+
+   benchmarkChecksums(corpora.back(), totalBytes);
+   return 0;
+}
@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <common/platform_thread.h>
+#include <condition_variable>
+#include <excmd.h>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "libcpu/cpu.h"
+#include "libcpu/mem.h"
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+static const int
+CoreCount = 3;
+
+//! Longest a core may take to respond before we consider the interrupt lost
+static const int64_t
+LostInterruptNs = 1000 * 1000 * 1000;
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * State shared between the signalling thread and one waiting core, the
+ * interrupt word and wakeup counts are only used by the baseline scheme as
+ * libcpu keeps its own in cpu::Core.
+ */
+struct BenchmarkCore
+{
+   std::atomic<uint32_t> interrupt { 0 };
+   std::atomic<int64_t> signalTime { 0 };
+   std::atomic<int64_t> latencyNs { -1 };
+   uint64_t wakeups = 0;
+   uint64_t spuriousWakeups = 0;
+};
+
+struct BenchmarkResult
+{
+   std::vector<int64_t> latencies;
+   uint64_t wakeups = 0;
+   uint64_t spuriousWakeups = 0;
+};
+
+static const uint32_t
+QuitInterrupt = 1 << 1;
+
+static int64_t
+nowNs()
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Called by a core when it has taken an interrupt, records the latency from
+ * when it was signalled.
+ */
+static bool
+handleInterrupt(BenchmarkCore &core,
+                uint32_t flags)
+{
+   if (flags & QuitInterrupt) {
+      return false;
+   }
+
+   core.latencyNs.store(nowNs() - core.signalTime.load());
+   return true;
+}
+
+
+/**
+ * The scheme libcpu used before its per-core futex, one mutex and condition
+ * variable shared by every core with notify_all on every interrupt, kept as
+ * a baseline to compare against.
+ */
+struct SharedConditionScheme
+{
+   static const char *name()
+   {
+      return "shared condition variable";
+   }
+
+   void interrupt(BenchmarkCore &core, uint32_t flags)
+   {
+      std::unique_lock<std::mutex> lock { mutex };
+      core.interrupt.fetch_or(flags);
+      condition.notify_all();
+   }
+
+   void wait(BenchmarkCore &core)
+   {
+      std::unique_lock<std::mutex> lock { mutex };
+      auto woken = false;
+
+      while (true) {
+         auto flags = core.interrupt.exchange(0);
+
+         if (flags) {
+            woken = false;
+            lock.unlock();
+
+            if (!handleInterrupt(core, flags)) {
+               return;
+            }
+
+            lock.lock();
+            continue;
+         }
+
+         if (woken) {
+            core.spuriousWakeups++;
+         }
+
+         condition.wait(lock);
+         core.wakeups++;
+         woken = true;
+      }
+   }
+
+   std::mutex mutex;
+   std::condition_variable condition;
+};
+
+
+/**
+ * Interrupt the cores one at a time, waiting for each interrupt to be taken
+ * before sending the next.
+ */
+template<typename Scheme>
+static BenchmarkResult
+runBenchmark(unsigned iterations)
+{
+   Scheme scheme;
+   BenchmarkCore cores[CoreCount];
+   std::vector<std::thread> threads;
+   BenchmarkResult result;
+
+   for (auto i = 0; i < CoreCount; ++i) {
+      threads.emplace_back([&scheme, &cores, i]() { scheme.wait(cores[i]); });
+   }
+
+   // Give the cores a chance to go to sleep
+   std::this_thread::sleep_for(std::chrono::milliseconds { 50 });
+   result.latencies.reserve(iterations);
+
+   for (auto i = 0u; i < iterations; ++i) {
+      auto &core = cores[i % CoreCount];
+      core.latencyNs.store(-1);
+      core.signalTime.store(nowNs());
+      scheme.interrupt(core, 1);
+
+      auto latency = int64_t { -1 };
+
+      while ((latency = core.latencyNs.load()) < 0) {
+         std::this_thread::yield();
+      }
+
+      result.latencies.push_back(latency);
+
+      // Let the core get back to sleep before the next interrupt
+      std::this_thread::sleep_for(std::chrono::microseconds { 20 });
+   }
+
+   for (auto i = 0; i < CoreCount; ++i) {
+      scheme.interrupt(cores[i], QuitInterrupt);
+   }
+
+   for (auto &thread : threads) {
+      thread.join();
+   }
+
+   for (auto &core : cores) {
+      result.wakeups += core.wakeups;
+      result.spuriousWakeups += core.spuriousWakeups;
+   }
+
+   return result;
+}
+
+
+// When each libcpu core was last interrupted and how long it took to respond
+static BenchmarkCore
+sCpuCores[CoreCount];
+
+static void
+cpuInterruptHandler(uint32_t flags)
+{
+   if (flags & cpu::SRESET_INTERRUPT) {
+      platform::exitThread(0);
+   }
+
+   auto &core = sCpuCores[cpu::this_core::id()];
+   core.latencyNs.store(nowNs() - core.signalTime.load());
+}
+
+static void
+cpuEntrypoint()
+{
+   cpu::this_core::setInterruptMask(cpu::GENERIC_INTERRUPT);
+
+   while (true) {
+      cpu::this_core::waitForInterrupt();
+   }
+}
+
+/**
+ * The same round robin as runBenchmark, but through cpu::interrupt and
+ * cpu::this_core::waitForInterrupt on the real cores, with the wakeup counts
+ * taken from cpu::getInterruptStats.
+ */
+static bool
+runCpuBenchmark(unsigned iterations,
+                BenchmarkResult &result)
+{
+   cpu::setCoreEntrypointHandler(&cpuEntrypoint);
+   cpu::setInterruptHandler(&cpuInterruptHandler);
+   cpu::start();
+
+   // Give the cores a chance to go to sleep
+   std::this_thread::sleep_for(std::chrono::milliseconds { 50 });
+   result.latencies.reserve(iterations);
+
+   for (auto i = 0u; i < iterations; ++i) {
+      auto coreId = static_cast<int>(i % CoreCount);
+      auto &core = sCpuCores[coreId];
+      core.latencyNs.store(-1);
+      core.signalTime.store(nowNs());
+      cpu::interrupt(coreId, cpu::GENERIC_INTERRUPT);
+
+      auto latency = int64_t { -1 };
+
+      while ((latency = core.latencyNs.load()) < 0) {
+         if (nowNs() - core.signalTime.load() > LostInterruptNs) {
+            std::cout << "Core " << coreId << " did not take interrupt " << i << std::endl;
+            return false;
+         }
+
+         std::this_thread::yield();
+      }
+
+      result.latencies.push_back(latency);
+
+      // Let the core get back to sleep before the next interrupt
+      std::this_thread::sleep_for(std::chrono::microseconds { 20 });
+   }
+
+   cpu::halt();
+   cpu::join();
+
+   for (auto i = 0; i < CoreCount; ++i) {
+      auto stats = cpu::getInterruptStats(i);
+      result.wakeups += stats.wakeups;
+      result.spuriousWakeups += stats.spuriousWakeups;
+   }
+
+   return true;
+}
+
+static void
+printResult(const char *name,
+            BenchmarkResult &result)
+{
+   auto &latencies = result.latencies;
+   std::sort(latencies.begin(), latencies.end());
+
+   auto total = int64_t { 0 };
+
+   for (auto latency : latencies) {
+      total += latency;
+   }
+
+   auto avgUs = (static_cast<double>(total) / latencies.size()) / 1000.0;
+   auto p50Us = latencies[latencies.size() / 2] / 1000.0;
+   auto p99Us = latencies[(latencies.size() * 99) / 100] / 1000.0;
+
+   std::cout << name << std::endl;
+   std::cout << std::fixed << std::setprecision(2)
+             << "  wake latency avg " << avgUs << " us, p50 " << p50Us << " us, p99 " << p99Us << " us" << std::endl;
+   std::cout << "  wakeups " << result.wakeups << ", spurious " << result.spuriousWakeups << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+   excmd::parser parser;
+   excmd::option_state options;
+   using excmd::description;
+   using excmd::default_value;
+
+   gLog = spdlog::stdout_logger_st("interrupt-benchmark");
+
+   parser.global_options()
+      .add_option("h,help",
+                  description { "Show the help." })
+      .add_option("iterations",
+                  description { "Number of interrupts to send." },
+                  default_value<uint32_t> { 20000 });
+
+   try {
+      options = parser.parse(argc, argv);
+   } catch (excmd::exception ex) {
+      std::cout << "Error parsing command line: " << ex.what() << std::endl;
+      std::exit(-1);
+   }
+
+   if (options.has("help")) {
+      std::cout << parser.format_help("interrupt-benchmark") << std::endl;
+      std::exit(0);
+   }
+
+   auto iterations = std::max(1u, options.get<uint32_t>("iterations"));
+   std::cout << "Sending " << iterations << " interrupts round robin to " << CoreCount << " cores" << std::endl;
+
+   auto shared = runBenchmark<SharedConditionScheme>(iterations);
+   printResult(SharedConditionScheme::name(), shared);
+
+   mem::initialise();
+   cpu::initialise();
+
+   auto libcpu = BenchmarkResult { };
+
+   if (!runCpuBenchmark(iterations, libcpu)) {
+      return -1;
+   }
+
+   printResult("libcpu", libcpu);
+   return 0;
+}
@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <common/log.h>
+#include <excmd.h>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "libcpu/cpu.h"
+#include "libcpu/mem.h"
+#include "libcpu/src/jit/jit.h"
+#include "libcpu/espresso/espresso_instructionset.h"
+
+using namespace espresso;
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+// Copies of the instruction in the block, followed by a blr
+static const uint32_t
+BlockLength = 256;
+
+static const uint32_t
+CodeAddress = mem::MEM2Base;
+
+static const uint32_t
+DataAddress = mem::MEM2Base + 0x100000;
+
+// GQR0 is left as float, GQR1 loads and stores unsigned 16 bit values
+static const uint32_t
+QuantizedGqr = 0x00050005;
+
+struct Benchmark
+{
+   const char *name;
+   InstructionID id;
+   std::function<void(Instruction &)> setup;
+};
+
+struct BenchmarkResult
+{
+   // Average time taken by one instruction in nanoseconds
+   double ns;
+
+   // Guest register loads and stores emitted for the block
+   uint64_t coreLoads;
+   uint64_t coreStores;
+};
+
+struct BenchmarkOptions
+{
+   uint32_t iterations;
+   bool verify;
+};
+
+static std::vector<Benchmark>
+getBenchmarks()
+{
+   auto dForm = [](Instruction &instr) {
+      instr.rD = 5;
+      instr.rA = 3;
+      instr.d = 8;
+   };
+
+   auto xForm = [](Instruction &instr) {
+      instr.rD = 5;
+      instr.rA = 3;
+      instr.rB = 4;
+   };
+
+   auto rotate = [](Instruction &instr) {
+      instr.rA = 5;
+      instr.rS = 3;
+      instr.sh = 8;
+      instr.mb = 0;
+      instr.me = 23;
+   };
+
+   auto multiple = [](Instruction &instr) {
+      instr.rD = 24;
+      instr.rA = 3;
+      instr.d = 0x40;
+   };
+
+   auto paired = [](uint32_t gqr, uint32_t w) {
+      return [=](Instruction &instr) {
+         instr.frD = 1;
+         instr.rA = 3;
+         instr.qd = 8;
+         instr.i = gqr;
+         instr.w = w;
+      };
+   };
+
+   return {
+      { "add", InstructionID::add, xForm },
+      { "addi", InstructionID::addi, dForm },
+      { "rlwinm", InstructionID::rlwinm, rotate },
+      { "mfmsr (fallback)", InstructionID::mfmsr, [](Instruction &instr) { instr.rD = 5; } },
+      { "lbz", InstructionID::lbz, dForm },
+      { "lhz", InstructionID::lhz, dForm },
+      { "lha", InstructionID::lha, dForm },
+      { "lwz", InstructionID::lwz, dForm },
+      { "lwzx", InstructionID::lwzx, xForm },
+      { "lwbrx", InstructionID::lwbrx, xForm },
+      { "stb", InstructionID::stb, dForm },
+      { "sth", InstructionID::sth, dForm },
+      { "stw", InstructionID::stw, dForm },
+      { "stwx", InstructionID::stwx, xForm },
+      { "lfs", InstructionID::lfs, dForm },
+      { "lfd", InstructionID::lfd, dForm },
+      { "stfs", InstructionID::stfs, dForm },
+      { "stfd", InstructionID::stfd, dForm },
+      { "lmw r24-r31", InstructionID::lmw, multiple },
+      { "stmw r24-r31", InstructionID::stmw, multiple },
+      { "psq_l float", InstructionID::psq_l, paired(0, 0) },
+      { "psq_l float w=1", InstructionID::psq_l, paired(0, 1) },
+      { "psq_l u16", InstructionID::psq_l, paired(1, 0) },
+      { "psq_st float", InstructionID::psq_st, paired(0, 0) },
+      { "psq_st u16", InstructionID::psq_st, paired(1, 0) },
+   };
+}
+
+static void
+resetState(cpu::Core *state)
+{
+   state->gpr[3] = DataAddress;
+   state->gpr[4] = 0x10;
+   state->gqr[0].value = 0;
+   state->gqr[1].value = QuantizedGqr;
+
+   for (auto i = 0u; i < 32; ++i) {
+      state->fpr[i].paired0 = 1.5;
+      state->fpr[i].paired1 = -2.25;
+   }
+}
+
+static void
+writeBlock(const Benchmark &benchmark)
+{
+   auto instr = encodeInstruction(benchmark.id);
+   benchmark.setup(instr);
+
+   for (auto i = 0u; i < BlockLength; ++i) {
+      mem::write(CodeAddress + i * 4, instr.value);
+   }
+
+   auto bclr = encodeInstruction(InstructionID::bclr);
+   bclr.bo = 0x1f;
+   mem::write(CodeAddress + BlockLength * 4, bclr.value);
+
+   for (auto i = 0u; i < 64; ++i) {
+      mem::write(DataAddress + i * 4, 1.0f + i);
+   }
+
+   cpu::jit::clearCache();
+}
+
+static BenchmarkResult
+measure(const Benchmark &benchmark,
+        cpu::jit_mode mode,
+        uint32_t iterations)
+{
+   auto state = cpu::this_core::state();
+   auto result = BenchmarkResult { };
+   cpu::setJitMode(mode);
+   writeBlock(benchmark);
+
+   // The first run compiles the block
+   auto before = cpu::getJitStats();
+   resetState(state);
+   state->nia = CodeAddress;
+   cpu::this_core::executeSub();
+
+   auto after = cpu::getJitStats();
+   result.coreLoads = after.coreLoads - before.coreLoads;
+   result.coreStores = after.coreStores - before.coreStores;
+
+   auto start = std::chrono::steady_clock::now();
+
+   for (auto i = 0u; i < iterations; ++i) {
+      state->nia = CodeAddress;
+      cpu::this_core::executeSub();
+   }
+
+   auto elapsed = std::chrono::steady_clock::now() - start;
+   auto ns = std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(elapsed).count();
+   result.ns = ns / (static_cast<double>(iterations) * BlockLength);
+   return result;
+}
+
+// Handshake for checkCrossCorePin, the epoch pinned on core 1 and whether
+//  core 2 has released it yet
+static std::atomic<uint64_t>
+sPinnedEpoch { 0 };
+
+static std::atomic<bool>
+sPinned { false };
+
+static std::atomic<bool>
+sUnpinned { false };
+
+/**
+ * A kernel call can switch fibers and return on a different core, so an
+ * epoch pinned on one core may be unpinned on another. Check retired blocks
+ * are still reclaimed once that has happened.
+ */
+static bool
+checkCrossCorePin()
+{
+   sPinnedEpoch.store(cpu::jit::pinEpoch());
+   sPinned.store(true);
+
+   while (!sUnpinned.load()) {
+      std::this_thread::yield();
+   }
+
+   auto state = cpu::this_core::state();
+   cpu::setJitMode(cpu::jit_mode::enabled);
+   writeBlock(getBenchmarks().front());
+   resetState(state);
+   state->nia = CodeAddress;
+   cpu::this_core::executeSub();
+
+   cpu::jit::invalidate(CodeAddress, BlockLength * 4);
+
+   // Each entry to the dispatcher gives reclamation a chance to advance
+   for (auto i = 0; i < 16 && cpu::getJitStats().pendingBytes; ++i) {
+      resetState(state);
+      state->nia = CodeAddress;
+      cpu::this_core::executeSub();
+   }
+
+   return cpu::getJitStats().pendingBytes == 0;
+}
+
+static void
+unpinCrossCore()
+{
+   while (!sPinned.load()) {
+      std::this_thread::yield();
+   }
+
+   cpu::jit::unpinEpoch(sPinnedEpoch.load());
+
+   // This core goes on to wait for interrupts rather than execute anything
+   cpu::jit::markCoreIdle();
+   sUnpinned.store(true);
+}
+
+static void
+runBenchmarks(const BenchmarkOptions &options)
+{
+   auto benchmarks = getBenchmarks();
+
+   if (options.verify) {
+      // Any difference from the interpreter aborts in jit_verify.cpp
+      for (auto &benchmark : benchmarks) {
+         std::cout << "Verifying " << benchmark.name << std::endl;
+         measure(benchmark, cpu::jit_mode::verify, 1);
+      }
+
+      std::cout << "JIT matches the interpreter" << std::endl;
+
+      if (!checkCrossCorePin()) {
+         std::cout << "Retired blocks were not reclaimed after unpinning on another core" << std::endl;
+         std::exit(-1);
+      }
+
+      std::cout << "Retired blocks reclaimed after unpinning on another core" << std::endl;
+      return;
+   }
+
+   std::cout << std::left << std::setw(20) << ""
+             << std::right << std::setw(14) << "interpreter"
+             << std::setw(14) << "jit"
+             << std::setw(9) << "speedup"
+             << std::setw(8) << "loads"
+             << std::setw(8) << "stores" << std::endl;
+
+   for (auto &benchmark : benchmarks) {
+      auto interpreter = measure(benchmark, cpu::jit_mode::disabled, options.iterations);
+      auto jit = measure(benchmark, cpu::jit_mode::enabled, options.iterations);
+
+      std::cout << std::left << std::setw(20) << benchmark.name
+                << std::right << std::fixed << std::setprecision(2)
+                << std::setw(11) << interpreter.ns << " ns"
+                << std::setw(11) << jit.ns << " ns"
+                << std::setw(8) << (interpreter.ns / jit.ns) << "x"
+                << std::setw(8) << jit.coreLoads
+                << std::setw(8) << jit.coreStores << std::endl;
+   }
+}
+
+int main(int argc, char **argv)
+{
+   excmd::parser parser;
+   excmd::option_state options;
+   using excmd::description;
+   using excmd::default_value;
+
+   gLog = spdlog::stdout_logger_st("jit-benchmark");
+
+   parser.global_options()
+      .add_option("h,help",
+                  description { "Show the help." })
+      .add_option("iterations",
+                  description { "Number of times to run each block of 256 instructions." },
+                  default_value<uint32_t> { 20000 })
+      .add_option("verify",
+                  description { "Run each instruction once under jit_mode::verify, then check code reclamation, instead of timing." });
+
+   try {
+      options = parser.parse(argc, argv);
+   } catch (excmd::exception ex) {
+      std::cout << "Error parsing command line: " << ex.what() << std::endl;
+      std::exit(-1);
+   }
+
+   if (options.has("help")) {
+      std::cout << parser.format_help("jit-benchmark") << std::endl;
+      std::exit(0);
+   }
+
+   auto benchmarkOptions = BenchmarkOptions { };
+   benchmarkOptions.iterations = std::max(1u, options.get<uint32_t>("iterations"));
+   benchmarkOptions.verify = options.has("verify");
+
+   mem::initialise();
+   cpu::initialise();
+
+   // Run on a single core, the same as hardware-test, core 2 only takes
+   //  part in the cross core pin check
+   cpu::setCoreEntrypointHandler(
+      [&]() {
+         if (cpu::this_core::id() == 1) {
+            runBenchmarks(benchmarkOptions);
+         } else if (cpu::this_core::id() == 2 && benchmarkOptions.verify) {
+            unpinCrossCore();
+         }
+      });
+
+   cpu::start();
+   cpu::join();
+   return 0;
+}
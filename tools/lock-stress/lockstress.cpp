@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <common/adaptivelock.h>
+#include <excmd.h>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <thread>
+#include <vector>
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+struct StressOptions
+{
+   unsigned threads;
+   unsigned iterations;
+   unsigned holdSpins;
+};
+
+/**
+ * Run more lock users than there are host cores, the way decaf's three
+ * emulated cores plus its host threads do on a small CI machine, and check
+ * that the lock still provides mutual exclusion and makes progress.
+ */
+static bool
+runStress(const StressOptions &options)
+{
+   AdaptiveLock lock;
+   std::atomic<uint32_t> inside { 0 };
+   std::atomic<bool> failed { false };
+   std::vector<std::thread> threads;
+   uint64_t counter = 0;
+
+   auto start = std::chrono::steady_clock::now();
+
+   for (auto i = 0u; i < options.threads; ++i) {
+      threads.emplace_back([&, i]() {
+         std::mt19937 rng { i };
+
+         for (auto j = 0u; j < options.iterations; ++j) {
+            lock.lock(i + 1);
+
+            if (inside.fetch_add(1) != 0) {
+               failed = true;
+            }
+
+            // Mostly short critical sections, with the occasional long one
+            auto spins = (rng() % 64) ? options.holdSpins : options.holdSpins * 100;
+
+            for (auto k = 0u; k < spins; ++k) {
+               adaptive_lock::pause();
+            }
+
+            counter++;
+            inside.fetch_sub(1);
+
+            if (lock.unlock() != i + 1) {
+               failed = true;
+            }
+         }
+      });
+   }
+
+   for (auto &thread : threads) {
+      thread.join();
+   }
+
+   auto end = std::chrono::steady_clock::now();
+   auto seconds = std::chrono::duration<double>(end - start).count();
+   auto expected = static_cast<uint64_t>(options.threads) * options.iterations;
+   auto &stats = lock.stats();
+
+   std::cout << std::fixed << std::setprecision(2)
+             << "Completed in " << seconds << "s, "
+             << (expected / seconds / 1000000.0) << "M acquisitions/s" << std::endl;
+   std::cout << "acquisitions " << stats.acquisitions.load()
+             << ", contended " << stats.contentions.load()
+             << ", parked " << stats.parks.load()
+             << ", max hold " << (stats.maxHoldNs.load() / 1000.0) << "us" << std::endl;
+
+   if (failed) {
+      std::cout << "FAILED: mutual exclusion was violated" << std::endl;
+      return false;
+   }
+
+   if (counter != expected) {
+      std::cout << "FAILED: counter is " << counter << ", expected " << expected << std::endl;
+      return false;
+   }
+
+   std::cout << "PASSED" << std::endl;
+   return true;
+}
+
+int main(int argc, char **argv)
+{
+   excmd::parser parser;
+   excmd::option_state options;
+   using excmd::description;
+   using excmd::default_value;
+
+   gLog = spdlog::stdout_logger_st("lock-stress");
+
+   // Default to more threads than host cores so some lock holders get preempted
+   auto hostCores = std::max(1u, std::thread::hardware_concurrency());
+
+   parser.global_options()
+      .add_option("h,help",
+                  description { "Show the help." })
+      .add_option("threads",
+                  description { "Number of threads contending for the lock, defaults to twice the host core count." },
+                  default_value<uint32_t> { std::max(4u, hostCores * 2) })
+      .add_option("iterations",
+                  description { "Number of times each thread takes the lock." },
+                  default_value<uint32_t> { 200000 })
+      .add_option("hold-spins",
+                  description { "Number of pause instructions to execute while holding the lock." },
+                  default_value<uint32_t> { 16 });
+
+   try {
+      options = parser.parse(argc, argv);
+   } catch (excmd::exception ex) {
+      std::cout << "Error parsing command line: " << ex.what() << std::endl;
+      std::exit(-1);
+   }
+
+   if (options.has("help")) {
+      std::cout << parser.format_help("lock-stress") << std::endl;
+      std::exit(0);
+   }
+
+   auto stressOptions = StressOptions { };
+   stressOptions.threads = std::max(1u, options.get<uint32_t>("threads"));
+   stressOptions.iterations = options.get<uint32_t>("iterations");
+   stressOptions.holdSpins = options.get<uint32_t>("hold-spins");
+
+   std::cout << "Running " << stressOptions.threads << " threads on " << hostCores << " host cores" << std::endl;
+   return runStress(stressOptions) ? 0 : -1;
+}
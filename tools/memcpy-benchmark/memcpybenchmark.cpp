@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <chrono>
+#include <common/memory_copy.h>
+#include <cstring>
+#include <excmd.h>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+// Guest copy sizes, from small structures up to whole asset files
+static const size_t
+CopySizes[] = {
+   64,
+   512,
+   4 * 1024,
+   32 * 1024,
+   256 * 1024,
+   1024 * 1024,
+   4 * 1024 * 1024,
+   16 * 1024 * 1024,
+   64 * 1024 * 1024,
+};
+
+static const uint8_t
+Guard = 0xCD;
+
+static std::vector<uint8_t>
+randomBytes(size_t size,
+            std::mt19937 &rng)
+{
+   auto bytes = std::vector<uint8_t>(size);
+
+   for (auto &byte : bytes) {
+      byte = static_cast<uint8_t>(rng());
+   }
+
+   return bytes;
+}
+
+static bool
+checkGuards(const std::vector<uint8_t> &buffer,
+            size_t start,
+            size_t end)
+{
+   return std::all_of(buffer.begin(), buffer.begin() + start, [](uint8_t value) { return value == Guard; })
+       && std::all_of(buffer.begin() + end, buffer.end(), [](uint8_t value) { return value == Guard; });
+}
+
+/**
+ * Compare against libc for every small size, and for sizes around the
+ * non-temporal threshold at every destination alignment, with guard bytes
+ * either side of the destination to catch overruns.
+ */
+static bool
+verify()
+{
+   std::mt19937 rng { 0x5EED };
+   auto threshold = memory_copy_non_temporal_threshold();
+   auto sizes = std::vector<size_t> { };
+   auto failed = 0u;
+
+   for (auto size = size_t { 0 }; size <= 256; ++size) {
+      sizes.push_back(size);
+   }
+
+   if (threshold) {
+      for (auto extra : { 0, 1, 31, 32, 63, 64, 127, 128, 129 }) {
+         sizes.push_back(threshold + extra);
+      }
+   }
+
+   for (auto size : sizes) {
+      auto src = randomBytes(size + 64, rng);
+
+      for (auto dstOffset = 0u; dstOffset < 32; ++dstOffset) {
+         for (auto srcOffset : { 0u, 7u }) {
+            auto dst = std::vector<uint8_t>(size + 64, Guard);
+            auto end = dstOffset + size;
+
+            // memory_copy
+            memory_copy(dst.data() + dstOffset, src.data() + srcOffset, size);
+
+            if (std::memcmp(dst.data() + dstOffset, src.data() + srcOffset, size) || !checkGuards(dst, dstOffset, end)) {
+               std::cout << "memory_copy mismatch, size " << size << ", dst offset " << dstOffset << ", src offset " << srcOffset << std::endl;
+               ++failed;
+            }
+
+            // memory_set
+            std::fill(dst.begin(), dst.end(), Guard);
+            memory_set(dst.data() + dstOffset, 0x5A, size);
+
+            if (std::any_of(dst.begin() + dstOffset, dst.begin() + end, [](uint8_t value) { return value != 0x5A; }) || !checkGuards(dst, dstOffset, end)) {
+               std::cout << "memory_set mismatch, size " << size << ", dst offset " << dstOffset << std::endl;
+               ++failed;
+            }
+         }
+      }
+
+      // memory_move, overlapping in both directions
+      for (auto shift : { 1u, 17u, 32u }) {
+         auto expected = src;
+         auto actual = src;
+
+         if (size + shift > src.size()) {
+            continue;
+         }
+
+         std::memmove(expected.data() + shift, expected.data(), size);
+         memory_move(actual.data() + shift, actual.data(), size);
+
+         if (expected != actual) {
+            std::cout << "memory_move forward mismatch, size " << size << ", shift " << shift << std::endl;
+            ++failed;
+         }
+
+         expected = src;
+         actual = src;
+         std::memmove(expected.data(), expected.data() + shift, size);
+         memory_move(actual.data(), actual.data() + shift, size);
+
+         if (expected != actual) {
+            std::cout << "memory_move backward mismatch, size " << size << ", shift " << shift << std::endl;
+            ++failed;
+         }
+      }
+   }
+
+   return failed == 0;
+}
+
+static double
+measure(size_t size,
+        uint64_t totalBytes,
+        const std::function<void()> &func)
+{
+   auto iterations = std::max<uint64_t>(1, totalBytes / size);
+   func();
+
+   auto start = std::chrono::steady_clock::now();
+
+   for (auto i = uint64_t { 0 }; i < iterations; ++i) {
+      func();
+   }
+
+   auto end = std::chrono::steady_clock::now();
+   auto seconds = std::chrono::duration<double>(end - start).count();
+   return (static_cast<double>(size) * iterations) / seconds / (1024.0 * 1024.0 * 1024.0);
+}
+
+static std::string
+formatSize(size_t size)
+{
+   if (size >= 1024 * 1024) {
+      return std::to_string(size / (1024 * 1024)) + " MiB";
+   } else if (size >= 1024) {
+      return std::to_string(size / 1024) + " KiB";
+   } else {
+      return std::to_string(size) + " B";
+   }
+}
+
+static void
+printResult(const char *name,
+            size_t size,
+            double reference,
+            double optimised)
+{
+   std::cout << std::left << std::setw(10) << name
+             << std::right << std::setw(10) << formatSize(size)
+             << std::fixed << std::setprecision(2)
+             << std::setw(10) << reference << " GiB/s"
+             << std::setw(10) << optimised << " GiB/s"
+             << std::setw(8) << (optimised / reference) << "x" << std::endl;
+}
+
+/**
+ * Benchmark against the C library, which is what the HLE memory functions
+ * called before memory_copy was added.
+ */
+static void
+benchmark(size_t size,
+          uint64_t totalBytes)
+{
+   std::mt19937 rng { 0x5EED };
+
+   // Offset the destination so neither side is trivially page aligned
+   auto src = randomBytes(size + 64, rng);
+   auto dst = std::vector<uint8_t>(size + 64);
+   auto srcPtr = src.data() + 4;
+   auto dstPtr = dst.data() + 8;
+
+   auto copyReference = measure(size, totalBytes, [&]() { std::memcpy(dstPtr, srcPtr, size); });
+   auto copyOptimised = measure(size, totalBytes, [&]() { memory_copy(dstPtr, srcPtr, size); });
+   printResult("memcpy", size, copyReference, copyOptimised);
+
+   auto moveReference = measure(size, totalBytes, [&]() { std::memmove(dstPtr, srcPtr, size); });
+   auto moveOptimised = measure(size, totalBytes, [&]() { memory_move(dstPtr, srcPtr, size); });
+   printResult("memmove", size, moveReference, moveOptimised);
+
+   auto setReference = measure(size, totalBytes, [&]() { std::memset(dstPtr, 0, size); });
+   auto setOptimised = measure(size, totalBytes, [&]() { memory_set(dstPtr, 0, size); });
+   printResult("memset", size, setReference, setOptimised);
+}
+
+int main(int argc, char **argv)
+{
+   excmd::parser parser;
+   excmd::option_state options;
+   using excmd::description;
+   using excmd::default_value;
+
+   gLog = spdlog::stdout_logger_st("memcpy-benchmark");
+
+   parser.global_options()
+      .add_option("h,help",
+                  description { "Show the help." })
+      .add_option("megabytes",
+                  description { "Number of megabytes to copy for each size and function." },
+                  default_value<uint32_t> { 2048 })
+      .add_option("verify-only",
+                  description { "Only check the functions against the C library." });
+
+   try {
+      options = parser.parse(argc, argv);
+   } catch (excmd::exception ex) {
+      std::cout << "Error parsing command line: " << ex.what() << std::endl;
+      std::exit(-1);
+   }
+
+   if (options.has("help")) {
+      std::cout << parser.format_help("memcpy-benchmark") << std::endl;
+      std::exit(0);
+   }
+
+   if (!verify()) {
+      std::cout << "FAILED" << std::endl;
+      return -1;
+   }
+
+   std::cout << "Functions match the C library" << std::endl;
+
+   if (options.has("verify-only")) {
+      return 0;
+   }
+
+   auto totalBytes = static_cast<uint64_t>(std::max(1u, options.get<uint32_t>("megabytes"))) * 1024 * 1024;
+   std::cout << "Non-temporal threshold " << formatSize(memory_copy_non_temporal_threshold()) << std::endl;
+   std::cout << std::left << std::setw(20) << ""
+             << std::right << std::setw(16) << "libc"
+             << std::setw(16) << "memory_copy"
+             << std::setw(9) << "speedup" << std::endl;
+
+   for (auto size : CopySizes) {
+      benchmark(size, totalBytes);
+   }
+
+   return 0;
+}
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <spdlog/spdlog.h>
 #include <libdecaf/decaf.h>
+#include <libdecaf/decaf_config.h>
 #include <libcpu/cpu.h>
 #include <libcpu/mem.h>
 
@@ -31,6 +32,19 @@ getCommandLineParser()
                     value<std::string> {});
 
    parser.add_command("replay")
+      .add_option("surface-writeback",
+                  description { "Write surfaces rendered by the GPU back to memory." })
+      .add_option("golden",
+                  description { "Compare memory at golden-address with this file after the trace, enables surface-writeback." },
+                  value<std::string> {})
+      .add_option("golden-address",
+                  description { "Address of the memory compared with the golden file, usually a color buffer." },
+                  value<std::string> {})
+      .add_option("golden-size",
+                  description { "Number of bytes to write with update-golden." },
+                  value<std::string> {})
+      .add_option("update-golden",
+                  description { "Write the golden file instead of comparing with it." })
       .add_argument("trace file", value<std::string> {});
 
    return parser;
@@ -63,6 +77,28 @@ start(excmd::parser &parser,
    }
 
    auto traceFile = options.get<std::string>("trace file");
+   auto goldenFile = std::string { };
+   auto goldenAddress = uint32_t { 0 };
+   auto goldenSize = uint32_t { 0 };
+   auto updateGolden = options.has("update-golden");
+
+   if (options.has("golden")) {
+      if (!options.has("golden-address") || (updateGolden && !options.has("golden-size"))) {
+         std::cout << "golden needs golden-address, and golden-size with update-golden" << std::endl;
+         std::exit(-1);
+      }
+
+      goldenFile = options.get<std::string>("golden");
+      goldenAddress = static_cast<uint32_t>(std::stoul(options.get<std::string>("golden-address"), nullptr, 0));
+
+      if (updateGolden) {
+         goldenSize = static_cast<uint32_t>(std::stoul(options.get<std::string>("golden-size"), nullptr, 0));
+      }
+   }
+
+   if (options.has("surface-writeback") || !goldenFile.empty()) {
+      decaf::config::gpu::surface_writeback = true;
+   }
 
    std::vector<spdlog::sink_ptr> sinks;
    sinks.push_back(spdlog::sinks::stdout_sink_st::instance());
@@ -91,6 +127,10 @@ start(excmd::parser &parser,
                result = -1;
             } else {
                result = window.run(traceFile);
+
+               if (result && !goldenFile.empty()) {
+                  result = window.checkGolden(goldenAddress, goldenSize, goldenFile, updateGolden) ? 0 : -1;
+               }
             }
          }
       });
@@ -2,6 +2,7 @@
 #include "clilog.h"
 #include <array>
 #include <fstream>
+#include <iterator>
 #include <common/teenyheap.h>
 #include <libdecaf/decaf.h>
 #include <libdecaf/decaf_nullinputdriver.h>
@@ -14,6 +15,7 @@
 #include <libdecaf/src/modules/gx2/gx2_cbpool.h>
 #include <libdecaf/src/modules/gx2/gx2_state.h>
 #include <libcpu/mem.h>
+#include <vector>
 
 static TeenyHeap *
 gSystemHeap = nullptr;
@@ -480,3 +482,52 @@ SDLWindow::run(const std::string &tracePath)
 
    return true;
 }
+
+/**
+ * Compare memory with a golden file once the readbacks from the last frame
+ * have been written back, or write the golden file when updating it.
+ */
+bool
+SDLWindow::checkGolden(uint32_t address,
+                       uint32_t size,
+                       const std::string &path,
+                       bool update)
+{
+   // The trace is over so waiting for the GPU here costs nothing, then
+   //  syncPoll runs the writeback fence callbacks.
+   gl::glFinish();
+   mGraphicsDriver->syncPoll([](unsigned int, unsigned int) { });
+
+   if (update) {
+      std::ofstream file { path, std::ofstream::binary };
+
+      if (!file.is_open()) {
+         gCliLog->error("Could not write golden file {}", path);
+         return false;
+      }
+
+      file.write(mem::translate<char>(address), size);
+      gCliLog->info("Wrote {} bytes at 0x{:08X} to {}", size, address, path);
+      return true;
+   }
+
+   std::ifstream file { path, std::ifstream::binary };
+
+   if (!file.is_open()) {
+      gCliLog->error("Could not open golden file {}", path);
+      return false;
+   }
+
+   std::vector<char> golden { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+   auto memory = mem::translate<char>(address);
+
+   for (auto i = 0u; i < golden.size(); ++i) {
+      if (memory[i] != golden[i]) {
+         gCliLog->error("Memory at 0x{:08X} differs from {} at offset {}", address, path, i);
+         return false;
+      }
+   }
+
+   gCliLog->info("Memory at 0x{:08X} matches {}", address, path);
+   return true;
+}
@@ -15,6 +15,10 @@ public:
 
    bool createWindow();
    bool run(const std::string &tracePath);
+   bool checkGolden(uint32_t address,
+                    uint32_t size,
+                    const std::string &path,
+                    bool update);
 
 protected:
    void initialiseContext();
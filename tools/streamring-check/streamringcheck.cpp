@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <excmd.h>
+#include <iostream>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <vector>
+#include "gpu/opengl/opengl_streamring.h"
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+using gpu::opengl::StreamRing;
+
+/**
+ * A pretend GPU for StreamRing, fences are numbered in the order they are
+ * inserted and the GPU completes them in that order.
+ *
+ * Every byte of the ring remembers the stream position at which the data
+ * written to it ends, data is still in use by the GPU until a completed
+ * fence covers that position.
+ */
+class FakeGpu
+{
+public:
+   FakeGpu(uint32_t size) :
+      mOwner(size, 0)
+   {
+      mRing.reset(size);
+   }
+
+   bool
+   allocate(uint32_t size,
+            uint32_t alignment)
+   {
+      auto start = mRing.allocate(size, alignment,
+                                  [this]() { fence(); },
+                                  [this]() { waitOldest(); });
+      auto offset = start % mRing.size();
+      auto ok = true;
+
+      if (offset % alignment) {
+         std::cout << "allocation at " << start << " is not aligned to " << alignment << std::endl;
+         ok = false;
+      }
+
+      if (offset + size > mRing.size()) {
+         std::cout << "allocation at " << start << " of " << size << " bytes straddles the end of the ring" << std::endl;
+         ok = false;
+      }
+
+      for (auto i = offset; ok && i < offset + size; ++i) {
+         if (mOwner[i] > mCompletedPosition) {
+            std::cout << "allocation at " << start << " overwrites data still in use up to " << mOwner[i]
+                      << ", GPU has completed " << mCompletedPosition << std::endl;
+            ok = false;
+         }
+      }
+
+      for (auto i = offset; i < std::min(offset + size, mRing.size()); ++i) {
+         mOwner[i] = start + size;
+      }
+
+      return ok;
+   }
+
+   //! End of a command buffer, as GLDriver::executeBuffer does.
+   void
+   fence()
+   {
+      if (!mRing.hasUnfenced()) {
+         return;
+      }
+
+      mFencePositions.push_back(mRing.position());
+      mRing.pushFence(static_cast<uint32_t>(mFencePositions.size() - 1));
+   }
+
+   //! Let the GPU complete fences up to and including id.
+   void
+   complete(uint32_t id)
+   {
+      mCompleted = std::max(mCompleted, id + 1);
+   }
+
+   //! Release completed fences without waiting, as retireFences(false) does.
+   void
+   poll()
+   {
+      while (mRing.hasFences() && mRing.oldestFence() < mCompleted) {
+         retire();
+      }
+   }
+
+   uint32_t
+   fences() const
+   {
+      return static_cast<uint32_t>(mFencePositions.size());
+   }
+
+   uint32_t
+   waits() const
+   {
+      return mWaits;
+   }
+
+   uint64_t
+   position() const
+   {
+      return mRing.position();
+   }
+
+private:
+   void
+   waitOldest()
+   {
+      auto id = mRing.oldestFence();
+
+      // Only a fence the GPU has not completed yet is a real wait
+      if (id >= mCompleted) {
+         mWaits++;
+         complete(id);
+      }
+
+      retire();
+   }
+
+   void
+   retire()
+   {
+      mCompletedPosition = std::max(mCompletedPosition, mFencePositions[mRing.oldestFence()]);
+      mRing.popFence();
+   }
+
+private:
+   StreamRing<uint32_t> mRing;
+   std::vector<uint64_t> mOwner;
+   std::vector<uint64_t> mFencePositions;
+   uint64_t mCompletedPosition = 0;
+   uint32_t mCompleted = 0;
+   uint32_t mWaits = 0;
+};
+
+/**
+ * Stream random allocations through a small ring, completing fences after a
+ * random number of command buffers.
+ */
+static bool
+checkRandom(uint32_t size,
+            uint32_t batches,
+            uint32_t seed)
+{
+   static const uint32_t Alignments[] = { 1, 4, 16, 256 };
+   std::mt19937 rng { seed };
+   FakeGpu gpu { size };
+
+   for (auto batch = 0u; batch < batches; ++batch) {
+      auto count = rng() % 8;
+
+      for (auto i = 0u; i < count; ++i) {
+         // Mostly small uploads, with the occasional one which fills the ring
+         auto bytes = (rng() % 32) ? 1 + rng() % (size / 8) : size - rng() % 64;
+
+         if (!gpu.allocate(bytes, Alignments[rng() % 4])) {
+            return false;
+         }
+      }
+
+      gpu.fence();
+
+      // The GPU lags a few command buffers behind
+      if (gpu.fences() > 3 && rng() % 2) {
+         gpu.complete(gpu.fences() - 1 - rng() % 4);
+      }
+
+      gpu.poll();
+   }
+
+   if (gpu.position() < size * 4ull) {
+      std::cout << "random: ring only wrapped " << (gpu.position() / size) << " times" << std::endl;
+      return false;
+   }
+
+   std::cout << "random: " << batches << " command buffers, wrapped " << (gpu.position() / size)
+             << " times, " << gpu.waits() << " waits" << std::endl;
+   return true;
+}
+
+/**
+ * When the GPU keeps up, the ring must never wait.
+ */
+static bool
+checkNoWaits(uint32_t size)
+{
+   FakeGpu gpu { size };
+
+   for (auto batch = 0u; batch < 1000; ++batch) {
+      if (!gpu.allocate(size / 3 + batch % 7, 16)) {
+         return false;
+      }
+
+      gpu.fence();
+      gpu.complete(gpu.fences() - 1);
+      gpu.poll();
+   }
+
+   if (gpu.waits()) {
+      std::cout << "no waits: waited " << gpu.waits() << " times while the GPU kept up" << std::endl;
+      return false;
+   }
+
+   std::cout << "no waits: wrapped " << (gpu.position() / size) << " times without waiting" << std::endl;
+   return true;
+}
+
+/**
+ * A single command buffer which uploads more than the ring holds must fence
+ * its own data and wait for it, rather than overwrite it or deadlock.
+ */
+static bool
+checkOversizedBatch(uint32_t size)
+{
+   FakeGpu gpu { size };
+
+   for (auto i = 0u; i < 10; ++i) {
+      if (!gpu.allocate(size / 2 + 1, 4)) {
+         return false;
+      }
+   }
+
+   if (!gpu.fences() || !gpu.waits()) {
+      std::cout << "oversized batch: expected a fence and a wait, got "
+                << gpu.fences() << " fences and " << gpu.waits() << " waits" << std::endl;
+      return false;
+   }
+
+   std::cout << "oversized batch: " << gpu.fences() << " fences, " << gpu.waits() << " waits" << std::endl;
+   return true;
+}
+
+int main(int argc, char **argv)
+{
+   excmd::parser parser;
+   excmd::option_state options;
+   using excmd::description;
+   using excmd::default_value;
+
+   gLog = spdlog::stdout_logger_st("streamring-check");
+
+   parser.global_options()
+      .add_option("h,help",
+                  description { "Show the help." })
+      .add_option("size",
+                  description { "Size of the ring in bytes, rounded up to a multiple of 256." },
+                  default_value<uint32_t> { 4096 })
+      .add_option("batches",
+                  description { "Number of command buffers to stream in the random check." },
+                  default_value<uint32_t> { 20000 })
+      .add_option("seed",
+                  description { "Seed for the random check." },
+                  default_value<uint32_t> { 1 });
+
+   try {
+      options = parser.parse(argc, argv);
+   } catch (excmd::exception ex) {
+      std::cout << "Error parsing command line: " << ex.what() << std::endl;
+      std::exit(-1);
+   }
+
+   if (options.has("help")) {
+      std::cout << parser.format_help("streamring-check") << std::endl;
+      std::exit(0);
+   }
+
+   auto size = std::max(1024u, (options.get<uint32_t>("size") + 255) & ~255u);
+   auto batches = options.get<uint32_t>("batches");
+   auto seed = options.get<uint32_t>("seed");
+
+   if (!checkNoWaits(size)
+    || !checkOversizedBatch(size)
+    || !checkRandom(size, batches, seed)) {
+      std::cout << "FAILED" << std::endl;
+      return -1;
+   }
+
+   return 0;
+}